@@ -0,0 +1,227 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <kmtricks/utils.hpp>
+
+namespace km::bench {
+
+template<typename T>
+inline void do_not_optimize(T const& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class State
+{
+  using clock_t = std::chrono::steady_clock;
+
+public:
+  explicit State(uint64_t iterations) : m_iterations(iterations) {}
+
+  uint64_t iterations() const { return m_iterations; }
+
+  // Restrict timing to [start, stop], the whole call is timed otherwise.
+  void start() { m_manual = true; m_begin = clock_t::now(); }
+  void stop() { m_elapsed += clock_t::now() - m_begin; }
+
+  void set_items(uint64_t items) { m_items = items; }
+  void set_bytes(uint64_t bytes) { m_bytes = bytes; }
+  void set_param(const std::string& key, const std::string& value) { m_params[key] = value; }
+
+  bool manual() const { return m_manual; }
+  double elapsed_ns() const { return std::chrono::duration<double, std::nano>(m_elapsed).count(); }
+
+private:
+  uint64_t m_iterations;
+  bool m_manual {false};
+  clock_t::time_point m_begin;
+  clock_t::duration m_elapsed {0};
+
+public:
+  uint64_t m_items {0};
+  uint64_t m_bytes {0};
+  std::map<std::string, std::string> m_params;
+};
+
+struct Result
+{
+  std::string name;
+  uint64_t iterations {0};
+  std::vector<double> ns_per_iter;
+  double items_per_sec {0};
+  double bytes_per_sec {0};
+  std::map<std::string, std::string> params;
+
+  double median() const
+  {
+    std::vector<double> v = ns_per_iter;
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0 : v[v.size() / 2];
+  }
+};
+
+using bench_fn_t = std::function<void(State&)>;
+
+class Runner
+{
+  using clock_t = std::chrono::steady_clock;
+
+  struct entry_t
+  {
+    std::string name;
+    bench_fn_t fn;
+    bool stage;
+  };
+
+public:
+  Runner(double min_time, uint32_t repetitions)
+    : m_min_time_ns(min_time * 1e9), m_repetitions(repetitions) {}
+
+  // Micro-benchmarks are scaled until one run lasts at least min_time.
+  void add(const std::string& name, bench_fn_t fn) { m_entries.push_back({name, fn, false}); }
+
+  // Stage benchmarks always run a single iteration.
+  void add_stage(const std::string& name, bench_fn_t fn) { m_entries.push_back({name, fn, true}); }
+
+  std::vector<std::string> names() const
+  {
+    std::vector<std::string> n;
+    for (auto& e : m_entries) n.push_back(e.name);
+    return n;
+  }
+
+  const std::vector<Result>& run(const std::string& filter)
+  {
+    for (auto& e : m_entries)
+    {
+      if (!filter.empty() && e.name.find(filter) == std::string::npos)
+        continue;
+
+      Result r; r.name = e.name;
+      uint64_t iterations = 1;
+
+      if (!e.stage)
+      {
+        while (true)
+        {
+          double ns = once(e.fn, iterations, nullptr);
+          if (ns >= m_min_time_ns || iterations >= (1ULL << 40))
+            break;
+          double scale = ns > 0 ? (m_min_time_ns * 1.4) / ns : 10.0;
+          iterations = std::max(iterations * 2, static_cast<uint64_t>(iterations * std::min(scale, 100.0)));
+        }
+      }
+
+      State last(iterations);
+      for (uint32_t i=0; i<m_repetitions; i++)
+      {
+        State s(iterations);
+        r.ns_per_iter.push_back(once(e.fn, iterations, &s) / iterations);
+        last = s;
+      }
+      r.iterations = iterations;
+      r.params = last.m_params;
+      double secs = r.median() * iterations / 1e9;
+      if (secs > 0)
+      {
+        r.items_per_sec = last.m_items / secs;
+        r.bytes_per_sec = last.m_bytes / secs;
+      }
+      report(std::cerr, r);
+      m_results.push_back(r);
+    }
+    return m_results;
+  }
+
+  void write_json(std::ostream& out, const std::map<std::string, std::string>& context) const
+  {
+    out << "{\n  \"context\": {";
+    bool first = true;
+    for (auto& [k, v] : context)
+    {
+      out << (first ? "\n" : ",\n") << "    \"" << k << "\": \"" << v << "\"";
+      first = false;
+    }
+    out << "\n  },\n  \"benchmarks\": [";
+    for (size_t i=0; i<m_results.size(); i++)
+    {
+      auto& r = m_results[i];
+      out << (i ? ",\n" : "\n");
+      out << "    {\"name\": \"" << r.name << "\""
+          << ", \"iterations\": " << r.iterations
+          << std::fixed << std::setprecision(3)
+          << ", \"ns_per_iter\": " << r.median()
+          << ", \"repetitions\": [";
+      for (size_t j=0; j<r.ns_per_iter.size(); j++)
+        out << (j ? ", " : "") << r.ns_per_iter[j];
+      out << "], \"items_per_sec\": " << r.items_per_sec
+          << ", \"bytes_per_sec\": " << r.bytes_per_sec
+          << ", \"params\": {";
+      bool pfirst = true;
+      for (auto& [k, v] : r.params)
+      {
+        out << (pfirst ? "" : ", ") << "\"" << k << "\": \"" << v << "\"";
+        pfirst = false;
+      }
+      out << "}}";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+private:
+  double once(const bench_fn_t& fn, uint64_t iterations, State* out)
+  {
+    State s(iterations);
+    auto begin = clock_t::now();
+    fn(s);
+    auto end = clock_t::now();
+    if (out) *out = s;
+    return s.manual() ? s.elapsed_ns() : std::chrono::duration<double, std::nano>(end - begin).count();
+  }
+
+  static void report(std::ostream& out, const Result& r)
+  {
+    out << std::left << std::setw(48) << r.name
+        << std::right << std::setw(14) << std::fixed << std::setprecision(1) << r.median() << " ns/it"
+        << std::setw(12) << r.iterations << " it";
+    if (r.items_per_sec > 0)
+      out << std::setw(14) << std::setprecision(2) << r.items_per_sec / 1e6 << " Mitems/s";
+    if (r.bytes_per_sec > 0)
+      out << std::setw(12) << std::setprecision(2) << r.bytes_per_sec / (1 << 20) << " MiB/s";
+    out << std::endl;
+  }
+
+private:
+  double m_min_time_ns;
+  uint32_t m_repetitions;
+  std::vector<entry_t> m_entries;
+  std::vector<Result> m_results;
+};
+
+};
@@ -0,0 +1,546 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <sstream>
+
+#include <kmtricks/config.hpp>
+#include <kmtricks/kmer.hpp>
+#include <kmtricks/kmer_hash.hpp>
+#include <kmtricks/bitmatrix.hpp>
+#include <kmtricks/packc.hpp>
+#include <kmtricks/io/lz4_stream.hpp>
+#include <kmtricks/io/hash_file.hpp>
+#include <kmtricks/merge.hpp>
+#include <kmtricks/task.hpp>
+#include <kmtricks/gatb/gatb_utils.hpp>
+
+#ifdef WITH_HOWDE
+#include <bloom_tree.h>
+#include <file_manager.h>
+#include <query.h>
+#endif
+
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+using namespace km;
+using namespace km::bench;
+
+#define BENCH_C 65535
+
+struct bench_options
+{
+  std::string filter;
+  std::string json;
+  std::string work_dir {"./km_bench_tmp"};
+  std::string run_dir;
+  double min_time {0.5};
+  uint32_t repetitions {3};
+  uint64_t seed {42};
+  uint32_t nb_samples {8};
+  uint32_t nb_queries {1000};
+  bool list {false};
+  bool generate {false};
+  bool keep {false};
+};
+
+static void usage(const char* name)
+{
+  std::cerr
+    << "Usage: " << name << " [options]\n\n"
+    << "  --filter STR       run benchmarks whose name contains STR.\n"
+    << "  --json FILE        write results as JSON to FILE ('-' for stdout).\n"
+    << "  --min-time SEC     minimal duration of a micro-benchmark run. [0.5]\n"
+    << "  --repetitions INT  number of measured runs per benchmark. [3]\n"
+    << "  --seed INT         seed of the synthetic data generator. [42]\n"
+    << "  --samples INT      number of synthetic samples for stage benchmarks. [8]\n"
+    << "  --work-dir DIR     directory for synthetic data. [./km_bench_tmp]\n"
+    << "  --keep             keep the work directory.\n"
+    << "  --generate         only generate the synthetic reads and fof in --work-dir.\n"
+#ifdef WITH_HOWDE
+    << "  --run-dir DIR      kmtricks run with an index, enables bloomtree benchmarks.\n"
+    << "  --queries INT      number of synthetic queries per batch. [1000]\n"
+#endif
+    << "  --list             list benchmarks and exit.\n";
+}
+
+static bench_options parse(int argc, char* argv[])
+{
+  bench_options opt;
+  for (int i=1; i<argc; i++)
+  {
+    std::string a = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc)
+        throw InputError(fmt::format("{}: missing value.", a));
+      return argv[++i];
+    };
+    if (a == "--filter") opt.filter = value();
+    else if (a == "--json") opt.json = value();
+    else if (a == "--min-time") opt.min_time = std::stod(value());
+    else if (a == "--repetitions") opt.repetitions = std::stoul(value());
+    else if (a == "--seed") opt.seed = std::stoull(value());
+    else if (a == "--samples") opt.nb_samples = std::stoul(value());
+    else if (a == "--work-dir") opt.work_dir = value();
+    else if (a == "--run-dir") opt.run_dir = value();
+    else if (a == "--queries") opt.nb_queries = std::stoul(value());
+    else if (a == "--keep") opt.keep = true;
+    else if (a == "--generate") opt.generate = true;
+    else if (a == "--list") opt.list = true;
+    else if (a == "-h" || a == "--help") { usage(argv[0]); std::exit(0); }
+    else throw InputError(fmt::format("Unknown option: {}", a));
+  }
+  return opt;
+}
+
+/* Micro-benchmarks */
+
+template<int H, size_t MAX_K>
+void register_hasher(Runner& runner, const bench_options& opt, size_t kmer_size, const std::string& name)
+{
+  const size_t n = 4096;
+  auto tag = fmt::format("<{}>/k={}", MAX_K, kmer_size);
+
+  runner.add("hash/" + name + tag, [=](State& s) {
+    Rng rng(opt.seed);
+    auto kmers = random_kmers<MAX_K>(rng, n, kmer_size);
+    typename KmerHashers<H>::template Hasher<MAX_K> hasher;
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+      for (auto& k : kmers) { auto h = hasher(k); do_not_optimize(h); }
+    s.stop();
+    s.set_items(s.iterations() * n);
+  });
+
+  runner.add("hash/" + name + "_win" + tag, [=](State& s) {
+    Rng rng(opt.seed);
+    auto kmers = random_kmers<MAX_K>(rng, n, kmer_size);
+    typename KmerHashers<H>::template WinHasher<MAX_K> hasher(0, 1ULL << 20);
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+      for (auto& k : kmers) { auto h = hasher(k); do_not_optimize(h); }
+    s.stop();
+    s.set_items(s.iterations() * n);
+  });
+}
+
+template<size_t MAX_K>
+void register_kmer(Runner& runner, const bench_options& opt, size_t kmer_size)
+{
+  const size_t n = 4096;
+  auto tag = fmt::format("<{}>/k={}", MAX_K, kmer_size);
+
+  runner.add("kmer/set_polynom" + tag, [=](State& s) {
+    Rng rng(opt.seed);
+    std::vector<std::string> seqs;
+    for (size_t i=0; i<n; i++) seqs.push_back(random_dna(rng, kmer_size));
+    Kmer<MAX_K> kmer;
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+      for (auto& seq : seqs) { kmer.set_polynom(seq); do_not_optimize(kmer); }
+    s.stop();
+    s.set_items(s.iterations() * n);
+  });
+
+  runner.add("kmer/canonical" + tag, [=](State& s) {
+    Rng rng(opt.seed);
+    auto kmers = random_kmers<MAX_K>(rng, n, kmer_size);
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+      for (auto& k : kmers) { auto c = k.canonical(); do_not_optimize(c); }
+    s.stop();
+    s.set_items(s.iterations() * n);
+  });
+
+  runner.add("kmer/sort" + tag, [=](State& s) {
+    Rng rng(opt.seed);
+    auto kmers = random_kmers<MAX_K>(rng, n, kmer_size);
+    std::vector<Kmer<MAX_K>> tmp;
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+    {
+      tmp = kmers;
+      std::sort(tmp.begin(), tmp.end());
+      do_not_optimize(tmp.front());
+    }
+    s.stop();
+    s.set_items(s.iterations() * n);
+  });
+
+  runner.add("kmer/minimizer" + tag + "/m=10", [=](State& s) {
+    Rng rng(opt.seed);
+    auto kmers = random_kmers<MAX_K>(rng, n, kmer_size);
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+      for (auto& k : kmers) { auto m = k.minimizer(10); do_not_optimize(m); }
+    s.stop();
+    s.set_items(s.iterations() * n);
+  });
+
+  register_hasher<0, MAX_K>(runner, opt, kmer_size, "folly");
+#ifdef WITH_XXHASH
+  register_hasher<1, MAX_K>(runner, opt, kmer_size, "xxhash");
+#endif
+}
+
+void register_micro(Runner& runner, const bench_options& opt)
+{
+  register_kmer<32>(runner, opt, 31);
+  register_kmer<64>(runner, opt, 63);
+
+  runner.add("bitmatrix/transpose/4096x4096", [=](State& s) {
+    const size_t n = 4096;
+    BitMatrix mat(n, n / 8, true);
+    Rng rng(opt.seed);
+    for (size_t i=0; i<n * n / 8; i++) mat.matrix[i] = rng.next();
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+    {
+      BitMatrix* t = mat.transpose();
+      do_not_optimize(t->matrix[0]);
+      delete t;
+    }
+    s.stop();
+    s.set_bytes(s.iterations() * n * n / 8);
+  });
+
+  runner.add("packc/pack_v/w=4", [=](State& s) {
+    const size_t n = 1 << 16;
+    Rng rng(opt.seed);
+    auto counts = random_counts<uint32_t>(rng, n, 1000);
+    std::vector<uint8_t> packed(byte_count_pack(n, 4));
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+    {
+      pack_v(counts, packed, 4);
+      do_not_optimize(packed[0]);
+    }
+    s.stop();
+    s.set_items(s.iterations() * n);
+  });
+
+  const size_t lz4_size = 8 << 20;
+
+  runner.add("lz4/write/8MiB", [=](State& s) {
+    Rng rng(opt.seed);
+    auto counts = random_counts<uint16_t>(rng, lz4_size / 2, 64);
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+    {
+      std::stringstream ss;
+      lz4_stream::basic_ostream<8192> out(ss);
+      out.write(reinterpret_cast<const char*>(counts.data()), lz4_size);
+      out.close();
+      do_not_optimize(ss.tellp());
+    }
+    s.stop();
+    s.set_bytes(s.iterations() * lz4_size);
+  });
+
+  runner.add("lz4/read/8MiB", [=](State& s) {
+    Rng rng(opt.seed);
+    auto counts = random_counts<uint16_t>(rng, lz4_size / 2, 64);
+    std::string compressed;
+    {
+      std::stringstream ss;
+      {
+        lz4_stream::basic_ostream<8192> out(ss);
+        out.write(reinterpret_cast<const char*>(counts.data()), lz4_size);
+      }
+      compressed = ss.str();
+    }
+    std::vector<char> buffer(lz4_size);
+    s.set_param("ratio", fmt::format("{:.3f}", static_cast<double>(lz4_size) / compressed.size()));
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+    {
+      std::stringstream ss(compressed);
+      lz4_stream::basic_istream<8192> in(ss);
+      in.read(buffer.data(), lz4_size);
+      do_not_optimize(buffer[0]);
+    }
+    s.stop();
+    s.set_bytes(s.iterations() * lz4_size);
+  });
+
+  runner.add("hash_writer/p4/1M", [=](State& s) {
+    const size_t n = 1 << 20;
+    Rng rng(opt.seed);
+    std::vector<uint64_t> hashes(n);
+    for (auto& h : hashes) h = rng.below(1ULL << 40);
+    std::sort(hashes.begin(), hashes.end());
+    auto counts = random_counts<uint16_t>(rng, n, 255);
+    std::string path = fmt::format("{}/bench.hash.p4", opt.work_dir);
+    s.start();
+    for (uint64_t it=0; it<s.iterations(); it++)
+    {
+      HashWriter<BENCH_C, 32768> hw(path, 2, 0, 0, true);
+      for (size_t i=0; i<n; i++)
+        hw.write(hashes[i], counts[i]);
+    }
+    s.stop();
+    s.set_items(s.iterations() * n);
+    s.set_bytes(s.iterations() * n * (sizeof(uint64_t) + sizeof(uint16_t)));
+    s.set_param("file_size", std::to_string(fs::file_size(path)));
+  });
+}
+
+/* Stage benchmarks */
+
+class StageData
+{
+public:
+  StageData(const bench_options& opt) : m_opt(opt) {}
+
+  // Runs config and repartition once on synthetic reads, shared by all count benchmarks.
+  void prepare_run()
+  {
+    if (m_run_ready) return;
+    m_reads = generate_reads(fmt::format("{}/reads", m_opt.work_dir), m_opt.nb_samples,
+                             200000, 20000, 150, 0.01, m_opt.seed);
+    KmDir::get().init(fmt::format("{}/run", m_opt.work_dir), m_reads, true);
+    IProperties* props = get_config_properties(31, 10, 0, 0, 1, 16);
+    ConfigTask<32> config_task(m_reads, props, 10000000, 16);
+    config_task.exec();
+    RepartTask<32> repart_task(m_reads);
+    repart_task.exec(); repart_task.postprocess();
+
+    Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
+    LOCAL(config_storage);
+    m_config.load(config_storage->getGroup("gatb"));
+    KmDir::get().init_part(m_config._nb_partitions);
+    for (uint32_t p=0; p<m_config._nb_partitions; p++)
+      m_parts.push_back(p);
+    m_run_ready = true;
+  }
+
+  void run_superk()
+  {
+    for (auto& sample : KmDir::get().m_fof)
+    {
+      SuperKTask<32> task(std::get<0>(sample), false, m_parts);
+      task.exec();
+    }
+    m_superk_ready = true;
+  }
+
+  void prepare_superk()
+  {
+    prepare_run();
+    if (!m_superk_ready) run_superk();
+  }
+
+public:
+  const bench_options& m_opt;
+  std::string m_reads;
+  Configuration m_config;
+  std::vector<uint32_t> m_parts;
+  bool m_run_ready {false};
+  bool m_superk_ready {false};
+};
+
+template<typename Task, typename... Args>
+uint64_t count_all(StageData& data, KM_FILE type, Args... args)
+{
+  uint64_t nb_kmers = 0;
+  for (auto& sample : KmDir::get().m_fof)
+  {
+    const std::string& id = std::get<0>(sample);
+    auto storage = std::make_shared<SuperKStorageReader>(KmDir::get().get_superk_path(id));
+    auto pinfo = std::make_shared<PartiInfo<5>>(KmDir::get().get_superk_path(id));
+    uint32_t iid = KmDir::get().m_fof.get_i(id);
+    for (auto p : data.m_parts)
+    {
+      std::string path = KmDir::get().get_count_part_path(id, p, false, type);
+      Task task(path, data.m_config, storage, pinfo, p, iid, args...);
+      task.exec();
+      nb_kmers += pinfo->getNbKmer(p);
+    }
+  }
+  return nb_kmers;
+}
+
+void register_stages(Runner& runner, const bench_options& opt, StageData& data)
+{
+  runner.add_stage("stage/superk", [&](State& s) {
+    data.prepare_run();
+    s.start();
+    data.run_superk();
+    s.stop();
+    s.set_param("samples", std::to_string(opt.nb_samples));
+  });
+
+  runner.add_stage("stage/count/kmer", [&](State& s) {
+    data.prepare_superk();
+    s.start();
+    uint64_t n = count_all<CountTask<32, BENCH_C, SuperKStorageReader>>(
+      data, KM_FILE::KMER, 31u, 1u, false, nullptr, false);
+    s.stop();
+    s.set_items(n);
+    s.set_param("partitions", std::to_string(data.m_parts.size()));
+  });
+
+  runner.add_stage("stage/count/hash", [&](State& s) {
+    data.prepare_superk();
+    HashWindow hw(KmDir::get().m_hash_win);
+    s.start();
+    uint64_t n = count_all<HashCountTask<32, BENCH_C, SuperKStorageReader>>(
+      data, KM_FILE::HASH, hw.get_window_size_bits(), 31u, 1u, false, nullptr, false);
+    s.stop();
+    s.set_items(n);
+  });
+
+  const size_t pool_size = 1 << 20;
+
+  runner.add_stage(fmt::format("stage/merge/kmer/n={}", opt.nb_samples), [&, pool_size](State& s) {
+    auto paths = generate_kmer_parts<32, BENCH_C>(fmt::format("{}/merge_kmer", opt.work_dir),
+                                                  opt.nb_samples, pool_size, 31, 0.5, false, opt.seed);
+    std::vector<uint32_t> ab(opt.nb_samples, 1);
+    std::string out = fmt::format("{}/merge_kmer/matrix.count", opt.work_dir);
+    s.start();
+    KmerMerger<32, BENCH_C> merger(paths, ab, 31, 1, 1);
+    merger.write_as_bin(out, false);
+    s.stop();
+    s.set_items(pool_size);
+    s.set_param("matrix_size", std::to_string(fs::file_size(out)));
+  });
+
+  runner.add_stage(fmt::format("stage/merge/hash/n={}", opt.nb_samples), [&, pool_size](State& s) {
+    auto paths = generate_hash_parts<BENCH_C>(fmt::format("{}/merge_hash", opt.work_dir),
+                                              opt.nb_samples, pool_size, 0.5, true, opt.seed);
+    std::vector<uint32_t> ab(opt.nb_samples, 1);
+    std::string out = fmt::format("{}/merge_hash/matrix.count_hash", opt.work_dir);
+    s.start();
+    HashMerger<BENCH_C, 32768, HashReader<BENCH_C, 32768>> merger(paths, ab, 1, 1);
+    merger.write_as_bin(out, false);
+    s.stop();
+    s.set_items(pool_size);
+    s.set_param("matrix_size", std::to_string(fs::file_size(out)));
+  });
+
+#ifdef WITH_HOWDE
+  if (!opt.run_dir.empty())
+  {
+    runner.add_stage(fmt::format("stage/bloomtree/batch_query/q={}", opt.nb_queries), [&](State& s) {
+      KmDir::get().init(opt.run_dir, "", false);
+      std::string index_path;
+      for (auto& p : fs::directory_iterator(KmDir::get().m_index_storage))
+        if (p.path().string().find(".sbt") != std::string::npos)
+          index_path = p.path().string();
+      if (index_path.empty())
+        throw IOError(fmt::format("No index found in {}.", KmDir::get().m_index_storage));
+
+      // Queries are drawn from the indexed samples so that the tree is actually descended.
+      std::stringstream fasta;
+      Rng rng(opt.seed);
+      Fof& fof = KmDir::get().m_fof;
+      for (uint32_t q=0; q<opt.nb_queries; q++)
+      {
+        std::string seq;
+        std::string file = bc::utils::split(fof.get_files(fof.get_id(rng.below(fof.size()))), ',')[0];
+        std::ifstream in(file);
+        for (std::string line; std::getline(in, line) && seq.size() < 200;)
+          if (!line.empty() && line[0] != '>' && line[0] != '@' && line[0] != '+')
+            seq = line;
+        if (seq.size() < 100) seq = random_dna(rng, 200);
+        fasta << ">q" << q << "\n" << seq << "\n";
+      }
+
+      std::string repart = fmt::format("{}_gatb/repartition.minimRepart", KmDir::get().m_repart_storage);
+      std::string win = KmDir::get().m_hash_win;
+      std::vector<Query*> queries;
+      Query::read_query_file(fasta, "", 0.7, queries, repart, win);
+
+      BloomTree* root = BloomTree::read_topology(index_path);
+      FileManager* manager = root->nodesShareFiles ? new FileManager(root, false) : nullptr;
+
+      s.start();
+      root->batch_query(queries, true);
+      s.stop();
+      s.set_items(queries.size());
+
+      for (auto q : queries) delete q;
+      delete manager;
+      delete root;
+    });
+  }
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+  bench_options opt;
+  try
+  {
+    opt = parse(argc, argv);
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << std::endl;
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  spdlog::set_level(spdlog::level::warn);
+  fs::create_directories(opt.work_dir);
+
+  if (opt.generate)
+  {
+    std::cout << generate_reads(opt.work_dir, opt.nb_samples, 200000, 20000, 150, 0.01, opt.seed)
+              << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  Runner runner(opt.min_time, opt.repetitions);
+  StageData data(opt);
+  register_micro(runner, opt);
+  register_stages(runner, opt, data);
+
+  if (opt.list)
+  {
+    for (auto& n : runner.names())
+      std::cout << n << "\n";
+    return EXIT_SUCCESS;
+  }
+
+  runner.run(opt.filter);
+
+  std::map<std::string, std::string> context {
+    {"version", PROJECT_VER},
+    {"git_sha1", GIT_SHA1},
+    {"compiler", COMPILER_CXX},
+    {"host", HOST_SYSTEM},
+    {"native", NATIVE_BUILD},
+    {"seed", std::to_string(opt.seed)},
+    {"samples", std::to_string(opt.nb_samples)},
+    {"hardware_concurrency", std::to_string(std::thread::hardware_concurrency())}
+  };
+
+  if (opt.json == "-")
+    runner.write_json(std::cout, context);
+  else if (!opt.json.empty())
+  {
+    std::ofstream out(opt.json); check_fstream_good(opt.json, out);
+    runner.write_json(out, context);
+  }
+
+  if (!opt.keep)
+    fs::remove_all(opt.work_dir);
+
+  return EXIT_SUCCESS;
+}
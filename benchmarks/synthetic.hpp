@@ -0,0 +1,176 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <kmtricks/kmer.hpp>
+#include <kmtricks/utils.hpp>
+#include <kmtricks/io/kmer_file.hpp>
+#include <kmtricks/io/hash_file.hpp>
+
+namespace fs = std::filesystem;
+
+namespace km::bench {
+
+// splitmix64, identical streams on every platform for a given seed
+class Rng
+{
+public:
+  explicit Rng(uint64_t seed) : m_state(seed) {}
+
+  uint64_t next()
+  {
+    uint64_t z = (m_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t below(uint64_t n) { return next() % n; }
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+  uint64_t m_state;
+};
+
+inline std::string random_dna(Rng& rng, size_t size)
+{
+  static const char alpha[] = "ACGT";
+  std::string seq(size, 'A');
+  for (size_t i=0; i<size; i++)
+    seq[i] = alpha[rng.below(4)];
+  return seq;
+}
+
+template<size_t MAX_K>
+std::vector<Kmer<MAX_K>> random_kmers(Rng& rng, size_t n, size_t kmer_size)
+{
+  std::vector<Kmer<MAX_K>> kmers;
+  kmers.reserve(n);
+  for (size_t i=0; i<n; i++)
+    kmers.emplace_back(random_dna(rng, kmer_size));
+  return kmers;
+}
+
+template<typename T>
+std::vector<T> random_counts(Rng& rng, size_t n, uint64_t max)
+{
+  std::vector<T> v(n);
+  for (auto& c : v)
+    c = static_cast<T>(1 + rng.below(max));
+  return v;
+}
+
+/*
+  Samples are drawn from one random genome with a per-sample substitution rate,
+  so that the datasets share most of their k-mers like real cohorts do.
+  Writes <dir>/S<i>.fasta and <dir>/kmtricks.fof, returns the fof path.
+*/
+inline std::string generate_reads(const std::string& dir, uint32_t nb_samples, size_t genome_size,
+                                  size_t nb_reads, size_t read_size, double mutation_rate,
+                                  uint64_t seed)
+{
+  fs::create_directories(dir);
+  Rng rng(seed);
+  std::string genome = random_dna(rng, genome_size);
+  std::string fof_path = fmt::format("{}/kmtricks.fof", dir);
+  std::ofstream fof(fof_path); check_fstream_good(fof_path, fof);
+
+  for (uint32_t s=0; s<nb_samples; s++)
+  {
+    Rng srng(seed + s + 1);
+    std::string sample = genome;
+    for (auto& c : sample)
+      if (srng.uniform() < mutation_rate)
+        c = "ACGT"[srng.below(4)];
+
+    std::string path = fs::absolute(fmt::format("{}/S{}.fasta", dir, s)).string();
+    std::ofstream out(path); check_fstream_good(path, out);
+    for (size_t r=0; r<nb_reads; r++)
+    {
+      size_t pos = srng.below(genome_size - read_size + 1);
+      out << ">" << r << "\n" << sample.substr(pos, read_size) << "\n";
+    }
+    fof << "S" << s << ": " << path << "\n";
+  }
+  return fof_path;
+}
+
+/*
+  Sorted partition files as produced by the count stage: each sample keeps a random
+  subset (presence) of a shared pool of k-mers/hashes.
+*/
+template<size_t MAX_K, size_t MAX_C>
+std::vector<std::string> generate_kmer_parts(const std::string& dir, uint32_t nb_samples,
+                                             size_t pool_size, size_t kmer_size,
+                                             double presence, bool lz4, uint64_t seed)
+{
+  using count_type = typename selectC<MAX_C>::type;
+  fs::create_directories(dir);
+  Rng rng(seed);
+  auto pool = random_kmers<MAX_K>(rng, pool_size, kmer_size);
+  std::sort(pool.begin(), pool.end());
+  pool.erase(std::unique(pool.begin(), pool.end()), pool.end());
+
+  std::vector<std::string> paths;
+  for (uint32_t s=0; s<nb_samples; s++)
+  {
+    paths.push_back(fmt::format("{}/S{}.kmer{}", dir, s, lz4 ? ".lz4" : ""));
+    KmerWriter<8192> kw(paths.back(), kmer_size, requiredC<MAX_C>::value / 8, s, 0, lz4);
+    for (auto& k : pool)
+      if (rng.uniform() < presence)
+        kw.write<MAX_K, MAX_C>(k, static_cast<count_type>(1 + rng.below(std::min<uint64_t>(MAX_C, 1000))));
+  }
+  return paths;
+}
+
+template<size_t MAX_C>
+std::vector<std::string> generate_hash_parts(const std::string& dir, uint32_t nb_samples,
+                                             size_t pool_size, double presence, bool compress,
+                                             uint64_t seed)
+{
+  using count_type = typename selectC<MAX_C>::type;
+  fs::create_directories(dir);
+  Rng rng(seed);
+  std::vector<uint64_t> pool(pool_size);
+  for (auto& h : pool)
+    h = rng.next();
+  std::sort(pool.begin(), pool.end());
+  pool.erase(std::unique(pool.begin(), pool.end()), pool.end());
+
+  std::vector<std::string> paths;
+  for (uint32_t s=0; s<nb_samples; s++)
+  {
+    paths.push_back(fmt::format("{}/S{}.hash{}", dir, s, compress ? ".p4" : ""));
+    HashWriter<MAX_C, 32768> hw(paths.back(), requiredC<MAX_C>::value / 8, s, 0, compress);
+    for (auto& h : pool)
+      if (rng.uniform() < presence)
+        hw.write(h, static_cast<count_type>(1 + rng.below(std::min<uint64_t>(MAX_C, 1000))));
+  }
+  return paths;
+}
+
+};
@@ -0,0 +1,378 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <xxhash.h>
+#include <fmt/format.h>
+
+#include <kmtricks/exceptions.hpp>
+#include <kmtricks/hash.hpp>
+#include <kmtricks/kmer.hpp>
+#include <kmtricks/packc.hpp>
+#include <kmtricks/repartition.hpp>
+#include <kmtricks/utils.hpp>
+#include <kmtricks/io/mmap_file.hpp>
+#include <kmtricks/io/vector_matrix_file.hpp>
+
+namespace km {
+
+/*
+  Per-sample counters stored as bit planes: bit j of the counter of sample s is bit s of plane
+  j. Adding a row of sample bits is a ripple-carry over the planes with word-wide AND/XOR, so
+  all the samples are updated at once. The word loops are vectorized by the compiler.
+*/
+class BitSlicedCounter
+{
+public:
+  BitSlicedCounter(size_t nb_samples)
+    : m_nb_samples(nb_samples), m_words((nb_samples + 63) / 64), m_carry(m_words, 0)
+  {}
+
+  // Add a row of NBYTES(nb_samples) bytes, sample s is bit s%8 of byte s/8.
+  void add(const uint8_t* row)
+  {
+    m_carry[m_words - 1] = 0;
+    std::memcpy(m_carry.data(), row, NBYTES(m_nb_samples));
+
+    for (auto& plane : m_planes)
+    {
+      uint64_t any = 0;
+      for (size_t w = 0; w < m_words; w++)
+      {
+        uint64_t c = plane[w] & m_carry[w];
+        plane[w] ^= m_carry[w];
+        m_carry[w] = c;
+        any |= c;
+      }
+      if (!any)
+        return;
+    }
+    m_planes.push_back(m_carry);
+  }
+
+  // Add the counters to 'counts' and reset them.
+  void flush(std::vector<uint32_t>& counts)
+  {
+    for (size_t j = 0; j < m_planes.size(); j++)
+    {
+      for (size_t s = 0; s < m_nb_samples; s++)
+        counts[s] += ((m_planes[j][s / 64] >> (s % 64)) & 1) << j;
+    }
+    m_planes.clear();
+  }
+
+private:
+  size_t m_nb_samples;
+  size_t m_words;
+  std::vector<uint64_t> m_carry;
+  std::vector<std::vector<uint64_t>> m_planes;
+};
+
+enum class BF_LAYOUT
+{
+  BF,
+  BFT,
+  BFC
+};
+
+/*
+  A memory-mapped partition matrix of a hash:bf:bin, hash:bft:bin or hash:bfc:bin run. In the BF
+  layout (.cmbf), each hash position is a row of one bit per sample. In the BFT layout (.rmbf),
+  the rows are the Bloom filters of the samples, one bit per hash position of the partition. In
+  the BFC layout (.cmbf), each hash position is a row of one log-bucket of 'width' bits per
+  sample, packed as in packc.hpp.
+*/
+class BFPartition
+{
+public:
+  BFPartition(const std::string& path, BF_LAYOUT layout, uint32_t nb_samples)
+    : m_layout(layout), m_nb_samples(nb_samples)
+  {
+    std::ifstream in(path, std::ios::binary | std::ios::in); check_fstream_good(path, in);
+    m_header.deserialize(&in);
+    m_header.sanity_check();
+    if (m_header.compressed)
+      throw IOError(fmt::format("{} is compressed, only uncompressed matrices can be queried.", path));
+    if (nb_samples == 0 || m_header.bits % nb_samples ||
+        (layout != BF_LAYOUT::BFC && m_header.bits != nb_samples) ||
+        m_header.bits / nb_samples > 32)
+      throw IOError(fmt::format("{} has {} bits per row, expected {} samples.",
+                                path, m_header.bits, nb_samples));
+    m_width = m_header.bits / nb_samples;
+    size_t offset = in.tellg();
+
+    m_file = std::make_unique<MappedFile>(path);
+    size_t nb_rows = 0;
+    if (layout == BF_LAYOUT::BFT)
+    {
+      m_row_bytes = m_header.window / 8;
+      nb_rows = ROUND_UP(m_header.bits, 8);
+    }
+    else
+    {
+      m_row_bytes = byte_count_pack(nb_samples, m_width);
+      nb_rows = m_header.window;
+    }
+    if (m_file->size() < offset + nb_rows * m_row_bytes)
+      throw IOError(fmt::format("{} is truncated.", path));
+    m_data = m_file->data() + offset;
+  }
+
+  uint32_t partition() const { return m_header.partition; }
+  uint32_t nb_samples() const { return m_nb_samples; }
+  uint32_t width() const { return m_width; }
+  uint64_t first() const { return m_header.first; }
+  uint64_t window() const { return m_header.window; }
+
+  // Number of distinct values of a row entry, log-buckets are at most to_n_b(UINT32_MAX) = 32.
+  uint32_t nb_buckets() const { return std::min<uint32_t>((1ULL << m_width) - 1, 32) + 1; }
+
+  // Add the hits of the sorted positions [begin, end) to the counts of each sample.
+  void accumulate(const uint64_t* begin, const uint64_t* end,
+                  std::vector<uint32_t>& counts, BitSlicedCounter& counter) const
+  {
+    if (m_layout == BF_LAYOUT::BFT)
+    {
+      // One pass per sample over its Bloom filter, sorted positions keep it forward.
+      for (uint32_t s = 0; s < m_nb_samples; s++)
+      {
+        const uint8_t* row = m_data + s * m_row_bytes;
+        uint32_t c = 0;
+        for (const uint64_t* it = begin; it != end; ++it)
+        {
+          uint64_t pos = *it - m_header.first;
+          c += (row[pos / 8] >> (pos % 8)) & 1;
+        }
+        counts[s] += c;
+      }
+    }
+    else if (m_layout == BF_LAYOUT::BFC)
+    {
+      std::vector<uint32_t> hist(m_nb_samples * nb_buckets(), 0);
+      histogram(begin, end, hist, counter);
+      for (uint32_t s = 0; s < m_nb_samples; s++)
+        counts[s] += (end - begin) - hist[s * nb_buckets()];
+    }
+    else
+    {
+      for (const uint64_t* it = begin; it != end; ++it)
+        counter.add(m_data + (*it - m_header.first) * m_row_bytes);
+      counter.flush(counts);
+    }
+  }
+
+  // Add the entries at the sorted positions [begin, end) to the per-sample histograms of
+  // nb_buckets() entries, 'hist' is sample-major. In the BF/BFT layouts, the entries are 0/1.
+  void histogram(const uint64_t* begin, const uint64_t* end,
+                 std::vector<uint32_t>& hist, BitSlicedCounter& counter) const
+  {
+    uint32_t nb = nb_buckets();
+    if (m_layout == BF_LAYOUT::BFC)
+    {
+      std::vector<uint32_t> row(m_nb_samples);
+      for (const uint64_t* it = begin; it != end; ++it)
+      {
+        unpack_v(m_data + (*it - m_header.first) * m_row_bytes, m_nb_samples, m_width, row.data());
+        for (uint32_t s = 0; s < m_nb_samples; s++)
+          hist[s * nb + row[s]]++;
+      }
+    }
+    else
+    {
+      std::vector<uint32_t> counts(m_nb_samples, 0);
+      accumulate(begin, end, counts, counter);
+      for (uint32_t s = 0; s < m_nb_samples; s++)
+      {
+        hist[s * nb] += (end - begin) - counts[s];
+        hist[s * nb + 1] += counts[s];
+      }
+    }
+  }
+
+private:
+  VectorMatrixFileHeader m_header;
+  BF_LAYOUT m_layout;
+  uint32_t m_nb_samples;
+  uint32_t m_width {1};
+  std::unique_ptr<MappedFile> m_file;
+  const uint8_t* m_data {nullptr};
+  size_t m_row_bytes {0};
+};
+
+// Abundance of a query in one sample, 'min' and 'median' are log-buckets (see to_n_b).
+struct QueryAbundance
+{
+  uint32_t hits {0};
+  uint32_t min {0};
+  uint32_t median {0};
+};
+
+/*
+  Index-free queries over the partition matrices of a hash:bf:bin, hash:bft:bin or hash:bfc:bin
+  run. The k-mers of a query are routed to their partition with the repartition and hashed in
+  the partition window as in the counting step, then the rows at these positions are summed
+  per sample.
+*/
+template<size_t MAX_K>
+class BFTQuery
+{
+public:
+  BFTQuery(const std::vector<std::string>& paths,
+           BF_LAYOUT layout,
+           uint32_t nb_samples,
+           const std::string& repart_path,
+           const std::string& win_path,
+           uint32_t kmer_size)
+    : m_repart(repart_path, ""), m_win(win_path), m_kmer_size(kmer_size),
+      m_hash_len(((kmer_size + 31) / 32) * sizeof(uint64_t)), m_nb_samples(nb_samples)
+  {
+    m_parts.resize(m_win.nb_partitions());
+    for (auto& path : paths)
+    {
+      auto part = std::make_unique<BFPartition>(path, layout, nb_samples);
+      if (part->partition() >= m_parts.size() ||
+          part->window() != m_win.get_window_size_bits() ||
+          part->first() != m_win.get_lower(part->partition()))
+        throw IOError(fmt::format("{} does not match {}.", path, win_path));
+      if (m_width == 0)
+      {
+        m_width = part->width();
+        m_nb_buckets = part->nb_buckets();
+      }
+      else if (part->width() != m_width)
+        throw IOError(fmt::format("{} has {} bits per sample, expected {}.",
+                                  path, part->width(), m_width));
+      m_parts[part->partition()] = std::move(part);
+    }
+  }
+
+  uint32_t nb_samples() const { return m_nb_samples; }
+  uint32_t width() const { return m_width; }
+  uint32_t nb_buckets() const { return m_nb_buckets; }
+
+  // Positions of the k-mers of 'seq' in the Bloom filters, k-mers with non-ACGT are skipped.
+  std::vector<uint64_t> hashes(const std::string& seq) const
+  {
+    std::vector<uint64_t> res;
+    if (seq.size() < m_kmer_size)
+      return res;
+    res.reserve(seq.size() - m_kmer_size + 1);
+
+    uint64_t w = m_win.get_window_size_bits();
+    Kmer<MAX_K> kmer;
+    size_t run = 0;
+    for (size_t i = 0; i < seq.size(); i++)
+    {
+      switch (seq[i])
+      {
+        case 'A': case 'C': case 'G': case 'T':
+        case 'a': case 'c': case 'g': case 't':
+          run++;
+          break;
+        default:
+          run = 0;
+          continue;
+      }
+      if (run < m_kmer_size)
+        continue;
+      kmer.set_polynom(seq.data() + i + 1 - m_kmer_size, m_kmer_size);
+      Kmer<MAX_K> cano = kmer.canonical();
+      uint64_t p = m_repart.get_partition(cano.minimizer(m_win.minim_size()).value());
+      res.push_back((XXH64(cano.get_data64(), m_hash_len, 0) % w) + (w * p));
+    }
+    return res;
+  }
+
+  // Number of k-mers of 'seq' found in each sample, 'nb_kmers' is set to the number of k-mers.
+  std::vector<uint32_t> query(const std::string& seq, uint64_t& nb_kmers) const
+  {
+    std::vector<uint32_t> counts(m_nb_samples, 0);
+    BitSlicedCounter counter(m_nb_samples);
+    for_each_partition(seq, nb_kmers, [&](const BFPartition& part, const uint64_t* b, const uint64_t* e) {
+      part.accumulate(b, e, counts, counter);
+    });
+    return counts;
+  }
+
+  // Hits and min/median log-bucket of the k-mers of 'seq' in each sample, 'nb_kmers' is set to
+  // the number of k-mers. The median is the lower median over all the k-mers, absent ones included.
+  std::vector<QueryAbundance> abundance(const std::string& seq, uint64_t& nb_kmers) const
+  {
+    std::vector<uint32_t> hist(m_nb_samples * m_nb_buckets, 0);
+    BitSlicedCounter counter(m_nb_samples);
+    for_each_partition(seq, nb_kmers, [&](const BFPartition& part, const uint64_t* b, const uint64_t* e) {
+      part.histogram(b, e, hist, counter);
+    });
+
+    std::vector<QueryAbundance> res(m_nb_samples);
+    if (nb_kmers == 0)
+      return res;
+    for (uint32_t s = 0; s < m_nb_samples; s++)
+    {
+      const uint32_t* h = hist.data() + s * m_nb_buckets;
+      res[s].hits = nb_kmers - h[0];
+      res[s].min = 0;
+      while (h[res[s].min] == 0)
+        res[s].min++;
+      uint64_t seen = 0;
+      for (res[s].median = 0; (seen += h[res[s].median]) < (nb_kmers + 1) / 2; res[s].median++);
+    }
+    return res;
+  }
+
+private:
+  // Call f(partition, begin, end) on the sorted positions of 'seq', grouped by partition.
+  template<typename F>
+  void for_each_partition(const std::string& seq, uint64_t& nb_kmers, F&& f) const
+  {
+    std::vector<uint64_t> positions = hashes(seq);
+    nb_kmers = positions.size();
+    std::sort(positions.begin(), positions.end());
+
+    uint64_t w = m_win.get_window_size_bits();
+    for (size_t i = 0; i < positions.size();)
+    {
+      uint64_t p = positions[i] / w;
+      size_t j = i;
+      while (j < positions.size() && positions[j] / w == p)
+        j++;
+      if (!m_parts[p])
+        throw IOError(fmt::format("Partition {} is missing.", p));
+      f(*m_parts[p], positions.data() + i, positions.data() + j);
+      i = j;
+    }
+  }
+
+  Repartition m_repart;
+  HashWindow m_win;
+  uint32_t m_kmer_size;
+  size_t m_hash_len;
+  uint32_t m_nb_samples {0};
+  uint32_t m_width {0};
+  uint32_t m_nb_buckets {0};
+  std::vector<std::unique_ptr<BFPartition>> m_parts;
+};
+
+};
@@ -42,6 +42,9 @@
 #include <kmtricks/cli/index.hpp>
 #include <kmtricks/cli/query.hpp>
 #include <kmtricks/cli/combine.hpp>
+#include <kmtricks/cli/extract.hpp>
+#include <kmtricks/cli/add.hpp>
+#include <kmtricks/cli/sketch.hpp>
 
 namespace km
 {
@@ -73,6 +76,9 @@ private:
   index_options_t index_opt {nullptr};
   query_options_t query_opt {nullptr};
   combine_options_t combine_opt {nullptr};
+  extract_options_t extract_opt {nullptr};
+  add_options_t add_opt {nullptr};
+  sketch_options_t sketch_opt {nullptr};
 };
 
 };  // namespace km
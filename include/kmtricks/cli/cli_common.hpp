@@ -49,6 +49,11 @@ inline void add_common(bc::cmd_t cmd, km_options_t options)
     ->def("info")
     ->checker(bc::check::f::in("debug|info|warning|error"))
     ->setter(options->verbosity);
+  cmd->add_param("--io-backend", "I/O backend of the kmtricks files [sync|threads|uring].")
+    ->meta("STR")
+    ->def("sync")
+    ->checker(bc::check::f::in("sync|threads|uring"))
+    ->setter(options->io_backend);
 }
 
 };  // namespace kmdiff
\ No newline at end of file
@@ -32,6 +32,9 @@
 #include <kmtricks/cmd/index.hpp>
 #include <kmtricks/cmd/query.hpp>
 #include <kmtricks/cmd/combine.hpp>
+#include <kmtricks/cmd/extract.hpp>
+#include <kmtricks/cmd/sketch.hpp>
+#include <kmtricks/cmd/add.hpp>
 
 #include <kmtricks/io.hpp>
 #include <kmtricks/utils.hpp>
@@ -43,6 +46,8 @@
 #include <kmtricks/progress.hpp>
 #include <kmtricks/signals.hpp>
 #include <kmtricks/matrix.hpp>
+#include <kmtricks/bft_query.hpp>
+#include <kmtricks/io/fastx.hpp>
 
 #ifdef WITH_PLUGIN
 #include <kmtricks/plugin_manager.hpp>
@@ -53,6 +58,7 @@
 #include <cmd_cluster.h>
 #include <cmd_build_sbt.h>
 #include <cmd_query.h>
+#include <kmtricks/sketch_topology.hpp>
 #endif
 
 namespace km {
@@ -66,7 +72,8 @@ struct main_all
     all_options_t opt = std::static_pointer_cast<struct all_options>(options);
     spdlog::debug(opt->display());
     opt->sanity_check();
-    KmDir::get().init(opt->dir, opt->fof, true);
+    // On resume, the run directory and its copy of the fof already exist.
+    KmDir::get().init(opt->dir, opt->fof, !opt->resume);
     opt->dump(KmDir::get().m_options);
 
 #ifdef WITH_PLUGIN
@@ -94,9 +101,12 @@ struct main_repart
                                           opt->repart_type,
                                           1,
                                           opt->nb_parts);
-    ConfigTask<MAX_K> config_task(opt->fof, props, opt->bloom_size, opt->nb_parts);
+    ConfigTask<MAX_K> config_task(opt->fof, props, opt->bloom_size, opt->nb_parts, opt->nb_threads);
     config_task.exec();
-    RepartTask<MAX_K> repart_task(opt->fof); repart_task.exec(); repart_task.postprocess();
+    uint32_t sample_reads = opt->sample_reads ? opt->sample_reads
+                                              : auto_sample_reads(KmDir::get().m_fof.size());
+    RepartTask<MAX_K> repart_task(opt->fof, "", sample_reads, opt->sample_seed, opt->nb_threads);
+    repart_task.exec(); repart_task.postprocess();
 
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
     LOCAL(config_storage);
@@ -137,7 +147,9 @@ struct main_superk
                                         p, config._nb_partitions));
     }
 
-    SuperKTask<MAX_K> superk_task(opt->id, opt->lz4, opt->restrict_to_list); superk_task.exec();
+    SuperKTask<MAX_K> superk_task(opt->id, opt->lz4, opt->restrict_to_list, opt->packed,
+                                  opt->nb_threads);
+    superk_task.exec();
   }
 };
 
@@ -163,8 +175,14 @@ struct main_count
     TaskPool pool(opt->nb_threads);
     HashWindow hw(KmDir::get().m_hash_win);
 
-    hist_t hist = opt->hist ? std::make_shared<KHist>(KmDir::get().m_fof.get_i(opt->id),
-                                          config._kmerSize, 1, 255) : nullptr;
+    hist_t hist = opt->hist ? make_hist<DMAX_C>(KmDir::get().m_fof.get_i(opt->id),
+                                                config._kmerSize, opt->hist_log) : nullptr;
+    sketch_t sketch = opt->sketch ? std::make_shared<KSketch>(KmDir::get().m_fof.get_i(opt->id),
+                                          config._kmerSize, 12, opt->sketch_scale,
+                                          opt->sketch_size) : nullptr;
+
+    // A single partition gets all the threads for its sort and dump.
+    uint32_t part_threads = opt->partition_id != -1 ? opt->nb_threads : 1;
 
     for (size_t i=0; i<config._nb_partitions; i++)
     {
@@ -181,14 +199,14 @@ struct main_count
           spdlog::debug("[push] - CountTask - S={}, P={}", opt->id, i);
           pool.add_task(std::make_shared<CountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
             path, config, superk_storage, pinfo, i, KmDir::get().m_fof.get_i(opt->id),
-            config._kmerSize, opt->c_ab_min, opt->lz4, get_hist_clone(hist), opt->clear));
+            config._kmerSize, opt->c_ab_min, opt->lz4, hist, opt->clear, part_threads, sketch));
         }
         else if (opt->format == "kff")
         {
           spdlog::debug("[push] - KffCountTask - S={}, P={}", opt->id, i);
           pool.add_task(std::make_shared<KffCountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
             path, config, superk_storage, pinfo, i, KmDir::get().m_fof.get_i(opt->id),
-            config._kmerSize, opt->c_ab_min, get_hist_clone(hist), opt->clear));
+            config._kmerSize, opt->c_ab_min, hist, opt->clear, part_threads, sketch));
         }
       }
       else if (opt->format == "hash" || opt->format == "vector")
@@ -202,14 +220,15 @@ struct main_count
           pool.add_task(std::make_shared<HashCountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
                 path, config, superk_storage, pinfo, i, KmDir::get().m_fof.get_i(opt->id),
                 hw.get_window_size_bits(), config._kmerSize, opt->c_ab_min, opt->lz4,
-                get_hist_clone(hist), opt->clear));
+                hist, opt->clear, 1, sketch));
         }
         else
         {
           spdlog::debug("[push] - HashVecCountTask - S={}, P={}", opt->id, i);
           pool.add_task(std::make_shared<HashVecCountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
             path, config, superk_storage, pinfo, i, KmDir::get().m_fof.get_i(opt->id),
-            hw.get_window_size_bits(), config._kmerSize, opt->c_ab_min, opt->lz4, get_hist_clone(hist), opt->clear));
+            hw.get_window_size_bits(), config._kmerSize, opt->c_ab_min, opt->lz4, hist, opt->clear,
+            1, sketch));
         }
       }
     }
@@ -217,9 +236,15 @@ struct main_count
 
     if (opt->hist)
     {
-      hist->merge_clones();
+      hist->reduce();
       HistWriter(KmDir::get().get_hist_path(opt->id), *hist, false);
     }
+
+    if (opt->sketch)
+    {
+      sketch->reduce();
+      SketchWriter(KmDir::get().get_sketch_path(opt->id), *sketch, false);
+    }
   }
 };
 
@@ -246,7 +271,10 @@ struct main_merge
       {
         hist.push_back(HistReader<8192>(KmDir::get().get_hist_path(std::get<0>(id))).get());
       }
-      opt->m_ab_min_vec = compute_merge_thresholds(hist, opt->m_ab_min_f, KmDir::get().get_merge_th_path());
+      if (opt->m_ab_auto)
+        opt->m_ab_min_vec = compute_auto_thresholds(hist, KmDir::get().get_merge_th_path());
+      else
+        opt->m_ab_min_vec = compute_merge_thresholds(hist, opt->m_ab_min_f, KmDir::get().get_merge_th_path());
     }
 
     HashWindow hw(KmDir::get().m_hash_win);
@@ -497,6 +525,242 @@ struct main_combine
   }
 };
 
+template<size_t MAX_K>
+struct main_add
+{
+  void operator()(km_options_t options)
+  {
+    spdlog::info("Run with {} implementation", Kmer<MAX_K>::name());
+    add_options_t opt = std::static_pointer_cast<struct add_options>(options);
+    spdlog::debug(opt->display());
+    KmDir::get().init(opt->dir, "", false);
+
+    Timer timer;
+
+    auto run = parse_run_options(KmDir::get().m_options);
+    MODE mode = str_to_mode(run["mode"]);
+    FORMAT format = str_to_format2(run["format"]);
+    COUNT_FORMAT cformat = str_to_cformat(run["count_format"]);
+    OUT_FORMAT out_format = str_to_format(run["bf_format"]);
+    COMMAND until = str_to_cmd(run["until"]);
+    bool lz4 = run["lz4"] == "1";
+    uint32_t c_ab_min = std::stoul(run["c_ab_min"]);
+    uint32_t m_ab_min = std::stoul(run["m_ab_min"]);
+    uint32_t r_min = std::stoul(run["r_min"]);
+    uint32_t save_if = std::stoul(run["save_if"]);
+
+    if (format != FORMAT::BIN || mode == MODE::BFC || mode == MODE::UNKNOWN ||
+        cformat == COUNT_FORMAT::UNKNOWN || (mode == MODE::BF && cformat != COUNT_FORMAT::HASH))
+      throw InputError(fmt::format("{}: matrix format not supported by 'kmtricks add'.", opt->dir));
+    if (run["kff"] == "1" || run["logan"] == "1" || run["m_ab_float"] == "1")
+      throw InputError("'kmtricks add' does not support runs made with --kff-output, --logan or a relative/auto --soft-min.");
+    // The rows dropped by --recurrence-min or kept by --share-min depend on the counts of the
+    // existing samples, which are no longer available.
+    if (mode != MODE::BFT && (r_min > 1 || save_if > 0))
+      throw InputError("'kmtricks add' does not support runs made with --recurrence-min > 1 or --share-min > 0.");
+    if (until == COMMAND::REPART || until == COMMAND::SUPERK || until == COMMAND::COUNT ||
+        (mode == MODE::BFT && until == COMMAND::MERGE))
+      throw InputError(fmt::format("{}: the run was stopped before the matrices (--until {}).",
+                                   opt->dir, cmd_to_str(until)));
+    if (!run["m_ab_min_path"].empty())
+      spdlog::warn("Per-sample --soft-min thresholds do not cover the new samples, --soft-min {} is used.", m_ab_min);
+
+    Fof new_fof(opt->fof);
+    std::vector<std::string> ids;
+    for (auto& s : new_fof)
+    {
+      if (KmDir::get().m_fof.has(std::get<0>(s)))
+        throw IDError(fmt::format("{} is already in {}.", std::get<0>(s), KmDir::get().m_fof_path));
+      ids.push_back(std::get<0>(s));
+    }
+
+    // The run fof is replaced only once all the matrices are extended.
+    std::string fof_path = KmDir::get().m_fof_path + ".add";
+    {
+      std::ofstream out(fof_path, std::ios::out); check_fstream_good(fof_path, out);
+      for (auto& path : {KmDir::get().m_fof_path, opt->fof})
+      {
+        std::ifstream inf(path, std::ios::in); check_fstream_good(path, inf);
+        for (std::string line; std::getline(inf, line);)
+          if (!bc::utils::trim(line).empty())
+            out << line << '\n';
+      }
+    }
+    KmDir::get().m_fof = Fof(fof_path);
+
+    Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
+    LOCAL(config_storage);
+    Configuration config = Configuration();
+    config.load(config_storage->getGroup("gatb"));
+
+    HashWindow hw(KmDir::get().m_hash_win);
+
+    // Partitions missing from the matrices were left out with --restrict-to.
+    bool cpr = lz4 && cformat == COUNT_FORMAT::KMER;
+    std::vector<uint32_t> partitions;
+    for (uint32_t p=0; p<config._nb_partitions; p++)
+    {
+      if (mode == MODE::BFT || fs::exists(KmDir::get().get_matrix_path(p, mode, format, cformat, cpr)))
+        partitions.push_back(p);
+    }
+    if (partitions.empty())
+      throw InputError(fmt::format("{}: no matrix found.", opt->dir));
+
+    spdlog::info("Add {} samples to {} ({} partitions)...", ids.size(), opt->dir, partitions.size());
+
+    {
+      TaskPool pool(opt->nb_threads);
+      for (auto& id : ids)
+      {
+        spdlog::debug("[push] - SuperKTask - S={}", id);
+        pool.add_task(std::make_shared<SuperKTask<MAX_K>>(id, lz4, partitions));
+      }
+      pool.join_all();
+    }
+
+    KM_FILE km_file = cformat == COUNT_FORMAT::KMER ? KM_FILE::KMER : KM_FILE::HASH;
+    if (mode == MODE::BFT) km_file = KM_FILE::VECTOR;
+    bool count_lz4 = mode == MODE::BFT ? false : lz4;
+
+    // The new sketches use the parameters of the existing ones.
+    uint64_t sketch_scale = 1000, sketch_size = 0;
+    std::string first_sketch = KmDir::get().get_sketch_path(KmDir::get().m_fof.get_id(0));
+    if (opt->sketch && fs::exists(first_sketch))
+    {
+      sketch_t first = SketchReader<8192>(first_sketch).get();
+      sketch_scale = first->minhash().scale();
+      sketch_size = first->minhash().size();
+    }
+
+    std::vector<hist_t> hists;
+    std::vector<sketch_t> sketches;
+    TaskPool count_pool(opt->nb_threads);
+    for (auto& sample : new_fof)
+    {
+      std::string id = std::get<0>(sample);
+      uint32_t iid = KmDir::get().m_fof.get_i(id);
+      uint32_t a_min = std::get<2>(sample) == 0 ? c_ab_min : std::get<2>(sample);
+
+      sk_storage_t superk_storage = std::make_shared<SuperKStorageReader>(KmDir::get().get_superk_path(id));
+      parti_info_t pinfo = std::make_shared<PartiInfo<5>>(KmDir::get().get_superk_path(id));
+      hists.push_back(opt->hist ? make_hist<DMAX_C>(iid, config._kmerSize, opt->hist_log) : nullptr);
+      sketches.push_back(opt->sketch ? std::make_shared<KSketch>(iid, config._kmerSize, 12, sketch_scale,
+                                                                 sketch_size) : nullptr);
+
+      for (auto p : partitions)
+      {
+        KmDir::get().init_one_part(p);
+        std::string path = KmDir::get().get_count_part_path(id, p, count_lz4, km_file);
+        task_t task;
+        if (km_file == KM_FILE::KMER)
+        {
+          task = std::make_shared<CountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
+            path, config, superk_storage, pinfo, p, iid, config._kmerSize, a_min, lz4,
+            hists.back(), !opt->keep_tmp, 1, sketches.back());
+        }
+        else if (km_file == KM_FILE::HASH)
+        {
+          task = std::make_shared<HashCountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
+            path, config, superk_storage, pinfo, p, iid, hw.get_window_size_bits(),
+            config._kmerSize, a_min, lz4, hists.back(), !opt->keep_tmp, 1, sketches.back());
+        }
+        else
+        {
+          task = std::make_shared<HashVecCountTask<MAX_K, DMAX_C, SuperKStorageReader>>(
+            path, config, superk_storage, pinfo, p, iid, hw.get_window_size_bits(),
+            config._kmerSize, a_min, false, hists.back(), !opt->keep_tmp, 1, sketches.back());
+        }
+        spdlog::debug("[push] - {}", task->name());
+        count_pool.add_task(task);
+      }
+    }
+    count_pool.join_all();
+
+    if (opt->hist)
+    {
+      reduce_histograms(hists, opt->nb_threads);
+      for (auto& h : hists)
+      {
+        HistWriter(KmDir::get().get_hist_path(KmDir::get().m_fof.get_id(h->idx())), *h, false);
+      }
+    }
+
+    if (opt->sketch)
+    {
+      reduce_sketches(sketches, opt->nb_threads);
+      for (auto& sk : sketches)
+        SketchWriter(KmDir::get().get_sketch_path(KmDir::get().m_fof.get_id(sk->idx())), *sk, false);
+    }
+
+    std::vector<std::string> outputs;
+    TaskPool pool(opt->nb_threads);
+    if (mode == MODE::BFT)
+    {
+      // Filters are per sample, the new ones are built directly from the vector counts.
+      for (auto& id : ids)
+      {
+        spdlog::debug("[push] - FormatVectorTask - S={}", id);
+        pool.add_task(std::make_shared<FormatVectorTask>(
+          id, out_format, hw.bloom_size(), config._nb_partitions, false, config._kmerSize,
+          !opt->keep_tmp));
+      }
+      pool.join_all();
+    }
+    else
+    {
+      std::vector<uint32_t> ab_vec(ids.size(), m_ab_min);
+      for (auto p : partitions)
+      {
+        std::string matrix = KmDir::get().get_matrix_path(p, mode, format, cformat, cpr);
+        outputs.push_back(matrix + ".add");
+
+        std::vector<std::string> paths;
+        for (auto& id : ids)
+          paths.push_back(KmDir::get().get_count_part_path(id, p, count_lz4, km_file));
+
+        task_t task;
+        if (mode == MODE::BF)
+          task = std::make_shared<BfMatrixAppendTask<DMAX_C>>(
+            matrix, outputs.back(), paths, ab_vec);
+        else if (cformat == COUNT_FORMAT::KMER)
+          task = std::make_shared<MatrixAppendTask<MAX_K, DMAX_C>>(
+            matrix, outputs.back(), paths, ab_vec, config._kmerSize, mode == MODE::PA, lz4);
+        else
+          task = std::make_shared<MatrixAppendTask<1, DMAX_C>>(
+            matrix, outputs.back(), paths, ab_vec, config._kmerSize, mode == MODE::PA, lz4);
+        spdlog::debug("[push] - {}", task->name());
+        pool.add_task(task);
+      }
+      pool.join_all();
+
+      if (!opt->keep_tmp)
+      {
+        for (auto& id : ids)
+          for (auto p : partitions)
+            Eraser::get().erase(KmDir::get().get_count_part_path(id, p, count_lz4, km_file));
+      }
+    }
+
+    for (auto& o : outputs)
+      fs::rename(o, o.substr(0, o.size() - 4));
+    fs::rename(fof_path, KmDir::get().m_fof_path);
+
+    if (mode == MODE::BFT)
+    {
+      std::string bf_list = KmDir::get().get_bf_list_path();
+      std::ofstream out(bf_list, std::ios::out); check_fstream_good(bf_list, out);
+      for (auto id: KmDir::get().m_fof)
+        out << fs::absolute(fs::path(
+          KmDir::get().get_filter_path(std::get<0>(id), out_format))).string() << "\n";
+      if (fs::exists(KmDir::get().get_index_path()))
+        spdlog::warn("The HowDeSBT tree cannot be extended, run 'kmtricks index' to rebuild it.");
+    }
+
+    spdlog::info("Done in {}. {} now has {} samples.", timer.formatted(), opt->dir,
+                 KmDir::get().m_fof.size());
+  }
+};
+
 
 template<size_t MAX_K>
 struct main_agg
@@ -666,6 +930,128 @@ struct main_agg
   }
 };
 
+template<size_t MAX_K>
+struct main_extract
+{
+  void operator()(km_options_t options)
+  {
+    spdlog::info("Run with {} implementation", Kmer<MAX_K>::name());
+    extract_options_t opt = std::static_pointer_cast<struct extract_options>(options);
+    spdlog::debug(opt->display());
+
+    KmDir::get().init(opt->dir, "", false);
+    Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
+    LOCAL(config_storage);
+    Configuration config = Configuration();
+    config.load(config_storage->getGroup("gatb"));
+
+    if (opt->samples.empty())
+      throw InputError("--samples: at least one sample ID is required.");
+    if (opt->format == "bin" && opt->output == "stdout")
+      throw InputError("--output: a file path is required with --format bin.");
+
+    std::vector<uint32_t> columns;
+    for (auto& s : opt->samples)
+      columns.push_back(KmDir::get().m_fof.get_i(s));
+
+    COUNT_FORMAT cformat = str_to_cformat(opt->matrix);
+    std::vector<std::string> paths = KmDir::get().get_matrix_paths(config._nb_partitions,
+                                                                  MODE::COUNT, FORMAT::BIN,
+                                                                  cformat, opt->lz4_in);
+    if (paths.empty())
+      throw IOError("No files found for these parameters.");
+
+    if (cformat == COUNT_FORMAT::KMER)
+    {
+      MatrixColumnExtractor<MAX_K, DMAX_C> mce(paths, columns, config._kmerSize);
+      if (opt->format == "text")
+        opt->output == "stdout" ? mce.write_as_text(std::cout) : mce.write_as_text(opt->output);
+      else
+        mce.write_as_bin(opt->output, opt->lz4);
+    }
+    else
+    {
+      MatrixHashColumnExtractor<DMAX_C> mhce(paths, columns);
+      if (opt->format == "text")
+        opt->output == "stdout" ? mhce.write_as_text(std::cout) : mhce.write_as_text(opt->output);
+      else
+        mhce.write_as_bin(opt->output, opt->lz4);
+    }
+  }
+};
+
+template<size_t MAX_K>
+struct main_sketch
+{
+  void operator()(km_options_t options)
+  {
+    sketch_options_t opt = std::static_pointer_cast<struct sketch_options>(options);
+    spdlog::debug(opt->display());
+
+    KmDir::get().init(opt->dir, "", false);
+
+    std::vector<sketch_t> sketches;
+    for (auto& id : KmDir::get().m_fof)
+    {
+      std::string path = KmDir::get().get_sketch_path(std::get<0>(id));
+      if (!fs::exists(path))
+        throw IOError(fmt::format("{} not found, the samples have to be counted with --sketch.", path));
+      sketches.push_back(SketchReader<8192>(path).get());
+    }
+
+    size_t n = sketches.size();
+    std::vector<double> dist;
+    if (!opt->cardinality)
+    {
+      // containment is not symmetric, the full matrix is computed.
+      dist.resize(n * n);
+      parallel_for_each(n, opt->nb_threads, [&sketches, &dist, &opt, n](size_t i) {
+        for (size_t j=0; j<n; j++)
+        {
+          MinHashCmp cmp(sketches[i]->minhash(), sketches[j]->minhash());
+          if (opt->dist == "containment")
+            dist[i * n + j] = cmp.containment();
+          else if (opt->dist == "jaccard")
+            dist[i * n + j] = cmp.jaccard();
+          else
+            dist[i * n + j] = mash_distance(cmp.jaccard(), sketches[i]->ksize());
+        }
+      });
+    }
+
+    auto write = [&](std::ostream& out) {
+      if (opt->cardinality)
+      {
+        for (auto& sk : sketches)
+          out << KmDir::get().m_fof.get_id(sk->idx()) << "\t"
+              << static_cast<uint64_t>(std::llround(sk->cardinality())) << "\n";
+        return;
+      }
+      out << "#";
+      for (auto& sk : sketches)
+        out << "\t" << KmDir::get().m_fof.get_id(sk->idx());
+      out << "\n";
+      for (size_t i=0; i<n; i++)
+      {
+        out << KmDir::get().m_fof.get_id(sketches[i]->idx());
+        for (size_t j=0; j<n; j++)
+          out << fmt::format("\t{:.6g}", dist[i * n + j]);
+        out << "\n";
+      }
+    };
+
+    if (opt->output == "stdout")
+    {
+      write(std::cout);
+    }
+    else
+    {
+      std::ofstream out(opt->output, std::ios::out); check_fstream_good(opt->output, out);
+      write(out);
+    }
+  }
+};
+
 template<size_t MAX_K>
 struct main_filter
 {
@@ -804,37 +1190,44 @@ struct main_index
     }
 
     std::string index = KmDir::get().get_index_path();
-    std::string howde_index_str = fmt::format("cluster --list={} --out={}",
-                                              bf_list, index);
-
-    if (opt->upper != 0)
-      howde_index_str += fmt::format(" {}..{}", opt->lower, opt->upper);
+    if (opt->topology == "sketch")
+    {
+      sketch_topology(opt, bf_list, index);
+    }
     else
-      howde_index_str += fmt::format(" --bits={}", opt->bits);
+    {
+      std::string howde_index_str = fmt::format("cluster --list={} --out={}",
+                                                bf_list, index);
 
-    if (opt->cull > 0)
-      howde_index_str += fmt::format(" --cull={}", opt->cull);
+      if (opt->upper != 0)
+        howde_index_str += fmt::format(" {}..{}", opt->lower, opt->upper);
+      else
+        howde_index_str += fmt::format(" --bits={}", opt->bits);
 
-    if (opt->cull2)
-      howde_index_str += " --cull";
+      if (opt->cull > 0)
+        howde_index_str += fmt::format(" --cull={}", opt->cull);
 
-    if (opt->cullsd > 0)
-      howde_index_str += fmt::format(" --cull={}sd", opt->cullsd);
-    std::vector<std::string> howde_index = bc::utils::split(howde_index_str, ' ');
+      if (opt->cull2)
+        howde_index_str += " --cull";
 
-    char** arr = new char*[howde_index.size()+1];
-    arr[howde_index.size()] = nullptr;
-    for (size_t i=0; i<howde_index.size(); i++)
-      arr[i] = strdup(howde_index.at(i).c_str());
+      if (opt->cullsd > 0)
+        howde_index_str += fmt::format(" --cull={}sd", opt->cullsd);
+      std::vector<std::string> howde_index = bc::utils::split(howde_index_str, ' ');
 
-    ClusterCommand cluster_cmd("cluster");
-    cluster_cmd.parse(howde_index.size(), arr);
-    cluster_cmd.execute();
+      char** arr = new char*[howde_index.size()+1];
+      arr[howde_index.size()] = nullptr;
+      for (size_t i=0; i<howde_index.size(); i++)
+        arr[i] = strdup(howde_index.at(i).c_str());
 
-    for (size_t i=0; i<howde_index.size(); i++)
-      free(arr[i]);
+      ClusterCommand cluster_cmd("cluster");
+      cluster_cmd.parse(howde_index.size(), arr);
+      cluster_cmd.execute();
 
-    delete[] arr;
+      for (size_t i=0; i<howde_index.size(); i++)
+        free(arr[i]);
+
+      delete[] arr;
+    }
 
     spdlog::info("Build index...");
     std::stringstream ss;
@@ -867,8 +1260,47 @@ struct main_index
       free(arr2[i]);
     delete[] arr2;
   }
+
+private:
+  // NN-chain topology on the sketches of the filter windows, see sketch_topology.hpp.
+  void sketch_topology(index_options_t opt, const std::string& bf_list, const std::string& index)
+  {
+    if (opt->cull > 0 || opt->cull2 || opt->cullsd > 0)
+      spdlog::warn("--cull, --cull2 and --cullsd are ignored with --topology sketch.");
+
+    std::vector<std::string> leaves;
+    for (auto id: KmDir::get().m_fof)
+      leaves.push_back(fs::absolute(fs::path(
+        KmDir::get().get_filter_path(std::get<0>(id), OUT_FORMAT::HOWDE))).string());
+
+    uint64_t lower = opt->upper != 0 ? opt->lower : 0;
+    uint64_t upper = opt->upper != 0 ? opt->upper : opt->bits;
+    std::vector<FilterSignature> sigs(leaves.size());
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    parallel_for_each(leaves.size(), opt->nb_threads, [&](size_t i) {
+      try
+      {
+        sigs[i] = filter_signature(leaves[i], opt->sketch_size, lower, upper);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        error = std::current_exception();
+      }
+    });
+    if (error)
+      std::rethrow_exception(error);
+
+    SketchTopology topology(std::move(sigs), opt->nb_threads);
+    topology.build();
+    std::ofstream out(index, std::ios::out); check_fstream_good(index, out);
+    topology.write(out, leaves, bf_list);
+  }
 };
 
+#endif
+
 template<size_t MAX_K>
 struct main_query
 {
@@ -877,6 +1309,7 @@ struct main_query
     spdlog::info("Run with {} implementation", Kmer<MAX_K>::name());
     query_options_t opt = std::static_pointer_cast<struct query_options>(options);
     spdlog::debug(opt->display());
+    opt->sanity_check();
 
     KmDir::get().init(opt->dir, "", false);
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
@@ -884,6 +1317,120 @@ struct main_query
     Configuration config = Configuration();
     config.load(config_storage->getGroup("gatb"));
 
+    if (opt->engine == "bft")
+      query_bft(opt, config);
+    else
+      query_howde(opt);
+  }
+
+  void query_bft(query_options_t opt, Configuration& config)
+  {
+    size_t nb_samples = KmDir::get().m_fof.size();
+    BF_LAYOUT layout = BF_LAYOUT::BFT;
+    std::vector<std::string> paths = KmDir::get().get_matrix_paths(
+      config._nb_partitions, MODE::BFT, FORMAT::BIN, COUNT_FORMAT::HASH, false);
+    if (paths.empty())
+    {
+      layout = BF_LAYOUT::BF;
+      paths = KmDir::get().get_matrix_paths(
+        config._nb_partitions, MODE::BF, FORMAT::BIN, COUNT_FORMAT::HASH, false);
+    }
+    if (paths.empty())
+      throw IOError("No bf/bft/bfc matrices found, run the pipeline with --mode hash:bft:bin "
+                    "and --until merge or --keep-tmp.");
+
+    // bf and bfc matrices share the .cmbf extension, bfc rows have several bits per sample.
+    if (layout == BF_LAYOUT::BF)
+    {
+      std::ifstream in(paths[0], std::ios::binary | std::ios::in); check_fstream_good(paths[0], in);
+      VectorMatrixFileHeader header; header.deserialize(&in);
+      if (header.bits != nb_samples)
+        layout = BF_LAYOUT::BFC;
+    }
+
+    BFTQuery<MAX_K> engine(paths, layout, nb_samples,
+                           fmt::format("{}_gatb/repartition.minimRepart", KmDir::get().m_repart_storage),
+                           KmDir::get().m_hash_win, config._kmerSize);
+
+    std::vector<std::string> names;
+    std::vector<std::string> seqs;
+    if (FastxReader::is_fastx(opt->query))
+    {
+      FastxReader reader(opt->query);
+      while (reader.next())
+      {
+        names.push_back(reader.name());
+        seqs.emplace_back(reader.seq(), reader.size());
+      }
+    }
+    else
+    {
+      std::ifstream in(opt->query); check_fstream_good(opt->query, in);
+      std::string stem = fs::path(opt->query).stem().string();
+      std::string line;
+      for (size_t i = 1; std::getline(in, line); i++)
+      {
+        if (line.empty())
+          continue;
+        names.push_back(fmt::format("{}{}", stem, i));
+        seqs.push_back(std::move(line));
+      }
+    }
+
+    // (ratio, sample index, abundance) of the samples above the threshold, for each query.
+    std::vector<std::vector<std::tuple<double, size_t, QueryAbundance>>> results(seqs.size());
+    std::atomic<size_t> next {0};
+    auto worker = [&]() {
+      for (size_t i = next++; i < seqs.size(); i = next++)
+      {
+        uint64_t nb_kmers = 0;
+        std::vector<QueryAbundance> ab;
+        if (layout == BF_LAYOUT::BFC)
+          ab = engine.abundance(seqs[i], nb_kmers);
+        else
+          for (uint32_t hits : engine.query(seqs[i], nb_kmers))
+            ab.push_back(QueryAbundance{hits, 0, 0});
+        if (nb_kmers == 0)
+          continue;
+        for (size_t s = 0; s < ab.size(); s++)
+        {
+          double ratio = static_cast<double>(ab[s].hits) / nb_kmers;
+          if (ratio >= opt->threshold)
+            results[i].emplace_back(ratio, s, ab[s]);
+        }
+        std::stable_sort(results[i].begin(), results[i].end(),
+                         [](auto& a, auto& b) { return std::get<0>(a) > std::get<0>(b); });
+      }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < opt->nb_threads; t++)
+      threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+      t.join();
+
+    std::ofstream out_file;
+    if (opt->output != "stdout")
+    {
+      out_file.open(opt->output); check_fstream_good(opt->output, out_file);
+    }
+    std::ostream& out = opt->output != "stdout" ? out_file : std::cout;
+    for (size_t i = 0; i < seqs.size(); i++)
+    {
+      out << fmt::format("* [{}]\n", names[i]);
+      for (auto& [ratio, s, ab] : results[i])
+      {
+        if (layout == BF_LAYOUT::BFC)
+          out << fmt::format("[{}] {:.2f} {} {}\n", KmDir::get().m_fof.get_id(s), ratio, ab.min, ab.median);
+        else
+          out << fmt::format("[{}] {:.2f}\n", KmDir::get().m_fof.get_id(s), ratio);
+      }
+    }
+  }
+
+  void query_howde([[maybe_unused]] query_options_t opt)
+  {
+#ifdef WITH_HOWDE
     std::string index_path;
     for (auto& p : fs::directory_iterator(KmDir::get().m_index_storage))
     {
@@ -913,6 +1460,7 @@ struct main_query
     ss << "--threshold-shared-positions=" << opt->threshold_shared_positions << " ";
     if (opt->check) ss << "--consistencycheck ";
     if (opt->nodetail) ss << "--no-detail ";
+    if (opt->mmap) ss << "--mmap ";
     if (opt->output != "stdout") ss << "--out=" << opt->output;
 
     std::string howde_query_str = ss.str();
@@ -934,8 +1482,10 @@ struct main_query
     for (size_t i=0; i<howde_query.size(); i++)
       free(arr[i]);
     delete[] arr;
+#else
+    throw PipelineError("kmtricks is built without HowDeSBT, use --engine bft.");
+#endif
   }
 };
 
-#endif
 };
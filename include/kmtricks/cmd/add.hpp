@@ -0,0 +1,88 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <kmtricks/cli/cli_common.hpp>
+#include <kmtricks/cmd/cmd_common.hpp>
+#include <kmtricks/utils.hpp>
+
+namespace km {
+
+struct add_options : km_options
+{
+  std::string fof;
+  bool keep_tmp {false};
+  bool hist {false};
+  bool hist_log {false};
+  bool sketch {false};
+
+  std::string display()
+  {
+    std::stringstream ss;
+    ss << this->global_display();
+    RECORD(ss, fof);
+    RECORD(ss, keep_tmp);
+    RECORD(ss, hist);
+    RECORD(ss, hist_log);
+    RECORD(ss, sketch);
+    std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
+    return ret;
+  }
+};
+
+using add_options_t = std::shared_ptr<struct add_options>;
+
+// Parse the options.txt of a run, as written by kmtricks pipeline (see RECORD).
+inline std::map<std::string, std::string> parse_run_options(const std::string& path)
+{
+  std::ifstream inf(path, std::ios::in); check_fstream_good(path, inf);
+  std::string line; std::getline(inf, line);
+  std::string prefix = "Options: ";
+  if (line.compare(0, prefix.size(), prefix) == 0)
+    line.erase(0, prefix.size());
+
+  std::vector<std::string> records(1);
+  for (size_t i=0; i<line.size(); i++)
+  {
+    if (line[i] == '\\' && i + 1 < line.size())
+      records.back().push_back(line[++i]);
+    else if (line[i] == ',')
+      records.emplace_back();
+    else
+      records.back().push_back(line[i]);
+  }
+
+  std::map<std::string, std::string> run;
+  for (auto& e : records)
+  {
+    auto pos = e.find('=');
+    if (pos == std::string::npos)
+      continue;
+    run[bc::utils::trim(e.substr(0, pos))] = bc::utils::trim(e.substr(pos + 1));
+  }
+  return run;
+}
+
+};
@@ -17,7 +17,10 @@
  *****************************************************************************/
 
 #pragma once
+#include <filesystem>
+#include <fstream>
 #include <memory>
+#include <sstream>
 #include <thread>
 
 #include <spdlog/spdlog.h>
@@ -41,25 +44,38 @@ struct all_options : km_options
   std::string m_ab_min_path;
   double m_ab_min_f {0.0};
   bool m_ab_float = {false};
+  bool m_ab_auto {false};
   uint32_t save_if {0};
 
   uint32_t minim_type {0};
   uint32_t minim_size {0};
   uint32_t repart_type {0};
   uint32_t nb_parts {0};
+  uint32_t sample_reads {0};
+  uint64_t sample_seed {0};
 
   uint64_t bloom_size {0};
 
   bool keep_tmp {false};
   bool lz4 {false};
+  bool packed_superk {false};
   bool kff {false};
   bool skip_merge {false};
+  bool count_merge {false};
   bool hist {false};
+  bool hist_log {false};
+  bool sketch {false};
   bool logan {false};
+  bool telemetry {false};
+  bool trace {false};
+  bool resume {false};
 
   uint32_t bwidth {0};
 
-  uint32_t max_memory {8000};
+  uint64_t sketch_scale {1000};
+  uint32_t sketch_size {0};
+
+  uint32_t max_memory {0};
   double restrict_to;
   std::vector<uint32_t> restrict_to_list;
   std::vector<uint32_t> m_ab_min_vec;
@@ -92,19 +108,32 @@ struct all_options : km_options
     RECORD(ss, m_ab_min_path);
     RECORD(ss, m_ab_min_f);
     RECORD(ss, m_ab_float);
+    RECORD(ss, m_ab_auto);
     RECORD(ss, save_if);
     RECORD(ss, minim_size);
     RECORD(ss, minim_type);
     RECORD(ss, repart_type);
     RECORD(ss, nb_parts);
+    RECORD(ss, sample_reads);
+    RECORD(ss, sample_seed);
     RECORD(ss, bloom_size);
     RECORD(ss, keep_tmp);
     RECORD(ss, lz4);
+    RECORD(ss, packed_superk);
     RECORD(ss, kff);
     RECORD(ss, skip_merge);
+    RECORD(ss, count_merge);
     RECORD(ss, hist);
+    RECORD(ss, hist_log);
+    RECORD(ss, sketch);
+    RECORD(ss, sketch_scale);
+    RECORD(ss, sketch_size);
     RECORD(ss, logan);
+    RECORD(ss, telemetry);
+    RECORD(ss, trace);
+    RECORD(ss, resume);
     RECORD(ss, focus);
+    RECORD(ss, max_memory);
     RECORD(ss, restrict_to);
     RECORD(ss, bwidth);
 #ifdef WITH_PLUGIN
@@ -120,8 +149,46 @@ struct all_options : km_options
     return ss.str();
   }
 
+  // Options that change the content of the run directory, a run can only be resumed with the same ones.
+  std::string fingerprint() const
+  {
+    std::ifstream in(fof, std::ios::in); check_fstream_good(fof, in);
+    std::stringstream content; content << in.rdbuf();
+
+    // FNV-1a, stable across builds unlike std::hash
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : content.str())
+      h = (h ^ c) * 0x100000001b3ULL;
+
+    std::stringstream ss;
+    ss << "fof=" << std::hex << h << std::dec
+       << ";k=" << kmer_size << ";hard_min=" << c_ab_min << ";soft_min=" << m_ab_min
+       << ";soft_min_path=" << m_ab_min_path << ";recurrence_min=" << r_min << ";share_min=" << save_if
+       << ";minim=" << minim_size << "/" << minim_type << ";repart=" << repart_type
+       << ";parts=" << nb_parts << ";restrict_to=" << restrict_to << ";bloom_size=" << bloom_size
+       << ";bwidth=" << bwidth << ";lz4=" << lz4 << ";kff=" << kff << ";skip_merge=" << skip_merge
+       << ";count_merge=" << count_merge << ";packed_superk=" << packed_superk
+       << ";from=" << from << ";mode=" << cformat_to_str(count_format) << ":" << mode_to_str(mode)
+       << ":" << format_to_str2(format) << ":" << format_to_str(out_format) << ";restrict_list=";
+    for (auto& p : restrict_to_list)
+      ss << p << ",";
+    return ss.str();
+  }
+
   void sanity_check()
   {
+    if (!resume && fs::is_directory(dir))
+    {
+      throw PipelineError(fmt::format("{} already exists, use --resume to continue a previous run.", dir));
+    }
+    if (resume && !fs::exists(fmt::format("{}/journal.txt", dir)))
+    {
+      throw PipelineError(fmt::format("Unable to resume, {}/journal.txt not found.", dir));
+    }
+    if (resume && (hist || sketch || m_ab_float || logan))
+    {
+      throw PipelineError("--resume is not supported with --hist, --sketch, --logan or a relative/auto --soft-min.");
+    }
     if ((logan) && (kmer_size != 31))
     {
       throw PipelineError("--logan available only for --kmer-size equal to 31");
@@ -134,6 +201,10 @@ struct all_options : km_options
     {
       throw PipelineError("--logan does not support --kff-output");
     }
+    if ((logan) && (sketch))
+    {
+      throw PipelineError("--logan does not support --sketch");
+    }
     if ((kff) && (until != COMMAND::COUNT))
     {
       throw PipelineError("--kff-output/--kff-sk-output available only with --until count");
@@ -142,6 +213,15 @@ struct all_options : km_options
     {
       throw PipelineError("--kff-output/--kff-sk-output available only in k-mer mode.");
     }
+    if (hist_log && m_ab_float)
+    {
+      throw PipelineError("--hist-log is not available with a relative/auto --soft-min.");
+    }
+    if (count_merge && (until == COMMAND::COUNT || skip_merge || kff || logan || sketch || m_ab_float))
+    {
+      throw PipelineError("--count-merge is not available with --until count, --skip-merge, "
+                          "--kff-output, --logan, --sketch or a relative/auto --soft-min.");
+    }
     if (skip_merge)
     {
       if ((mode != MODE::BFT) || (count_format != COUNT_FORMAT::HASH))
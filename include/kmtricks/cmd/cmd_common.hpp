@@ -24,11 +24,31 @@
 #include <sstream>
 #include <string>
 
-#define RECORD(ss, var) ss << #var << "=" << var << ", "
+#define RECORD(ss, var) ss << #var << "=" << km::record_value(var) << ", "
 
 namespace km
 {
 
+// Records are separated by ", ": backslashes and commas in string values are escaped so that
+// options.txt can be parsed back.
+template<typename T>
+const T& record_value(const T& value)
+{
+  return value;
+}
+
+inline std::string record_value(const std::string& value)
+{
+  std::string ret;
+  for (char c : value)
+  {
+    if (c == '\\' || c == ',')
+      ret.push_back('\\');
+    ret.push_back(c);
+  }
+  return ret;
+}
+
 enum class COMMAND
 {
   ALL,
@@ -46,6 +66,9 @@ enum class COMMAND
   SOCKS_BUILD,
   SOCKS_LOOKUP,
   COMBINE,
+  EXTRACT,
+  ADD,
+  SKETCH,
   UNKNOWN
 };
 
@@ -77,6 +100,12 @@ inline COMMAND str_to_cmd(const std::string& s)
     return COMMAND::SOCKS_LOOKUP;
   else if (s == "combine")
     return COMMAND::COMBINE;
+  else if (s == "extract")
+    return COMMAND::EXTRACT;
+  else if (s == "add")
+    return COMMAND::ADD;
+  else if (s == "sketch")
+    return COMMAND::SKETCH;
   else
     return COMMAND::ALL;
 }
@@ -109,6 +138,12 @@ inline std::string cmd_to_str(COMMAND cmd)
     return "socks-lookup";
   else if (cmd == COMMAND::COMBINE)
     return "combine";
+  else if (cmd == COMMAND::EXTRACT)
+    return "extract";
+  else if (cmd == COMMAND::ADD)
+    return "add";
+  else if (cmd == COMMAND::SKETCH)
+    return "sketch";
   else
     return "all";
 }
@@ -276,6 +311,7 @@ struct km_options
   std::string verbosity{};
   int nb_threads{1};
   std::string dir;
+  std::string io_backend {"sync"};
 
   std::string global_display()
   {
@@ -284,6 +320,7 @@ struct km_options
     RECORD(ss, dir);
     RECORD(ss, verbosity);
     RECORD(ss, nb_threads);
+    RECORD(ss, io_backend);
     return ss.str();
   }
 };
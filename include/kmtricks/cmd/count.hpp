@@ -40,6 +40,11 @@ struct count_options : km_options
   bool lz4;
   bool kff;
   bool hist;
+  bool hist_log {false};
+  bool sketch {false};
+
+  uint64_t sketch_scale {1000};
+  uint32_t sketch_size {0};
 
   std::string format;
 
@@ -55,6 +60,10 @@ struct count_options : km_options
     RECORD(ss, lz4);
     RECORD(ss, kff);
     RECORD(ss, hist);
+    RECORD(ss, hist_log);
+    RECORD(ss, sketch);
+    RECORD(ss, sketch_scale);
+    RECORD(ss, sketch_size);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
@@ -44,6 +44,8 @@ struct index_options : km_options
   size_t upper;
   bool cull2;
   double cullsd;
+  std::string topology;
+  uint32_t sketch_size;
 
   std::string display()
   {
@@ -63,6 +65,8 @@ struct index_options : km_options
     RECORD(ss, upper);
     RECORD(ss, cull2);
     RECORD(ss, cullsd);
+    RECORD(ss, topology);
+    RECORD(ss, sketch_size);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
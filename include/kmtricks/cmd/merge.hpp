@@ -34,7 +34,8 @@ struct merge_options : km_options
   uint32_t m_ab_min;
   std::string m_ab_min_path;
   double m_ab_min_f;
-  bool m_ab_float;
+  bool m_ab_float {false};
+  bool m_ab_auto {false};
   uint32_t r_min;
   int32_t partition_id;
   uint32_t save_if;
@@ -53,6 +54,7 @@ struct merge_options : km_options
     ss << this->global_display();
     RECORD(ss, m_ab_min);
     RECORD(ss, m_ab_min_path);
+    RECORD(ss, m_ab_auto);
     RECORD(ss, r_min);
     RECORD(ss, partition_id);
     RECORD(ss, save_if);
@@ -25,6 +25,7 @@
 
 #include <kmtricks/cli/cli_common.hpp>
 #include <kmtricks/cmd/cmd_common.hpp>
+#include <kmtricks/exceptions.hpp>
 
 namespace km {
 
@@ -32,10 +33,12 @@ struct query_options : km_options
 {
   std::string query;
   std::string output;
+  std::string engine;
   double threshold;
   double threshold_shared_positions;
   bool nodetail;
   bool check;
+  bool mmap;
   int z;
   std::string display()
   {
@@ -43,14 +46,22 @@ struct query_options : km_options
     ss << this->global_display();
     RECORD(ss, query);
     RECORD(ss, output);
+    RECORD(ss, engine);
     RECORD(ss, threshold);
     RECORD(ss, threshold_shared_positions);
     RECORD(ss, nodetail);
     RECORD(ss, check);
+    RECORD(ss, mmap);
     RECORD(ss, z);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
+
+  void sanity_check()
+  {
+    if (engine == "bft" && z > 0)
+      throw PipelineError("--z is not available with --engine bft.");
+  }
 };
 
 using query_options_t = std::shared_ptr<struct query_options>;
@@ -37,6 +37,8 @@ struct repart_options : km_options
   uint32_t minim_size;
   uint32_t repart_type;
   uint32_t nb_parts;
+  uint32_t sample_reads;
+  uint64_t sample_seed;
   uint64_t bloom_size;
 
   std::string display()
@@ -49,6 +51,8 @@ struct repart_options : km_options
     RECORD(ss, minim_type);
     RECORD(ss, repart_type);
     RECORD(ss, nb_parts);
+    RECORD(ss, sample_reads);
+    RECORD(ss, sample_seed);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
@@ -32,6 +32,7 @@ struct superk_options : km_options
 {
   std::string id;
   bool lz4;
+  bool packed {false};
   std::vector<uint32_t> restrict_to_list;
 
   std::string display()
@@ -40,6 +41,7 @@ struct superk_options : km_options
     ss << this->global_display();
     RECORD(ss, id);
     RECORD(ss, lz4);
+    RECORD(ss, packed);
     std::string ret = ss.str(); ret.pop_back(); ret.pop_back();
     return ret;
   }
@@ -0,0 +1,141 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <kmtricks/kmer.hpp>
+#include <kmtricks/utils.hpp>
+
+namespace km {
+
+/*
+  Sorted counts of one sample partition kept in memory, in place of a count file. A run is
+  filled by a count processor, then read back in order by a KmerMerger/HashMerger through
+  a reader with the interface of KmerReader/HashReader.
+*/
+template<size_t MAX_C>
+class KmerRun
+{
+  using count_type = typename selectC<MAX_C>::type;
+public:
+  KmerRun(uint32_t kmer_size) : m_kmer_slots((kmer_size + 31) / 32) {}
+
+  // Same interface as KmerWriter::write_raw.
+  template<size_t C = MAX_C>
+  void write_raw(const uint64_t* data, const count_type count)
+  {
+    m_kmers.insert(m_kmers.end(), data, data + m_kmer_slots);
+    m_counts.push_back(count);
+  }
+
+  size_t size() const { return m_counts.size(); }
+  uint32_t kmer_slots() const { return m_kmer_slots; }
+  const uint64_t* kmer(size_t i) const { return m_kmers.data() + i * m_kmer_slots; }
+  count_type count(size_t i) const { return m_counts[i]; }
+
+  static uint64_t memory(uint64_t nb_kmers, uint32_t kmer_size)
+  {
+    return nb_kmers * (((kmer_size + 31) / 32) * sizeof(uint64_t) + sizeof(count_type));
+  }
+
+private:
+  uint32_t m_kmer_slots;
+  std::vector<uint64_t> m_kmers;
+  std::vector<count_type> m_counts;
+};
+
+template<size_t MAX_C>
+using krun_t = std::shared_ptr<KmerRun<MAX_C>>;
+
+template<size_t MAX_C>
+class KmerRunReader
+{
+public:
+  KmerRunReader(krun_t<MAX_C> run) : m_run(run) {}
+
+  // Same interface as KmerReader::read.
+  template<size_t MAX_K, size_t C = MAX_C>
+  bool read(Kmer<MAX_K>& kmer, typename selectC<MAX_C>::type& count)
+  {
+    if (m_index == m_run->size())
+      return false;
+    std::memcpy(kmer.get_data64_unsafe(), m_run->kmer(m_index),
+                m_run->kmer_slots() * sizeof(uint64_t));
+    count = m_run->count(m_index++);
+    return true;
+  }
+
+private:
+  krun_t<MAX_C> m_run;
+  size_t m_index {0};
+};
+
+template<size_t MAX_C>
+class HashRun
+{
+  using count_type = typename selectC<MAX_C>::type;
+public:
+  void write(uint64_t hash, count_type count)
+  {
+    m_hashes.push_back(hash);
+    m_counts.push_back(count);
+  }
+
+  void flush() {}
+
+  size_t size() const { return m_hashes.size(); }
+  uint64_t hash(size_t i) const { return m_hashes[i]; }
+  count_type count(size_t i) const { return m_counts[i]; }
+
+  static uint64_t memory(uint64_t nb_kmers)
+  {
+    return nb_kmers * (sizeof(uint64_t) + sizeof(count_type));
+  }
+
+private:
+  std::vector<uint64_t> m_hashes;
+  std::vector<count_type> m_counts;
+};
+
+template<size_t MAX_C>
+using hrun_t = std::shared_ptr<HashRun<MAX_C>>;
+
+template<size_t MAX_C>
+class HashRunReader
+{
+public:
+  HashRunReader(hrun_t<MAX_C> run) : m_run(run) {}
+
+  bool read(uint64_t& hash, typename selectC<MAX_C>::type& count)
+  {
+    if (m_index == m_run->size())
+      return false;
+    hash = m_run->hash(m_index);
+    count = m_run->count(m_index++);
+    return true;
+  }
+
+private:
+  hrun_t<MAX_C> m_run;
+  size_t m_index {0};
+};
+
+};
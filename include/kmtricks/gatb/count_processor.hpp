@@ -24,6 +24,8 @@
 #include <kmtricks/io/kff_file.hpp>
 #include <kmtricks/utils.hpp>
 #include <kmtricks/histogram.hpp>
+#include <kmtricks/sketch.hpp>
+#include <kmtricks/count_run.hpp>
 
 namespace km {
 
@@ -46,7 +48,8 @@ public:
   virtual ~ICountProcessor() {}
 };
 
-template<size_t span, size_t MAX_C, size_t buf_size = 32768>
+// Writer is a HashWriter, or a HashRun to keep the counts in memory.
+template<size_t span, size_t MAX_C, size_t buf_size = 32768, typename Writer = HashWriter<MAX_C, buf_size>>
 class HashCountProcessor : public IHashProcessor<span>
 {
 public:
@@ -54,8 +57,10 @@ public:
   using Type = typename ::Kmer<span>::Type;
   using km_count_type = typename selectC<DMAX_C>::type;
 
-  HashCountProcessor(uint32_t kmer_size, uint32_t abundance_min, hw_t<MAX_C, buf_size> writer, hist_t hist)
-    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist)
+  HashCountProcessor(uint32_t kmer_size, uint32_t abundance_min, std::shared_ptr<Writer> writer, hist_t hist,
+                     sketch_t sketch = nullptr)
+    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist ? &hist->shard() : nullptr),
+      m_sketch(sketch ? &sketch->shard() : nullptr)
   {}
 
   bool process(size_t partId, uint64_t hash, uint32_t count) override
@@ -65,6 +70,7 @@ public:
     {
       m_count = count >= m_max_c ? m_max_c : static_cast<km_count_type>(count);
       m_writer->write(hash, m_count);
+      if (m_sketch) m_sketch->add(sketch_hash(hash));
     }
     return true;
   }
@@ -74,8 +80,9 @@ public:
 private:
   uint32_t m_kmer_size;
   uint32_t m_abundance_min;
-  hw_t<MAX_C, buf_size> m_writer;
-  hist_t m_hist;
+  std::shared_ptr<Writer> m_writer;
+  KHistShard* m_hist;
+  SketchShard* m_sketch;
   typename ::Kmer<span>::ModelCanonical m_model {m_kmer_size};
   km_count_type m_count;
   uint32_t m_max_c {std::numeric_limits<km_count_type>::max()};
@@ -90,9 +97,9 @@ public:
   using km_count_type = typename selectC<DMAX_C>::type;
 
   HashVecProcessor(uint32_t kmer_size, uint32_t abundance_min, bvw_t<buf_size> writer,
-                   hist_t hist, size_t window)
-    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist),
-      m_window(window)
+                   hist_t hist, size_t window, sketch_t sketch = nullptr)
+    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist ? &hist->shard() : nullptr),
+      m_sketch(sketch ? &sketch->shard() : nullptr), m_window(window)
   {
     m_vec.resize(NBYTES(m_window), 0);
   }
@@ -101,7 +108,10 @@ public:
   {
     if (m_hist) m_hist->inc(count);
     if (count >= m_abundance_min)
+    {
       BITSET(m_vec, hash - (m_window * partId));
+      if (m_sketch) m_sketch->add(sketch_hash(hash));
+    }
     return true;
   }
 
@@ -111,7 +121,8 @@ private:
   uint32_t m_kmer_size;
   uint32_t m_abundance_min;
   bvw_t<buf_size> m_writer;
-  hist_t m_hist;
+  KHistShard* m_hist;
+  SketchShard* m_sketch;
   typename ::Kmer<span>::ModelCanonical m_model {m_kmer_size};
   km_count_type m_count;
   uint32_t m_max_c {std::numeric_limits<km_count_type>::max()};
@@ -119,7 +130,8 @@ private:
   size_t m_window;
 };
 
-template<size_t span, size_t MAX_C, size_t buf_size = 8192>
+// Writer is a KmerWriter, or a KmerRun to keep the counts in memory.
+template<size_t span, size_t MAX_C, size_t buf_size = 8192, typename Writer = KmerWriter<buf_size>>
 class KmerCountProcessor : public ICountProcessor<span>
 {
 public:
@@ -128,8 +140,10 @@ public:
   using km_count_type = typename selectC<MAX_C>::type;
 
   KmerCountProcessor(uint32_t kmer_size,
-                     uint32_t abundance_min, kw_t<buf_size> writer, hist_t hist)
-    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist)
+                     uint32_t abundance_min, std::shared_ptr<Writer> writer, hist_t hist,
+                     sketch_t sketch = nullptr)
+    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist ? &hist->shard() : nullptr),
+      m_sketch(sketch ? &sketch->shard() : nullptr), m_kmer_slots((kmer_size + 31) / 32)
   {}
 
   bool process(size_t partId, const Type &kmer, uint32_t count) override
@@ -141,6 +155,7 @@ public:
       m_count = count >= m_max_c ? m_max_c : static_cast<km_count_type>(count);
       //m_writer->template write<span, MAX_C>(kmkmer, m_count);
       m_writer->template write_raw<MAX_C>(kmer.get_data(), m_count);
+      if (m_sketch) m_sketch->add(sketch_hash(kmer.get_data(), m_kmer_slots));
     }
     return true;
   }
@@ -148,46 +163,13 @@ public:
 private:
   uint32_t m_kmer_size;
   uint32_t m_abundance_min;
-  kw_t<buf_size> m_writer;
-  hist_t m_hist;
+  std::shared_ptr<Writer> m_writer;
+  KHistShard* m_hist;
+  SketchShard* m_sketch;
+  size_t m_kmer_slots;
   typename ::Kmer<span>::ModelCanonical m_model {m_kmer_size};
   km_count_type m_count;
   uint32_t m_max_c {std::numeric_limits<km_count_type>::max()};
 };
 
-template<size_t span, size_t MAX_C>
-class KffCountProcessor : public ICountProcessor<span>
-{
-public:
-  using Count = typename ::Kmer<span>::Count;
-  using Type = typename ::Kmer<span>::Type;
-  using km_count_type = typename selectC<MAX_C>::type;
-
-  KffCountProcessor(uint32_t kmer_size,
-                    uint32_t abundance_min, kff_w_t<MAX_C> writer, hist_t hist)
-    : m_kmer_size(kmer_size), m_abundance_min(abundance_min), m_writer(writer), m_hist(hist)
-  {}
-
-  bool process(size_t partId, const Type &kmer, uint32_t count) override
-  {
-    if (m_hist) m_hist->inc(count);
-    if (count >= m_abundance_min)
-    {
-      Kmer<span> kmkmer(m_model.toString(kmer));
-      m_count = count >= m_max_c ? m_max_c : static_cast<km_count_type>(count);
-      m_writer->template write<span>(kmkmer, m_count);
-    }
-    return true;
-  }
-
-private:
-  uint32_t m_kmer_size;
-  uint32_t m_abundance_min;
-  kff_w_t<MAX_C> m_writer;
-  hist_t m_hist;
-  typename::Kmer<span>::ModelCanonical m_model {m_kmer_size};
-  km_count_type m_count;
-  uint32_t m_max_c {std::numeric_limits<km_count_type>::max()};
-};
-
 };
\ No newline at end of file
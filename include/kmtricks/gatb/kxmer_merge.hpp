@@ -0,0 +1,269 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <gatb/gatb_core.hpp>
+
+namespace km {
+
+/*
+  Key used by the merge for a k-mer type. One- and two-word k-mers are merged on native
+  integers, the kx-mer buckets are read in place since LargeInt<1> and LargeInt<2> only
+  wrap an uint64_t and an __uint128_t. Larger types use LargeInt operators.
+*/
+template<typename Type>
+struct kx_key
+{
+  using type = Type;
+
+  static const type* cast(const Type* kxmers) { return kxmers; }
+  static Type to_kmer(const type& key) { return key; }
+  static type from_int(uint64_t v) { type key; key.setVal(v); return key; }
+};
+
+template<>
+struct kx_key<LargeInt<1>>
+{
+  using type = uint64_t;
+  static_assert(sizeof(LargeInt<1>) == sizeof(type));
+
+  static const type* cast(const LargeInt<1>* kxmers) { return reinterpret_cast<const type*>(kxmers); }
+  static LargeInt<1> to_kmer(const type& key) { LargeInt<1> kmer; kmer.setVal(key); return kmer; }
+  static type from_int(uint64_t v) { return v; }
+};
+
+#ifdef __SIZEOF_INT128__
+template<>
+struct kx_key<LargeInt<2>>
+{
+  using type = __uint128_t;
+  static_assert(sizeof(LargeInt<2>) == sizeof(type));
+
+  static const type* cast(const LargeInt<2>* kxmers) { return reinterpret_cast<const type*>(kxmers); }
+  static LargeInt<2> to_kmer(const type& key)
+  {
+    LargeInt<2> kmer; std::memcpy(static_cast<void*>(&kmer), &key, sizeof(key)); return kmer;
+  }
+  static type from_int(uint64_t v) { return v; }
+};
+#endif
+
+/*
+  Expands the sorted kx-mer buckets of a partition into sorted k-mers and counts them.
+
+  A kx-mer of size x holds x+1 k-mers. The i-th one is rebuilt from the radix of the
+  kx-mer bucket and its prefix of size i, so the k-mers of a given (x, i) are sorted within
+  a group of 4^i consecutive radixes. This gives 453 sorted streams for KX = 4, which are
+  merged with a loser tree: one comparison per level for each k-mer, and equal k-mers
+  are counted as they come out of the tree.
+*/
+template<typename Type, size_t KX = 4>
+class KxmerMerger
+{
+  using traits = kx_key<Type>;
+  using key_t = typename traits::type;
+
+  struct cursor
+  {
+    const key_t* cur {nullptr};
+    const key_t* end {nullptr};
+    const key_t* const* buckets {nullptr};
+    const uint64_t* sizes {nullptr};
+    int radix {0};
+    int high {0};
+    int shift {0};
+    int radix_shift {0};
+    key_t radix_mask {};
+  };
+
+public:
+  KxmerMerger(Type** radix_kmers, uint64_t* radix_sizes, size_t kmer_size)
+    : m_kmer_size(kmer_size)
+  {
+    key_t one = traits::from_int(1);
+    m_kmer_mask = (one << (kmer_size * 2)) - one;
+    m_sentinel = ~traits::from_int(0);
+    m_upper = m_sentinel;
+
+    m_buckets.resize(256 * (KX + 1));
+    for (size_t i = 0; i < m_buckets.size(); i++)
+      m_buckets[i] = traits::cast(radix_kmers[i]);
+    m_sizes = radix_sizes;
+
+    for (size_t xx = 0; xx < KX + 1; xx++)
+    {
+      for (size_t prefix = 0; prefix <= xx; prefix++)
+      {
+        int width = 256 >> (2 * prefix);
+        for (int low = 0; low < 256; low += width)
+          add_cursor(xx, prefix, low, low + width - 1);
+      }
+    }
+  }
+
+  // Restrict the merge to the k-mers whose first four nucleotides are in [first, last).
+  void restrict_to(int first, int last)
+  {
+    if (first > 0)
+    {
+      key_t lower = traits::from_int(first) << ((m_kmer_size - 4) * 2);
+      for (auto& c : m_cursors)
+        seek(c, lower);
+    }
+    if (last < 256)
+      m_upper = traits::from_int(last) << ((m_kmer_size - 4) * 2);
+  }
+
+  // emit(const Type& kmer, uint32_t count) is called once per distinct k-mer, in order.
+  template<typename Emit>
+  void merge(Emit&& emit)
+  {
+    size_t leaves = 1;
+    while (leaves < m_cursors.size())
+      leaves <<= 1;
+
+    m_keys.assign(leaves, m_sentinel);
+    for (size_t i = 0; i < m_cursors.size(); i++)
+      m_keys[i] = next(m_cursors[i]);
+
+    // m_losers[n] is the loser of the match at node n, winners go up.
+    m_losers.assign(leaves, 0);
+    std::vector<uint32_t> winners(2 * leaves);
+    for (size_t i = 0; i < leaves; i++)
+      winners[leaves + i] = i;
+    for (size_t n = leaves - 1; n >= 1; n--)
+    {
+      uint32_t l = winners[2 * n], r = winners[2 * n + 1];
+      bool left = !(m_keys[r] < m_keys[l]);
+      winners[n] = left ? l : r;
+      m_losers[n] = left ? r : l;
+    }
+
+    uint32_t winner = winners[1];
+    if (m_keys[winner] == m_sentinel)
+      return;
+
+    key_t previous = m_keys[winner];
+    uint32_t count = 0;
+    while (true)
+    {
+      const key_t& key = m_keys[winner];
+      if (key != previous)
+      {
+        emit(traits::to_kmer(previous), count);
+        if (key == m_sentinel)
+          break;
+        previous = key;
+        count = 0;
+      }
+      count++;
+
+      m_keys[winner] = next(m_cursors[winner]);
+      for (size_t n = (leaves + winner) >> 1; n >= 1; n >>= 1)
+      {
+        if (m_keys[m_losers[n]] < m_keys[winner])
+          std::swap(m_losers[n], winner);
+      }
+    }
+  }
+
+private:
+  void add_cursor(size_t xx, size_t prefix, int low, int high)
+  {
+    cursor c;
+    c.buckets = m_buckets.data() + 256 * xx;
+    c.sizes = m_sizes + 256 * xx;
+    c.shift = (4 - prefix) * 2;
+    c.radix_shift = (m_kmer_size - 4) * 2 + 2 * prefix;
+    c.high = high;
+    set_radix(c, low);
+    m_cursors.push_back(c);
+  }
+
+  void set_radix(cursor& c, int radix) const
+  {
+    c.radix = radix;
+    c.cur = c.buckets[radix];
+    c.end = c.cur + c.sizes[radix];
+    c.radix_mask = traits::from_int(radix) << c.radix_shift;
+  }
+
+  key_t value(const cursor& c, const key_t* kx) const
+  {
+    return ((*kx >> c.shift) | c.radix_mask) & m_kmer_mask;
+  }
+
+  key_t next(cursor& c) const
+  {
+    while (c.cur == c.end)
+    {
+      if (c.radix == c.high)
+        return m_sentinel;
+      set_radix(c, c.radix + 1);
+    }
+    key_t key = value(c, c.cur++);
+    return key < m_upper ? key : m_sentinel;
+  }
+
+  // The stream of a cursor is sorted, skip the k-mers lower than 'lower'.
+  void seek(cursor& c, const key_t& lower) const
+  {
+    while (true)
+    {
+      if (c.cur != c.end && !(value(c, c.end - 1) < lower))
+      {
+        const key_t* lo = c.cur;
+        const key_t* hi = c.end - 1;
+        while (lo < hi)
+        {
+          const key_t* mid = lo + (hi - lo) / 2;
+          if (value(c, mid) < lower)
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+        c.cur = lo;
+        return;
+      }
+      if (c.radix == c.high)
+      {
+        c.cur = c.end;
+        return;
+      }
+      set_radix(c, c.radix + 1);
+    }
+  }
+
+private:
+  size_t m_kmer_size;
+  key_t m_kmer_mask;
+  key_t m_sentinel;
+  key_t m_upper;
+  std::vector<const key_t*> m_buckets;
+  uint64_t* m_sizes {nullptr};
+  std::vector<cursor> m_cursors;
+  std::vector<key_t> m_keys;
+  std::vector<uint32_t> m_losers;
+};
+
+};
@@ -0,0 +1,154 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gatb/gatb_core.hpp>
+#include <gatb/bank/impl/BankStrings.hpp>
+
+#include <kmtricks/io/fof.hpp>
+#include <kmtricks/io/fastx.hpp>
+
+namespace km {
+
+// Reads drawn per sample when no value is given, about 2M reads in total.
+inline uint32_t auto_sample_reads(size_t nb_samples)
+{
+  return std::max<uint32_t>(500, 2000000 / std::max<size_t>(nb_samples, 1));
+}
+
+/*
+  In-memory bank over a stratified sample of a fof: up to 'per_sample' reads are drawn from
+  each sample, spread over its files. The files are visited in parallel, each one by
+  reservoir sampling over its first 'scan_factor * quota' reads with a generator seeded
+  from 'seed' and the file rank, and the reads are stored in fof order, so the sample only
+  depends on the seed.
+
+  estimate() reports the sizes of the whole dataset, summed from the estimates of each
+  file, so that ConfigurationAlgorithm sizes the partitions for all the reads while
+  RepartitorAlgorithm only iterates the sample. With per_sample = 0, only the estimates
+  are computed.
+*/
+class SampleBank : public BankStrings
+{
+  static constexpr uint64_t scan_factor = 16;
+
+  struct file_sample
+  {
+    std::vector<std::string> reads;
+    u_int64_t nb {0};
+    u_int64_t size {0};
+    u_int64_t max {0};
+  };
+
+public:
+  SampleBank(const Fof& fof, uint32_t per_sample, uint64_t seed, size_t nb_threads)
+    : BankStrings(std::vector<std::string>{})
+  {
+    std::vector<std::pair<std::string, uint64_t>> files;
+    for (auto& [_, paths, __] : fof)
+    {
+      uint64_t quota = (per_sample + paths.size() - 1) / paths.size();
+      for (auto& p : paths)
+        files.emplace_back(p, quota);
+    }
+
+    std::vector<file_sample> samples(files.size());
+    std::atomic<size_t> next {0};
+    auto worker = [&]() {
+      for (size_t i = next++; i < files.size(); i = next++)
+        samples[i] = draw(files[i].first, files[i].second, seed + i);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < std::max<size_t>(1, std::min(nb_threads, files.size())); t++)
+      threads.emplace_back(worker);
+    for (auto& t : threads)
+      t.join();
+
+    for (auto& s : samples)
+    {
+      m_nb += s.nb;
+      m_size += s.size;
+      m_max = std::max(m_max, s.max);
+      std::move(s.reads.begin(), s.reads.end(), std::back_inserter(_sequencesData));
+    }
+    init();
+  }
+
+  std::string getId() override { static std::string s("sample"); return s; }
+
+  void estimate(u_int64_t& number, u_int64_t& totalSize, u_int64_t& maxSize) override
+  {
+    number = m_nb;
+    totalSize = m_size;
+    maxSize = m_max;
+  }
+
+private:
+  static file_sample draw(const std::string& path, uint64_t quota, uint64_t seed)
+  {
+    file_sample s;
+    IBank* bank = Bank::open(path); LOCAL(bank);
+    bank->estimate(s.nb, s.size, s.max);
+    if (quota == 0)
+      return s;
+
+    s.reads.reserve(quota);
+    std::mt19937_64 gen(seed);
+    uint64_t seen = 0;
+    auto offer = [&](const char* read, size_t size) {
+      if (s.reads.size() < quota)
+        s.reads.emplace_back(read, size);
+      else
+      {
+        uint64_t j = gen() % (seen + 1);
+        if (j < quota)
+          s.reads[j].assign(read, size);
+      }
+      seen++;
+    };
+
+    if (FastxReader::is_fastx(path))
+    {
+      FastxReader reader(path);
+      while (seen < quota * scan_factor && reader.next())
+        offer(reader.seq(), reader.size());
+    }
+    else
+    {
+      Iterator<Sequence>* it = bank->iterator(); LOCAL(it);
+      for (it->first(); !it->isDone() && seen < quota * scan_factor; it->next())
+        offer(it->item().getDataBuffer(), it->item().getDataSize());
+    }
+    return s;
+  }
+
+private:
+  u_int64_t m_nb {0};
+  u_int64_t m_size {0};
+  u_int64_t m_max {0};
+};
+
+};
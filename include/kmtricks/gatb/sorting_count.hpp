@@ -23,7 +23,12 @@
 #include <gatb/tools/misc/api/Abundance.hpp>
 #include <robin_hood.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 #include <kmtricks/gatb/count_processor.hpp>
+#include <kmtricks/gatb/kxmer_merge.hpp>
 #include <kmtricks/superk.hpp>
 
 #include <sabuhash.h>
@@ -124,12 +129,20 @@ class ReadSuperk
   typedef typename ::Kmer<span>::Type Type;
 
 public:
+  // Kx-mers buffered per bucket before a flush when several readers share a partition.
+  static constexpr size_t flush_size = std::max<size_t>(4, 256 / sizeof(Type));
+
   ReadSuperk(Storage *superk_storage, int file_id, size_t kmer_size, uint64_t *r_idx,
-             Type **radix_kmers, uint64_t *radix_sizes)
+             Type **radix_kmers, uint64_t *radix_sizes, bool shared = false)
       : m_superk_storage(superk_storage), m_file_id(file_id), m_kmer_size(kmer_size),
-        m_r_idx(r_idx), m_radix_kmers(radix_kmers), m_radix_sizes(radix_sizes)
+        m_radix_kmers(radix_kmers), m_radix_sizes(radix_sizes), m_r_idx(r_idx), m_shared(shared)
   {
     m_kx = 4;
+    if (m_shared)
+    {
+      m_local.resize(256 * (m_kx + 1) * flush_size);
+      m_local_sizes.resize(256 * (m_kx + 1), 0);
+    }
     Type un;
     un.setVal(1);
     m_kmer_mask = (un << (m_kmer_size * 2)) - 1;
@@ -197,7 +210,6 @@ public:
         Type newnt;
         Type mink, prev_mink;
         prev_mink.setVal(0);
-        uint64_t idx;
 
         bool prev_which = (temp < rev_temp);
 
@@ -236,10 +248,7 @@ public:
 
             //record kxmer
             rid = radix_kxmer.getVal();
-            //idx = _r_idx[IX(kx_size,rid)]++;
-            idx = __sync_fetch_and_add(m_r_idx + IX(kx_size, rid), 1); // si le sync fetch est couteux, faire un mini buffer par thread
-
-            m_radix_kmers[IX(kx_size, rid)][idx] = kinsert << ((4 - kx_size) * 2); //[kx_size][rid]
+            record(IX(kx_size, rid), kinsert << ((4 - kx_size) * 2)); //[kx_size][rid]
 
             radix_kxmer_forward = (mink & m_mask_radix) >> m_shift_radix;
             kx_size = 0;
@@ -294,10 +303,7 @@ public:
 
         //record kxmer
         rid = radix_kxmer.getVal();
-        //idx = _r_idx[IX(kx_size,rid)]++;
-        idx = __sync_fetch_and_add(m_r_idx + IX(kx_size, rid), 1); // si le sync fetch est couteux, faire un mini buffer par thread
-
-        m_radix_kmers[IX(kx_size, rid)][idx] = kinsert << ((4 - kx_size) * 2); // [kx_size][rid]
+        record(IX(kx_size, rid), kinsert << ((4 - kx_size) * 2)); // [kx_size][rid]
         //cout << "went okay " << idx << endl;
 
         //////////////////////////////////////////////////////////
@@ -309,10 +315,41 @@ public:
       }
     }
 
+    if (m_shared)
+    {
+      for (size_t b = 0; b < m_local_sizes.size(); b++)
+        flush(b);
+    }
+
     if (m_buffer != 0)
       free(m_buffer);
   }
 
+private:
+  void record(size_t bucket, const Type& kxmer)
+  {
+    if (!m_shared)
+    {
+      m_radix_kmers[bucket][m_r_idx[bucket]++] = kxmer;
+      return;
+    }
+    m_local[bucket * flush_size + m_local_sizes[bucket]++] = kxmer;
+    if (m_local_sizes[bucket] == flush_size)
+      flush(bucket);
+  }
+
+  // One reservation in the shared bucket for all the kx-mers buffered by this reader.
+  void flush(size_t bucket)
+  {
+    uint32_t n = m_local_sizes[bucket];
+    if (n == 0)
+      return;
+    uint64_t idx = __sync_fetch_and_add(m_r_idx + bucket, n);
+    std::copy(&m_local[bucket * flush_size], &m_local[bucket * flush_size] + n,
+              m_radix_kmers[bucket] + idx);
+    m_local_sizes[bucket] = 0;
+  }
+
 private:
   Storage* m_superk_storage;
   int m_file_id;
@@ -324,6 +361,9 @@ private:
   Type **m_radix_kmers;
   uint64_t *m_radix_sizes;
   uint64_t *m_r_idx;
+  bool m_shared;
+  std::vector<Type> m_local;
+  std::vector<uint32_t> m_local_sizes;
 
   Type m_superk, m_seedk;
   Type m_radix, m_mask_radix;
@@ -395,10 +435,13 @@ public:
                  int kmer_size,
                  uint64_t *r_idx,
                  uint64_t *array,
-                 uint64_t window)
+                 uint64_t window,
+                 bool shared = false)
       : superk_storage(superk_storage), file_id(file_id), buffer(0), buffer_size(0),
-        kmer_size(kmer_size), r_idx(r_idx), array(array), win_size(window)
+        kmer_size(kmer_size), r_idx(r_idx), array(array), win_size(window), shared(shared)
   {
+    if (shared)
+      local.reserve(flush_size);
     Type un;
     un.setVal(1);
     kmer_mask = (un << (kmer_size * 2)) - 1;
@@ -448,14 +491,11 @@ public:
         Type temp = seedk;
         Type rev_temp = revcomp(temp, kmer_size);
         Type mink, newnt;
-        uint64_t idx;
 
         bool which = (temp < rev_temp);
         mink = which ? temp : rev_temp;
 
-        idx = *r_idx;
-        array[idx] = (*hasher.get())(mink);
-        ++*r_idx;
+        record((*hasher.get())(mink));
 
         for (int i = 0; i < nbK; i++, rem--)
         {
@@ -479,18 +519,40 @@ public:
 
           which = (temp < rev_temp);
           mink = which ? temp : rev_temp;
-          idx = *r_idx;
 
-          array[idx] = (*hasher.get())(mink);
-          ++*r_idx;
+          record((*hasher.get())(mink));
         }
         nbsuperkmer_read++;
       }
     }
+    if (shared)
+      flush();
     if (buffer != 0)
       free(buffer);
   }
 
+private:
+  static constexpr size_t flush_size = 4096;
+
+  void record(uint64_t hash)
+  {
+    if (!shared)
+    {
+      array[(*r_idx)++] = hash;
+      return;
+    }
+    local.push_back(hash);
+    if (local.size() == flush_size)
+      flush();
+  }
+
+  void flush()
+  {
+    uint64_t idx = __sync_fetch_and_add(r_idx, local.size());
+    std::copy(local.begin(), local.end(), array + idx);
+    local.clear();
+  }
+
 private:
   Storage *superk_storage;
   int file_id;
@@ -505,6 +567,8 @@ private:
   uint64_t *array;
   uint64_t win_size;
   hasher_t<span> hasher;
+  bool shared;
+  std::vector<uint64_t> local;
 };
 
 template <size_t span>
@@ -554,73 +618,6 @@ private:
   size_t m_size;
 };
 
-template <size_t span>
-class KXmerPointer
-{
-  typedef typename ::Kmer<span>::Type Type;
-
-public:
-  KXmerPointer(Type **kxmers,
-               int prefix_size,
-               int x_size,
-               int min_radix,
-               int max_radix,
-               int kmer_size,
-               uint64_t *radix_sizes)
-      : m_kxmers(kxmers), m_radix_sizes(radix_sizes), m_prefix_size(prefix_size), m_x_size(x_size),
-        m_low_radix(min_radix), m_high_radix(max_radix), m_kmer_size(kmer_size),
-        m_idx_radix(min_radix)
-  {
-    Type un;
-    un.setVal(1);
-    m_kmer_mask = (un << (m_kmer_size * 2)) - un;
-    m_shift_size = ((4 - m_prefix_size) * 2);
-    m_radix_mask.setVal(m_idx_radix);
-    m_radix_mask = m_radix_mask << ((m_kmer_size - 4) * 2);
-    m_radix_mask = m_radix_mask << (2 * m_prefix_size);
-  }
-
-  bool next()
-  {
-    m_cur_idx++;
-    while (m_idx_radix <= m_high_radix &&
-           static_cast<uint64_t>(m_cur_idx) >= m_radix_sizes[m_idx_radix])
-    {
-      m_idx_radix++;
-      m_cur_idx = 0;
-      m_radix_mask.setVal(m_idx_radix);
-      m_radix_mask = m_radix_mask << ((m_kmer_size - 4) * 2);
-      m_radix_mask = m_radix_mask << (2 * m_prefix_size);
-    }
-    return (m_idx_radix <= m_high_radix);
-  }
-
-  Type value() const
-  {
-    return (((m_kxmers[m_idx_radix][m_cur_idx]) >> m_shift_size) | m_radix_mask) & m_kmer_mask;
-  }
-
-  uint32_t getBankId() const
-  {
-    return 0;
-  }
-
-private:
-  Type **m_kxmers;
-  uint64_t *m_radix_sizes;
-  int64_t m_cur_idx{-1};
-  Type m_cur_radix;
-  Type m_kmer_mask;
-  Type m_radix_mask;
-  int m_idx_radix;
-  int m_low_radix;
-  int m_high_radix;
-  int m_shift_size;
-  int m_prefix_size;
-  int m_kmer_size;
-  int m_x_size;
-};
-
 template <typename Storage, size_t span>
 class KmerPartCounter : public IPartitionCounter<ICountProcessor<span>, Storage, span>
 {
@@ -630,29 +627,20 @@ public:
   typedef ICountProcessor<span> CountProcessor;
   static const size_t KX = 4;
 
-private:
-  typedef std::pair<int, Type> kxp;
-  struct kxpcomp
-  {
-    bool operator()(kxp l, kxp r)
-    {
-      return r.second < l.second;
-    }
-  };
-
 public:
   KmerPartCounter(CountProcessor *processor,
                   PartiInfo<5>* pinfo,
                   int parti,
                   size_t kmer_size,
                   MemAllocator &pool,
-                  Storage *superk_storage)
+                  Storage *superk_storage,
+                  size_t nb_threads = 1)
       : IPartitionCounter<CountProcessor, Storage, span>(processor,
                                                 kmer_size,
                                                 pinfo, pool,
                                                 superk_storage,
                                                 parti),
-        radix_kmers(0), radix_sizes(0), r_idx(0)
+        radix_kmers(0), radix_sizes(0), r_idx(0), m_nb_threads(std::max<size_t>(nb_threads, 1))
   {
   }
 
@@ -697,219 +685,136 @@ private:
         }
       }
 
-      ReadSuperk<Storage, span> read_cmd(this->m_superk_storage, this->m_part, this->m_kmer_size,
-                                r_idx, radix_kmers, radix_sizes);
-      read_cmd.execute();
+      // Blocks are handed out by the storage, each reader decodes its own blocks.
+      bool shared = m_nb_threads > 1;
+      auto reader = [this, shared]() {
+        ReadSuperk<Storage, span> read_cmd(this->m_superk_storage, this->m_part, this->m_kmer_size,
+                                  r_idx, radix_kmers, radix_sizes, shared);
+        read_cmd.execute();
+      };
+      std::vector<std::thread> threads;
+      for (size_t t = 1; t < m_nb_threads; t++)
+        threads.emplace_back(reader);
+      reader();
+      for (auto& t : threads)
+        t.join();
     }
     this->m_superk_storage->closeFile(this->m_part);
   }
 
   void executeSort()
   {
-    for (size_t xx = 0; xx < (KX + 1); xx++)
+    if (m_nb_threads == 1)
     {
-      KmerSort<span> sort_cmd(radix_kmers + IX(xx, 0), 0, 255, radix_sizes + IX(xx, 0));
-      sort_cmd.execute();
+      for (size_t xx = 0; xx < (KX + 1); xx++)
+      {
+        KmerSort<span> sort_cmd(radix_kmers + IX(xx, 0), 0, 255, radix_sizes + IX(xx, 0));
+        sort_cmd.execute();
+      }
+      return;
     }
+
+    // Radix buckets are independent, workers pick them one by one.
+    std::atomic<int> next_bucket {0};
+    auto worker = [this, &next_bucket]() {
+      for (int b = next_bucket++; b < static_cast<int>(256 * (KX + 1)); b = next_bucket++)
+      {
+        KmerSort<span> sort_cmd(radix_kmers, b, b, radix_sizes);
+        sort_cmd.execute();
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < m_nb_threads; t++)
+      threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+      t.join();
   }
 
   void executeDump()
   {
-    int nbkxpointers = 453;
-    std::vector<KXmerPointer<span> *> vec_pointer(nbkxpointers);
-    int best_p;
-    std::priority_queue<kxp, std::vector<kxp>, kxpcomp> pq;
-    size_t nbBanks = nb_items_per_bank_per_part.size();
-
-    if (nbBanks == 0)
-      nbBanks = 1;
-
-    CounterBuilder solidCounter(nbBanks);
-    Type previous_kmer;
-    int pidx = 0;
-
-    vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(0, 0), 0, 0, 0, 255,
-                                                 this->m_kmer_size, radix_sizes + IX(0, 0));
-
-    vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(1, 0), 0, 1, 0, 255,
-                                                 this->m_kmer_size, radix_sizes + IX(1, 0));
-    int lowr = 0;
-    int maxr = 63;
-
-    for (uint32_t ii = 0; ii < 4; ii++)
-    {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(1, 0), 1, 1, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(1, 0));
-      lowr += 64;
-      maxr += 64;
-    }
-
-    vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(2, 0), 0, 2, 0, 255,
-                                                 this->m_kmer_size, radix_sizes + IX(2, 0));
-    lowr = 0;
-    maxr = 63;
-    for (uint32_t ii = 0; ii < 4; ii++)
-    {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(2, 0), 1, 2, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(2, 0));
-      lowr += 64;
-      maxr += 64;
-    }
-
-    lowr = 0;
-    maxr = 15;
-    for (uint32_t ii = 0; ii < 16; ii++)
-    {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(2, 0), 2, 2, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(2, 0));
-      lowr += 16;
-      maxr += 16;
-    }
-
-    vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(3, 0), 0, 3, 0, 255,
-                                                 this->m_kmer_size, radix_sizes + IX(3, 0));
-
-    lowr = 0;
-    maxr = 63;
-    for (uint32_t ii = 0; ii < 4; ii++)
-    {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(3, 0), 1, 3, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(3, 0));
-      lowr += 64;
-      maxr += 64;
-    }
-
-    lowr = 0;
-    maxr = 15;
-    for (uint32_t ii = 0; ii < 16; ii++)
-    {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(3, 0), 2, 3, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(3, 0));
-      lowr += 16;
-      maxr += 16;
-    }
-
-    lowr = 0;
-    maxr = 3;
-    for (uint32_t ii = 0; ii < 64; ii++)
-    {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(3, 0), 3, 3, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(3, 0));
-      lowr += 4;
-      maxr += 4;
-    }
-
-    vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(4, 0), 0, 4, 0, 255,
-                                                 this->m_kmer_size, radix_sizes + IX(4, 0));
+    auto insert = [this](const Type& kmer, uint32_t count) { this->insert(kmer, count); };
 
-    lowr = 0;
-    maxr = 63;
-    for (uint32_t ii = 0; ii < 4; ii++)
+    if (m_nb_threads == 1)
     {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(4, 0), 1, 4, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(4, 0));
-      lowr += 64;
-      maxr += 64;
+      dump(0, 256, insert);
+      return;
     }
 
-    lowr = 0;
-    maxr = 15;
-    for (uint32_t ii = 0; ii < 16; ii++)
+    /*
+      K-mers are split on their first four nucleotides into contiguous ranges, one per worker.
+      The first range goes directly to the processor, the others are buffered and replayed
+      in order, so the output is the same as with a single thread.
+    */
+    std::vector<int> bounds = dump_ranges();
+    size_t nb_ranges = bounds.size() - 1;
+    std::vector<std::vector<std::pair<Type, uint32_t>>> buffers(nb_ranges);
+    std::vector<std::thread> threads;
+
+    for (size_t r = 1; r < nb_ranges; r++)
     {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(4, 0), 2, 4, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(4, 0));
-      lowr += 16;
-      maxr += 16;
+      threads.emplace_back([this, r, &bounds, &buffers]() {
+        dump(bounds[r], bounds[r + 1], [&buffer = buffers[r]](const Type& kmer, uint32_t count) {
+          buffer.emplace_back(kmer, count);
+        });
+      });
     }
 
-    lowr = 0;
-    maxr = 3;
-    for (uint32_t ii = 0; ii < 64; ii++)
-    {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(4, 0), 3, 4, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(4, 0));
-      lowr += 4;
-      maxr += 4;
-    }
+    dump(bounds[0], bounds[1], insert);
 
-    lowr = 0;
-    maxr = 0;
-    for (uint32_t ii = 0; ii < 256; ii++)
+    for (size_t r = 1; r < nb_ranges; r++)
     {
-      vec_pointer[pidx++] = new KXmerPointer<span>(radix_kmers + IX(4, 0), 4, 4, lowr, maxr,
-                                                   this->m_kmer_size, radix_sizes + IX(4, 0));
-      lowr += 1;
-      maxr += 1;
+      threads[r - 1].join();
+      for (auto& [kmer, count] : buffers[r])
+        this->insert(kmer, count);
+      std::vector<std::pair<Type, uint32_t>>().swap(buffers[r]);
     }
+  }
 
-    for (int ii = 0; ii < nbkxpointers; ii++)
+  // Range boundaries over the 256 k-mer prefixes, balanced on the k-mers per radix.
+  std::vector<int> dump_ranges() const
+  {
+    std::vector<uint64_t> weights(256, 0);
+    uint64_t total = 0;
+    for (size_t xx = 0; xx < (KX + 1); xx++)
     {
-      if (vec_pointer[ii]->next())
+      for (int ii = 0; ii < 256; ii++)
       {
-        pq.push(kxp(ii, vec_pointer[ii]->value()));
+        weights[ii] += radix_sizes[IX(xx, ii)] * (xx + 1);
+        total += radix_sizes[IX(xx, ii)] * (xx + 1);
       }
     }
 
-    uint32_t count = 0;
-    if (pq.size() != 0)
+    std::vector<int> bounds {0};
+    uint64_t target = total / m_nb_threads + 1;
+    uint64_t acc = 0;
+    for (int ii = 0; ii < 255; ii++)
     {
-      best_p = pq.top().first;
-      pq.pop();
-      previous_kmer = vec_pointer[best_p]->value();
-      //solidCounter.init(vec_pointer[best_p]->getBankId());
-      count = 1;
-      while (1)
+      acc += weights[ii];
+      if (acc >= target && bounds.size() < m_nb_threads)
       {
-        if (!vec_pointer[best_p]->next())
-        {
-          if (pq.size() == 0)
-            break;
-          best_p = pq.top().first;
-          pq.pop();
-        }
-
-        if (vec_pointer[best_p]->value() != previous_kmer)
-        {
-          pq.push(kxp(best_p, vec_pointer[best_p]->value()));
-          best_p = pq.top().first;
-          pq.pop();
-
-          if (vec_pointer[best_p]->value() != previous_kmer)
-          {
-            //this->insert(previous_kmer, solidCounter);
-            this->insert(previous_kmer, count);
-            //solidCounter.init(vec_pointer[best_p]->getBankId());
-            count = 1;
-            previous_kmer = vec_pointer[best_p]->value();
-          }
-          else
-          {
-            //solidCounter.increase(vec_pointer[best_p]->getBankId());
-            count++;
-          }
-        }
-        else
-        {
-          //solidCounter.increase(vec_pointer[best_p]->getBankId());
-          count++;
-          //solidCounter.increase(vec_pointer[best_p]->getBankId());
-        }
+        bounds.push_back(ii + 1);
+        acc = 0;
       }
-      //this->insert(previous_kmer, solidCounter);
-      this->insert(previous_kmer, count);
     }
+    bounds.push_back(256);
+    return bounds;
+  }
 
-    for (int ii = 0; ii < nbkxpointers; ii++)
-    {
-      delete vec_pointer[ii];
-    }
+  // Merge the kx-mers into counted k-mers, restricted to the prefixes in [first, last).
+  template<typename Insert>
+  void dump(int first, int last, Insert&& insert)
+  {
+    KxmerMerger<Type, KX> merger(radix_kmers, radix_sizes, this->m_kmer_size);
+    merger.restrict_to(first, last);
+    merger.merge(std::forward<Insert>(insert));
   }
 
 private:
   Type **radix_kmers;
   uint64_t *radix_sizes;
   uint64_t *r_idx;
-  std::vector<size_t> nb_items_per_bank_per_part;
+  size_t m_nb_threads;
 };
 
 //template <size_t span>
@@ -943,13 +848,15 @@ public:
                   size_t kmer_size,
                   MemAllocator &pool,
                   Storage *superk_storage,
-                  uint64_t window)
+                  uint64_t window,
+                  size_t nb_threads = 1)
       : IPartitionCounter<CountProcessor, Storage, span>(processor,
                                                 kmer_size,
                                                 pinfo,
                                                 pool,
                                                 superk_storage,
-                                                parti), r_idx(0), window(window)
+                                                parti), r_idx(0), window(window),
+        m_nb_threads(std::max<size_t>(nb_threads, 1))
   {
   }
 
@@ -977,9 +884,19 @@ private:
 
     size_t nb_kmers = this->m_pinfo->getNbKmer(this->m_part);
     array = (uint64_t*) this->m_pool.pool_malloc(nb_kmers*sizeof(uint64_t), std::to_string(this->m_part).c_str());
-    ReadSuperkHash<Storage, span> read_cmd(this->m_superk_storage, this->m_part,
-                                  this->m_kmer_size, r_idx, array, window);
-    read_cmd.execute();
+
+    bool shared = m_nb_threads > 1;
+    auto reader = [this, shared]() {
+      ReadSuperkHash<Storage, span> read_cmd(this->m_superk_storage, this->m_part,
+                                    this->m_kmer_size, r_idx, array, window, shared);
+      read_cmd.execute();
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < m_nb_threads; t++)
+      threads.emplace_back(reader);
+    reader();
+    for (auto& t : threads)
+      t.join();
 
     this->m_superk_storage->closeFile(this->m_part);
   }
@@ -1016,6 +933,7 @@ private:
   uint64_t* array;
   uint64_t window;
   std::vector<size_t> nb_items_per_bank_per_part;
+  size_t m_nb_threads;
 };
 
 
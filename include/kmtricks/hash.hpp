@@ -89,6 +89,11 @@ public:
     return m_minim_size;
   }
 
+  uint64_t nb_partitions() const
+  {
+    return m_nb_partitions;
+  }
+
 private:
   uint64_t m_bloom_size {0};
   uint64_t m_nb_partitions {0};
@@ -20,10 +20,13 @@
 
 #include <vector>
 #include <algorithm>
+#include <numeric>
 #include <cstdint>
 #include <memory>
 #include <iostream>
-#include <mutex>
+#include <atomic>
+#include <thread>
+#include <limits>
 
 #include <kmtricks/utils.hpp>
 
@@ -31,6 +34,74 @@ namespace km {
 
 enum class KHistType { UNIQUE, TOTAL };
 
+/*
+  Bucket layout of a histogram: one bucket per count in [lower, upper], or with log-scale
+  buckets, one bucket per power of two, for high-coverage samples. Bucket 0 receives the counts
+  below lower and bucket size()+1 saturates with the counts above upper.
+*/
+class KHistBuckets
+{
+public:
+  KHistBuckets() = default;
+  KHistBuckets(uint64_t lower, uint64_t upper, bool log_scale)
+    : m_lower(lower), m_upper(upper), m_log(log_scale),
+      m_log_lower(log2(std::max<uint64_t>(lower, 1)))
+  {
+    m_size = m_log ? log2(m_upper) - m_log_lower + 1 : m_upper - m_lower + 1;
+  }
+
+  size_t size() const { return m_size; }
+  bool log_scale() const { return m_log; }
+
+  size_t index(uint64_t count) const
+  {
+    uint64_t x = std::min(count, m_upper + 1);
+    size_t in = m_log ? log2(x) - m_log_lower + 1 : x - m_lower + 1;
+    in = x > m_upper ? m_size + 1 : in;
+    return x >= m_lower ? in : 0;
+  }
+
+  // Smallest count of the in-range bucket b, b in [0, size()).
+  uint64_t value(size_t b) const
+  {
+    return m_log ? std::max<uint64_t>(m_lower, 1ULL << (m_log_lower + b)) : m_lower + b;
+  }
+
+private:
+  static size_t log2(uint64_t x) { return 63 - __builtin_clzll(x | 1); }
+
+private:
+  uint64_t m_lower {0};
+  uint64_t m_upper {0};
+  bool m_log {false};
+  size_t m_log_lower {0};
+  size_t m_size {0};
+};
+
+// Counts of one histogram updated by a single thread.
+class KHistShard
+{
+  friend class KHist;
+public:
+  KHistShard(const KHistBuckets& buckets)
+    : m_buckets(buckets), m_u(buckets.size() + 2, 0), m_n(buckets.size() + 2, 0)
+  {}
+
+  void inc(uint64_t count)
+  {
+    size_t b = m_buckets.index(count);
+    m_u[b]++;
+    m_n[b] += count;
+  }
+
+private:
+  KHistBuckets m_buckets;
+  std::vector<uint64_t> m_u;
+  std::vector<uint64_t> m_n;
+  std::thread::id m_owner;
+  KHistShard* m_next {nullptr};
+};
+
 class KHist
 {
   template<size_t buf_size>
@@ -41,51 +112,107 @@ class KHist
 
 public:
   KHist() = default;
-  KHist(int idx, size_t ksize, size_t lower, size_t upper)
-    : m_idx(idx), m_ksize(ksize), m_lower(lower), m_upper(upper)
+  KHist(int idx, size_t ksize, size_t lower, size_t upper, bool log_scale = false)
+    : m_idx(idx), m_ksize(ksize), m_lower(lower), m_upper(upper),
+      m_buckets(lower, upper, log_scale)
   {
-    m_hist_u.resize(m_upper - m_lower + 1, 0);
-    m_hist_n.resize(m_upper - m_lower + 1, 0);
+    m_hist_u.resize(m_buckets.size(), 0);
+    m_hist_n.resize(m_buckets.size(), 0);
   }
 
+  KHist(const KHist&) = delete;
+  KHist& operator=(const KHist&) = delete;
+
+  ~KHist()
+  {
+    for (KHistShard* s = m_shards.load(); s;)
+    {
+      KHistShard* next = s->m_next;
+      delete s;
+      s = next;
+    }
+  }
+
+  // Single-threaded update, concurrent updates go through shard().
   void inc(uint64_t count)
   {
     m_uniq++;
     m_total += count;
-    if (count < m_lower)
+    size_t b = m_buckets.index(count);
+    if (b == 0)
     {
       m_oob_lu++;
       m_oob_ln += count;
     }
-    else if (count > m_upper)
+    else if (b > m_buckets.size())
     {
       m_oob_uu++;
       m_oob_un += count;
     }
     else
     {
-      m_hist_u[count - m_lower]++;
-      m_hist_n[count - m_lower] += count;
+      m_hist_u[b - 1]++;
+      m_hist_n[b - 1] += count;
     }
   }
 
-  void set_type(KHistType type)
+  // Shard of the calling thread, created on first use. Shards are pushed on a lock-free list,
+  // a count task looks its shard up once and then updates it without synchronization.
+  KHistShard& shard()
   {
-    m_type = type;
+    std::thread::id id = std::this_thread::get_id();
+    for (KHistShard* s = m_shards.load(std::memory_order_acquire); s; s = s->m_next)
+      if (s->m_owner == id)
+        return *s;
+
+    KHistShard* s = new KHistShard(m_buckets);
+    s->m_owner = id;
+    s->m_next = m_shards.load(std::memory_order_relaxed);
+    while (!m_shards.compare_exchange_weak(s->m_next, s, std::memory_order_release,
+                                           std::memory_order_relaxed));
+    return *s;
+  }
+
+  // Folds the shards into the histogram, once all the updates are done.
+  void reduce()
+  {
+    KHistShard* s = m_shards.exchange(nullptr, std::memory_order_acq_rel);
+    while (s)
+    {
+      size_t last = m_buckets.size() + 1;
+      for (size_t b=0; b<=last; b++)
+      {
+        m_uniq += s->m_u[b];
+        m_total += s->m_n[b];
+      }
+      m_oob_lu += s->m_u[0];
+      m_oob_ln += s->m_n[0];
+      m_oob_uu += s->m_u[last];
+      m_oob_un += s->m_n[last];
+      for (size_t b=1; b<last; b++)
+      {
+        m_hist_u[b - 1] += s->m_u[b];
+        m_hist_n[b - 1] += s->m_n[b];
+      }
+      KHistShard* next = s->m_next;
+      delete s;
+      s = next;
+    }
   }
 
-  std::shared_ptr<KHist> clone()
+  void set_type(KHistType type)
   {
-    m_clone = true;
-    std::shared_ptr<KHist> hist = std::make_shared<KHist>(m_idx, m_ksize, m_lower, m_upper);
-    m_clones.push_back(hist);
-    return hist;
+    m_type = type;
   }
 
   uint64_t unique() const { return m_uniq; }
   uint64_t total() const { return m_total; }
   uint64_t lower() const { return m_lower; }
   uint64_t upper() const { return m_upper; }
+  bool log_scale() const { return m_buckets.log_scale(); }
+
+  // Smallest count of bucket i of get_vec().
+  uint64_t bucket_value(size_t i) const { return m_buckets.value(i); }
 
   uint64_t oob_lower_unique() const { return m_oob_lu; }
   uint64_t oob_upper_unique() const { return m_oob_uu; }
@@ -111,44 +238,13 @@ public:
     return m_hist_n;
   }
 
-  void merge_clones()
-  {
-    if (m_clone && !m_merged)
-    {
-      for (auto& h : m_clones)
-      {
-        m_uniq += h->m_uniq;
-        m_total += h->m_total;
-        m_oob_lu += h->m_oob_lu;
-        m_oob_uu += h->m_oob_uu;
-        m_oob_ln += h->m_oob_ln;
-        m_oob_un += h->m_oob_un;
-        for (size_t i=0; i<h->m_hist_u.size(); i++)
-        {
-          m_hist_u[i] += h->m_hist_u[i];
-          m_hist_n[i] += h->m_hist_n[i];
-        }
-      }
-      m_merged = true;
-      clear_clones();
-    }
-  }
-
-  void clear_clones()
-  {
-    m_clones.clear();
-    m_clone = false;
-    m_merged = false;
-  }
-
   std::string as_string(KHistType type = KHistType::UNIQUE, const std::string sep = "\n") const
   {
     std::stringstream ss;
-    uint64_t count = 0;
+    size_t i = 0;
     auto vec = m_type == KHistType::UNIQUE ? m_hist_u : m_hist_n;
-    std::for_each(vec.begin(), vec.end(), [&count, &ss, &sep](uint64_t c){
-      ss << std::to_string(count) << " " << std::to_string(c) << sep;
-      count++;
+    std::for_each(vec.begin(), vec.end(), [this, &i, &ss, &sep](uint64_t c){
+      ss << std::to_string(m_buckets.value(i++)) << " " << std::to_string(c) << sep;
     });
     return ss.str();
   }
@@ -198,27 +294,65 @@ private:
   uint64_t m_oob_ln {0};
   uint64_t m_oob_un {0};
 
+  KHistBuckets m_buckets;
   std::vector<uint64_t> m_hist_u;
   std::vector<uint64_t> m_hist_n;
-  std::vector<std::shared_ptr<KHist>> m_clones;
+  std::atomic<KHistShard*> m_shards {nullptr};
   KHistType m_type {KHistType::UNIQUE};
-  bool m_clone {false};
-  bool m_merged {false};
 };
 
 using hist_t = std::shared_ptr<KHist>;
 
-inline hist_t get_hist_clone(hist_t hist)
+// Histogram of a sample: one bucket per count in [1, 255], or with log_scale one bucket per
+// power of two up to the largest count a counter of MAX_C holds.
+template<size_t MAX_C>
+hist_t make_hist(int idx, size_t ksize, bool log_scale)
 {
-  if (hist)
-    return hist->clone();
-  return nullptr;
+  if (log_scale)
+    return std::make_shared<KHist>(idx, ksize, 1,
+                                   std::numeric_limits<typename selectC<MAX_C>::type>::max(), true);
+  return std::make_shared<KHist>(idx, ksize, 1, 255);
+}
+
+// The thresholds below read counts off the bucket indices.
+inline void check_linear_histograms(const std::vector<hist_t>& histograms)
+{
+  for (auto& h : histograms)
+    if (h->log_scale())
+      throw PipelineError("A relative/auto --soft-min requires linear histograms, not --hist-log ones.");
+}
+
+// Runs f(i) for i in [0, n), spread over nb_threads threads.
+template<typename F>
+void parallel_for_each(size_t n, size_t nb_threads, F&& f)
+{
+  std::atomic<size_t> next {0};
+  auto worker = [&f, &next, n]() {
+    for (size_t i = next++; i < n; i = next++)
+      f(i);
+  };
+  std::vector<std::thread> threads;
+  for (size_t t=1; t<std::min(nb_threads, n); t++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads)
+    t.join();
+}
+
+// Reduces the shards of the histograms, the histograms are spread over nb_threads threads.
+inline void reduce_histograms(std::vector<hist_t>& histograms, size_t nb_threads)
+{
+  parallel_for_each(histograms.size(), nb_threads, [&histograms](size_t i) {
+    if (histograms[i])
+      histograms[i]->reduce();
+  });
 }
 
 inline std::vector<uint32_t> compute_merge_thresholds(std::vector<hist_t>& histograms,
                                                       double p,
                                                       const std::string& path)
 {
+  check_linear_histograms(histograms);
   std::vector<uint32_t> thresholds(histograms.size());
   for (size_t h=0; h<histograms.size(); h++)
   {
@@ -229,7 +363,7 @@ inline std::vector<uint32_t> compute_merge_thresholds(std::vector<hist_t>& histo
     {
       if (sum > n)
       {
-        thresholds.push_back(i);
+        thresholds[h] = i;
         break;
       }
       sum += v[i];
@@ -243,4 +377,50 @@ inline std::vector<uint32_t> compute_merge_thresholds(std::vector<hist_t>& histo
   return thresholds;
 }
 
+/*
+  Solid threshold of a sample: the count at the first valley of its histogram, between the
+  k-mers from sequencing errors and the coverage peak. The valley is searched on a 3-bucket
+  moving average to skip the local minima of sparse histograms. Without valley, e.g. for
+  low-coverage samples, the lower bound of the histogram is returned.
+*/
+inline uint64_t first_valley(const KHist& hist)
+{
+  const std::vector<uint64_t>& v = hist.get_vec(KHistType::UNIQUE);
+  size_t n = v.size();
+  if (n < 3)
+    return hist.bucket_value(0);
+
+  std::vector<double> s(n);
+  for (size_t i=0; i<n; i++)
+  {
+    size_t lo = i ? i - 1 : 0, hi = std::min(i + 1, n - 1);
+    s[i] = static_cast<double>(std::accumulate(v.begin() + lo, v.begin() + hi + 1, 0ULL)) / (hi - lo + 1);
+  }
+
+  size_t i = 0;
+  while (i + 1 < n && s[i + 1] <= s[i])
+    i++;
+  if (i + 1 == n)
+    return hist.bucket_value(0);
+
+  size_t peak = std::max_element(s.begin() + i, s.end()) - s.begin();
+  size_t valley = std::min_element(v.begin(), v.begin() + peak + 1) - v.begin();
+  return hist.bucket_value(valley);
+}
+
+inline std::vector<uint32_t> compute_auto_thresholds(std::vector<hist_t>& histograms,
+                                                     const std::string& path)
+{
+  check_linear_histograms(histograms);
+  std::vector<uint32_t> thresholds;
+  for (auto& h : histograms)
+    thresholds.push_back(first_valley(*h));
+  std::ofstream out(path, std::ios::out); check_fstream_good(path, out);
+  for (auto& t: thresholds)
+  {
+    out << std::to_string(t) << "\n";
+  }
+  return thresholds;
+}
+
 };
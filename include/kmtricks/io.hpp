@@ -25,4 +25,5 @@
 #include <kmtricks/io/pa_matrix_file.hpp>
 #include <kmtricks/io/vector_file.hpp>
 #include <kmtricks/io/vector_matrix_file.hpp>
-#include <kmtricks/io/hist_file.hpp>
\ No newline at end of file
+#include <kmtricks/io/hist_file.hpp>
+#include <kmtricks/io/sketch_file.hpp>
\ No newline at end of file
@@ -0,0 +1,689 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+  #define KM_IO_URING
+  #include <linux/io_uring.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+#endif
+
+#include <fmt/format.h>
+
+#include <kmtricks/exceptions.hpp>
+
+namespace km {
+
+// A pending pread/pwrite, completed by an IOEngine.
+class io_op
+{
+public:
+  io_op(int fd, char* data, size_t size, uint64_t offset, bool write)
+    : m_fd(fd), m_offset(offset), m_write(write)
+  {
+    m_iov.iov_base = data;
+    m_iov.iov_len = size;
+  }
+
+  void complete(ssize_t result)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_result = result;
+      m_done = true;
+    }
+    m_cv.notify_all();
+  }
+
+  // Bytes transferred, or -1. A short transfer is completed here, synchronously, so that
+  // only the end of the file ends a read early.
+  ssize_t wait()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]{ return m_done; });
+    if (m_result < 0)
+      return -1;
+    size_t done = m_result;
+    while (done < size())
+    {
+      ssize_t n = m_write ? ::pwrite(m_fd, data() + done, size() - done, m_offset + done)
+                          : ::pread(m_fd, data() + done, size() - done, m_offset + done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return -1;
+      if (n == 0)
+        break;
+      done += n;
+    }
+    m_result = done;
+    return m_result;
+  }
+
+  // Blocking transfer, used by the thread engine.
+  ssize_t run() const
+  {
+    size_t done = 0;
+    while (done < size())
+    {
+      ssize_t n = m_write ? ::pwrite(m_fd, data() + done, size() - done, m_offset + done)
+                          : ::pread(m_fd, data() + done, size() - done, m_offset + done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return -errno;
+      if (n == 0)
+        break;
+      done += n;
+    }
+    return done;
+  }
+
+  int fd() const { return m_fd; }
+  char* data() const { return static_cast<char*>(m_iov.iov_base); }
+  size_t size() const { return m_iov.iov_len; }
+  uint64_t offset() const { return m_offset; }
+  bool is_write() const { return m_write; }
+  const iovec* iov() const { return &m_iov; }
+
+private:
+  int m_fd;
+  iovec m_iov;
+  uint64_t m_offset;
+  bool m_write;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_done {false};
+  ssize_t m_result {0};
+};
+
+using io_op_t = std::shared_ptr<io_op>;
+
+class IOEngine
+{
+public:
+  virtual ~IOEngine() = default;
+  virtual std::string name() const = 0;
+  // Operations given together are submitted together.
+  virtual void submit(const std::vector<io_op_t>& ops) = 0;
+};
+
+// Blocking pread/pwrite on a pool of threads.
+class ThreadIOEngine : public IOEngine
+{
+public:
+  ThreadIOEngine(size_t nb_threads)
+  {
+    for (size_t i = 0; i < std::max<size_t>(nb_threads, 1); i++)
+      m_threads.emplace_back(&ThreadIOEngine::worker, this);
+  }
+
+  ~ThreadIOEngine()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& t : m_threads)
+      t.join();
+  }
+
+  std::string name() const override { return "threads"; }
+
+  void submit(const std::vector<io_op_t>& ops) override
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_queue.insert(m_queue.end(), ops.begin(), ops.end());
+    }
+    m_cv.notify_all();
+  }
+
+private:
+  void worker()
+  {
+    while (true)
+    {
+      io_op_t op;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]{ return !m_queue.empty() || m_stop; });
+        if (m_queue.empty())
+          return;
+        op = std::move(m_queue.front());
+        m_queue.pop_front();
+      }
+      op->complete(op->run());
+    }
+  }
+
+private:
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque<io_op_t> m_queue;
+  bool m_stop {false};
+};
+
+#ifdef KM_IO_URING
+/*
+  io_uring through the raw system calls. Submissions are serialized by a mutex and a
+  thread reaps the completions. The number of operations in flight is bounded by the size
+  of the completion queue.
+*/
+class UringIOEngine : public IOEngine
+{
+public:
+  UringIOEngine(unsigned entries = 256)
+  {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (m_fd < 0)
+      throw IOError(fmt::format("io_uring unavailable: {}.", std::strerror(errno)));
+
+    m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+    m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_fd, IORING_OFF_SQ_RING);
+    m_cq_ptr = single ? m_sq_ptr
+                      : mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             m_fd, IORING_OFF_CQ_RING);
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+    if (m_sq_ptr == MAP_FAILED || m_cq_ptr == MAP_FAILED || m_sqes == MAP_FAILED)
+    {
+      ::close(m_fd);
+      throw IOError("io_uring unavailable: unable to map the rings.");
+    }
+
+    char* sq = static_cast<char*>(m_sq_ptr);
+    m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_sq_entries = params.sq_entries;
+
+    char* cq = static_cast<char*>(m_cq_ptr);
+    m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    m_max_inflight = params.cq_entries - 1;
+
+    m_reaper = std::thread(&UringIOEngine::reap, this);
+  }
+
+  ~UringIOEngine()
+  {
+    // A NOP with a null user_data stops the reaper.
+    push({nullptr});
+    m_reaper.join();
+    munmap(m_sqes, m_sqes_size);
+    if (m_cq_ptr != m_sq_ptr)
+      munmap(m_cq_ptr, m_cq_size);
+    munmap(m_sq_ptr, m_sq_size);
+    ::close(m_fd);
+  }
+
+  std::string name() const override { return "io_uring"; }
+
+  void submit(const std::vector<io_op_t>& ops) override
+  {
+    for (size_t i = 0; i < ops.size(); i += m_sq_entries)
+    {
+      auto end = ops.begin() + std::min(ops.size(), i + m_sq_entries);
+      push(std::vector<io_op_t>(ops.begin() + i, end));
+    }
+  }
+
+private:
+  void push(const std::vector<io_op_t>& ops)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_inflight_mutex);
+      m_inflight_cv.wait(lock, [&]{ return m_inflight + ops.size() <= m_max_inflight; });
+      m_inflight += ops.size();
+    }
+
+    std::unique_lock<std::mutex> lock(m_sq_mutex);
+    unsigned tail = *m_sq_tail;
+    for (auto& op : ops)
+    {
+      unsigned index = tail & m_sq_mask;
+      io_uring_sqe* sqe = &m_sqes[index];
+      std::memset(sqe, 0, sizeof(*sqe));
+      if (op)
+      {
+        sqe->opcode = op->is_write() ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = op->fd();
+        sqe->addr = reinterpret_cast<uint64_t>(op->iov());
+        sqe->len = 1;
+        sqe->off = op->offset();
+        // Keeps the operation alive until its completion is reaped.
+        sqe->user_data = reinterpret_cast<uint64_t>(new io_op_t(op));
+      }
+      else
+        sqe->opcode = IORING_OP_NOP;
+      m_sq_array[index] = index;
+      tail++;
+    }
+    __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit = ops.size();
+    while (to_submit > 0)
+    {
+      int ret = syscall(__NR_io_uring_enter, m_fd, to_submit, 0, 0, nullptr, 0);
+      if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+        continue;
+      if (ret < 0)
+        throw IOError(fmt::format("io_uring_enter: {}.", std::strerror(errno)));
+      to_submit -= ret;
+    }
+  }
+
+  void reap()
+  {
+    while (true)
+    {
+      unsigned head = *m_cq_head;
+      if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+      {
+        syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        continue;
+      }
+      io_uring_cqe cqe = m_cqes[head & m_cq_mask];
+      __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+      {
+        std::unique_lock<std::mutex> lock(m_inflight_mutex);
+        m_inflight--;
+      }
+      m_inflight_cv.notify_all();
+
+      if (!cqe.user_data)
+        return;
+      io_op_t* op = reinterpret_cast<io_op_t*>(cqe.user_data);
+      (*op)->complete(cqe.res);
+      delete op;
+    }
+  }
+
+private:
+  int m_fd {-1};
+  void* m_sq_ptr {nullptr};
+  void* m_cq_ptr {nullptr};
+  size_t m_sq_size {0};
+  size_t m_cq_size {0};
+  size_t m_sqes_size {0};
+
+  unsigned* m_sq_head;
+  unsigned* m_sq_tail;
+  unsigned* m_sq_array;
+  unsigned m_sq_mask;
+  unsigned m_sq_entries;
+  io_uring_sqe* m_sqes;
+
+  unsigned* m_cq_head;
+  unsigned* m_cq_tail;
+  unsigned m_cq_mask;
+  io_uring_cqe* m_cqes;
+
+  std::mutex m_sq_mutex;
+  std::mutex m_inflight_mutex;
+  std::condition_variable m_inflight_cv;
+  size_t m_inflight {0};
+  size_t m_max_inflight {0};
+  std::thread m_reaper;
+};
+#endif
+
+/*
+  Process-wide I/O backend of the kmtricks files, see IFile.
+    - sync: std::fstream, the default.
+    - threads: asynchronous pread/pwrite on a pool of threads.
+    - uring: io_uring, falls back to threads if unavailable.
+*/
+class AsyncIO
+{
+public:
+  static AsyncIO& get()
+  {
+    static AsyncIO async_io;
+    return async_io;
+  }
+
+  void configure(const std::string& backend, size_t nb_threads = 4,
+                 size_t chunk_size = 1 << 16, size_t depth = 2)
+  {
+    m_engine.reset();
+    m_chunk_size = chunk_size;
+    m_depth = std::max<size_t>(depth, 2);
+#ifdef KM_IO_URING
+    if (backend == "uring")
+    {
+      try
+      {
+        m_engine = std::make_unique<UringIOEngine>();
+      }
+      catch (const IOError&) {}
+    }
+#endif
+    if (!m_engine && backend != "sync")
+      m_engine = std::make_unique<ThreadIOEngine>(nb_threads);
+  }
+
+  IOEngine* engine() const { return m_engine.get(); }
+  std::string name() const { return m_engine ? m_engine->name() : "sync"; }
+  size_t chunk_size() const { return m_chunk_size; }
+  size_t depth() const { return m_depth; }
+
+private:
+  AsyncIO() = default;
+
+private:
+  std::unique_ptr<IOEngine> m_engine {nullptr};
+  size_t m_chunk_size {1 << 16};
+  size_t m_depth {2};
+};
+
+/*
+  Stream buffer over an IOEngine. Writes fill 'depth' buffers in turn, a full buffer is
+  submitted and the next one is reused once its previous write completed. Reads keep
+  'depth' chunks in flight ahead of the reader.
+*/
+class AsyncFileBuf : public std::streambuf
+{
+  struct slot
+  {
+    std::vector<char> data;
+    io_op_t op {nullptr};
+  };
+
+public:
+  AsyncFileBuf(IOEngine* engine, const std::string& path, std::ios_base::openmode mode,
+               size_t chunk_size, size_t depth)
+    : m_engine(engine), m_write(mode & std::ios::out), m_slots(depth)
+  {
+    m_fd = m_write ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)
+                   : ::open(path.c_str(), O_RDONLY);
+    for (auto& s : m_slots)
+      s.data.resize(chunk_size);
+    if (m_fd < 0)
+      return;
+    if (m_write)
+      setp(m_slots[0].data.data(), m_slots[0].data.data() + chunk_size);
+    else
+      read_ahead(0);
+  }
+
+  ~AsyncFileBuf()
+  {
+    if (m_fd < 0)
+      return;
+    if (m_write)
+      sync();
+    wait_all();
+    ::close(m_fd);
+  }
+
+  bool is_open() const { return m_fd >= 0; }
+
+protected:
+  int_type overflow(int_type c) override
+  {
+    if (!m_write || m_fd < 0)
+      return traits_type::eof();
+    submit_write();
+    m_cur = (m_cur + 1) % m_slots.size();
+    if (!finish(m_slots[m_cur]))
+      return traits_type::eof();
+    char* begin = m_slots[m_cur].data.data();
+    setp(begin, begin + m_slots[m_cur].data.size());
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() override
+  {
+    if (!m_write || m_fd < 0)
+      return 0;
+    submit_write();
+    return wait_all() ? 0 : -1;
+  }
+
+  int_type underflow() override
+  {
+    if (m_write || m_fd < 0)
+      return traits_type::eof();
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    if (m_current)
+    {
+      // The consumed chunk is reused for the next read-ahead.
+      slot& done = m_slots[m_cur];
+      done.op = m_eof ? nullptr : issue_read(done);
+      if (done.op)
+        m_engine->submit({done.op});
+      m_cur = (m_cur + 1) % m_slots.size();
+      m_current = false;
+    }
+
+    slot& s = m_slots[m_cur];
+    if (!s.op)
+      return traits_type::eof();
+    ssize_t n = s.op->wait();
+    if (n <= 0)
+    {
+      m_eof = true;
+      return traits_type::eof();
+    }
+    if (static_cast<size_t>(n) < s.data.size())
+      m_eof = true;
+    m_base = s.op->offset();
+    m_current = true;
+    setg(s.data.data(), s.data.data(), s.data.data() + n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+  {
+    if (m_fd < 0)
+      return pos_type(off_type(-1));
+    uint64_t current = m_write ? m_base + (pptr() - pbase()) : m_base + (gptr() - eback());
+    if (dir == std::ios::cur && off == 0)
+      return pos_type(current);
+
+    off_type target = off;
+    if (dir == std::ios::cur)
+      target += current;
+    else if (dir == std::ios::end)
+    {
+      if (m_write)
+        sync();
+      struct stat st;
+      if (::fstat(m_fd, &st) < 0)
+        return pos_type(off_type(-1));
+      target += st.st_size;
+    }
+    return seekpos(pos_type(target), std::ios::in | std::ios::out);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode) override
+  {
+    off_type target = pos;
+    if (m_fd < 0 || target < 0)
+      return pos_type(off_type(-1));
+
+    if (m_write)
+    {
+      if (sync() < 0)
+        return pos_type(off_type(-1));
+      m_base = target;
+      return pos;
+    }
+
+    // Inside the current chunk, only the get pointer moves.
+    if (m_current && static_cast<uint64_t>(target) >= m_base
+        && static_cast<uint64_t>(target) <= m_base + (egptr() - eback()))
+    {
+      setg(eback(), eback() + (target - m_base), egptr());
+      return pos;
+    }
+    wait_all();
+    read_ahead(target);
+    return pos;
+  }
+
+private:
+  void submit_write()
+  {
+    size_t size = pptr() - pbase();
+    if (size == 0)
+      return;
+    slot& s = m_slots[m_cur];
+    s.op = std::make_shared<io_op>(m_fd, pbase(), size, m_base, true);
+    m_base += size;
+    m_engine->submit({s.op});
+    setp(pptr(), epptr());
+  }
+
+  io_op_t issue_read(slot& s)
+  {
+    io_op_t op = std::make_shared<io_op>(m_fd, s.data.data(), s.data.size(), m_next, false);
+    m_next += s.data.size();
+    return op;
+  }
+
+  void read_ahead(uint64_t offset)
+  {
+    m_next = offset;
+    m_base = offset;
+    m_cur = 0;
+    m_eof = false;
+    m_current = false;
+    std::vector<io_op_t> ops;
+    for (auto& s : m_slots)
+    {
+      s.op = issue_read(s);
+      ops.push_back(s.op);
+    }
+    m_engine->submit(ops);
+    setg(nullptr, nullptr, nullptr);
+  }
+
+  // Waits for a write and checks it was complete.
+  bool finish(slot& s)
+  {
+    if (!s.op)
+      return true;
+    ssize_t n = s.op->wait();
+    bool ok = (n == static_cast<ssize_t>(s.op->size()));
+    s.op = nullptr;
+    return ok;
+  }
+
+  bool wait_all()
+  {
+    bool ok = true;
+    for (auto& s : m_slots)
+    {
+      if (!s.op)
+        continue;
+      ssize_t n = s.op->wait();
+      if (m_write)
+        ok &= (n == static_cast<ssize_t>(s.op->size()));
+      s.op = nullptr;
+    }
+    if (m_write)
+    {
+      char* begin = m_slots[m_cur].data.data();
+      setp(begin, begin + m_slots[m_cur].data.size());
+    }
+    return ok;
+  }
+
+private:
+  IOEngine* m_engine;
+  bool m_write;
+  int m_fd {-1};
+  std::vector<slot> m_slots;
+  size_t m_cur {0};
+  uint64_t m_base {0};   // file offset of the put area, or of the get area
+  uint64_t m_next {0};   // next read-ahead offset
+  bool m_current {false};
+  bool m_eof {false};
+};
+
+class AsyncFileStream : public std::iostream
+{
+public:
+  AsyncFileStream(IOEngine* engine, const std::string& path, std::ios_base::openmode mode)
+    : std::iostream(nullptr),
+      m_buf(engine, path, mode, AsyncIO::get().chunk_size(), AsyncIO::get().depth())
+  {
+    rdbuf(&m_buf);
+    if (!m_buf.is_open())
+      setstate(std::ios::failbit);
+  }
+
+private:
+  AsyncFileBuf m_buf;
+};
+
+// std::fstream, or an AsyncFileStream when an asynchronous backend is configured.
+inline std::iostream* open_file_stream(const std::string& path, std::ios_base::openmode mode)
+{
+  IOEngine* engine = AsyncIO::get().engine();
+  bool simple = (mode & std::ios::in) != (mode & std::ios::out) && !(mode & std::ios::app);
+  if (engine && simple)
+    return new AsyncFileStream(engine, path, mode);
+  return new std::fstream(path, mode);
+}
+
+};
@@ -0,0 +1,179 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <zlib.h>
+#include <fmt/format.h>
+
+#include <kmtricks/exceptions.hpp>
+#include <kmtricks/io/inflate.hpp>
+
+namespace km {
+
+/*
+  Streaming FASTA/FASTQ reader, plain or gzipped, with the record rules of GATB's BankFasta:
+  sequence lines are concatenated up to the next '>', '@' or '+' line, empty lines are
+  skipped and a trailing '\r' is dropped.
+
+  Lines are found with memchr over a large aligned buffer. Quality lines are only scanned,
+  the sequence and the header are the only parts copied out of the buffer. The file is inflated
+  ahead by an InflateStream, 'nb_threads' is the number of threads used on BGZF inputs.
+*/
+class FastxReader
+{
+  static constexpr size_t alignment = 64;
+
+public:
+  FastxReader(const std::string& path, size_t buffer_size = 1 << 20, size_t nb_threads = 1)
+    : m_path(path), m_size((buffer_size + alignment - 1) / alignment * alignment),
+      m_stream(path, nb_threads, m_size)
+  {
+    m_buffer = static_cast<char*>(std::aligned_alloc(alignment, m_size));
+  }
+
+  ~FastxReader()
+  {
+    std::free(m_buffer);
+  }
+
+  FastxReader(const FastxReader&) = delete;
+  FastxReader& operator=(const FastxReader&) = delete;
+
+  // True if the first non-empty character is a FASTA/FASTQ header.
+  static bool is_fastx(const std::string& path)
+  {
+    gzFile file = gzopen(path.c_str(), "rb");
+    if (!file)
+      return false;
+    int c;
+    while ((c = gzgetc(file)) != -1 && isspace(c))
+      ;
+    gzclose(file);
+    return c == '>' || c == '@';
+  }
+
+  // Read the next record, its sequence is then available with seq() and size().
+  bool next()
+  {
+    const char* line;
+    size_t len;
+    if (!m_header)
+    {
+      do
+      {
+        if (!next_line(line, len))
+          return false;
+      } while (len == 0 || (line[0] != '>' && line[0] != '@'));
+      m_next_name.assign(line + 1, len - 1);
+    }
+    m_header = false;
+    m_seq.clear();
+    m_name.swap(m_next_name);
+
+    while (next_line(line, len))
+    {
+      if (len == 0)
+        continue;
+      if (line[0] == '>' || line[0] == '@')
+      {
+        m_next_name.assign(line + 1, len - 1);
+        m_header = true;
+        return true;
+      }
+      if (line[0] == '+')
+      {
+        size_t qual = 0;
+        while (qual < m_seq.size() && next_line(line, len))
+          qual += len;
+        return true;
+      }
+      m_seq.append(line, len);
+    }
+    return true;
+  }
+
+  char* seq() { return m_seq.data(); }
+  size_t size() const { return m_seq.size(); }
+  // Header line of the record, without the leading '>' or '@'.
+  const std::string& name() const { return m_name; }
+
+private:
+  // Next line without its end of line, valid until the next call.
+  bool next_line(const char*& line, size_t& len)
+  {
+    while (true)
+    {
+      char* eol = static_cast<char*>(std::memchr(m_buffer + m_begin, '\n', m_end - m_begin));
+      if (eol || (m_eof && m_begin < m_end))
+      {
+        char* end = eol ? eol : m_buffer + m_end;
+        line = m_buffer + m_begin;
+        len = end - line;
+        m_begin = eol ? eol - m_buffer + 1 : m_end;
+        if (len > 0 && line[len - 1] == '\r')
+          len--;
+        return true;
+      }
+      if (m_eof)
+        return false;
+      refill();
+    }
+  }
+
+  void refill()
+  {
+    size_t rest = m_end - m_begin;
+    if (rest == m_size)
+    {
+      // A line larger than the buffer.
+      m_size *= 2;
+      char* buffer = static_cast<char*>(std::aligned_alloc(alignment, m_size));
+      std::memcpy(buffer, m_buffer + m_begin, rest);
+      std::free(m_buffer);
+      m_buffer = buffer;
+    }
+    else if (m_begin > 0)
+      std::memmove(m_buffer, m_buffer + m_begin, rest);
+    m_begin = 0;
+    m_end = rest;
+
+    size_t n = m_stream.read(m_buffer + m_end, m_size - m_end);
+    m_end += n;
+    m_eof = (n == 0);
+  }
+
+private:
+  std::string m_path;
+  size_t m_size;
+  InflateStream m_stream;
+  char* m_buffer {nullptr};
+  size_t m_begin {0};
+  size_t m_end {0};
+  bool m_eof {false};
+  bool m_header {false};
+  std::string m_seq;
+  std::string m_name;
+  std::string m_next_name;
+};
+
+};
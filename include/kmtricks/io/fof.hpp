@@ -81,6 +81,11 @@ public:
     return m_map.at(id);
   }
 
+  bool has(const std::string& id) const
+  {
+    return m_map.count(id);
+  }
+
   std::string get_files(const std::string& id)
   {
     if (!m_map.count(id))
@@ -18,6 +18,8 @@
 
 #pragma once
 #include <kmtricks/io/io_common.hpp>
+#include <kmtricks/io/kmer_file.hpp>
+#include <kmtricks/io/hash_file.hpp>
 #include <kmtricks/utils.hpp>
 #include <kmtricks/histogram.hpp>
 
@@ -42,6 +44,8 @@ public:
     stream->write(reinterpret_cast<char*>(&oob_lu), sizeof(oob_lu));
     stream->write(reinterpret_cast<char*>(&oob_un), sizeof(oob_un));
     stream->write(reinterpret_cast<char*>(&oob_uu), sizeof(oob_uu));
+    if (km_version >= 1)
+      stream->write(reinterpret_cast<char*>(&log_scale), sizeof(log_scale));
   }
 
   void deserialize(std::istream* stream) override
@@ -58,6 +62,9 @@ public:
     stream->read(reinterpret_cast<char*>(&oob_lu), sizeof(oob_lu));
     stream->read(reinterpret_cast<char*>(&oob_un), sizeof(oob_un));
     stream->read(reinterpret_cast<char*>(&oob_uu), sizeof(oob_uu));
+    // Histograms written before version 1 are linear.
+    if (km_version >= 1)
+      stream->read(reinterpret_cast<char*>(&log_scale), sizeof(log_scale));
   }
 
   void sanity_check() override
@@ -79,6 +86,7 @@ public:
   uint64_t oob_uu;
   uint64_t oob_ln;
   uint64_t oob_un;
+  uint8_t log_scale {0};
 };
 
 template<size_t buf_size = 8192>
@@ -100,6 +108,7 @@ public:
     this->m_header.oob_lu = hist.m_oob_lu;
     this->m_header.oob_un = hist.m_oob_un;
     this->m_header.oob_uu = hist.m_oob_uu;
+    this->m_header.log_scale = hist.log_scale();
 
     this->m_header.serialize(this->m_first_layer.get());
 
@@ -129,7 +138,8 @@ public:
   hist_t get()
   {
     hist_t histo = std::make_shared<KHist>(this->m_header.id, this->m_header.kmer_size,
-                                           this->m_header.lower, this->m_header.upper);
+                                           this->m_header.lower, this->m_header.upper,
+                                           this->m_header.log_scale);
     histo->m_oob_lu = this->m_header.oob_lu;
     histo->m_oob_uu = this->m_header.oob_uu;
     histo->m_oob_ln = this->m_header.oob_ln;
@@ -146,7 +156,7 @@ public:
   void write_as_text(std::ostream& stream, bool n)
   {
     hist_t histo = get();
-    uint64_t current = histo->lower();
+    size_t current = 0;
     stream << "@LOWER=" << histo->lower() << "\n";
     stream << "@UPPER=" << histo->upper() << "\n";
 
@@ -155,21 +165,49 @@ public:
       histo->set_type(KHistType::TOTAL);
       stream << "@OOB_L=" << histo->oob_lower_total() << "\n";
       stream << "@OOB_U=" << histo->oob_upper_total() << "\n";
-      for_each(histo->begin(), histo->end(), [&current, &stream](uint64_t c) {
-        stream << std::to_string(current) << " " << std::to_string(c) << "\n";
-        current++;
+      for_each(histo->begin(), histo->end(), [&histo, &current, &stream](uint64_t c) {
+        stream << std::to_string(histo->bucket_value(current++)) << " " << std::to_string(c) << "\n";
       });
     }
     else
     {
       stream << "@OOB_L=" << histo->oob_lower_unique() << "\n";
       stream << "@OOB_U=" << histo->oob_upper_unique() << "\n";
-      for_each(histo->begin(), histo->end(), [&current, &stream](uint64_t c) {
-        stream << std::to_string(current) << " " << std::to_string(c) << "\n";
-        current++;
+      for_each(histo->begin(), histo->end(), [&histo, &current, &stream](uint64_t c) {
+        stream << std::to_string(histo->bucket_value(current++)) << " " << std::to_string(c) << "\n";
       });
     }
   }
 };
 
+// Fills a histogram from the k-mer count files of a sample, e.g. its partitions.
+template<size_t MAX_K, size_t MAX_C>
+void hist_from_kmer_files(const std::vector<std::string>& paths, KHist& hist, size_t nb_threads)
+{
+  parallel_for_each(paths.size(), nb_threads, [&paths, &hist](size_t i) {
+    KHistShard& shard = hist.shard();
+    KmerReader<8192> reader(paths[i]);
+    Kmer<MAX_K> kmer; kmer.set_k(reader.infos().kmer_size);
+    typename selectC<MAX_C>::type count = 0;
+    while (reader.template read<MAX_K, MAX_C>(kmer, count))
+      shard.inc(count);
+  });
+  hist.reduce();
+}
+
+// Fills a histogram from the hash count files of a sample, e.g. its partitions.
+template<size_t MAX_C>
+void hist_from_hash_files(const std::vector<std::string>& paths, KHist& hist, size_t nb_threads)
+{
+  parallel_for_each(paths.size(), nb_threads, [&paths, &hist](size_t i) {
+    KHistShard& shard = hist.shard();
+    HashReader<MAX_C, 32768> reader(paths[i]);
+    uint64_t hash = 0;
+    typename selectC<MAX_C>::type count = 0;
+    while (reader.read(hash, count))
+      shard.inc(count);
+  });
+  hist.reduce();
+}
+
 };
@@ -0,0 +1,378 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <kmtricks/exceptions.hpp>
+
+namespace km {
+
+/*
+  Decompressed content of a file, produced ahead of the reader by a background thread into a
+  bounded queue of buffers, so that inflating overlaps with the parsing.
+
+  BGZF files are inflated block by block by 'nb_threads' threads. Other gzip files, with one
+  or several members, are inflated by the background thread with zlib. Uncompressed files
+  are read as is.
+*/
+class InflateStream
+{
+  using buffer_t = std::vector<char>;
+
+  static constexpr size_t bgzf_header_size = 18;
+  static constexpr size_t bgzf_batch = 16;
+
+public:
+  InflateStream(const std::string& path, size_t nb_threads = 1, size_t chunk_size = 1 << 20,
+                size_t queue_size = 4)
+    : m_path(path), m_nb_threads(std::max<size_t>(nb_threads, 1)), m_chunk_size(chunk_size),
+      m_queue_size(std::max<size_t>(queue_size, 1))
+  {
+    m_file = std::fopen(path.c_str(), "rb");
+    if (!m_file)
+      throw IOError(fmt::format("Unable to open {}.", path));
+
+    unsigned char header[bgzf_header_size];
+    size_t n = std::fread(header, 1, bgzf_header_size, m_file);
+    std::rewind(m_file);
+
+    if (n >= 2 && header[0] == 0x1f && header[1] == 0x8b)
+    {
+      bool bgzf = n == bgzf_header_size && (header[3] & 4) && header[12] == 'B' && header[13] == 'C';
+      m_producer = bgzf ? std::thread(&InflateStream::produce_bgzf, this)
+                        : std::thread(&InflateStream::produce_gzip, this);
+    }
+    else
+      m_producer = std::thread(&InflateStream::produce_plain, this);
+  }
+
+  ~InflateStream()
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    m_producer.join();
+    std::fclose(m_file);
+  }
+
+  InflateStream(const InflateStream&) = delete;
+  InflateStream& operator=(const InflateStream&) = delete;
+
+  // Copy up to size decompressed bytes to dst, returns 0 at the end of the file.
+  size_t read(char* dst, size_t size)
+  {
+    size_t copied = 0;
+    while (copied < size)
+    {
+      if (m_pos == m_current.size())
+      {
+        if (!pop())
+          break;
+        continue;
+      }
+      size_t n = std::min(size - copied, m_current.size() - m_pos);
+      std::memcpy(dst + copied, m_current.data() + m_pos, n);
+      m_pos += n;
+      copied += n;
+    }
+    return copied;
+  }
+
+private:
+  bool pop()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]{ return !m_queue.empty() || m_done; });
+    if (m_queue.empty())
+    {
+      if (m_error)
+        std::rethrow_exception(m_error);
+      return false;
+    }
+    m_current = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_pos = 0;
+    lock.unlock();
+    m_cv.notify_all();
+    return true;
+  }
+
+  // Returns false if the reader is gone.
+  bool push(buffer_t&& buffer)
+  {
+    if (buffer.empty())
+      return true;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]{ return m_queue.size() < m_queue_size || m_stop; });
+    if (m_stop)
+      return false;
+    m_queue.push_back(std::move(buffer));
+    lock.unlock();
+    m_cv.notify_all();
+    return true;
+  }
+
+  template<typename F>
+  void produce(F&& f)
+  {
+    try
+    {
+      f();
+    }
+    catch (...)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_error = std::current_exception();
+    }
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_done = true;
+    }
+    m_cv.notify_all();
+  }
+
+  void produce_plain()
+  {
+    produce([this]{
+      while (true)
+      {
+        buffer_t buffer(m_chunk_size);
+        size_t n = std::fread(buffer.data(), 1, buffer.size(), m_file);
+        buffer.resize(n);
+        if (n == 0 || !push(std::move(buffer)))
+          break;
+      }
+      if (std::ferror(m_file))
+        throw IOError(fmt::format("Unable to read {}.", m_path));
+    });
+  }
+
+  // Members are inflated one after the other. Like gzip, trailing bytes that do not start a
+  // member are ignored with a warning. A file that ends within a member is an error.
+  void produce_gzip()
+  {
+    produce([this]{
+      z_stream zs {};
+      if (inflateInit2(&zs, 15 + 16) != Z_OK)
+        throw IOError(fmt::format("Unable to inflate {}.", m_path));
+
+      buffer_t in(m_chunk_size);
+      buffer_t out(m_chunk_size);
+      zs.next_out = reinterpret_cast<Bytef*>(out.data());
+      zs.avail_out = out.size();
+      bool end = false, empty = true;
+      try
+      {
+        while (!end)
+        {
+          if (zs.avail_in == 0)
+          {
+            zs.avail_in = std::fread(in.data(), 1, in.size(), m_file);
+            zs.next_in = reinterpret_cast<Bytef*>(in.data());
+            if (zs.avail_in == 0)
+            {
+              if (std::ferror(m_file))
+                throw IOError(fmt::format("Unable to read {}.", m_path));
+              // Members are followed by EOF or by the next member, an empty file has none.
+              if (!empty)
+                throw IOError(fmt::format("Truncated gzip file {}.", m_path));
+              break;
+            }
+            empty = false;
+          }
+          int ret = inflate(&zs, Z_NO_FLUSH);
+          if (ret == Z_STREAM_END)
+          {
+            // Next member, if any, starts with the gzip magic.
+            if (zs.avail_in < 2)
+            {
+              std::memmove(in.data(), zs.next_in, zs.avail_in);
+              zs.next_in = reinterpret_cast<Bytef*>(in.data());
+              zs.avail_in += std::fread(in.data() + zs.avail_in, 1, in.size() - zs.avail_in, m_file);
+              if (std::ferror(m_file))
+                throw IOError(fmt::format("Unable to read {}.", m_path));
+            }
+            if (zs.avail_in == 0)
+              end = true;
+            else if (zs.avail_in < 2 || zs.next_in[0] != 0x1f || zs.next_in[1] != 0x8b)
+            {
+              spdlog::warn("{}: trailing garbage after the last gzip member ignored.", m_path);
+              end = true;
+            }
+            else
+              inflateReset(&zs);
+          }
+          else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            throw IOError(fmt::format("Corrupted gzip file {}.", m_path));
+
+          if (zs.avail_out == 0 || end)
+          {
+            out.resize(out.size() - zs.avail_out);
+            if (!push(std::move(out)))
+              break;
+            out = buffer_t(m_chunk_size);
+            zs.next_out = reinterpret_cast<Bytef*>(out.data());
+            zs.avail_out = out.size();
+          }
+        }
+      }
+      catch (...)
+      {
+        inflateEnd(&zs);
+        throw;
+      }
+      inflateEnd(&zs);
+    });
+  }
+
+  // BGZF blocks are independent deflate streams of at most 64KB, read by batches and
+  // inflated in parallel into a single output buffer.
+  void produce_bgzf()
+  {
+    produce([this]{
+      std::vector<buffer_t> blocks;
+      while (true)
+      {
+        blocks.clear();
+        size_t max_blocks = bgzf_batch * m_nb_threads;
+        while (blocks.size() < max_blocks)
+        {
+          buffer_t block = read_bgzf_block();
+          if (block.empty())
+            break;
+          blocks.push_back(std::move(block));
+        }
+        if (blocks.empty())
+          break;
+
+        std::vector<size_t> offsets(blocks.size() + 1, 0);
+        for (size_t i = 0; i < blocks.size(); i++)
+          offsets[i + 1] = offsets[i] + isize(blocks[i]);
+
+        buffer_t out(offsets.back());
+        std::atomic<size_t> next {0};
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto worker = [&]() {
+          for (size_t i = next++; i < blocks.size(); i = next++)
+          {
+            try
+            {
+              inflate_bgzf_block(blocks[i], out.data() + offsets[i], offsets[i + 1] - offsets[i]);
+            }
+            catch (...)
+            {
+              std::unique_lock<std::mutex> lock(error_mutex);
+              error = std::current_exception();
+            }
+          }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < std::min(m_nb_threads, blocks.size()); t++)
+          threads.emplace_back(worker);
+        worker();
+        for (auto& t : threads)
+          t.join();
+        if (error)
+          std::rethrow_exception(error);
+
+        if (!push(std::move(out)))
+          break;
+      }
+    });
+  }
+
+  buffer_t read_bgzf_block()
+  {
+    unsigned char header[bgzf_header_size];
+    size_t n = std::fread(header, 1, bgzf_header_size, m_file);
+    if (n == 0)
+      return {};
+    if (n != bgzf_header_size || header[0] != 0x1f || header[1] != 0x8b || header[12] != 'B' || header[13] != 'C')
+      throw IOError(fmt::format("Corrupted BGZF file {}.", m_path));
+
+    size_t size = (header[16] | (header[17] << 8)) + 1;
+    if (size < bgzf_header_size + 8)
+      throw IOError(fmt::format("Corrupted BGZF file {}.", m_path));
+    buffer_t block(size);
+    std::memcpy(block.data(), header, bgzf_header_size);
+    if (std::fread(block.data() + bgzf_header_size, 1, size - bgzf_header_size, m_file) != size - bgzf_header_size)
+      throw IOError(fmt::format("Truncated BGZF file {}.", m_path));
+    return block;
+  }
+
+  static size_t isize(const buffer_t& block)
+  {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(block.data()) + block.size() - 4;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<size_t>(p[3]) << 24);
+  }
+
+  void inflate_bgzf_block(const buffer_t& block, char* out, size_t size) const
+  {
+    z_stream zs {};
+    if (inflateInit2(&zs, -15) != Z_OK)
+      throw IOError(fmt::format("Unable to inflate {}.", m_path));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(block.data()) + bgzf_header_size);
+    zs.avail_in = block.size() - bgzf_header_size - 8;
+    // Empty blocks, such as the EOF marker, may come with a null out.
+    char empty;
+    zs.next_out = reinterpret_cast<Bytef*>(size ? out : &empty);
+    zs.avail_out = size;
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END || zs.avail_out != 0)
+      throw IOError(fmt::format("Corrupted BGZF block in {}.", m_path));
+  }
+
+private:
+  std::string m_path;
+  size_t m_nb_threads;
+  size_t m_chunk_size;
+  size_t m_queue_size;
+  std::FILE* m_file {nullptr};
+
+  std::thread m_producer;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque<buffer_t> m_queue;
+  bool m_stop {false};
+  bool m_done {false};
+  std::exception_ptr m_error;
+
+  buffer_t m_current;
+  size_t m_pos {0};
+};
+
+};
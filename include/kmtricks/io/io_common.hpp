@@ -24,10 +24,12 @@
 #include <map>
 
 #include <kmtricks/io/lz4_stream.hpp>
+#include <kmtricks/io/async_io.hpp>
 #include <kmtricks/exceptions.hpp>
 #include <kmtricks/utils.hpp>
 
-#define KM_IO_VERSION 0x0
+// 0x1: log_scale in HistFileHeader
+#define KM_IO_VERSION 0x1
 
 namespace km {
 
@@ -44,7 +46,8 @@ enum class KM_FILE
   BITMATRIX,
   KFF,
   HIST,
-  SUPERK
+  SUPERK,
+  SKETCH
 };
 
 const std::map<KM_FILE, uint64_t> MAGICS = {
@@ -58,7 +61,8 @@ const std::map<KM_FILE, uint64_t> MAGICS = {
   {KM_FILE::HIST, 0x747369686b},
   {KM_FILE::SUPERK, 0x6b7265707573},
   {KM_FILE::MATRIX_HASH, 0x685f78697274616d},
-  {KM_FILE::PAMATRIX_HASH, 0x685f74616d6170}
+  {KM_FILE::PAMATRIX_HASH, 0x685f74616d6170},
+  {KM_FILE::SKETCH, 0x686374656b73}
 };
 
 inline KM_FILE get_km_file_type(const std::string& path)
@@ -92,6 +96,8 @@ inline KM_FILE get_km_file_type(const std::string& path)
     return KM_FILE::HIST;
   else if (km_file == MAGICS.at(KM_FILE::SUPERK))
     return KM_FILE::SUPERK;
+  else if (km_file == MAGICS.at(KM_FILE::SKETCH))
+    return KM_FILE::SKETCH;
   else
     throw IOError("Not a kmtricks file.");
 }
@@ -118,6 +124,8 @@ inline std::string km_file_to_str(KM_FILE f)
     return "histogram";
   else if (f == KM_FILE::SUPERK)
     return "super-k-mer";
+  else if (f == KM_FILE::SKETCH)
+    return "sketch";
   else
     return "base";
 }
@@ -169,7 +177,7 @@ public:
   IFile () : m_first_layer(new std::fstream{}) {}
 
   IFile (const std::string& path, std::ios_base::openmode mode)
-    : m_first_layer(new std::fstream{path, mode}), m_path(path)
+    : m_first_layer(open_file_stream(path, mode)), m_path(path)
   {
     if (!this->m_first_layer->good())
       throw std::runtime_error("Unable to open " + path);
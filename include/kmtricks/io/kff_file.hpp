@@ -17,29 +17,43 @@
  *****************************************************************************/
 
 #pragma once
+#include <algorithm>
 #include <cstdint>
+#include <deque>
 #include <string>
 #include <memory>
 #include <optional>
+#include <tuple>
+#include <vector>
 
 // ext
 #include <kff_io.hpp>
 
 // int
 #include <kmtricks/kmer.hpp>
+#include <kmtricks/count_run.hpp>
 
 namespace km {
 
 using kff_t = std::unique_ptr<Kff_file>;
-using kff_raw_t = std::unique_ptr<Section_Raw>;
 using kff_min_t = std::unique_ptr<Section_Minimizer>;
 
-template<size_t MAX_C>
+/*
+  Writes the counted k-mers of a partition as KFF minimizer sections, from their 2-bit words.
+  K-mers are grouped by the smallest forward m-mer of their canonical form, one section per
+  minimizer. In a section, k-mers overlapping by k-1 are chained into blocks of up to 'max'
+  k-mers that contain the minimizer at the same position, as super-k-mers. kmtricks and KFF
+  use the same 2-bit encoding (A=0, C=1, T=2, G=3), so the words are copied as is.
+  The k-mers must be written in increasing order, as output by the counter.
+*/
+template<size_t MAX_K, size_t MAX_C>
 class KffWriter
 {
+  using count_type = typename selectC<MAX_C>::type;
 public:
-  KffWriter(const std::string& path, size_t kmer_size)
-    : m_kmer_size(kmer_size)
+  KffWriter(const std::string& path, size_t kmer_size, size_t minim_size, size_t max_block = 255)
+    : m_kmer_size(kmer_size), m_minim_size(minim_size), m_max_block(max_block),
+      m_slots((kmer_size + 31) / 32), m_run(kmer_size)
   {
     m_kff_file = std::make_unique<Kff_file>(path, "w");
     uint8_t encoding[] = {0, 1, 3, 2};
@@ -47,88 +61,255 @@ public:
 
     Section_GV sgv(m_kff_file.get());
     sgv.write_var("k", m_kmer_size);
-    sgv.write_var("max", 1);
-    sgv.write_var("data_size", sizeof(typename selectC<MAX_C>::type));
+    sgv.write_var("m", m_minim_size);
+    sgv.write_var("max", m_max_block);
+    sgv.write_var("data_size", sizeof(count_type));
     sgv.close();
-    m_kff_sec = std::make_unique<Section_Raw>(m_kff_file.get());
   }
 
-  template<size_t MAX_K>
-  void write(const Kmer<MAX_K>& kmer, typename selectC<MAX_C>::type count)
+  ~KffWriter() { close(); }
+
+  // Same interface as KmerWriter::write_raw.
+  template<size_t C = MAX_C>
+  void write_raw(const uint64_t* data, const count_type count)
   {
-    uint8_t encoded[1024];
-    uint8_t counts[sizeof(count)];
-    if constexpr(sizeof(count) == 1)
-      counts[0] = count;
-    else if constexpr(sizeof(count) == 2)
-      u8from16(counts, count);
-    else
-      u8from32(counts, count);
-
-    m_kmer = kmer.to_string();
-    encode_sequence(encoded);
-    m_kff_sec->write_compacted_sequence(encoded, m_kmer_size, counts);
+    m_run.write_raw(data, count);
+  }
+
+  template<size_t K = MAX_K>
+  void write(const Kmer<K>& kmer, count_type count)
+  {
+    m_run.write_raw(kmer.get_data64(), count);
   }
 
   void close()
   {
-    m_kff_sec->close();
+    if (!m_kff_file)
+      return;
+    write_sections();
     m_kff_file->close();
+    m_kff_file.reset();
   }
 
-  uint8_t uint8_packing(std::string sequence)
+  static uint64_t memory(uint64_t nb_kmers, uint32_t kmer_size)
   {
-    size_t size = sequence.size();
-    uint8_t val = 0;
-    for (size_t i = 0; i < size; i++)
+    return KmerRun<MAX_C>::memory(nb_kmers, kmer_size) +
+           nb_kmers * (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint16_t) + 1);
+  }
+
+  // Number of blocks written by close().
+  uint64_t nb_blocks() const
+  {
+    return m_nb_blocks;
+  }
+
+private:
+  uint8_t base(const uint64_t* w, size_t j) const
+  {
+    size_t i = m_kmer_size - 1 - j;
+    return (w[i / 32] >> (2 * (i % 32))) & 3;
+  }
+
+  // Smallest m-mer over both strands of a k-mer, its first position and strand (1 if it is
+  // read on the reverse complement). Neighbour k-mers share it whatever their canonical form.
+  std::tuple<uint64_t, uint16_t, uint8_t> minimizer(const uint64_t* w) const
+  {
+    uint64_t mask = m_minim_size == 32 ? ~0ULL : (1ULL << (2 * m_minim_size)) - 1;
+    uint64_t v = 0, r = 0, best = ~0ULL;
+    uint16_t pos = 0;
+    uint8_t strand = 0;
+    for (size_t j = 0; j < m_kmer_size; j++)
     {
-      val <<= 2;
-      val += (sequence[i] >> 1) & 0b11;
+      v = ((v << 2) | base(w, j)) & mask;
+      r = ((r << 2) | (base(w, m_kmer_size - 1 - j) ^ 2)) & mask;
+      if (j + 1 < m_minim_size)
+        continue;
+      if (v < best)
+        std::tie(best, pos, strand) = std::make_tuple(v, j + 1 - m_minim_size, 0);
+      if (r < best)
+        std::tie(best, pos, strand) = std::make_tuple(r, j + 1 - m_minim_size, 1);
     }
-    return val;
+    return {best, pos, strand};
   }
 
-  void encode_sequence(uint8_t* encoded)
+  // Index of the canonical form of 'w' in the sorted run, or -1.
+  int64_t find(const uint64_t* w) const
   {
-    size_t size = m_kmer.length();
-    size_t remnant = size % 4;
-    if (remnant > 0)
+    m_tmp.set_k(m_kmer_size);
+    m_tmp.set64_p(w);
+    Kmer<MAX_K> c = m_tmp.canonical();
+    const uint64_t* cw = c.get_data64();
+
+    size_t lo = 0, hi = m_run.size();
+    while (lo < hi)
     {
-      encoded[0] = uint8_packing(m_kmer.substr(0, remnant));
-      encoded += 1;
+      size_t mid = (lo + hi) / 2;
+      int cmp = compare(m_run.kmer(mid), cw);
+      if (cmp == 0)
+        return mid;
+      else if (cmp < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
     }
+    return -1;
+  }
 
-    size_t nb_uint_needed = size / 4;
-    for (size_t i = 0; i < nb_uint_needed; i++)
+  int compare(const uint64_t* a, const uint64_t* b) const
+  {
+    for (size_t i = m_slots; i-- > 0;)
+      if (a[i] != b[i])
+        return a[i] < b[i] ? -1 : 1;
+    return 0;
+  }
+
+  // y = x.b, dropping the first base of x.
+  void push_back(const uint64_t* x, uint64_t* y, uint8_t b) const
+  {
+    for (size_t i = m_slots - 1; i > 0; i--)
+      y[i] = (x[i] << 2) | (x[i - 1] >> 62);
+    y[0] = (x[0] << 2) | b;
+    if (m_kmer_size % 32)
+      y[m_slots - 1] &= (1ULL << (2 * (m_kmer_size % 32))) - 1;
+  }
+
+  // y = b.x, dropping the last base of x.
+  void push_front(const uint64_t* x, uint64_t* y, uint8_t b) const
+  {
+    for (size_t i = 0; i + 1 < m_slots; i++)
+      y[i] = (x[i] >> 2) | (x[i + 1] << 62);
+    y[m_slots - 1] = x[m_slots - 1] >> 2;
+    y[(m_kmer_size - 1) / 32] |= static_cast<uint64_t>(b) << (2 * ((m_kmer_size - 1) % 32));
+  }
+
+  // Extend 'w' with an unused counted k-mer of the same minimizer on one side, 'w' is updated
+  // to the new k-mer.
+  int64_t extend(uint64_t* w, bool right, const std::vector<bool>& used,
+                 const std::vector<uint64_t>& minims, uint64_t minim) const
+  {
+    uint64_t y[(MAX_K + 31) / 32] = {0};
+    for (uint8_t b = 0; b < 4; b++)
     {
-      encoded[i] = uint8_packing(m_kmer.substr(remnant + 4 * i, 4));
+      if (right) push_back(w, y, b); else push_front(w, y, b);
+      int64_t j = find(y);
+      if (j >= 0 && !used[j] && minims[j] == minim)
+      {
+        std::copy(y, y + m_slots, w);
+        return j;
+      }
     }
+    return -1;
   }
 
-private:
-  void u8from32(uint8_t b[4], uint32_t u32)
+  static void encode(const std::vector<uint8_t>& bases, size_t begin, size_t n, uint8_t* out)
   {
-    b[3] = (uint8_t)u32;
-    b[2] = (uint8_t)(u32>>=8);
-    b[1] = (uint8_t)(u32>>=8);
-    b[0] = (uint8_t)(u32>>=8);
+    size_t nb_bytes = (n + 3) / 4;
+    size_t pad = nb_bytes * 4 - n;
+    std::fill(out, out + nb_bytes, 0);
+    for (size_t i = 0; i < n; i++)
+      out[(pad + i) / 4] |= bases[begin + i] << (2 * (3 - (pad + i) % 4));
   }
 
-  void u8from16(uint8_t b[2], uint16_t u16)
+  void write_sections()
   {
-    b[1] = (uint8_t)(u16>>=8);
-    b[0] = (uint8_t)(u16>>=8);
+    size_t n = m_run.size();
+    if (n == 0)
+      return;
+
+    std::vector<uint64_t> minims(n);
+    std::vector<uint16_t> pos(n);
+    std::vector<uint8_t> strands(n);
+    std::vector<uint32_t> order(n);
+    for (size_t i = 0; i < n; i++)
+    {
+      std::tie(minims[i], pos[i], strands[i]) = minimizer(m_run.kmer(i));
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint32_t a, uint32_t b) { return minims[a] < minims[b]; });
+
+    std::vector<bool> used(n, false);
+    std::vector<uint8_t> bases(m_kmer_size + 2 * m_max_block);
+    std::vector<uint8_t> encoded(bases.size() / 4 + 1);
+    std::vector<uint8_t> data(m_max_block * sizeof(count_type));
+    std::deque<count_type> counts;
+    uint64_t first[(MAX_K + 31) / 32] = {0}, last[(MAX_K + 31) / 32] = {0};
+
+    for (size_t o = 0; o < n;)
+    {
+      size_t end = o;
+      while (end < n && minims[order[end]] == minims[order[o]])
+        end++;
+
+      kff_min_t section = std::make_unique<Section_Minimizer>(m_kff_file.get());
+      std::vector<uint8_t> minim(m_minim_size);
+      for (size_t j = 0; j < m_minim_size; j++)
+        minim[j] = (minims[order[o]] >> (2 * (m_minim_size - 1 - j))) & 3;
+      encode(minim, 0, m_minim_size, encoded.data());
+      section->write_minimizer(encoded.data());
+
+      for (; o < end; o++)
+      {
+        uint32_t i = order[o];
+        if (used[i])
+          continue;
+        used[i] = true;
+
+        // The block is bases[b, e), its k-mers contain the minimizer at 'mpos'. The first
+        // k-mer is oriented on the strand of its minimizer.
+        size_t b = m_max_block, e = b + m_kmer_size, mpos = pos[i];
+        for (size_t j = 0; j < m_kmer_size; j++)
+        {
+          uint8_t c = strands[i] ? base(m_run.kmer(i), m_kmer_size - 1 - j) ^ 2
+                                 : base(m_run.kmer(i), j);
+          bases[b + j] = c;
+          push_back(first, first, c);
+        }
+        std::copy(first, first + m_slots, last);
+        counts.assign(1, m_run.count(i));
+
+        int64_t j;
+        while (counts.size() < m_max_block && counts.size() <= mpos &&
+               (j = extend(last, true, used, minims, minims[i])) >= 0)
+        {
+          used[j] = true;
+          bases[e++] = last[0] & 3;
+          counts.push_back(m_run.count(j));
+        }
+        while (counts.size() < m_max_block && mpos + 1 + m_minim_size <= m_kmer_size &&
+               (j = extend(first, false, used, minims, minims[i])) >= 0)
+        {
+          used[j] = true;
+          bases[--b] = (first[(m_kmer_size - 1) / 32] >> (2 * ((m_kmer_size - 1) % 32))) & 3;
+          counts.push_front(m_run.count(j));
+          mpos++;
+        }
+
+        for (size_t c = 0; c < counts.size(); c++)
+          for (size_t byte = 0; byte < sizeof(count_type); byte++)
+            data[c * sizeof(count_type) + byte] =
+              static_cast<uint64_t>(counts[c]) >> (8 * (sizeof(count_type) - 1 - byte));
+        encode(bases, b, e - b, encoded.data());
+        section->write_compacted_sequence(encoded.data(), e - b, mpos, data.data());
+        m_nb_blocks++;
+      }
+      section->close();
+    }
   }
 
 private:
   kff_t m_kff_file {nullptr};
-  kff_raw_t m_kff_sec {nullptr};
   size_t m_kmer_size;
-  std::string m_kmer;
+  size_t m_minim_size;
+  size_t m_max_block;
+  size_t m_slots;
+  KmerRun<MAX_C> m_run;
+  mutable Kmer<MAX_K> m_tmp;
+  uint64_t m_nb_blocks {0};
 };
 
-template<size_t MAX_C>
-using kff_w_t = std::shared_ptr<KffWriter<MAX_C>>;
+template<size_t MAX_K, size_t MAX_C>
+using kff_w_t = std::shared_ptr<KffWriter<MAX_K, MAX_C>>;
 
 using kff_reader_t = std::unique_ptr<Kff_reader>;
 
@@ -242,6 +423,16 @@ public:
     return std::nullopt;
   }
 
+  // Count of the last k-mer read, as written by KffWriter<MAX_K, MAX_C>.
+  template<size_t MAX_C>
+  typename selectC<MAX_C>::type count() const
+  {
+    typename selectC<MAX_C>::type c = 0;
+    for (size_t i=0; i<sizeof(c); i++)
+      c = (c << 8) | m_data[i];
+    return c;
+  }
+
 private:
   std::string to_string()
   {
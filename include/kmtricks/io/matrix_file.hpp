@@ -90,6 +90,99 @@ public:
   uint32_t partition;
 };
 
+// Maps a set of sample columns to contiguous runs of a matrix row. Rows are decoded run by run,
+// gaps between runs are skipped (seeked over on uncompressed files) instead of being copied.
+class ColumnProjection
+{
+  struct run
+  {
+    uint64_t gap;
+    uint64_t bytes;
+  };
+
+public:
+  ColumnProjection() {}
+
+  ColumnProjection(const std::vector<uint32_t>& columns, uint32_t nb_counts, uint32_t count_bytes)
+    : m_count_bytes(count_bytes)
+  {
+    std::vector<std::pair<uint32_t, uint32_t>> sorted;
+    for (uint32_t i=0; i<columns.size(); i++)
+    {
+      if (columns[i] >= nb_counts)
+        throw IOError(fmt::format("Column {} is out of range ({} columns).", columns[i], nb_counts));
+      sorted.emplace_back(columns[i], i);
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    int64_t last = -1;
+    uint64_t end = 0;
+    for (auto& [c, i] : sorted)
+    {
+      if (static_cast<int64_t>(c) != last)
+      {
+        if (last != -1 && static_cast<int64_t>(c) == last + 1)
+          m_runs.back().bytes += count_bytes;
+        else
+          m_runs.push_back(run{(c - end) * count_bytes, count_bytes});
+        end = c + 1;
+        last = c;
+        m_unique++;
+      }
+      m_order.emplace_back(m_unique - 1, i);
+    }
+    m_tail = (nb_counts - end) * count_bytes;
+    m_buffer.resize(m_unique * count_bytes);
+  }
+
+  size_t size() const
+  {
+    return m_order.size();
+  }
+
+  bool read(std::istream* stream, bool seekable)
+  {
+    char* dest = m_buffer.data();
+    for (auto& r : m_runs)
+    {
+      skip(stream, r.gap, seekable);
+      stream->read(dest, r.bytes);
+      if (static_cast<uint64_t>(stream->gcount()) != r.bytes)
+        return false;
+      dest += r.bytes;
+    }
+    skip(stream, m_tail, seekable);
+    return true;
+  }
+
+  template<typename count_type>
+  void project(std::vector<count_type>& counts) const
+  {
+    const count_type* values = reinterpret_cast<const count_type*>(m_buffer.data());
+    for (auto& [u, i] : m_order)
+      counts[i] = values[u];
+  }
+
+private:
+  void skip(std::istream* stream, uint64_t bytes, bool seekable)
+  {
+    if (!bytes)
+      return;
+    if (seekable && bytes >= 8192)
+      stream->seekg(bytes, std::ios::cur);
+    else
+      stream->ignore(bytes);
+  }
+
+private:
+  uint32_t m_count_bytes {0};
+  uint32_t m_unique {0};
+  uint64_t m_tail {0};
+  std::vector<run> m_runs;
+  std::vector<std::pair<uint32_t, uint32_t>> m_order;
+  std::vector<char> m_buffer;
+};
+
 template<size_t buf_size = 8192>
 class MatrixWriter : public IFile<MatrixFileHeader, std::ostream, buf_size>
 {
@@ -165,6 +258,40 @@ public:
     return true;
   }
 
+  template<size_t MAX_C>
+  void set_columns(const std::vector<uint32_t>& columns)
+  {
+    m_proj = ColumnProjection(columns, this->m_header.nb_counts, requiredC<MAX_C>::value/8);
+  }
+
+  // Read a row, keeping only the columns given to set_columns (in the same order).
+  template<size_t MAX_K, size_t MAX_C>
+  bool read_columns(Kmer<MAX_K>& kmer, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    this->m_second_layer->read(reinterpret_cast<char*>(kmer.get_data64_unsafe()),
+                                this->m_header.kmer_slots*8);
+    if (!this->m_second_layer->gcount())
+      return false;
+    if (!m_proj.read(this->m_second_layer.get(), !this->m_header.compressed))
+      return false;
+    m_proj.project(counts);
+    return true;
+  }
+
+  template<size_t MAX_K, size_t MAX_C>
+  void write_columns_as_text(std::ostream& stream)
+  {
+    Kmer<MAX_K> kmer; kmer.set_k(this->m_header.kmer_size);
+    std::vector<typename selectC<MAX_C>::type> counts(m_proj.size());
+    while (read_columns<MAX_K, MAX_C>(kmer, counts))
+    {
+      stream << kmer.to_string();
+      for (auto& c : counts)
+        stream << " " << std::to_string(c);
+      stream << "\n";
+    }
+  }
+
   template<size_t MAX_K, size_t MAX_C>
   void write_as_text(std::ostream& stream)
   {
@@ -189,6 +316,9 @@ public:
       stream << kmer.to_string() << '\n';
     }
   }
+
+private:
+  ColumnProjection m_proj;
 };
 
 class MatrixHashFileHeader : public KmHeader
@@ -289,6 +419,38 @@ public:
     return true;
   }
 
+  template<size_t MAX_C>
+  void set_columns(const std::vector<uint32_t>& columns)
+  {
+    m_proj = ColumnProjection(columns, this->m_header.nb_counts, requiredC<MAX_C>::value/8);
+  }
+
+  template<size_t MAX_C>
+  bool read_columns(uint64_t& hash, std::vector<typename selectC<MAX_C>::type>& counts)
+  {
+    this->m_second_layer->read(reinterpret_cast<char*>(&hash), sizeof(hash));
+    if (!this->m_second_layer->gcount())
+      return false;
+    if (!m_proj.read(this->m_second_layer.get(), !this->m_header.compressed))
+      return false;
+    m_proj.project(counts);
+    return true;
+  }
+
+  template<size_t MAX_C>
+  void write_columns_as_text(std::ostream& stream)
+  {
+    uint64_t hash;
+    std::vector<typename selectC<MAX_C>::type> counts(m_proj.size());
+    while (read_columns<MAX_C>(hash, counts))
+    {
+      stream << std::to_string(hash);
+      for (auto& c : counts)
+        stream << " " << std::to_string(c);
+      stream << "\n";
+    }
+  }
+
   template<size_t MAX_C>
   void write_as_text(std::ostream& stream)
   {
@@ -302,6 +464,9 @@ public:
       stream << "\n";
     }
   }
+
+private:
+  ColumnProjection m_proj;
 };
 
 template<size_t buf_size = 8192>
@@ -562,5 +727,98 @@ private:
   std::vector<std::string> m_paths;
 };
 
+template<size_t MAX_K, size_t MAX_C>
+class MatrixColumnExtractor
+{
+public:
+  MatrixColumnExtractor(const std::vector<std::string>& paths,
+                        const std::vector<uint32_t>& columns,
+                        uint32_t kmer_size)
+    : m_paths(paths), m_columns(columns), m_kmer_size(kmer_size)
+  {
+
+  }
+
+  void write_as_bin(const std::string& path, bool compressed)
+  {
+    MatrixWriter<8192> mw(path, m_kmer_size, requiredC<MAX_C>::value/8, m_columns.size(), 0, -1, compressed);
+    Kmer<MAX_K> k; k.set_k(m_kmer_size);
+    std::vector<typename selectC<MAX_C>::type> counts(m_columns.size());
+    for (auto& p : m_paths)
+    {
+      MatrixReader<8192> mr(p);
+      mr.template set_columns<MAX_C>(m_columns);
+      while (mr.template read_columns<MAX_K, MAX_C>(k, counts))
+        mw.template write<MAX_K, MAX_C>(k, counts);
+    }
+  }
+
+  void write_as_text(std::ostream& out)
+  {
+    for (auto& p : m_paths)
+    {
+      MatrixReader<8192> mr(p);
+      mr.template set_columns<MAX_C>(m_columns);
+      mr.template write_columns_as_text<MAX_K, MAX_C>(out);
+    }
+  }
+
+  void write_as_text(const std::string& path)
+  {
+    std::ofstream out(path, std::ios::out); check_fstream_good(path, out);
+    write_as_text(out);
+  }
+
+private:
+  std::vector<std::string> m_paths;
+  std::vector<uint32_t> m_columns;
+  uint32_t m_kmer_size;
+};
+
+template<size_t MAX_C>
+class MatrixHashColumnExtractor
+{
+public:
+  MatrixHashColumnExtractor(const std::vector<std::string>& paths,
+                            const std::vector<uint32_t>& columns)
+    : m_paths(paths), m_columns(columns)
+  {
+
+  }
+
+  void write_as_bin(const std::string& path, bool compressed)
+  {
+    MatrixHashWriter<8192> mw(path, requiredC<MAX_C>::value/8, m_columns.size(), 0, -1, compressed);
+    uint64_t hash;
+    std::vector<typename selectC<MAX_C>::type> counts(m_columns.size());
+    for (auto& p : m_paths)
+    {
+      MatrixHashReader<8192> mr(p);
+      mr.template set_columns<MAX_C>(m_columns);
+      while (mr.template read_columns<MAX_C>(hash, counts))
+        mw.template write<MAX_C>(hash, counts);
+    }
+  }
+
+  void write_as_text(std::ostream& out)
+  {
+    for (auto& p : m_paths)
+    {
+      MatrixHashReader<8192> mr(p);
+      mr.template set_columns<MAX_C>(m_columns);
+      mr.template write_columns_as_text<MAX_C>(out);
+    }
+  }
+
+  void write_as_text(const std::string& path)
+  {
+    std::ofstream out(path, std::ios::out); check_fstream_good(path, out);
+    write_as_text(out);
+  }
+
+private:
+  std::vector<std::string> m_paths;
+  std::vector<uint32_t> m_columns;
 };
 
+};
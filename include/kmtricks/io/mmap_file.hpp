@@ -0,0 +1,85 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <kmtricks/exceptions.hpp>
+
+namespace km {
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+  MappedFile(const std::string& path, bool random = true)
+    : m_path(path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw IOError(fmt::format("Unable to open {}.", path));
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+      ::close(fd);
+      throw IOError(fmt::format("Unable to stat {}.", path));
+    }
+    m_size = st.st_size;
+
+    if (m_size > 0)
+    {
+      void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED)
+      {
+        ::close(fd);
+        throw IOError(fmt::format("Unable to map {}.", path));
+      }
+      m_data = static_cast<const uint8_t*>(data);
+      ::madvise(data, m_size, random ? MADV_RANDOM : MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+  }
+
+  ~MappedFile()
+  {
+    if (m_data)
+      ::munmap(const_cast<uint8_t*>(m_data), m_size);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const { return m_data; }
+  size_t size() const { return m_size; }
+  const std::string& path() const { return m_path; }
+
+private:
+  std::string m_path;
+  const uint8_t* m_data {nullptr};
+  size_t m_size {0};
+};
+
+};
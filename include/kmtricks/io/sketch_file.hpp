@@ -0,0 +1,128 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <kmtricks/io/io_common.hpp>
+#include <kmtricks/sketch.hpp>
+
+namespace km {
+
+class SketchFileHeader : public KmHeader
+{
+public:
+  SketchFileHeader() {};
+
+  void serialize(std::ostream* stream) override
+  {
+    _serialize(stream);
+    stream->write(reinterpret_cast<char*>(&sketch_magic), sizeof(sketch_magic));
+    stream->write(reinterpret_cast<char*>(&kmer_size), sizeof(kmer_size));
+    stream->write(reinterpret_cast<char*>(&id), sizeof(id));
+    stream->write(reinterpret_cast<char*>(&hll_p), sizeof(hll_p));
+    stream->write(reinterpret_cast<char*>(&scale), sizeof(scale));
+    stream->write(reinterpret_cast<char*>(&size), sizeof(size));
+    stream->write(reinterpret_cast<char*>(&nb_hashes), sizeof(nb_hashes));
+  }
+
+  void deserialize(std::istream* stream) override
+  {
+    _deserialize(stream);
+    stream->read(reinterpret_cast<char*>(&sketch_magic), sizeof(sketch_magic));
+    stream->read(reinterpret_cast<char*>(&kmer_size), sizeof(kmer_size));
+    stream->read(reinterpret_cast<char*>(&id), sizeof(id));
+    stream->read(reinterpret_cast<char*>(&hll_p), sizeof(hll_p));
+    stream->read(reinterpret_cast<char*>(&scale), sizeof(scale));
+    stream->read(reinterpret_cast<char*>(&size), sizeof(size));
+    stream->read(reinterpret_cast<char*>(&nb_hashes), sizeof(nb_hashes));
+  }
+
+  void sanity_check() override
+  {
+    _sanity_check();
+    if (sketch_magic != MAGICS.at(KM_FILE::SKETCH))
+      throw IOError("Invalid file format.");
+  }
+
+public:
+  uint64_t sketch_magic {MAGICS.at(KM_FILE::SKETCH)};
+  uint32_t kmer_size;
+  uint32_t id;
+  uint8_t hll_p;
+  uint64_t scale;
+  uint64_t size;
+  uint64_t nb_hashes;
+};
+
+template<size_t buf_size = 8192>
+class SketchWriter : public IFile<SketchFileHeader, std::ostream, buf_size>
+{
+  using ocstream = lz4_stream::basic_ostream<buf_size>;
+public:
+  SketchWriter(const std::string& path, const KSketch& sketch, bool lz4)
+    : IFile<SketchFileHeader, std::ostream, buf_size>(path, std::ios::out | std::ios::binary)
+  {
+    this->m_header.compressed = lz4;
+    this->m_header.kmer_size = sketch.ksize();
+    this->m_header.id = sketch.idx();
+    this->m_header.hll_p = sketch.hll().p();
+    this->m_header.scale = sketch.minhash().scale();
+    this->m_header.size = sketch.minhash().size();
+    this->m_header.nb_hashes = sketch.minhash().hashes().size();
+
+    this->m_header.serialize(this->m_first_layer.get());
+
+    this->template set_second_layer<ocstream>(this->m_header.compressed);
+
+    this->m_second_layer->write(reinterpret_cast<const char*>(sketch.hll().registers().data()),
+                                sketch.hll().registers().size());
+    this->m_second_layer->write(reinterpret_cast<const char*>(sketch.minhash().hashes().data()),
+                                sketch.minhash().hashes().size() * sizeof(uint64_t));
+  }
+};
+
+template<size_t buf_size = 8192>
+class SketchReader : public IFile<SketchFileHeader, std::istream, buf_size>
+{
+  using icstream = lz4_stream::basic_istream<buf_size>;
+public:
+  SketchReader(const std::string& path)
+    : IFile<SketchFileHeader, std::istream, buf_size>(path, std::ios::in | std::ios::binary)
+  {
+    this->m_header.deserialize(this->m_first_layer.get());
+    this->m_header.sanity_check();
+
+    this->template set_second_layer<icstream>(this->m_header.compressed);
+  }
+
+  sketch_t get()
+  {
+    sketch_t sketch = std::make_shared<KSketch>(this->m_header.id, this->m_header.kmer_size,
+                                                this->m_header.hll_p, this->m_header.scale,
+                                                this->m_header.size);
+    auto& regs = sketch->hll().registers();
+    this->m_second_layer->read(reinterpret_cast<char*>(regs.data()), regs.size());
+    auto& hashes = sketch->minhash().hashes();
+    hashes.resize(this->m_header.nb_hashes);
+    this->m_second_layer->read(reinterpret_cast<char*>(hashes.data()),
+                               hashes.size() * sizeof(uint64_t));
+    sketch->minhash().compact();
+    return sketch;
+  }
+};
+
+};
@@ -17,10 +17,15 @@
  *****************************************************************************/
 
 #pragma once
+#include <cstring>
 #include <string>
 #include <vector>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <lz4.h>
 #include <kmtricks/io/superk_file.hpp>
 #include <gatb/gatb_core.hpp>
 #include <gatb/system/api/IThread.hpp>
@@ -30,6 +35,60 @@ namespace fs = std::filesystem;
 
 namespace km {
 
+/*
+  Packed layout: all the partitions of a sample are appended to <base>.pack as tagged
+  blocks, [partition, raw size, stored size] followed by the block, LZ4 compressed when
+  stored < raw. <base>.pidx gives the blocks of each partition:
+
+    uint32 nb_partitions, then per partition: uint64 nb_blocks, nb_blocks x superk_block
+*/
+struct superk_block_header
+{
+  uint32_t partition;
+  uint32_t raw;
+  uint32_t stored;
+};
+
+struct superk_block
+{
+  uint64_t offset;
+  uint32_t raw;
+  uint32_t stored;
+};
+
+using superk_index_t = std::vector<std::vector<superk_block>>;
+
+inline void write_pack_index(const std::string& path, const superk_index_t& index)
+{
+  std::ofstream out(path, std::ios::out | std::ios::binary); check_fstream_good(path, out);
+  uint32_t nb_parts = index.size();
+  out.write(reinterpret_cast<char*>(&nb_parts), sizeof(nb_parts));
+  for (auto& blocks : index)
+  {
+    uint64_t n = blocks.size();
+    out.write(reinterpret_cast<char*>(&n), sizeof(n));
+    out.write(reinterpret_cast<const char*>(blocks.data()), n * sizeof(superk_block));
+  }
+}
+
+inline superk_index_t read_pack_index(const std::string& path)
+{
+  std::ifstream in(path, std::ios::in | std::ios::binary); check_fstream_good(path, in);
+  uint32_t nb_parts = 0;
+  in.read(reinterpret_cast<char*>(&nb_parts), sizeof(nb_parts));
+  superk_index_t index(nb_parts);
+  for (auto& blocks : index)
+  {
+    uint64_t n = 0;
+    in.read(reinterpret_cast<char*>(&n), sizeof(n));
+    blocks.resize(n);
+    in.read(reinterpret_cast<char*>(blocks.data()), n * sizeof(superk_block));
+  }
+  if (!in.good())
+    throw IOError(fmt::format("Truncated super-k-mer index {}.", path));
+  return index;
+}
+
 class SuperKStorageReader
 {
 public:
@@ -54,16 +113,65 @@ public:
       std::getline(info, line); m_nbk_per_file[i] = std::stoll(line);
       std::getline(info, line); m_file_size[i] = std::stoll(line);
     }
+
+    m_packed = std::getline(info, line) && line == "packed";
+    if (m_packed)
+    {
+      m_index = read_pack_index(fmt::format("{}/{}.pidx", m_path, m_base));
+      if (m_index.size() != static_cast<size_t>(m_nb_files))
+        throw IOError(fmt::format("{}/{}.pidx does not match {}.", m_path, m_base, prefix));
+      m_cursors.resize(m_nb_files, 0);
+      for (auto& blocks : m_index)
+        m_nb_filled += !blocks.empty();
+
+      std::string pack = fmt::format("{}/{}.pack", m_path, m_base);
+      m_fd = ::open(pack.c_str(), O_RDONLY);
+      if (m_fd == -1)
+        throw IOError(fmt::format("Unable to open {}.", pack));
+    }
   }
 
   ~SuperKStorageReader()
   {
     closeFiles();
+    if (m_fd != -1)
+      ::close(m_fd);
+  }
+
+  bool packed() const { return m_packed; }
+
+  // Files holding the super-k-mers of some partitions, the info file first.
+  // Packed storages keep all the partitions in one pack and its index.
+  static std::vector<std::string> files(const std::string& prefix, const std::vector<uint32_t>& parts)
+  {
+    std::string info_path = fmt::format("{}/SuperKmerBinInfoFile", prefix);
+    std::vector<std::string> paths {info_path};
+    std::ifstream info(info_path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(info, line);)
+      lines.push_back(line);
+    if (lines.size() < 3)
+      return paths;
+
+    const std::string& base = lines[0];
+    const std::string& path = lines[1];
+    if (lines.back() == "packed")
+    {
+      paths.push_back(fmt::format("{}/{}.pack", path, base));
+      paths.push_back(fmt::format("{}/{}.pidx", path, base));
+    }
+    else
+    {
+      for (auto& p : parts)
+        paths.push_back(fmt::format("{}/{}.{}", path, base, p));
+    }
+    return paths;
   }
 
   void flushFile(int fileId)
   {
-    m_files[fileId]->flush();
+    if (!m_packed)
+      m_files[fileId]->flush();
   }
 
   void flushFiles()
@@ -74,6 +182,13 @@ public:
 
   void eraseFiles()
   {
+    if (m_packed)
+    {
+      closeFiles();
+      std::remove(fmt::format("{}/{}.pack", m_path, m_base).c_str());
+      std::remove(fmt::format("{}/{}.pidx", m_path, m_base).c_str());
+      return;
+    }
     for (int i=0; i<m_nb_files; i++)
       eraseFile(i);
   }
@@ -81,7 +196,27 @@ public:
   void eraseFile(int fileId)
   {
     closeFile(fileId);
-    std::remove(fmt::format("{}/{}.{}", m_path, m_base, fileId).c_str());
+    if (!m_packed)
+      std::remove(fmt::format("{}/{}.{}", m_path, m_base, fileId).c_str());
+  }
+
+  // Erase the super-k-mers of a counted partition. A pack is erased once all its partitions are.
+  void clearFile(int fileId)
+  {
+    closeFile(fileId);
+    if (!m_packed)
+    {
+      Eraser::get().erase(getFileName(fileId));
+      return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_index[fileId].empty() || !m_cleared.insert(fileId).second)
+      return;
+    if (m_cleared.size() == m_nb_filled)
+    {
+      Eraser::get().erase(fmt::format("{}/{}.pack", m_path, m_base));
+      Eraser::get().erase(fmt::format("{}/{}.pidx", m_path, m_base));
+    }
   }
 
   void openFiles()
@@ -93,8 +228,13 @@ public:
 
   void openFile(int fileId)
   {
-    std::string path = fmt::format("{}/{}.{}", m_path, m_base, fileId);
-    m_files[fileId] = std::make_shared<SuperkReader<8192>>(path);
+    if (m_packed)
+      m_cursors[fileId] = 0;
+    else
+    {
+      std::string path = fmt::format("{}/{}.{}", m_path, m_base, fileId);
+      m_files[fileId] = std::make_shared<SuperkReader<8192>>(path);
+    }
     m_synchros[fileId] = gatb::core::system::impl::System::thread().newSynchronizer();
     m_synchros[fileId]->use();
   }
@@ -107,6 +247,15 @@ public:
 
   void closeFile(int fileId)
   {
+    if (m_packed)
+    {
+      if (m_synchros[fileId])
+      {
+        m_synchros[fileId]->forget();
+        m_synchros[fileId] = nullptr;
+      }
+      return;
+    }
     if (!m_files.empty())
     {
       if (m_files[fileId])
@@ -123,6 +272,9 @@ public:
                 unsigned int* nb_bytes_read,
                 int file_id)
   {
+    if (m_packed)
+      return readPackedBlock(block, max_block_size, nb_bytes_read, file_id);
+
     m_synchros[file_id]->lock();
     int nbr = m_files[file_id]->read_size(nb_bytes_read);
 
@@ -159,6 +311,70 @@ public:
     return m_file_size[fileId];
   }
 
+  // Bytes stored on disk for a partition.
+  uint64_t getDiskSize(int fileId) const
+  {
+    if (!m_packed)
+    {
+      std::error_code ec;
+      uint64_t size = fs::file_size(getFileName(fileId), ec);
+      return ec ? 0 : size;
+    }
+    uint64_t size = 0;
+    for (auto& b : m_index[fileId])
+      size += sizeof(superk_block_header) + b.stored;
+    return size;
+  }
+
+private:
+  // Blocks are taken in order under the partition lock, then read with pread outside of it.
+  int readPackedBlock(unsigned char** block,
+                      unsigned int* max_block_size,
+                      unsigned int* nb_bytes_read,
+                      int file_id)
+  {
+    m_synchros[file_id]->lock();
+    if (m_cursors[file_id] == m_index[file_id].size())
+    {
+      m_synchros[file_id]->unlock();
+      return 0;
+    }
+    const superk_block& b = m_index[file_id][m_cursors[file_id]++];
+    m_synchros[file_id]->unlock();
+
+    if (b.raw > *max_block_size)
+    {
+      *block = (unsigned char*) realloc(*block, b.raw);
+      *max_block_size = b.raw;
+    }
+    *nb_bytes_read = b.raw;
+
+    uint64_t offset = b.offset + sizeof(superk_block_header);
+    if (b.stored == b.raw)
+    {
+      read_at(reinterpret_cast<char*>(*block), b.raw, offset);
+      return b.raw;
+    }
+
+    thread_local std::vector<char> buffer;
+    buffer.resize(b.stored);
+    read_at(buffer.data(), b.stored, offset);
+    if (LZ4_decompress_safe(buffer.data(), reinterpret_cast<char*>(*block), b.stored, b.raw) != static_cast<int>(b.raw))
+      throw IOError(fmt::format("Corrupted block in {}/{}.pack.", m_path, m_base));
+    return b.raw;
+  }
+
+  void read_at(char* buffer, size_t size, uint64_t offset) const
+  {
+    while (size > 0)
+    {
+      ssize_t n = ::pread(m_fd, buffer, size, offset);
+      if (n <= 0)
+        throw IOError(fmt::format("Unable to read {}/{}.pack.", m_path, m_base));
+      buffer += n; size -= n; offset += n;
+    }
+  }
+
 private:
   std::string m_base;
   std::string m_path;
@@ -167,6 +383,14 @@ private:
   std::vector<skr_t<8192>> m_files;
   std::vector<gatb::core::system::ISynchronizer*> m_synchros;
   int m_nb_files;
+
+  bool m_packed {false};
+  int m_fd {-1};
+  superk_index_t m_index;
+  std::vector<size_t> m_cursors;
+  std::unordered_set<int> m_cleared;
+  size_t m_nb_filled {0};
+  std::mutex m_mutex;
 };
 
 using sk_storage_t = std::shared_ptr<SuperKStorageReader>;
@@ -175,8 +399,10 @@ class SuperKStorageWriter
 {
 public:
   SuperKStorageWriter(const std::string& prefix, const std::string& name,
-                      size_t nb_files, bool lz4, std::unordered_set<int> restricted)
-    : m_path(prefix), m_base(name), m_nb_files(nb_files), m_lz4(lz4), m_restricted(restricted)
+                      size_t nb_files, bool lz4, std::unordered_set<int> restricted,
+                      bool packed = false)
+    : m_path(prefix), m_base(name), m_nb_files(nb_files), m_lz4(lz4), m_restricted(restricted),
+      m_packed(packed)
   {
     m_nbk_per_file.resize(m_nb_files, 0);
     m_file_size.resize(m_nb_files, 0);
@@ -234,7 +460,8 @@ public:
 
   void flushFile(int fileId)
   {
-    m_files[fileId]->flush();
+    if (!m_packed)
+      m_files[fileId]->flush();
   }
 
   void flushFiles()
@@ -252,12 +479,22 @@ public:
   void eraseFile(int fileId)
   {
     closeFile(fileId);
-    std::remove(fmt::format("{}/{}.{}", m_path, m_base, fileId).c_str());
+    if (!m_packed)
+      std::remove(fmt::format("{}/{}.{}", m_path, m_base, fileId).c_str());
   }
 
   void openFiles()
   {
     fs::create_directory(m_path);
+    if (m_packed)
+    {
+      std::string pack = fmt::format("{}/{}.pack", m_path, m_base);
+      m_fd = ::open(pack.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (m_fd == -1)
+        throw IOError(fmt::format("Unable to open {}.", pack));
+      m_index.resize(m_nb_files);
+      return;
+    }
     for (int i=0; i<m_nb_files; i++)
       openFile(i);
   }
@@ -277,12 +514,24 @@ public:
 
   void closeFiles()
   {
+    if (m_packed)
+    {
+      if (m_fd != -1)
+      {
+        ::close(m_fd);
+        m_fd = -1;
+        write_pack_index(fmt::format("{}/{}.pidx", m_path, m_base), m_index);
+      }
+      return;
+    }
     for (int i=0; i<m_nb_files; i++)
       closeFile(i);
   }
 
   void closeFile(int fileId)
   {
+    if (m_packed)
+      return;
     if (m_files[fileId])
     {
       if (!m_restricted.count(fileId))
@@ -300,6 +549,11 @@ public:
   {
     if (!m_restricted.count(file_id))
       return;
+    if (m_packed)
+    {
+      writePackedBlock(block, block_size, file_id, nbkmers);
+      return;
+    }
     m_synchros[file_id]->lock();
     m_nbk_per_file[file_id] += nbkmers;
     m_file_size[file_id] += block_size + sizeof(block_size);
@@ -337,7 +591,51 @@ public:
       info << m_nbk_per_file[i] << "\n";
       info << m_file_size[i] << "\n";
     }
+    if (m_packed)
+      info << "packed\n";
+  }
+
+private:
+  // The offset of a block is reserved under the lock, the block itself is written with pwrite.
+  void writePackedBlock(unsigned char* block, unsigned int block_size, int file_id, int nbkmers)
+  {
+    thread_local std::vector<char> record;
+    int bound = m_lz4 ? LZ4_compressBound(block_size) : block_size;
+    record.resize(sizeof(superk_block_header) + bound);
+
+    superk_block_header header {static_cast<uint32_t>(file_id), block_size, block_size};
+    char* data = record.data() + sizeof(header);
+    if (m_lz4)
+    {
+      int size = LZ4_compress_default(reinterpret_cast<char*>(block), data, block_size, bound);
+      if (size > 0 && static_cast<unsigned int>(size) < block_size)
+        header.stored = size;
+    }
+    if (header.stored == block_size)
+      std::memcpy(data, block, block_size);
+    std::memcpy(record.data(), &header, sizeof(header));
+
+    size_t size = sizeof(header) + header.stored;
+    uint64_t offset;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      offset = m_offset;
+      m_offset += size;
+      m_index[file_id].push_back({offset, header.raw, header.stored});
+      m_nbk_per_file[file_id] += nbkmers;
+      m_file_size[file_id] += block_size + sizeof(block_size);
+    }
+
+    const char* p = record.data();
+    while (size > 0)
+    {
+      ssize_t n = ::pwrite(m_fd, p, size, offset);
+      if (n <= 0)
+        throw IOError(fmt::format("Unable to write {}/{}.pack.", m_path, m_base));
+      p += n; size -= n; offset += n;
+    }
   }
+
 private:
   std::string m_base;
   std::string m_path;
@@ -353,6 +651,12 @@ private:
   size_t m_capacity;
   std::vector<uint8_t*> m_buffers;
   std::vector<int> m_buffers_idx;
+
+  bool m_packed {false};
+  int m_fd {-1};
+  uint64_t m_offset {0};
+  superk_index_t m_index;
+  std::mutex m_mutex;
 };
 
 };
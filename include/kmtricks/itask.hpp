@@ -20,9 +20,24 @@
 #include <functional>
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
+
+#include <kmtricks/journal.hpp>
+#include <kmtricks/telemetry.hpp>
 
 namespace km {
 
+// Lends idle worker threads to the tasks that split their work, see TaskPool.
+class IThreadLender
+{
+public:
+  virtual ~IThreadLender() = default;
+  // Up to n threads, without waiting.
+  virtual uint32_t borrow(uint32_t n) = 0;
+  virtual void give_back(uint32_t n) = 0;
+};
+
 class ITask
 {
 public:
@@ -36,6 +51,42 @@ public:
 
   virtual void set_level(uint32_t level) { m_priority_level = level; }
 
+  // Name and stage used in telemetry reports.
+  virtual std::string name() const { return "task"; }
+  virtual std::string stage() const { return "task"; }
+
+  // Files produced by the task, journaled so that an interrupted pipeline can be resumed.
+  virtual std::vector<std::string> outputs() const { return {}; }
+
+  // Estimated memory footprint in bytes, used by TaskPool to admit tasks under a memory budget.
+  virtual uint64_t memory() const { return 0; }
+
+  void run()
+  {
+    if (!Telemetry::get().enabled())
+    {
+      preprocess(); exec(); postprocess();
+    }
+    else
+    {
+      Telemetry& t = Telemetry::get();
+      TaskRecord r;
+      r.tid = Telemetry::thread_index();
+      r.pre[0] = t.now(); preprocess(); r.pre[1] = t.now();
+      r.exec[0] = t.now(); exec(); r.exec[1] = t.now();
+      r.post[0] = t.now(); postprocess(); r.post[1] = t.now();
+      r.name = name();
+      r.stage = stage();
+      r.rss = get_current_rss() / 1024;
+      r.peak_rss = get_peak_rss();
+      r.stats = std::move(m_stats);
+      t.record(std::move(r));
+    }
+
+    if (Journal::get().enabled())
+      Journal::get().record(name(), outputs());
+  }
+
   bool operator==(const ITask& task) const
   {
     return m_priority_level == task.m_priority_level;
@@ -83,6 +134,21 @@ public:
   void in() {m_in_queue = true;}
   void out() {m_in_queue = false;}
 
+  void set_lender(IThreadLender* lender) { m_lender = lender; }
+
+  // Extra threads for a task that splits its work, lent by the pool which runs it.
+  // A task run on its own gets all of them.
+  uint32_t borrow_threads(uint32_t n)
+  {
+    return m_lender ? m_lender->borrow(n) : n;
+  }
+
+  void give_back_threads(uint32_t n)
+  {
+    if (m_lender && n)
+      m_lender->give_back(n);
+  }
+
 protected:
   uint32_t m_priority_level;
   bool m_ready {false};
@@ -92,6 +158,27 @@ protected:
   bool m_running {false};
   bool m_in_queue {false};
   std::function<void()> m_callback {nullptr};
+  IThreadLender* m_lender {nullptr};
+  TaskStats m_stats;
+};
+
+// Threads borrowed by a task, given back when it goes out of scope, even on throw.
+class BorrowedThreads
+{
+public:
+  BorrowedThreads(ITask& task, uint32_t n)
+    : m_task(task), m_n(task.borrow_threads(n)) {}
+
+  ~BorrowedThreads() { m_task.give_back_threads(m_n); }
+
+  BorrowedThreads(const BorrowedThreads&) = delete;
+  BorrowedThreads& operator=(const BorrowedThreads&) = delete;
+
+  uint32_t size() const { return m_n; }
+
+private:
+  ITask& m_task;
+  uint32_t m_n;
 };
 
 using task_t = std::shared_ptr<ITask>;
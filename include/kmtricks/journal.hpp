@@ -0,0 +1,239 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <kmtricks/utils.hpp>
+
+namespace fs = std::filesystem;
+
+namespace km {
+
+/*
+  Append-only record of the completed pipeline tasks, one line per task:
+
+    done <tab> <task name> <tab> <output> <tab> <size> ...
+
+  Output paths are stored relative to the run directory. A task is considered
+  done on resume only if each of its outputs still has the recorded size.
+*/
+class Journal
+{
+  using outputs_t = std::vector<std::pair<std::string, uint64_t>>;
+
+public:
+  static Journal& get()
+  {
+    static Journal journal;
+    return journal;
+  }
+
+  static constexpr const char* magic = "kmtricks-journal\t1";
+  static constexpr uint64_t missing = UINT64_MAX;
+
+  // Start a new journal, a previous one at the same path is discarded.
+  void create(const std::string& path, const std::string& root, const std::string& fingerprint)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_root = root;
+    m_fingerprint = fingerprint;
+    m_done.clear();
+    m_values.clear();
+    m_out = std::ofstream(path, std::ios::out | std::ios::trunc); check_fstream_good(path, m_out);
+    m_out << magic << "\n" << "fingerprint\t" << fingerprint << std::endl;
+    m_enabled = true;
+  }
+
+  // Load the entries of a previous run, new entries are appended. Returns false if path is not a journal.
+  bool resume(const std::string& path, const std::string& root)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_root = root;
+    m_done.clear();
+    m_values.clear();
+    m_fingerprint.clear();
+
+    {
+      std::ifstream in(path, std::ios::in);
+      std::string line;
+      if (!in.good() || !std::getline(in, line) || line != magic)
+        return false;
+
+      while (std::getline(in, line))
+      {
+        // The last line may be truncated if the previous run was killed while writing it.
+        if (in.eof())
+          break;
+        auto fields = split(line);
+        if (fields[0] == "fingerprint" && fields.size() == 2)
+          m_fingerprint = fields[1];
+        else if (fields[0] == "set" && fields.size() == 3)
+          m_values[fields[1]] = fields[2];
+        else if (fields[0] == "done" && fields.size() >= 2 && fields.size() % 2 == 0)
+        {
+          outputs_t outputs;
+          for (size_t i=2; i<fields.size(); i+=2)
+            outputs.emplace_back(fields[i], std::stoull(fields[i+1]));
+          m_done[fields[1]] = std::move(outputs);
+        }
+      }
+    }
+
+    // Rewrite the valid entries, dropping a possibly truncated tail.
+    m_out = std::ofstream(path, std::ios::out | std::ios::trunc); check_fstream_good(path, m_out);
+    m_out << magic << "\n" << "fingerprint\t" << m_fingerprint << "\n";
+    for (auto& [k, v] : m_values)
+      m_out << "set\t" << k << "\t" << v << "\n";
+    for (auto& [task, outputs] : m_done)
+      write_done(task, outputs);
+    m_out.flush();
+    m_enabled = true;
+    return true;
+  }
+
+  bool enabled() const { return m_enabled; }
+
+  void disable()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_enabled = false;
+    m_out.close();
+  }
+
+  const std::string& fingerprint() const { return m_fingerprint; }
+
+  void set(const std::string& key, const std::string& value)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_values[key] = value;
+    m_out << "set\t" << key << "\t" << value << std::endl;
+  }
+
+  std::string value(const std::string& key) const
+  {
+    auto it = m_values.find(key);
+    return it == m_values.end() ? "" : it->second;
+  }
+
+  void record(const std::string& task, const std::vector<std::string>& paths)
+  {
+    outputs_t outputs;
+    for (auto& p : paths)
+      outputs.emplace_back(relative(p), size_of(p));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    write_done(task, outputs);
+    m_out.flush();
+    m_done[task] = std::move(outputs);
+  }
+
+  bool has(const std::string& task) const { return m_done.count(task); }
+
+  // Journaled, and all outputs still have their recorded sizes.
+  bool done(const std::string& task) const
+  {
+    auto it = m_done.find(task);
+    if (it == m_done.end())
+      return false;
+    for (auto& [p, size] : it->second)
+      if (size == missing || size_of(absolute(p)) != size)
+        return false;
+    return true;
+  }
+
+  // Journaled as an output of task, and still has its recorded size.
+  bool intact(const std::string& task, const std::string& path) const
+  {
+    auto it = m_done.find(task);
+    if (it == m_done.end())
+      return false;
+    std::string rel = relative(path);
+    for (auto& [p, size] : it->second)
+      if (p == rel)
+        return size != missing && size_of(path) == size;
+    return false;
+  }
+
+  // Size of a file, or of all files under a directory.
+  static uint64_t size_of(const std::string& path)
+  {
+    std::error_code ec;
+    if (fs::is_directory(path, ec))
+    {
+      uint64_t size = 0;
+      for (auto& e : fs::recursive_directory_iterator(path, ec))
+        if (e.is_regular_file(ec))
+          size += e.file_size(ec);
+      return size;
+    }
+    uint64_t size = fs::file_size(path, ec);
+    return ec ? missing : size;
+  }
+
+private:
+  Journal() {}
+
+  std::string relative(const std::string& path) const
+  {
+    std::string prefix = m_root + "/";
+    return path.rfind(prefix, 0) == 0 ? path.substr(prefix.size()) : path;
+  }
+
+  std::string absolute(const std::string& path) const
+  {
+    return fs::path(path).is_absolute() ? path : m_root + "/" + path;
+  }
+
+  void write_done(const std::string& task, const outputs_t& outputs)
+  {
+    m_out << "done\t" << task;
+    for (auto& [p, size] : outputs)
+      m_out << "\t" << p << "\t" << size;
+    m_out << "\n";
+  }
+
+  static std::vector<std::string> split(const std::string& line)
+  {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    for (std::string f; std::getline(ss, f, '\t');)
+      fields.push_back(f);
+    if (fields.empty())
+      fields.emplace_back();
+    return fields;
+  }
+
+private:
+  bool m_enabled {false};
+  std::string m_root;
+  std::string m_fingerprint;
+  std::map<std::string, outputs_t> m_done;
+  std::map<std::string, std::string> m_values;
+  std::ofstream m_out;
+  std::mutex m_mutex;
+};
+
+};
@@ -45,6 +45,11 @@ public:
     return fmt::format("{}/{}", m_superk_storage, sample_id);
   }
 
+  std::string get_superk_part_path(const std::string& sample_id, uint32_t part_id)
+  {
+    return fmt::format("{}/{}/skp.{}", m_superk_storage, sample_id, part_id);
+  }
+
   std::vector<std::string> get_files_to_merge(uint32_t part_id, bool compressed, KM_FILE km_file)
   {
     std::string ext;
@@ -183,6 +188,11 @@ public:
     return fmt::format(m_hist_template, m_hist_storage, id);
   }
 
+  std::string get_sketch_path(const std::string& id)
+  {
+    return fmt::format(m_sketch_template, m_sketch_storage, id);
+  }
+
   std::string get_merge_info_path(uint32_t part_id)
   {
     return fmt::format(m_stat_merge_template, m_stat_storage, part_id);
@@ -229,11 +239,15 @@ public:
     m_matrix_storage = fmt::format("{}/matrices", m_root);
     m_filter_storage = fmt::format("{}/filters", m_root);
     m_hist_storage = fmt::format("{}/histograms", m_root);
+    m_sketch_storage = fmt::format("{}/sketches", m_root);
     m_stat_storage = fmt::format("{}/merge_infos", m_root);
     m_index_storage = fmt::format("{}/howde_index", m_root);
     m_part_info_storage = fmt::format("{}/partition_infos", m_root);
     m_hash_win = fmt::format("{}/hash.info", m_root);
     m_run_infos = fmt::format("{}/run_infos.txt", m_root);
+    m_telemetry = fmt::format("{}/telemetry.json", m_root);
+    m_trace = fmt::format("{}/trace.json", m_root);
+    m_journal = fmt::format("{}/journal.txt", m_root);
     m_options = fmt::format("{}/options.txt", m_root);
     m_minimizer_storage = fmt::format("{}/minimizers", m_root);
     m_fpr_storage = fmt::format("{}/fpr", m_root);
@@ -250,6 +264,7 @@ public:
       fs::create_directory(m_matrix_storage);
       fs::create_directory(m_filter_storage);
       fs::create_directory(m_hist_storage);
+      fs::create_directory(m_sketch_storage);
       fs::create_directory(m_stat_storage);
       fs::create_directory(m_index_storage);
       fs::create_directory(m_part_info_storage);
@@ -296,12 +311,16 @@ public:
   std::string m_matrix_storage;
   std::string m_filter_storage;
   std::string m_hist_storage;
+  std::string m_sketch_storage;
   std::string m_stat_storage;
   std::string m_index_storage;
   std::string m_hash_win;
   std::string m_part_info_storage;
   std::string m_minimizer_storage;
   std::string m_run_infos;
+  std::string m_telemetry;
+  std::string m_trace;
+  std::string m_journal;
   std::string m_options;
   std::string m_fpr_storage;
   std::string m_plugin_storage;
@@ -310,6 +329,7 @@ public:
   std::string m_matrix_template {"{}/matrix_{}.{}"};
   std::string m_part_template {"{}/partition_{}/{}.{}"};
   std::string m_hist_template {"{}/{}.hist"};
+  std::string m_sketch_template {"{}/{}.sketch"};
   std::string m_stat_merge_template {"{}/partition{}.merge_info"};
 
   Fof m_fof;
@@ -15,6 +15,8 @@
 #include <kmtricks/hash.hpp>
 #include <kmtricks/repartition.hpp>
 #include <kmtricks/io/fof.hpp>
+#include <kmtricks/io/vector_matrix_file.hpp>
+#include <kmtricks/merge.hpp>
 
 namespace fs = std::filesystem;
 
@@ -529,7 +531,8 @@ class MatrixMerger
           for (auto& p : paths)
           {
             m_elements.push_back(std::make_unique<element>(p, pos));
-            m_queue.push(m_elements.back().get());
+            if (*m_elements.back())
+              m_queue.push(m_elements.back().get());
             pos += m_elements.back()->n;
           }
           if constexpr (MAX_C != 1)
@@ -560,7 +563,7 @@ class MatrixMerger
             m_queue.push(elem);
 
           if (m_queue.empty())
-            return false;
+            return true;
 
           for (elem = m_queue.top(); elem->value == m_current_kmer; elem = m_queue.top())
           {
@@ -911,4 +914,170 @@ class MatrixMergeTask : public ITask
    bool m_cpr;
 };
 
+/*
+  Append the columns of new samples to a partition matrix. The count files of the new
+  samples are merged into a delta matrix which is then joined with the existing one, so the
+  columns of the existing samples are copied as is. MAX_K == 1 for hash matrices, as in
+  MatrixMerger, and MAX_C is the count type of the new count files. The delta keeps every
+  k-mer solid in one of the new samples, the result is that of a merge with a recurrence
+  min of 1 and no rescue.
+*/
+template<std::size_t MAX_K, std::size_t MAX_C>
+class MatrixAppendTask : public ITask
+{
+  template<std::size_t C>
+  using partition_merge_type = typename MatrixMerger<MAX_K, C>::PartitionMerger;
+
+  public:
+    MatrixAppendTask(const std::string& matrix,
+                     const std::string& output,
+                     const std::vector<std::string>& paths,
+                     const std::vector<uint32_t>& ab_vec,
+                     uint32_t kmer_size,
+                     bool pa,
+                     bool cpr)
+      : ITask(4),
+        m_matrix(matrix),
+        m_output(output),
+        m_paths(paths),
+        m_ab_vec(ab_vec),
+        m_kmer_size(kmer_size),
+        m_pa(pa),
+        m_cpr(cpr)
+    {
+    }
+
+    std::string name() const override
+    {
+      return fmt::format("append {}", fs::path(m_matrix).filename().string());
+    }
+    std::string stage() const override { return "merge"; }
+    std::vector<std::string> outputs() const override { return {m_output}; }
+
+    void exec() override
+    {
+      std::string delta = m_output + ".delta";
+
+      if constexpr(MAX_K == 1)
+      {
+        HashMerger<MAX_C, 32768, HashReader<MAX_C, 32768>> merger(m_paths, m_ab_vec, 1, 0);
+        if (m_pa)
+          merger.write_as_pa(delta, m_cpr);
+        else
+          merger.write_as_bin(delta, m_cpr);
+      }
+      else
+      {
+        KmerMerger<MAX_K, MAX_C> merger(m_paths, m_ab_vec, m_kmer_size, 1, 0);
+        if (m_pa)
+          merger.write_as_pa(delta, m_cpr);
+        else
+          merger.write_as_bin(delta, m_cpr);
+      }
+
+      if (m_pa)
+        partition_merge_type<1>({m_matrix, delta}).write(m_output, m_cpr);
+      else
+        partition_merge_type<MAX_C>({m_matrix, delta}).write(m_output, m_cpr);
+
+      fs::remove(delta);
+    }
+
+    void preprocess() override {}
+    void postprocess() override
+    {
+      this->m_finish = true;
+      this->exec_callback();
+    }
+
+  private:
+    std::string m_matrix;
+    std::string m_output;
+    std::vector<std::string> m_paths;
+    std::vector<uint32_t> m_ab_vec;
+    uint32_t m_kmer_size;
+    bool m_pa;
+    bool m_cpr;
+};
+
+/*
+  Same as MatrixAppendTask for bf matrices, whose rows are the positions of the hash window:
+  the bits of the new samples are appended to each row.
+*/
+template<std::size_t MAX_C>
+class BfMatrixAppendTask : public ITask
+{
+  public:
+    BfMatrixAppendTask(const std::string& matrix,
+                       const std::string& output,
+                       const std::vector<std::string>& paths,
+                       const std::vector<uint32_t>& ab_vec)
+      : ITask(4),
+        m_matrix(matrix),
+        m_output(output),
+        m_paths(paths),
+        m_ab_vec(ab_vec)
+    {
+    }
+
+    std::string name() const override
+    {
+      return fmt::format("append {}", fs::path(m_matrix).filename().string());
+    }
+    std::string stage() const override { return "merge"; }
+    std::vector<std::string> outputs() const override { return {m_output}; }
+
+    void exec() override
+    {
+      std::string delta = m_output + ".delta";
+      {
+        VectorMatrixReader<8192> mr(m_matrix);
+        auto& i = mr.infos();
+        HashMerger<MAX_C, 32768, HashReader<MAX_C, 32768>> merger(m_paths, m_ab_vec, 1, 0);
+        merger.write_as_bf(delta, i.first, i.first + i.window - 1, false);
+      }
+
+      VectorMatrixReader<8192> mr(m_matrix);
+      VectorMatrixReader<8192> dr(delta);
+      auto& i = mr.infos();
+      uint32_t n = i.bits;
+      uint32_t d = dr.infos().bits;
+
+      VectorMatrixWriter<8192> out(m_output, n + d, i.id, i.partition, i.first, i.window, i.compressed);
+
+      std::vector<uint8_t> row(NBYTES(n));
+      std::vector<uint8_t> drow(NBYTES(d));
+      std::vector<uint8_t> orow(NBYTES(n + d));
+      for (uint64_t r = 0; r < i.window; ++r)
+      {
+        if (!mr.read(row) || !dr.read(drow))
+          throw IOError(fmt::format("{}: unexpected end of file.", m_matrix));
+
+        std::fill(orow.begin(), orow.end(), 0);
+        std::copy(row.begin(), row.end(), orow.begin());
+        for (uint32_t j = 0; j < d; ++j)
+        {
+          if (BITCHECK(drow, j))
+            BITSET(orow, n + j);
+        }
+        out.write(orow);
+      }
+
+      fs::remove(delta);
+    }
+
+    void preprocess() override {}
+    void postprocess() override
+    {
+      this->m_finish = true;
+      this->exec_callback();
+    }
+
+  private:
+    std::string m_matrix;
+    std::string m_output;
+    std::vector<std::string> m_paths;
+    std::vector<uint32_t> m_ab_vec;
+};
+
 } // namespace km
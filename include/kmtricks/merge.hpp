@@ -99,7 +99,74 @@ private:
   std::vector<uint64_t> m_total_w_rescue;
 };
 
-template<size_t MAX_K, size_t MAX_C>
+#ifdef WITH_PLUGIN
+// Merged rows buffered for a block plugin, see MergeBlock.
+template<size_t MAX_C>
+class MergeBlockBuffer
+{
+  using count_type = typename selectC<MAX_C>::type;
+public:
+  void init(size_t capacity, size_t nb_samples, size_t key_slots)
+  {
+    m_capacity = capacity;
+    m_nb_samples = nb_samples;
+    m_key_slots = key_slots;
+    m_keys.resize(capacity * key_slots);
+    m_counts.resize(capacity * nb_samples);
+    m_keep.resize(capacity);
+  }
+
+  bool exhausted() const { return m_pos == m_rows; }
+  bool full() const { return m_rows == m_capacity; }
+  void clear() { m_rows = m_pos = 0; }
+
+  void push(const uint64_t* key, const std::vector<count_type>& counts, bool keep)
+  {
+    std::copy(key, key + m_key_slots, m_keys.data() + m_rows * m_key_slots);
+    for (size_t s=0; s<m_nb_samples; s++)
+      m_counts[s * m_capacity + m_rows] = counts[s];
+    m_keep[m_rows++] = keep;
+  }
+
+  // Column-major view of the buffered rows, the key pointer is set by the merger.
+  MergeBlock block()
+  {
+    if (m_rows < m_capacity)
+      for (size_t s=1; s<m_nb_samples; s++)
+        std::copy(m_counts.data() + s * m_capacity, m_counts.data() + s * m_capacity + m_rows,
+                  m_counts.data() + s * m_rows);
+    MergeBlock b;
+    b.counts = m_counts.data();
+    b.keep = m_keep.data();
+    b.nb_rows = m_rows;
+    b.nb_samples = m_nb_samples;
+    return b;
+  }
+
+  const uint64_t* keys() const { return m_keys.data(); }
+  const uint64_t* key() const { return m_keys.data() + m_pos * m_key_slots; }
+
+  void pop(std::vector<count_type>& counts, bool& keep)
+  {
+    for (size_t s=0; s<m_nb_samples; s++)
+      counts[s] = m_counts[s * m_rows + m_pos];
+    keep = m_keep[m_pos++];
+  }
+
+private:
+  size_t m_capacity {0};
+  size_t m_nb_samples {0};
+  size_t m_key_slots {0};
+  size_t m_rows {0};
+  size_t m_pos {0};
+  std::vector<uint64_t> m_keys;
+  std::vector<count_type> m_counts;
+  std::vector<uint8_t> m_keep;
+};
+#endif
+
+// Reader is a KmerReader, or a KmerRunReader to merge counts kept in memory.
+template<size_t MAX_K, size_t MAX_C, typename Reader = KmerReader<8192>>
 class KmerMerger
 {
   using count_type = typename selectC<MAX_C>::type;
@@ -124,6 +191,19 @@ public:
     init_state();
   }
 
+  KmerMerger(std::vector<std::shared_ptr<Reader>> readers,
+             std::vector<uint32_t>& abundance_min_vec,
+             uint32_t kmer_size,
+             uint32_t recurrence_min,
+             uint32_t save_if,
+             uint32_t partition)
+    : m_r_min(recurrence_min), m_save_if(save_if), m_partition(partition),
+      m_input_streams(std::move(readers)), m_size(m_input_streams.size()),
+      m_kmer_size(kmer_size), m_a_min_vec(abundance_min_vec)
+  {
+    init_state();
+  }
+
   const Kmer<MAX_K>& current() const
   {
     return m_current;
@@ -142,9 +222,10 @@ public:
   void init_stream()
   {
     for (auto& path: m_paths)
-      m_input_streams.push_back(std::make_shared<KmerReader<8192>>(path));
+      m_input_streams.push_back(std::make_shared<Reader>(path));
     m_size = m_paths.size();
     m_kmer_size = m_input_streams[0]->infos().kmer_size;
+    m_partition = m_input_streams[0]->infos().partition;
   }
 
   void init_state()
@@ -172,6 +253,8 @@ public:
   void set_plugin(IMergePlugin* plugin)
   {
     m_plugin = plugin;
+    if (m_plugin->block_size())
+      m_block.init(m_plugin->block_size(), m_size, kmer_slots);
   }
 #endif
 
@@ -181,6 +264,43 @@ public:
   }
 
   bool next()
+  {
+#ifdef WITH_PLUGIN
+    if (m_plugin && m_plugin->block_size())
+      return next_in_block();
+#endif
+    if (!merge_next())
+      return false;
+#ifdef WITH_PLUGIN
+    if (m_plugin)
+      m_keep = m_plugin->process_kmer(m_current.get_data64(), m_counts);
+#endif
+    return true;
+  }
+
+private:
+#ifdef WITH_PLUGIN
+  bool next_in_block()
+  {
+    if (m_block.exhausted())
+    {
+      m_block.clear();
+      while (!m_block.full() && merge_next())
+        m_block.push(m_current.get_data64(), m_counts, m_keep);
+      if (m_block.exhausted())
+        return false;
+      MergeBlock block = m_block.block();
+      block.kmers = m_block.keys();
+      block.kmer_slots = kmer_slots;
+      m_plugin->process_kmer_block(block);
+    }
+    m_current.set64_p(m_block.key());
+    m_block.pop(m_counts, m_keep);
+    return true;
+  }
+#endif
+
+  bool merge_next()
   {
     m_keep = false;
     m_finish = true;
@@ -249,16 +369,10 @@ public:
     if (recurrence >= m_r_min)
       m_keep = true;
 
-#ifdef WITH_PLUGIN
-    if (m_plugin)
-    {
-      m_keep = m_plugin->process_kmer(m_current.get_data64(), m_counts);
-    }
-#endif
-
     return !m_finish;
   }
 
+public:
   void write_as_bin(const std::string& path, bool compressed)
   {
     MatrixWriter mw(path, m_kmer_size, 1, m_size, 0, m_partition, compressed);
@@ -330,13 +444,13 @@ private:
   }
 
 private:
-  std::vector<std::string>& m_paths;
+  std::vector<std::string> m_paths;
   uint32_t m_a_min;
   uint32_t m_r_min;
   uint32_t m_save_if;
   uint32_t m_partition;
 
-  std::vector<kr_t<8192>> m_input_streams;
+  std::vector<std::shared_ptr<Reader>> m_input_streams;
   std::vector<element> m_elements;
   std::vector<size_t> m_need_check;
 
@@ -357,6 +471,8 @@ private:
 
 #ifdef WITH_PLUGIN
   IMergePlugin* m_plugin {nullptr};
+  MergeBlockBuffer<MAX_C> m_block;
+  static constexpr size_t kmer_slots = (MAX_K + 31) / 32;
 #endif
 };
 
@@ -384,6 +500,18 @@ public:
     init_state();
   }
 
+  HashMerger(std::vector<std::shared_ptr<Reader>> readers,
+             std::vector<uint32_t>& abundance_min_vec,
+             uint32_t recurrence_min,
+             uint32_t save_if,
+             uint32_t partition)
+    : m_r_min(recurrence_min), m_save_if(save_if), m_partition(partition),
+      m_input_streams(std::move(readers)), m_size(m_input_streams.size()),
+      m_a_min_vec(abundance_min_vec)
+  {
+    init_state();
+  }
+
   uint64_t current() const
   {
     return m_current;
@@ -430,6 +558,8 @@ public:
   void set_plugin(IMergePlugin* plugin)
   {
     m_plugin = plugin;
+    if (m_plugin->block_size())
+      m_block.init(m_plugin->block_size(), m_size, 1);
   }
 #endif
 
@@ -439,6 +569,42 @@ public:
   }
 
   bool next()
+  {
+#ifdef WITH_PLUGIN
+    if (m_plugin && m_plugin->block_size())
+      return next_in_block();
+#endif
+    if (!merge_next())
+      return false;
+#ifdef WITH_PLUGIN
+    if (m_plugin)
+      m_keep = m_plugin->process_hash(m_current, m_counts);
+#endif
+    return true;
+  }
+
+private:
+#ifdef WITH_PLUGIN
+  bool next_in_block()
+  {
+    if (m_block.exhausted())
+    {
+      m_block.clear();
+      while (!m_block.full() && merge_next())
+        m_block.push(&m_current, m_counts, m_keep);
+      if (m_block.exhausted())
+        return false;
+      MergeBlock block = m_block.block();
+      block.hashes = m_block.keys();
+      m_plugin->process_hash_block(block);
+    }
+    m_current = *m_block.key();
+    m_block.pop(m_counts, m_keep);
+    return true;
+  }
+#endif
+
+  bool merge_next()
   {
     m_keep = false;
     m_finish = true;
@@ -506,16 +672,10 @@ public:
     if (recurrence >= m_r_min)
       m_keep = true;
 
-#ifdef WITH_PLUGIN
-    if (m_plugin)
-    {
-      m_keep = m_plugin->process_hash(m_current, m_counts);
-    }
-#endif
-
     return !m_finish;
   }
 
+public:
   void write_as_bin(const std::string& path, bool compressed)
   {
     MatrixHashWriter<8192> mhw(path, sizeof(m_counts[0]), m_size, 0, m_partition, compressed);
@@ -655,7 +815,7 @@ private:
   }
 
 private:
-  std::vector<std::string>& m_paths;
+  std::vector<std::string> m_paths;
   uint32_t m_a_min;
   uint32_t m_r_min;
   uint32_t m_save_if;
@@ -681,6 +841,7 @@ private:
 
 #ifdef WITH_PLUGIN
   IMergePlugin* m_plugin {nullptr};
+  MergeBlockBuffer<MAX_C> m_block;
 #endif
 };
 };
@@ -2,6 +2,7 @@
 
 #include <bitpacker/bitpacker.hpp>
 #include <cmath>
+#include <cstring>
 #include <limits>
 #include <vector>
 
@@ -41,4 +42,34 @@ inline void pack_v(const std::vector<C>& vc, std::vector<uint8_t>& v, int w)
     bitpacker::insert(v, j, w, to_n_b(vc[i], w));
   }
 }
+
+/**
+ * Unpack `n` fields of `w` bits written by `pack_v`, `w` <= 56.
+ * Fields are stored MSB first. Each field is extracted with one big-endian 64-bit load at its
+ * first byte and two shifts, only the fields of the last 8 bytes are read byte by byte.
+ * @param v [IN] The packed fields, `byte_count_pack(n, w)` bytes
+ * @param n [IN] The number of fields
+ * @param w [IN] The size in bit of each field
+ * @param out [OUT] The `n` unpacked fields
+ */
+template<typename C>
+inline void unpack_v(const uint8_t* v, std::size_t n, int w, C* out)
+{
+  const std::size_t size = byte_count_pack(n, w);
+  std::size_t i = 0, j = 0;
+  for (; i < n && (j >> 3) + 8 <= size; ++i, j += w)
+  {
+    std::uint64_t word;
+    std::memcpy(&word, v + (j >> 3), sizeof(word));
+    word = __builtin_bswap64(word);
+    out[i] = static_cast<C>((word << (j & 7)) >> (64 - w));
+  }
+  for (; i < n; ++i, j += w)
+  {
+    std::uint64_t word = 0;
+    for (std::size_t b = j >> 3; b < size && b < (j >> 3) + 8; ++b)
+      word |= static_cast<std::uint64_t>(v[b]) << (56 - 8 * (b - (j >> 3)));
+    out[i] = static_cast<C>((word << (j & 7)) >> (64 - w));
+  }
+}
 }  // namespace km
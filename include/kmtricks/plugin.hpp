@@ -9,6 +9,27 @@
 
 namespace km {
 
+/*
+  A block of merged rows, in a column-major view. Row r is the k-mer kmers[r * kmer_slots, ...),
+  in the word layout of Kmer<MAX_K>, or the hash hashes[r]; the other pointer is null.
+  The counts of sample s are counts[s * nb_rows, (s+1) * nb_rows). keep[r] holds the decision
+  of the merge thresholds for row r and is updated by the plugin.
+*/
+struct MergeBlock
+{
+  using count_type = typename selectC<DMAX_C>::type;
+
+  const uint64_t* kmers {nullptr};
+  size_t kmer_slots {0};
+  const uint64_t* hashes {nullptr};
+  count_type* counts {nullptr};
+  uint8_t* keep {nullptr};
+  size_t nb_rows {0};
+  size_t nb_samples {0};
+
+  count_type* column(size_t s) { return counts + s * nb_rows; }
+};
+
 class IMergePlugin
 {
 public:
@@ -23,6 +44,46 @@ public:
   virtual bool process_kmer(const uint64_t* kmer_data, std::vector<typename selectC<DMAX_C>::type>& count_vector) { return true; }
   virtual bool process_hash(uint64_t h, std::vector<typename selectC<DMAX_C>::type>& count_vector) { return true; }
 
+  // v2 interface: a plugin returning a block size > 0 receives the rows by blocks of at most
+  // block_size() rows through process_kmer_block/process_hash_block, instead of one virtual
+  // call per row. The default implementations forward each row to the v1 interface.
+  virtual size_t block_size() const { return 0; }
+
+  virtual void process_kmer_block(MergeBlock& block)
+  {
+    std::vector<MergeBlock::count_type> row(block.nb_samples);
+    for (size_t r=0; r<block.nb_rows; r++)
+    {
+      gather(block, r, row);
+      block.keep[r] = process_kmer(block.kmers + r * block.kmer_slots, row);
+      scatter(block, r, row);
+    }
+  }
+
+  virtual void process_hash_block(MergeBlock& block)
+  {
+    std::vector<MergeBlock::count_type> row(block.nb_samples);
+    for (size_t r=0; r<block.nb_rows; r++)
+    {
+      gather(block, r, row);
+      block.keep[r] = process_hash(block.hashes[r], row);
+      scatter(block, r, row);
+    }
+  }
+
+private:
+  static void gather(MergeBlock& block, size_t r, std::vector<MergeBlock::count_type>& row)
+  {
+    for (size_t s=0; s<block.nb_samples; s++)
+      row[s] = block.counts[s * block.nb_rows + r];
+  }
+
+  static void scatter(MergeBlock& block, size_t r, const std::vector<MergeBlock::count_type>& row)
+  {
+    for (size_t s=0; s<block.nb_samples; s++)
+      block.counts[s * block.nb_rows + r] = row[s];
+  }
+
 protected:
   std::string m_output_directory;
   size_t m_kmer_size;
@@ -2,6 +2,7 @@
 #include <string>
 #include <dlfcn.h>
 #include <filesystem>
+#include <mutex>
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
@@ -103,8 +104,11 @@ public:
 
   static PluginManager<P>& get() { static PluginManager<P> pm; return pm;}
 
+  // Creates a configured plugin instance. Merge tasks call it concurrently, each task owns
+  // its instance, so a plugin only has to be thread-safe across instances.
   P* get_plugin()
   {
+    std::lock_guard<std::mutex> lock(m_mutex);
     P* p = m_load_plugin();
     p->configure(m_config);
     return p;
@@ -112,6 +116,7 @@ public:
 
   void destroy_plugin(P* p)
   {
+    std::lock_guard<std::mutex> lock(m_mutex);
     m_destroy_plugin(p);
   }
 
@@ -125,6 +130,7 @@ private:
     P* (*m_load_plugin)() {nullptr};
     void (*m_destroy_plugin)(P*) {nullptr};
     std::string m_plugin_name;
+    std::mutex m_mutex;
 };
 
 }
@@ -0,0 +1,306 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+#include <memory>
+#include <atomic>
+#include <thread>
+
+#include <kmtricks/histogram.hpp>
+
+namespace km {
+
+// Finalizer of MurmurHash3, the sketches need uniform 64-bit values.
+inline uint64_t sketch_hash(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// Hash of a k-mer stored on n 64-bit words.
+inline uint64_t sketch_hash(const uint64_t* data, size_t n)
+{
+  uint64_t h = sketch_hash(data[0]);
+  for (size_t i=1; i<n; i++)
+    h = sketch_hash(h ^ data[i]);
+  return h;
+}
+
+// Distinct count estimation with 2^p registers.
+class HyperLogLog
+{
+public:
+  HyperLogLog(uint8_t p = 12) : m_p(p), m_regs(size_t{1} << p, 0) {}
+
+  void add(uint64_t h)
+  {
+    size_t idx = h >> (64 - m_p);
+    // The guard bit bounds the rank to 64 - p + 1.
+    uint64_t w = (h << m_p) | (uint64_t{1} << (m_p - 1));
+    uint8_t rank = __builtin_clzll(w) + 1;
+    if (rank > m_regs[idx])
+      m_regs[idx] = rank;
+  }
+
+  void merge(const HyperLogLog& other)
+  {
+    for (size_t i=0; i<m_regs.size(); i++)
+      m_regs[i] = std::max(m_regs[i], other.m_regs[i]);
+  }
+
+  double estimate() const
+  {
+    double m = m_regs.size();
+    double sum = 0;
+    size_t zeros = 0;
+    for (auto r : m_regs)
+    {
+      sum += std::ldexp(1.0, -r);
+      zeros += r == 0;
+    }
+    double e = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+    // Linear counting for small cardinalities, 64-bit hashes do not need a large range correction.
+    if (e <= 2.5 * m && zeros)
+      e = m * std::log(m / zeros);
+    return e;
+  }
+
+  uint8_t p() const { return m_p; }
+  std::vector<uint8_t>& registers() { return m_regs; }
+  const std::vector<uint8_t>& registers() const { return m_regs; }
+
+private:
+  uint8_t m_p;
+  std::vector<uint8_t> m_regs;
+};
+
+/*
+  MinHash sketch: keeps the hashes below 2^64/scale (FracMinHash), and with size > 0, only the
+  size smallest ones (bottom-k). scale = 1 and size > 0 gives a plain bottom-k sketch.
+  Hashes are buffered, compact() has to be called before reading the sketch.
+*/
+class MinHash
+{
+public:
+  MinHash(uint64_t scale = 1000, size_t size = 0)
+    : m_scale(std::max<uint64_t>(scale, 1)), m_size(size), m_bound(scale_bound())
+  {}
+
+  void add(uint64_t h)
+  {
+    if (h <= m_bound)
+    {
+      m_hashes.push_back(h);
+      if (m_size && m_hashes.size() >= 2 * m_size)
+        compact();
+    }
+  }
+
+  void merge(const MinHash& other)
+  {
+    m_hashes.insert(m_hashes.end(), other.m_hashes.begin(), other.m_hashes.end());
+    compact();
+  }
+
+  // Sorts and dedups the hashes, a full bottom-k sketch then discards the hashes above its last one.
+  void compact()
+  {
+    std::sort(m_hashes.begin(), m_hashes.end());
+    m_hashes.erase(std::unique(m_hashes.begin(), m_hashes.end()), m_hashes.end());
+    if (m_size && m_hashes.size() >= m_size)
+    {
+      m_hashes.resize(m_size);
+      m_bound = m_hashes.back();
+    }
+  }
+
+  // Largest hash value covered by the sketch.
+  uint64_t bound() const { return m_bound; }
+  uint64_t scale() const { return m_scale; }
+  size_t size() const { return m_size; }
+
+  std::vector<uint64_t>& hashes() { return m_hashes; }
+  const std::vector<uint64_t>& hashes() const { return m_hashes; }
+
+private:
+  uint64_t scale_bound() const { return std::numeric_limits<uint64_t>::max() / m_scale; }
+
+private:
+  uint64_t m_scale;
+  size_t m_size;
+  uint64_t m_bound;
+  std::vector<uint64_t> m_hashes;
+};
+
+// Both sketches are compared on the hashes below the smallest of their bounds.
+struct MinHashCmp
+{
+  size_t inter {0};
+  size_t uni {0};
+  size_t a {0};
+  size_t b {0};
+
+  MinHashCmp(const MinHash& x, const MinHash& y)
+  {
+    uint64_t bound = std::min(x.bound(), y.bound());
+    auto i = x.hashes().begin(), ie = std::upper_bound(i, x.hashes().end(), bound);
+    auto j = y.hashes().begin(), je = std::upper_bound(j, y.hashes().end(), bound);
+    a = ie - i; b = je - j;
+    while (i != ie && j != je)
+    {
+      if (*i < *j) i++;
+      else if (*j < *i) j++;
+      else { inter++; i++; j++; }
+    }
+    uni = a + b - inter;
+  }
+
+  double jaccard() const { return uni ? static_cast<double>(inter) / uni : 0.0; }
+  // Fraction of x contained in y.
+  double containment() const { return a ? static_cast<double>(inter) / a : 0.0; }
+};
+
+// Mash distance of a Jaccard index between k-mer sets.
+inline double mash_distance(double jaccard, size_t kmer_size)
+{
+  if (jaccard <= 0)
+    return 1.0;
+  if (jaccard >= 1)
+    return 0.0;
+  return std::min(1.0, -std::log(2.0 * jaccard / (1.0 + jaccard)) / kmer_size);
+}
+
+// Sketches updated by a single thread.
+class SketchShard
+{
+  friend class KSketch;
+public:
+  SketchShard(uint8_t p, uint64_t scale, size_t size) : m_hll(p), m_mh(scale, size) {}
+
+  void add(uint64_t h)
+  {
+    m_hll.add(h);
+    m_mh.add(h);
+  }
+
+private:
+  HyperLogLog m_hll;
+  MinHash m_mh;
+  std::thread::id m_owner;
+  SketchShard* m_next {nullptr};
+};
+
+// Cardinality and similarity sketches of a sample, fed with the solid k-mers during counting.
+class KSketch
+{
+public:
+  KSketch(int idx, size_t ksize, uint8_t p = 12, uint64_t scale = 1000, size_t size = 0)
+    : m_idx(idx), m_ksize(ksize), m_hll(p), m_mh(scale, size)
+  {}
+
+  KSketch(const KSketch&) = delete;
+  KSketch& operator=(const KSketch&) = delete;
+
+  ~KSketch()
+  {
+    for (SketchShard* s = m_shards.load(); s;)
+    {
+      SketchShard* next = s->m_next;
+      delete s;
+      s = next;
+    }
+  }
+
+  // Single-threaded update, concurrent updates go through shard().
+  void add(uint64_t h)
+  {
+    m_hll.add(h);
+    m_mh.add(h);
+  }
+
+  // Shard of the calling thread, see KHist::shard().
+  SketchShard& shard()
+  {
+    std::thread::id id = std::this_thread::get_id();
+    for (SketchShard* s = m_shards.load(std::memory_order_acquire); s; s = s->m_next)
+      if (s->m_owner == id)
+        return *s;
+
+    SketchShard* s = new SketchShard(m_hll.p(), m_mh.scale(), m_mh.size());
+    s->m_owner = id;
+    s->m_next = m_shards.load(std::memory_order_relaxed);
+    while (!m_shards.compare_exchange_weak(s->m_next, s, std::memory_order_release,
+                                           std::memory_order_relaxed));
+    return *s;
+  }
+
+  // Folds the shards into the sketch, once all the updates are done.
+  void reduce()
+  {
+    SketchShard* s = m_shards.exchange(nullptr, std::memory_order_acq_rel);
+    while (s)
+    {
+      m_hll.merge(s->m_hll);
+      m_mh.hashes().insert(m_mh.hashes().end(), s->m_mh.hashes().begin(), s->m_mh.hashes().end());
+      SketchShard* next = s->m_next;
+      delete s;
+      s = next;
+    }
+    m_mh.compact();
+  }
+
+  double cardinality() const { return m_hll.estimate(); }
+
+  int idx() const { return m_idx; }
+  size_t ksize() const { return m_ksize; }
+
+  HyperLogLog& hll() { return m_hll; }
+  const HyperLogLog& hll() const { return m_hll; }
+  MinHash& minhash() { return m_mh; }
+  const MinHash& minhash() const { return m_mh; }
+
+private:
+  int m_idx {0};
+  size_t m_ksize {0};
+  HyperLogLog m_hll;
+  MinHash m_mh;
+  std::atomic<SketchShard*> m_shards {nullptr};
+};
+
+using sketch_t = std::shared_ptr<KSketch>;
+
+// Reduces the shards of the sketches, the sketches are spread over nb_threads threads.
+inline void reduce_sketches(std::vector<sketch_t>& sketches, size_t nb_threads)
+{
+  parallel_for_each(sketches.size(), nb_threads, [&sketches](size_t i) {
+    if (sketches[i])
+      sketches[i]->reduce();
+  });
+}
+
+};
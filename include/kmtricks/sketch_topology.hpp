@@ -0,0 +1,317 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <queue>
+#include <string>
+#include <fstream>
+#include <numeric>
+#include <limits>
+#include <tuple>
+#include <cstdint>
+
+#include <fmt/format.h>
+#include <bloom_filter_file.h>
+
+#include <kmtricks/exceptions.hpp>
+#include <kmtricks/utils.hpp>
+#include <kmtricks/histogram.hpp>
+
+namespace km {
+
+/*
+  One-permutation MinHash of the set bits of a Bloom filter window: the window is split into bins
+  and each bin keeps the offset of its first set bit. Bit positions are already hash values, and
+  the signature of the union of two filters is the element-wise minimum of their signatures.
+*/
+class FilterSignature
+{
+public:
+  static constexpr uint32_t empty = std::numeric_limits<uint32_t>::max();
+
+  FilterSignature(size_t nb_bins = 0) : m_bins(nb_bins, empty) {}
+
+  void set(size_t bin, uint32_t offset)
+  {
+    m_bins[bin] = std::min(m_bins[bin], offset);
+  }
+
+  void merge(const FilterSignature& other)
+  {
+    for (size_t i=0; i<m_bins.size(); i++)
+      m_bins[i] = std::min(m_bins[i], other.m_bins[i]);
+  }
+
+  // 1 - Jaccard estimate, over the bins filled in at least one of the signatures.
+  double distance(const FilterSignature& other) const
+  {
+    size_t filled = 0, match = 0;
+    for (size_t i=0; i<m_bins.size(); i++)
+    {
+      uint32_t x = m_bins[i], y = other.m_bins[i];
+      filled += std::min(x, y) != empty;
+      match += (x == y) & (x != empty);
+    }
+    return filled ? 1.0 - static_cast<double>(match) / filled : 1.0;
+  }
+
+  void clear() { std::vector<uint32_t>().swap(m_bins); }
+
+  const std::vector<uint32_t>& bins() const { return m_bins; }
+
+private:
+  std::vector<uint32_t> m_bins;
+};
+
+// sdsl bit vectors start with their size.
+constexpr uint64_t sdsl_size_bytes = 8;
+
+/*
+  Signature of the bits [lower, upper) of an uncompressed HowDeSBT filter, upper = 0 stands for
+  the whole filter. Only the window is read.
+*/
+inline FilterSignature filter_signature(const std::string& path, size_t nb_bins,
+                                        uint64_t lower = 0, uint64_t upper = 0)
+{
+  std::ifstream in(path, std::ios::in | std::ios::binary); check_fstream_good(path, in);
+  bffileheader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in || header.magic != bffileheaderMagic || header.numVectors < 1)
+    throw IOError(fmt::format("{} is not a HowDeSBT Bloom filter.", path));
+  if (header.info[0].compressor != bvcomp_uncompressed)
+    throw IOError(fmt::format("{} is compressed.", path));
+
+  if (upper == 0 || upper > header.numBits)
+    upper = header.numBits;
+  if (lower >= upper)
+    throw InputError(fmt::format("Empty bit window {}..{} for {}.", lower, upper, path));
+  if (nb_bins == 0)
+    throw InputError("Filter signatures need at least one bin.");
+
+  FilterSignature sig(nb_bins);
+  // Offsets in a bin are stored on 32 bits, FilterSignature::empty excluded.
+  uint64_t width = (upper - lower + nb_bins - 1) / nb_bins;
+  if (width > std::numeric_limits<uint32_t>::max())
+    throw InputError(fmt::format("Bins of {} bits for {}, use more bins.", width, path));
+  uint64_t first_word = lower / 64, end_word = (upper + 63) / 64;
+
+  in.seekg(header.info[0].offset + sdsl_size_bytes + first_word * sizeof(uint64_t));
+  std::vector<uint64_t> words(std::min<uint64_t>(end_word - first_word, 8192));
+  for (uint64_t w = first_word; w < end_word;)
+  {
+    size_t n = std::min<uint64_t>(words.size(), end_word - w);
+    in.read(reinterpret_cast<char*>(words.data()), n * sizeof(uint64_t));
+    if (!in)
+      throw IOError(fmt::format("{} is truncated.", path));
+    for (size_t i=0; i<n; i++, w++)
+    {
+      for (uint64_t word = words[i]; word; word &= word - 1)
+      {
+        uint64_t p = w * 64 + __builtin_ctzll(word);
+        if (p < lower)
+          continue;
+        if (p >= upper)
+          break;
+        sig.set((p - lower) / width, (p - lower) % width);
+      }
+    }
+  }
+  return sig;
+}
+
+/*
+  Binary tree built by NN-chain agglomeration of filter signatures. As in ClusterCommand, a new
+  node stands for the union of its children, here the union of their signatures, so the memory
+  is linear in the number of leaves.
+*/
+class SketchTopology
+{
+  struct Candidate
+  {
+    double d {std::numeric_limits<double>::infinity()};
+    uint32_t height {std::numeric_limits<uint32_t>::max()};
+    uint32_t node {std::numeric_limits<uint32_t>::max()};
+
+    bool operator<(const Candidate& c) const
+    {
+      return std::tie(d, height, node) < std::tie(c.d, c.height, c.node);
+    }
+  };
+
+public:
+  SketchTopology(std::vector<FilterSignature>&& leaves, size_t nb_threads = 1)
+    : m_nb_leaves(leaves.size()), m_nb_threads(std::max<size_t>(nb_threads, 1)),
+      m_sigs(std::move(leaves)), m_height(m_nb_leaves, 0)
+  {}
+
+  void build()
+  {
+    if (m_nb_leaves < 2)
+      throw PipelineError("At least two samples are required to compute a topology.");
+
+    m_sigs.reserve(2 * m_nb_leaves - 1);
+    std::vector<uint32_t> active(m_nb_leaves);
+    std::iota(active.begin(), active.end(), 0);
+    std::vector<uint32_t> pos(2 * m_nb_leaves - 1);
+    std::iota(pos.begin(), pos.begin() + m_nb_leaves, 0);
+
+    std::vector<bool> is_active(2 * m_nb_leaves - 1, false);
+    std::fill(is_active.begin(), is_active.begin() + m_nb_leaves, true);
+
+    std::vector<uint32_t> chain;
+    while (active.size() > 1)
+    {
+      if (chain.empty())
+        chain.push_back(active[0]);
+
+      uint32_t top = chain.back();
+      Candidate best = nearest(top, active);
+      // Ties go to the previous node of the chain, the chain always ends on a reciprocal pair.
+      if (chain.size() > 1)
+      {
+        uint32_t prev = chain[chain.size() - 2];
+        if (m_sigs[top].distance(m_sigs[prev]) <= best.d)
+          best.node = prev;
+      }
+
+      // The union of two signatures can be closer to a node than its children were (the
+      // distance is not reducible), so the part of the chain built before a merge may be stale
+      // and lead back to a node it already holds. The chain is then cut back to that node.
+      auto it = std::find(chain.begin(), chain.end(), best.node);
+      if (chain.size() > 1 && best.node == chain[chain.size() - 2])
+      {
+        chain.pop_back(); chain.pop_back();
+        uint32_t node = merge(top, best.node);
+        for (uint32_t c : {top, best.node})
+        {
+          is_active[c] = false;
+          pos[active.back()] = pos[c];
+          active[pos[c]] = active.back();
+          active.pop_back();
+        }
+        is_active[node] = true;
+        pos[node] = active.size();
+        active.push_back(node);
+        chain.erase(std::remove_if(chain.begin(), chain.end(),
+                                   [&is_active](uint32_t n) { return !is_active[n]; }),
+                    chain.end());
+      }
+      else if (it != chain.end())
+      {
+        chain.erase(it + 1, chain.end());
+      }
+      else
+      {
+        chain.push_back(best.node);
+      }
+    }
+    m_root = active[0];
+  }
+
+  // Writes the topology in the format of ClusterCommand, internal nodes are named
+  // {prefix}{number}.bf and numbered level by level from the root.
+  void write(std::ostream& out, const std::vector<std::string>& leaves,
+             const std::string& prefix) const
+  {
+    std::vector<uint32_t> number(m_children.size());
+    std::queue<uint32_t> queue; queue.push(m_root);
+    uint32_t next = 1;
+    while (!queue.empty())
+    {
+      uint32_t node = queue.front(); queue.pop();
+      if (node < m_nb_leaves)
+        continue;
+      number[node - m_nb_leaves] = next++;
+      for (uint32_t c : m_children[node - m_nb_leaves])
+        queue.push(c);
+    }
+
+    std::vector<std::pair<uint32_t, size_t>> stack {{m_root, 0}};
+    while (!stack.empty())
+    {
+      auto [node, level] = stack.back(); stack.pop_back();
+      out << std::string(level, '*');
+      if (node < m_nb_leaves)
+      {
+        out << leaves[node] << "\n";
+        continue;
+      }
+      out << prefix << number[node - m_nb_leaves] << ".bf\n";
+      stack.emplace_back(m_children[node - m_nb_leaves][1], level + 1);
+      stack.emplace_back(m_children[node - m_nb_leaves][0], level + 1);
+    }
+  }
+
+  size_t nb_leaves() const { return m_nb_leaves; }
+  uint32_t root() const { return m_root; }
+  uint32_t height(uint32_t node) const { return m_height[node]; }
+  // Children of an internal node, node >= nb_leaves().
+  const std::array<uint32_t, 2>& children(uint32_t node) const
+  {
+    return m_children[node - m_nb_leaves];
+  }
+
+private:
+  Candidate nearest(uint32_t node, const std::vector<uint32_t>& active) const
+  {
+    size_t nb_chunks = active.size() >= 4096 ? m_nb_threads : 1;
+    size_t chunk = (active.size() + nb_chunks - 1) / nb_chunks;
+    std::vector<Candidate> best(nb_chunks);
+    parallel_for_each(nb_chunks, nb_chunks, [&](size_t c) {
+      size_t end = std::min(active.size(), (c + 1) * chunk);
+      for (size_t i = c * chunk; i < end; i++)
+      {
+        uint32_t other = active[i];
+        if (other == node)
+          continue;
+        Candidate cand {m_sigs[node].distance(m_sigs[other]), m_height[other], other};
+        if (cand < best[c])
+          best[c] = cand;
+      }
+    });
+    return *std::min_element(best.begin(), best.end());
+  }
+
+  uint32_t merge(uint32_t a, uint32_t b)
+  {
+    if (b < a)
+      std::swap(a, b);
+    FilterSignature sig = m_sigs[a];
+    sig.merge(m_sigs[b]);
+    m_sigs[a].clear();
+    m_sigs[b].clear();
+    m_sigs.push_back(std::move(sig));
+    m_height.push_back(std::max(m_height[a], m_height[b]) + 1);
+    m_children.push_back({a, b});
+    return m_sigs.size() - 1;
+  }
+
+private:
+  size_t m_nb_leaves {0};
+  size_t m_nb_threads {1};
+  std::vector<FilterSignature> m_sigs;
+  std::vector<uint32_t> m_height;
+  std::vector<std::array<uint32_t, 2>> m_children;
+  uint32_t m_root {0};
+};
+
+};
@@ -30,6 +30,7 @@
 #include <gatb/kmer/impl/Model.hpp>
 
 #include <kmtricks/io/fof.hpp>
+#include <kmtricks/io/fastx.hpp>
 #include <kmtricks/kmdir.hpp>
 #include <kmtricks/gatb/count_processor.hpp>
 #include <kmtricks/gatb/sorting_count.hpp>
@@ -38,6 +39,7 @@
 #include <kmtricks/hash.hpp>
 #include <kmtricks/howde_utils.hpp>
 #include <kmtricks/gatb/gatb_utils.hpp>
+#include <kmtricks/gatb/sample_bank.hpp>
 #include <kmtricks/itask.hpp>
 #include <kmtricks/repartition.hpp>
 
@@ -55,17 +57,26 @@ class ConfigTask : public ITask
 {
 public:
   ConfigTask(const std::string& path, IProperties* props, uint64_t bloom_size,
-             uint32_t partitions)
-    : ITask(0), m_path(path), m_props(props), m_bloom_size(bloom_size), m_nb_partitions(partitions)
+             uint32_t partitions, uint32_t nb_threads = 1)
+    : ITask(0), m_path(path), m_props(props), m_bloom_size(bloom_size), m_nb_partitions(partitions),
+      m_nb_threads(nb_threads)
   {}
 
+  std::string name() const override { return "config"; }
+  std::string stage() const override { return "config"; }
+  std::vector<std::string> outputs() const override
+  {
+    return {KmDir::get().m_config_storage + "_gatb", KmDir::get().m_hash_win};
+  }
+
   void preprocess() {}
   void postprocess() {}
   void exec()
   {
     spdlog::debug("[exec] - ConfigTask");
     spdlog::info("{} samples found ({} read files).", KmDir::get().m_fof.size(), KmDir::get().m_fof.total());
-    IBank* bank = Bank::open(KmDir::get().m_fof.get_all()); LOCAL(bank);
+    // Only the estimates of the files are needed here, they are computed in parallel.
+    IBank* bank = new SampleBank(KmDir::get().m_fof, 0, 0, m_nb_threads); LOCAL(bank);
     Storage* config_storage =
       StorageFactory(STORAGE_FILE).create(KmDir::get().m_config_storage, true, false);
     LOCAL(config_storage);
@@ -93,6 +104,7 @@ private:
   IProperties* m_props;
   uint64_t m_bloom_size;
   uint32_t m_nb_partitions;
+  uint32_t m_nb_threads;
 };
 
 void check_repart_compatibility(Configuration& c1, Configuration& c2,
@@ -112,8 +124,20 @@ template<size_t span>
 class RepartTask : public ITask
 {
 public:
-  RepartTask(const std::string& path, const std::string& from = "")
-    : ITask(1), m_path(path), m_from(from) {}
+  RepartTask(const std::string& path, const std::string& from = "", uint32_t sample_reads = 0,
+             uint64_t seed = 0, uint32_t nb_threads = 1)
+    : ITask(1), m_path(path), m_from(from), m_sample_reads(sample_reads), m_seed(seed),
+      m_nb_threads(nb_threads) {}
+
+  std::string name() const override { return "repart"; }
+  std::string stage() const override { return "repart"; }
+  std::vector<std::string> outputs() const override
+  {
+    std::vector<std::string> paths {KmDir::get().m_repart_storage + "_gatb"};
+    if (fs::exists(KmDir::get().m_minimizer_storage))
+      paths.push_back(KmDir::get().m_minimizer_storage);
+    return paths;
+  }
 
   void preprocess() {}
   void postprocess()
@@ -142,7 +166,9 @@ public:
     if (m_from.empty())
     {
       Fof fof(m_path);
-      IBank* bank = Bank::open(fof.get_all()); LOCAL(bank);
+      IBank* bank = m_sample_reads ? new SampleBank(fof, m_sample_reads, m_seed, m_nb_threads)
+                                   : Bank::open(fof.get_all());
+      LOCAL(bank);
       Storage* rep_store =
         StorageFactory(STORAGE_FILE).create(KmDir::get().m_repart_storage, true, false);
 
@@ -174,7 +200,9 @@ public:
 private:
   std::string m_path;
   std::string m_from;
-  int m_cores;
+  uint32_t m_sample_reads;
+  uint64_t m_seed;
+  uint32_t m_nb_threads;
   uint32_t m_nb_parts {0};
   uint32_t m_minim_size {0};
 };
@@ -183,13 +211,32 @@ template<size_t span>
 class SuperKTask : public ITask
 {
 public:
-  SuperKTask(const std::string& sample_id, bool lz4, std::vector<uint32_t>& partitions)
-    : ITask(2), m_sample_id(sample_id), m_lz4(lz4), m_partitions(partitions) {}
+  SuperKTask(const std::string& sample_id, bool lz4, std::vector<uint32_t>& partitions,
+             bool packed = false, uint32_t nb_threads = 1)
+    : ITask(2), m_sample_id(sample_id), m_lz4(lz4), m_partitions(partitions), m_packed(packed),
+      m_nb_threads(nb_threads) {}
 
-  void preprocess() {}
+  std::string name() const override { return fmt::format("superk S={}", m_sample_id); }
+  std::string stage() const override { return "superk"; }
+  std::vector<std::string> outputs() const override { return m_outputs; }
+
+  void preprocess()
+  {
+    if (Telemetry::get().enabled())
+    {
+      for (auto& f : bc::utils::split(KmDir::get().m_fof.get_files(m_sample_id), ','))
+        m_stats.add_read_file("reads", f);
+    }
+  }
 
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+    {
+      std::error_code ec;
+      for (auto& e : fs::directory_iterator(KmDir::get().get_superk_path(m_sample_id), ec))
+        m_stats.add_written_file("superk", e.path().string());
+    }
     this->exec_callback();
     this->m_finish = true;
     this->m_running = false;
@@ -200,7 +247,6 @@ public:
     spdlog::debug("[exec] - SuperKTask - S={}", m_sample_id);
     this->m_running = true;
 
-    IBank* bank = Bank::open(KmDir::get().m_fof.get_files(m_sample_id)); LOCAL(bank);
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
     Storage* repart_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_repart_storage);
     LOCAL(config_storage); LOCAL(repart_storage);
@@ -210,13 +256,19 @@ public:
 
     Repartitor repartitor(repart_storage->getGroup("repartition"));
 
+    // FASTA/FASTQ inputs are parsed by FastxReader, other formats go through a GATB bank.
+    // m_nb_threads threads inflate BGZF inputs.
+    std::string files = KmDir::get().m_fof.get_files(m_sample_id);
+    std::vector<std::string> paths = bc::utils::split(files, ',');
+    bool fastx = std::all_of(paths.begin(), paths.end(), FastxReader::is_fastx);
+
     std::unordered_set<int> pset;
     for (auto& p : m_partitions)
     {
       pset.insert(p);
     }
     SuperKStorageWriter* superk_storage = new SuperKStorageWriter(
-      KmDir::get().get_superk_path(m_sample_id), "skp", config._nb_partitions, m_lz4, pset);
+      KmDir::get().get_superk_path(m_sample_id), "skp", config._nb_partitions, m_lz4, pset, m_packed);
 
     typedef typename ::Kmer<span>::ModelCanonical ModelCanonical;
     typedef typename ::Kmer<span>::template ModelMinimizer <ModelCanonical> Model;
@@ -224,7 +276,6 @@ public:
     uint32_t* freq_order = nullptr;
     Model model(config._kmerSize, config._minim_size, typename ::Kmer<span>::ComparatorMinimizerFrequencyOrLex(), freq_order);
 
-    Iterator<Sequence>* itSeq = bank->iterator(); LOCAL(itSeq);
     BankStats bank_stats;
     PartiInfo<5> pinfo (config._nb_partitions, config._minim_size);
 
@@ -246,11 +297,29 @@ public:
                                                         pinfo,
                                                         superk_storage);
 
-      for (itSeq->first(); !itSeq->isDone(); itSeq->next())
+      if (fastx)
+      {
+        Sequence sequence(Data::ASCII);
+        for (auto& path : paths)
+        {
+          FastxReader reader(path, 1 << 20, m_nb_threads);
+          while (reader.next())
+          {
+            sequence.getData().setRef(reader.seq(), reader.size());
+            fill_partitions(sequence);
+          }
+        }
+      }
+      else
       {
-        fill_partitions(itSeq->item());
+        IBank* bank = Bank::open(files); LOCAL(bank);
+        Iterator<Sequence>* itSeq = bank->iterator(); LOCAL(itSeq);
+        for (itSeq->first(); !itSeq->isDone(); itSeq->next())
+        {
+          fill_partitions(itSeq->item());
+        }
+        itSeq->finalize();
       }
-      itSeq->finalize();
     }
 
     progress->finish();
@@ -258,6 +327,10 @@ public:
     delete superk_storage;
     pinfo.saveInfoFile(KmDir::get().get_superk_path(m_sample_id));
     dump_pinfo(&pinfo, config._nb_partitions, KmDir::get().get_pinfos_path(m_sample_id));
+    for (auto& p : m_partitions)
+      m_stats.m_kmers_out += pinfo.getNbKmer(p);
+    for (auto& e : fs::directory_iterator(KmDir::get().get_superk_path(m_sample_id)))
+      m_outputs.push_back(e.path().string());
     spdlog::debug("[done] - SuperKTask - S={}", m_sample_id);
   }
 
@@ -265,6 +338,9 @@ private:
   std::string m_sample_id;
   bool m_lz4;
   std::vector<uint32_t>& m_partitions;
+  bool m_packed;
+  uint32_t m_nb_threads;
+  std::vector<std::string> m_outputs;
 };
 
 
@@ -279,10 +355,26 @@ public:
   LoganRepartTask(const std::string& sample_id, uint32_t iid, const std::string& utg_file, uint32_t abundance_min, bool lz4, std::vector<uint32_t>& partitions)
     : ITask(2), m_sample_id(sample_id), m_iid(iid), m_utg_file(utg_file), m_ab_min(abundance_min), m_lz4(lz4), m_partitions(partitions) {}
 
-  void preprocess() {}
+  std::string name() const override { return fmt::format("logan-repart S={}", m_sample_id); }
+  std::string stage() const override { return "superk"; }
+
+  void preprocess()
+  {
+    if (Telemetry::get().enabled())
+    {
+      for (auto& f : bc::utils::split(KmDir::get().m_fof.get_files(m_sample_id), ','))
+        m_stats.add_read_file("unitigs", f);
+    }
+  }
 
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+    {
+      for (auto& p : m_partitions)
+        m_stats.add_written_file(
+          "kmer", KmDir::get().get_unsorted_count_part_path(m_sample_id, p, m_lz4, KM_FILE::KMER));
+    }
     this->exec_callback();
     this->m_finish = true;
     this->m_running = false;
@@ -341,6 +433,7 @@ public:
 
         auto count = abundance >= m_max_c ? m_max_c : static_cast<km_count_type>(abundance);
         writers[part_id]->template write_raw<MAX_C>(kmer.value().get_data(), count);
+        m_stats.m_kmers_out++;
       });
     }
   }
@@ -377,9 +470,20 @@ public:
       m_lz4(lz4)
    { }
 
-  void preprocess() {}
+  std::string name() const override { return fmt::format("logan-count S={} P={}", m_sample_id, m_part_id); }
+  std::string stage() const override { return "count"; }
+
+  void preprocess()
+  {
+    if (Telemetry::get().enabled())
+      m_stats.add_read_file(
+        "kmer", KmDir::get().get_unsorted_count_part_path(m_sample_id, m_part_id, m_lz4, KM_FILE::KMER));
+  }
+
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+      m_stats.add_written_file("kmer", m_path);
     if (m_clear) {
       Eraser::get().erase(KmDir::get().get_unsorted_count_part_path(m_sample_id, m_part_id, m_lz4, KM_FILE::KMER));
     }
@@ -401,6 +505,9 @@ public:
       ckmers.emplace_back(kmer,count);
     }
 
+    m_stats.m_kmers_in = ckmers.size();
+    m_stats.m_kmers_out = ckmers.size();
+
     // sort k-mers
     std::sort(ckmers.begin(),ckmers.end());
 
@@ -436,7 +543,8 @@ public:
             parti_info_t pinfo,
             uint32_t part_id, uint32_t sample_id,
             uint32_t kmer_size, uint32_t abundance_min, bool lz4,
-            hist_t hist = nullptr, bool clear = false)
+            hist_t hist = nullptr, bool clear = false, uint32_t nb_threads = 1,
+            sketch_t sketch = nullptr)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -447,18 +555,39 @@ public:
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
       m_lz4(lz4),
-      m_hist(hist)
+      m_hist(hist),
+      m_nb_threads(nb_threads),
+      m_sketch(sketch)
    {
    }
 
-  void preprocess() {}
+  std::string name() const override
+  {
+    return fmt::format("count S={} P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
+  }
+  std::string stage() const override { return "count"; }
+  std::vector<std::string> outputs() const override { return {m_path}; }
+  uint64_t memory() const override
+  {
+    return get_required_memory<span>(m_pinfo->getNbKmer(m_part_id)) + split_memory();
+  }
+
+  void preprocess()
+  {
+    if (Telemetry::get().enabled())
+    {
+      m_stats.add_read("superk", m_superk_storage->getDiskSize(m_part_id));
+      m_stats.m_kmers_in = m_pinfo->getNbKmer(m_part_id);
+    }
+  }
+
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+      m_stats.add_written_file("kmer", m_path);
     if (this->m_clear)
     {
-      m_superk_storage->closeFile(m_part_id);
-      //m_superk_storage->eraseFile(m_part_id);
-      Eraser::get().erase(m_superk_storage->getFileName(m_part_id));
+      m_superk_storage->clearFile(m_part_id);
     }
     this->m_finish = true;
     this->exec_callback();
@@ -480,17 +609,29 @@ public:
     KmerCountProcessor<span, MAX_C>* processor(new KmerCountProcessor<span, MAX_C>(m_kmer_size,
                                                                                     m_ab_min,
                                                                                     writer,
-                                                                                    m_hist));
-
-    KmerPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id,
-                                                     m_kmer_size, pool, m_superk_storage.get());
+                                                                                    m_hist,
+                                                                                    m_sketch));
 
-    partition_counter.execute();
+    {
+      BorrowedThreads extra(*this, m_nb_threads - 1);
+      KmerPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id,
+                                                       m_kmer_size, pool, m_superk_storage.get(),
+                                                       extra.size() + 1);
+      partition_counter.execute();
+    }
     pool.free_all();
     delete processor;
     spdlog::debug("[done] - CountTask - S={}, P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
   }
 private:
+  // Upper bound of the k-mers buffered by the extra threads of a split partition.
+  uint64_t split_memory() const
+  {
+    if (m_nb_threads <= 1)
+      return 0;
+    return m_pinfo->getNbKmer(m_part_id) * sizeof(std::pair<typename ::Kmer<span>::Type, uint32_t>);
+  }
+
   std::string m_path;
   Configuration& m_config;
   //Storage& m_superk_storage;
@@ -503,6 +644,8 @@ private:
   uint32_t m_ab_min;
   bool m_lz4;
   hist_t m_hist;
+  uint32_t m_nb_threads;
+  sketch_t m_sketch;
 };
 
 template<size_t span, size_t MAX_C, typename Storage>
@@ -516,7 +659,8 @@ public:
                 parti_info_t pinfo,
                 uint32_t part_id, uint32_t sample_id, uint64_t window,
                 uint32_t kmer_size, uint32_t abundance_min, bool lz4,
-                hist_t hist = nullptr, bool clear = false)
+                hist_t hist = nullptr, bool clear = false, uint32_t nb_threads = 1,
+                sketch_t sketch = nullptr)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -528,17 +672,40 @@ public:
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
       m_lz4(lz4),
-      m_hist(hist)
+      m_hist(hist),
+      m_nb_threads(nb_threads),
+      m_sketch(sketch)
    {
    }
 
-  void preprocess() {}
+  std::string name() const override
+  {
+    return fmt::format("hash-count S={} P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
+  }
+  std::string stage() const override { return "count"; }
+  std::vector<std::string> outputs() const override { return {m_path}; }
+  uint64_t memory() const override
+  {
+    size_t nbk = m_pinfo->getNbKmer(m_part_id);
+    return nbk > 0 ? get_required_memory_hash<span>(nbk) : 0;
+  }
+
+  void preprocess()
+  {
+    if (Telemetry::get().enabled())
+    {
+      m_stats.add_read("superk", m_superk_storage->getDiskSize(m_part_id));
+      m_stats.m_kmers_in = m_pinfo->getNbKmer(m_part_id);
+    }
+  }
+
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+      m_stats.add_written_file("hash", m_path);
     if (this->m_clear)
     {
-      m_superk_storage->closeFile(m_part_id);
-      Eraser::get().erase(m_superk_storage->getFileName(m_part_id));
+      m_superk_storage->clearFile(m_part_id);
     }
     this->m_finish = true;
     this->exec_callback();
@@ -561,15 +728,18 @@ public:
     HashCountProcessor<span, MAX_C, 32768>* processor(new HashCountProcessor<span, MAX_C, 32768>(m_kmer_size,
                                                                                                  m_ab_min,
                                                                                                  writer,
-                                                                                                 m_hist));
+                                                                                                 m_hist,
+                                                                                                 m_sketch));
 
     if (nbk > 0)
     {
       MemAllocator pool(1);
       pool.reserve(req_mem);
 
+      BorrowedThreads extra(*this, m_nb_threads - 1);
       HashPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
-                                                       pool, m_superk_storage.get(), m_window);
+                                                       pool, m_superk_storage.get(), m_window,
+                                                       extra.size() + 1);
 
       partition_counter.execute();
       pool.free_all();
@@ -592,6 +762,8 @@ private:
   uint32_t m_ab_min;
   hist_t m_hist;
   bool m_lz4;
+  uint32_t m_nb_threads;
+  sketch_t m_sketch;
 };
 
 template<size_t span, size_t MAX_C, typename Storage>
@@ -605,7 +777,8 @@ public:
                 parti_info_t pinfo,
                 uint32_t part_id, uint32_t sample_id, uint64_t window,
                 uint32_t kmer_size, uint32_t abundance_min, bool lz4,
-                hist_t hist = nullptr, bool clear = false)
+                hist_t hist = nullptr, bool clear = false, uint32_t nb_threads = 1,
+                sketch_t sketch = nullptr)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -617,18 +790,40 @@ public:
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
       m_lz4(lz4),
-      m_hist(hist)
+      m_hist(hist),
+      m_nb_threads(nb_threads),
+      m_sketch(sketch)
    {
    }
 
-  void preprocess() {}
+  std::string name() const override
+  {
+    return fmt::format("hash-vec-count S={} P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
+  }
+  std::string stage() const override { return "count"; }
+  std::vector<std::string> outputs() const override { return {m_path}; }
+  uint64_t memory() const override
+  {
+    size_t nbk = m_pinfo->getNbKmer(m_part_id);
+    return (nbk > 0 ? get_required_memory_hash<span>(nbk) : 0) + NBYTES(m_window);
+  }
+
+  void preprocess()
+  {
+    if (Telemetry::get().enabled())
+    {
+      m_stats.add_read("superk", m_superk_storage->getDiskSize(m_part_id));
+      m_stats.m_kmers_in = m_pinfo->getNbKmer(m_part_id);
+    }
+  }
+
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+      m_stats.add_written_file("vector", m_path);
     if (this->m_clear)
     {
-      m_superk_storage->closeFile(m_part_id);
-      //m_superk_storage->eraseFile(m_part_id);
-      Eraser::get().erase(m_superk_storage->getFileName(m_part_id));
+      m_superk_storage->clearFile(m_part_id);
     }
     this->m_finish = true;
     this->exec_callback();
@@ -650,15 +845,17 @@ public:
                                                                  m_ab_min,
                                                                  writer,
                                                                  m_hist,
-                                                                 m_window));
+                                                                 m_window,
+                                                                 m_sketch));
 
     if (nbk > 0)
     {
       MemAllocator pool(1);
       pool.reserve(get_required_memory_hash<span>(nbk));
 
+      BorrowedThreads extra(*this, m_nb_threads - 1);
       HashPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
-                                            pool, m_superk_storage.get(), m_window);
+                                            pool, m_superk_storage.get(), m_window, extra.size() + 1);
 
       partition_counter.execute();
       pool.free_all();
@@ -681,6 +878,8 @@ private:
   uint32_t m_ab_min;
   bool m_lz4;
   hist_t m_hist;
+  uint32_t m_nb_threads;
+  sketch_t m_sketch;
 };
 
 template<size_t span, size_t MAX_C, typename Storage>
@@ -694,7 +893,8 @@ public:
             parti_info_t pinfo,
             uint32_t part_id, uint32_t sample_id,
             uint32_t kmer_size, uint32_t abundance_min,
-            hist_t hist = nullptr, bool clear = false)
+            hist_t hist = nullptr, bool clear = false, uint32_t nb_threads = 1,
+            sketch_t sketch = nullptr)
     : ITask(3, clear),
       m_path(path),
       m_config(config),
@@ -704,18 +904,40 @@ public:
       m_sample_id(sample_id),
       m_kmer_size(kmer_size),
       m_ab_min(abundance_min),
-      m_hist(hist)
+      m_hist(hist),
+      m_nb_threads(nb_threads),
+      m_sketch(sketch)
    {
    }
 
-  void preprocess() {}
+  std::string name() const override
+  {
+    return fmt::format("kff-count S={} P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
+  }
+  std::string stage() const override { return "count"; }
+  std::vector<std::string> outputs() const override { return {m_path}; }
+  uint64_t memory() const override
+  {
+    return get_required_memory<span>(m_pinfo->getNbKmer(m_part_id)) + split_memory() +
+           KffWriter<span, MAX_C>::memory(m_pinfo->getNbKmer(m_part_id), m_kmer_size);
+  }
+
+  void preprocess()
+  {
+    if (Telemetry::get().enabled())
+    {
+      m_stats.add_read("superk", m_superk_storage->getDiskSize(m_part_id));
+      m_stats.m_kmers_in = m_pinfo->getNbKmer(m_part_id);
+    }
+  }
+
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+      m_stats.add_written_file("kff", m_path);
     if (this->m_clear)
     {
-      m_superk_storage->closeFile(m_part_id);
-      //m_superk_storage->eraseFile(m_part_id);
-      Eraser::get().erase(m_superk_storage->getFileName(m_part_id));
+      m_superk_storage->clearFile(m_part_id);
     }
     this->m_finish = true;
     this->exec_callback();
@@ -727,23 +949,32 @@ public:
 
     MemAllocator pool(1);
     pool.reserve(get_required_memory<span>(m_pinfo->getNbKmer(m_part_id)));
-    kff_w_t<DMAX_C> writer = std::make_shared<KffWriter<MAX_C>>(m_path, m_kmer_size);
-
-    KffCountProcessor<span, DMAX_C>* processor(new KffCountProcessor<span, MAX_C>(m_kmer_size,
-                                                                                  m_ab_min,
-                                                                                  writer,
-                                                                                  m_hist));
+    kff_w_t<span, MAX_C> writer = std::make_shared<KffWriter<span, MAX_C>>(
+      m_path, m_kmer_size, m_config._minim_size);
 
-    KmerPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
-                                                     pool, m_superk_storage.get());
+    auto* processor = new KmerCountProcessor<span, MAX_C, 8192, KffWriter<span, MAX_C>>(
+      m_kmer_size, m_ab_min, writer, m_hist, m_sketch);
 
-    partition_counter.execute();
+    {
+      BorrowedThreads extra(*this, m_nb_threads - 1);
+      KmerPartCounter<Storage, span> partition_counter(processor, m_pinfo.get(), m_part_id, m_kmer_size,
+                                                       pool, m_superk_storage.get(), extra.size() + 1);
+      partition_counter.execute();
+    }
     pool.free_all();
     delete processor;
+    writer->close();
 
     spdlog::debug("[done] - KffCountTask - S={}, P={}", KmDir::get().m_fof.get_id(m_sample_id), m_part_id);
   }
 private:
+  uint64_t split_memory() const
+  {
+    if (m_nb_threads <= 1)
+      return 0;
+    return m_pinfo->getNbKmer(m_part_id) * sizeof(std::pair<typename ::Kmer<span>::Type, uint32_t>);
+  }
+
   std::string m_path;
   Configuration& m_config;
   storage_t m_superk_storage;
@@ -753,8 +984,91 @@ private:
   uint32_t m_kmer_size;
   uint32_t m_ab_min;
   hist_t m_hist;
+  uint32_t m_nb_threads;
+  sketch_t m_sketch;
 };
 
+template<size_t MAX_C>
+void add_merge_stats(TaskStats& stats, const std::vector<std::string>& paths, const std::string& type,
+                     const std::string& out_path, MergeStatistics<MAX_C>* infos)
+{
+  if (!Telemetry::get().enabled())
+    return;
+  for (auto& p : paths)
+    stats.add_read_file(type, p);
+  stats.add_written_file("matrix", out_path);
+  for (size_t i=0; i<infos->get_non_solid().size(); i++)
+  {
+    stats.m_kmers_in += infos->get_non_solid()[i] + infos->get_unique_w_rescue()[i];
+    stats.m_kmers_out += infos->get_unique_w_rescue()[i];
+  }
+}
+
+template<typename Merger>
+void write_kmer_matrix(Merger& merger, MODE mode, FORMAT format, const std::string& out_path, bool lz4)
+{
+  if (mode == MODE::COUNT)
+  {
+    if (format == FORMAT::TEXT)
+      merger.write_as_text(out_path);
+    else if (format == FORMAT::BIN)
+      merger.write_as_bin(out_path, lz4);
+  }
+  else if (mode == MODE::PA)
+  {
+    if (format == FORMAT::TEXT)
+      merger.write_as_pa_text(out_path);
+    else if (format == FORMAT::BIN)
+      merger.write_as_pa(out_path, lz4);
+  }
+}
+
+template<typename Merger>
+void write_hash_matrix(Merger& merger, MODE mode, FORMAT format, const std::string& out_path,
+                       bool lz4, HashWindow& win, uint32_t part_id, uint32_t bw)
+{
+  if (mode == MODE::COUNT)
+  {
+    if (format == FORMAT::TEXT)
+      merger.write_as_text(out_path);
+    else if (format == FORMAT::BIN)
+      merger.write_as_bin(out_path, lz4);
+  }
+  else if (mode == MODE::PA)
+  {
+    if (format == FORMAT::TEXT)
+      merger.write_as_pa_text(out_path);
+    else if (format == FORMAT::BIN)
+      merger.write_as_pa(out_path, lz4);
+  }
+  else if (mode == MODE::BF)
+  {
+      merger.write_as_bf(out_path, win.get_lower(part_id), win.get_upper(part_id), false);
+  }
+  else if (mode == MODE::BFT)
+  {
+      merger.write_as_bft(out_path, win.get_lower(part_id), win.get_upper(part_id), false);
+  }
+  else if (mode == MODE::BFC)
+  {
+      merger.write_as_bfc(out_path, win.get_lower(part_id), win.get_upper(part_id), bw, false);
+  }
+}
+
+template<size_t MAX_C>
+void write_fpr(MergeStatistics<MAX_C>* infos, HashWindow& win, uint32_t part_id)
+{
+  std::string fpr_path = fmt::format("{}/{}", KmDir::get().m_fpr_storage, fmt::format("partition_{}.txt", part_id));
+  std::ofstream fp(fpr_path, std::ios::out); check_fstream_good(fpr_path, fp);
+
+  size_t m = win.get_window_size_bits();
+  for (auto& n : infos->get_unique_w_rescue())
+  {
+    double fpr = bloom_fp(m, n);
+    fp << std::fixed << fpr << "\n";
+  }
+}
+
 template<size_t span, size_t MAX_C>
 class KmerMergeTask : public ITask
 {
@@ -772,6 +1086,13 @@ public:
       m_rec_min(recurrence_min), m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format)
   {}
 
+  std::string name() const override { return fmt::format("merge P={}", m_part_id); }
+  std::string stage() const override { return "merge"; }
+  std::vector<std::string> outputs() const override
+  {
+    return {KmDir::get().get_matrix_path(m_part_id, m_mode, m_format, COUNT_FORMAT::KMER, m_lz4)};
+  }
+
   void preprocess() {}
   void postprocess()
   {
@@ -811,20 +1132,7 @@ public:
     }
 #endif
 
-    if (m_mode == MODE::COUNT)
-    {
-      if (m_format == FORMAT::TEXT)
-        merger.write_as_text(out_path);
-      else if (m_format == FORMAT::BIN)
-        merger.write_as_bin(out_path, m_lz4);
-    }
-    else if (m_mode == MODE::PA)
-    {
-      if (m_format == FORMAT::TEXT)
-        merger.write_as_pa_text(out_path);
-      else if (m_format == FORMAT::BIN)
-        merger.write_as_pa(out_path, m_lz4);
-    }
+    write_kmer_matrix(merger, m_mode, m_format, out_path, m_lz4);
 
 #ifdef WITH_PLUGIN
     if (PluginManager<IMergePlugin>::get().use_plugin())
@@ -838,6 +1146,7 @@ public:
 #endif
 
     merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    add_merge_stats(m_stats, paths, "kmer", out_path, merger.get_infos());
 
     spdlog::debug("[done] - KmerMergeTask - P={}", m_part_id);
   }
@@ -870,6 +1179,13 @@ public:
   : ITask(4, clear), m_part_id(partition_id), m_ab_vec(ab_vec), m_rec_min(recurrence_min),
     m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format), m_win(win), m_bw(bw) {}
 
+  std::string name() const override { return fmt::format("hash-merge P={}", m_part_id); }
+  std::string stage() const override { return "merge"; }
+  std::vector<std::string> outputs() const override
+  {
+    return {KmDir::get().get_matrix_path(m_part_id, m_mode, m_format, COUNT_FORMAT::HASH, false)};
+  }
+
   void preprocess() {}
   void postprocess()
   {
@@ -909,67 +1225,323 @@ public:
     }
 #endif
 
-    if (m_mode == MODE::COUNT)
+    write_hash_matrix(merger, m_mode, m_format, out_path, m_lz4, m_win, m_part_id, m_bw);
+
+#ifdef WITH_PLUGIN
+    if (PluginManager<IMergePlugin>::get().use_plugin())
     {
-      if (m_format == FORMAT::TEXT)
-        merger.write_as_text(out_path);
-      else if (m_format == FORMAT::BIN)
-        merger.write_as_bin(out_path, m_lz4);
+      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
     }
-    else if (m_mode == MODE::PA)
+    else
     {
-      if (m_format == FORMAT::TEXT)
-        merger.write_as_pa_text(out_path);
-      else if (m_format == FORMAT::BIN)
-        merger.write_as_pa(out_path, m_lz4);
+      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
     }
-    else if (m_mode == MODE::BF)
+#endif
+    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    add_merge_stats(m_stats, paths, "hash", out_path, merger.get_infos());
+
+    if (m_mode == MODE::BF || m_mode == MODE::BFT)
+      write_fpr(merger.get_infos(), m_win, m_part_id);
+
+    spdlog::debug("[done] - HashMergeTask - P={}", m_part_id);
+  }
+
+private:
+  uint32_t m_part_id;
+  std::vector<uint32_t>& m_ab_vec;
+  uint32_t m_rec_min;
+  uint32_t m_save_if;
+  bool m_lz4;
+  MODE m_mode;
+  FORMAT m_format;
+  HashWindow& m_win;
+  uint32_t m_bw;
+};
+
+/*
+  Count and merge of one partition in a single task, for all the samples. The partition of
+  each sample is counted into a sorted KmerRun kept in memory, the runs are then merged as
+  count files would be, so no per-sample count file is written.
+*/
+template<size_t span, size_t MAX_C, typename Storage>
+class KmerCountMergeTask : public ITask
+{
+  using storage_t = std::shared_ptr<Storage>;
+public:
+  KmerCountMergeTask(uint32_t partition_id,
+                     std::vector<storage_t> superk_storages,
+                     std::vector<parti_info_t> pinfos,
+                     std::vector<uint32_t> count_ab_mins,
+                     std::vector<hist_t> hists,
+                     std::vector<uint32_t>& ab_vec,
+                     uint32_t kmer_size,
+                     uint32_t recurrence_min,
+                     uint32_t save_if,
+                     bool lz4,
+                     MODE mode,
+                     FORMAT format,
+                     bool clear = false,
+                     uint32_t nb_threads = 1)
+    : ITask(4, clear), m_part_id(partition_id), m_superk_storages(std::move(superk_storages)),
+      m_pinfos(std::move(pinfos)), m_count_ab_mins(std::move(count_ab_mins)),
+      m_hists(std::move(hists)), m_ab_vec(ab_vec), m_kmer_size(kmer_size),
+      m_rec_min(recurrence_min), m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format),
+      m_nb_threads(nb_threads)
+  {}
+
+  std::string name() const override { return fmt::format("merge P={}", m_part_id); }
+  std::string stage() const override { return "merge"; }
+  std::vector<std::string> outputs() const override
+  {
+    return {KmDir::get().get_matrix_path(m_part_id, m_mode, m_format, COUNT_FORMAT::KMER, m_lz4)};
+  }
+
+  // The runs of all the samples, and the counting of the largest one.
+  uint64_t memory() const override
+  {
+    uint64_t runs = 0, count = 0;
+    for (auto& pinfo : m_pinfos)
+    {
+      uint64_t nbk = pinfo->getNbKmer(m_part_id);
+      runs += KmerRun<MAX_C>::memory(nbk, m_kmer_size);
+      count = std::max<uint64_t>(count, get_required_memory<span>(nbk));
+    }
+    return runs + count;
+  }
+
+  void preprocess()
+  {
+    if (!Telemetry::get().enabled())
+      return;
+    for (size_t i=0; i<m_superk_storages.size(); i++)
     {
-        merger.write_as_bf(out_path, m_win.get_lower(m_part_id),
-                           m_win.get_upper(m_part_id), false);
+      m_stats.add_read("superk", m_superk_storages[i]->getDiskSize(m_part_id));
+      m_stats.m_kmers_in += m_pinfos[i]->getNbKmer(m_part_id);
     }
-    else if (m_mode == MODE::BFT)
+  }
+
+  void postprocess()
+  {
+    if (this->m_clear)
     {
-        merger.write_as_bft(out_path, m_win.get_lower(m_part_id),
-                            m_win.get_upper(m_part_id), false);
+      for (auto& storage : m_superk_storages)
+        storage->clearFile(m_part_id);
     }
-    else if (m_mode == MODE::BFC)
+    this->m_finish = true;
+    this->exec_callback();
+  }
+
+  void exec()
+  {
+    spdlog::debug("[exec] - KmerCountMergeTask - P={}", m_part_id);
+
+    std::vector<std::shared_ptr<KmerRunReader<MAX_C>>> runs;
+    for (size_t i=0; i<m_superk_storages.size(); i++)
     {
-        merger.write_as_bfc(out_path, m_win.get_lower(m_part_id),
-                            m_win.get_upper(m_part_id), m_bw, false);
+      krun_t<MAX_C> run = std::make_shared<KmerRun<MAX_C>>(m_kmer_size);
+      uint64_t nbk = m_pinfos[i]->getNbKmer(m_part_id);
+      if (nbk > 0)
+      {
+        MemAllocator pool(1);
+        pool.reserve(get_required_memory<span>(nbk));
+        auto* processor = new KmerCountProcessor<span, MAX_C, 8192, KmerRun<MAX_C>>(
+          m_kmer_size, m_count_ab_mins[i], run, m_hists[i]);
+        KmerPartCounter<Storage, span> partition_counter(processor, m_pinfos[i].get(), m_part_id,
+                                                         m_kmer_size, pool,
+                                                         m_superk_storages[i].get(), m_nb_threads);
+        partition_counter.execute();
+        pool.free_all();
+        delete processor;
+      }
+      runs.push_back(std::make_shared<KmerRunReader<MAX_C>>(run));
     }
 
+    std::string out_path = KmDir::get().get_matrix_path(m_part_id, m_mode, m_format,
+                                                        COUNT_FORMAT::KMER, m_lz4);
+    KmerMerger<span, MAX_C, KmerRunReader<MAX_C>> merger(runs, m_ab_vec, m_kmer_size, m_rec_min,
+                                                         m_save_if, m_part_id);
+
 #ifdef WITH_PLUGIN
+    IMergePlugin* plugin = nullptr;
+
     if (PluginManager<IMergePlugin>::get().use_plugin())
     {
+      plugin = PluginManager<IMergePlugin>::get().get_plugin();
+      plugin->set_out_dir(KmDir::get().m_plugin_storage);
+      plugin->set_kmer_size(m_kmer_size);
+      plugin->set_partition(m_part_id);
+      merger.set_plugin(plugin);
+    }
+#endif
+
+    write_kmer_matrix(merger, m_mode, m_format, out_path, m_lz4);
+
+#ifdef WITH_PLUGIN
+    if (PluginManager<IMergePlugin>::get().use_plugin())
       PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+#endif
+
+    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    add_merge_stats(m_stats, {}, "kmer", out_path, merger.get_infos());
+
+    spdlog::debug("[done] - KmerCountMergeTask - P={}", m_part_id);
+  }
+
+private:
+  uint32_t m_part_id;
+  std::vector<storage_t> m_superk_storages;
+  std::vector<parti_info_t> m_pinfos;
+  std::vector<uint32_t> m_count_ab_mins;
+  std::vector<hist_t> m_hists;
+  std::vector<uint32_t>& m_ab_vec;
+  uint32_t m_kmer_size;
+  uint32_t m_rec_min;
+  uint32_t m_save_if;
+  bool m_lz4;
+  MODE m_mode;
+  FORMAT m_format;
+  uint32_t m_nb_threads;
+};
+
+// Same as KmerCountMergeTask, in hash mode.
+template<size_t span, size_t MAX_C, typename Storage>
+class HashCountMergeTask : public ITask
+{
+  using storage_t = std::shared_ptr<Storage>;
+public:
+  HashCountMergeTask(uint32_t partition_id,
+                     std::vector<storage_t> superk_storages,
+                     std::vector<parti_info_t> pinfos,
+                     std::vector<uint32_t> count_ab_mins,
+                     std::vector<hist_t> hists,
+                     std::vector<uint32_t>& ab_vec,
+                     uint32_t kmer_size,
+                     uint32_t recurrence_min,
+                     uint32_t save_if,
+                     bool lz4,
+                     MODE mode,
+                     FORMAT format,
+                     HashWindow& win,
+                     bool clear,
+                     int32_t bw,
+                     uint32_t nb_threads = 1)
+    : ITask(4, clear), m_part_id(partition_id), m_superk_storages(std::move(superk_storages)),
+      m_pinfos(std::move(pinfos)), m_count_ab_mins(std::move(count_ab_mins)),
+      m_hists(std::move(hists)), m_ab_vec(ab_vec), m_kmer_size(kmer_size),
+      m_rec_min(recurrence_min), m_save_if(save_if), m_lz4(lz4), m_mode(mode), m_format(format),
+      m_win(win), m_bw(bw), m_nb_threads(nb_threads)
+  {}
+
+  std::string name() const override { return fmt::format("hash-merge P={}", m_part_id); }
+  std::string stage() const override { return "merge"; }
+  std::vector<std::string> outputs() const override
+  {
+    return {KmDir::get().get_matrix_path(m_part_id, m_mode, m_format, COUNT_FORMAT::HASH, false)};
+  }
+
+  uint64_t memory() const override
+  {
+    uint64_t runs = 0, count = 0;
+    for (auto& pinfo : m_pinfos)
+    {
+      uint64_t nbk = pinfo->getNbKmer(m_part_id);
+      runs += HashRun<MAX_C>::memory(nbk);
+      count = std::max<uint64_t>(count, nbk > 0 ? get_required_memory_hash<span>(nbk) : 0);
     }
-    else
+    return runs + count;
+  }
+
+  void preprocess()
+  {
+    if (!Telemetry::get().enabled())
+      return;
+    for (size_t i=0; i<m_superk_storages.size(); i++)
     {
-      merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+      m_stats.add_read("superk", m_superk_storages[i]->getDiskSize(m_part_id));
+      m_stats.m_kmers_in += m_pinfos[i]->getNbKmer(m_part_id);
     }
-#endif
-    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+  }
 
-    if (m_mode == MODE::BF || m_mode == MODE::BFT)
+  void postprocess()
+  {
+    if (this->m_clear)
     {
-      std::string fpr_path = fmt::format("{}/{}", KmDir::get().m_fpr_storage, fmt::format("partition_{}.txt", m_part_id));
-      std::ofstream fp(fpr_path, std::ios::out); check_fstream_good(fpr_path, fp);
+      for (auto& storage : m_superk_storages)
+        storage->clearFile(m_part_id);
+    }
+    this->m_finish = true;
+    this->exec_callback();
+  }
 
-      size_t m = m_win.get_window_size_bits();
-      for (auto& n : merger.get_infos()->get_unique_w_rescue())
+  void exec()
+  {
+    spdlog::debug("[exec] - HashCountMergeTask - P={}", m_part_id);
+
+    std::vector<std::shared_ptr<HashRunReader<MAX_C>>> runs;
+    for (size_t i=0; i<m_superk_storages.size(); i++)
+    {
+      hrun_t<MAX_C> run = std::make_shared<HashRun<MAX_C>>();
+      uint64_t nbk = m_pinfos[i]->getNbKmer(m_part_id);
+      if (nbk > 0)
       {
-        double fpr = bloom_fp(m, n);
-        fp << std::fixed << fpr << "\n";
+        MemAllocator pool(1);
+        pool.reserve(get_required_memory_hash<span>(nbk));
+        auto* processor = new HashCountProcessor<span, MAX_C, 32768, HashRun<MAX_C>>(
+          m_kmer_size, m_count_ab_mins[i], run, m_hists[i]);
+        HashPartCounter<Storage, span> partition_counter(processor, m_pinfos[i].get(), m_part_id,
+                                                         m_kmer_size, pool,
+                                                         m_superk_storages[i].get(),
+                                                         m_win.get_window_size_bits(),
+                                                         m_nb_threads);
+        partition_counter.execute();
+        pool.free_all();
+        delete processor;
       }
+      runs.push_back(std::make_shared<HashRunReader<MAX_C>>(run));
     }
 
-    spdlog::debug("[done] - HashMergeTask - P={}", m_part_id);
+    std::string out_path = KmDir::get().get_matrix_path(m_part_id, m_mode, m_format,
+                                                        COUNT_FORMAT::HASH, false);
+    HashMerger<MAX_C, 32768, HashRunReader<MAX_C>> merger(runs, m_ab_vec, m_rec_min, m_save_if,
+                                                          m_part_id);
+
+#ifdef WITH_PLUGIN
+    IMergePlugin* plugin = nullptr;
+
+    if (PluginManager<IMergePlugin>::get().use_plugin())
+    {
+      plugin = PluginManager<IMergePlugin>::get().get_plugin();
+      plugin->set_out_dir(KmDir::get().m_plugin_storage);
+      plugin->set_kmer_size(0);
+      plugin->set_partition(m_part_id);
+      merger.set_plugin(plugin);
+    }
+#endif
+
+    write_hash_matrix(merger, m_mode, m_format, out_path, m_lz4, m_win, m_part_id, m_bw);
+
+#ifdef WITH_PLUGIN
+    if (PluginManager<IMergePlugin>::get().use_plugin())
+      PluginManager<IMergePlugin>::get().destroy_plugin(plugin);
+#endif
+
+    merger.get_infos()->serialize(KmDir::get().get_merge_info_path(m_part_id));
+    add_merge_stats(m_stats, {}, "hash", out_path, merger.get_infos());
+
+    if (m_mode == MODE::BF || m_mode == MODE::BFT)
+      write_fpr(merger.get_infos(), m_win, m_part_id);
+
+    spdlog::debug("[done] - HashCountMergeTask - P={}", m_part_id);
   }
 
 private:
   uint32_t m_part_id;
+  std::vector<storage_t> m_superk_storages;
+  std::vector<parti_info_t> m_pinfos;
+  std::vector<uint32_t> m_count_ab_mins;
+  std::vector<hist_t> m_hists;
   std::vector<uint32_t>& m_ab_vec;
+  uint32_t m_kmer_size;
   uint32_t m_rec_min;
   uint32_t m_save_if;
   bool m_lz4;
@@ -977,6 +1549,7 @@ private:
   FORMAT m_format;
   HashWindow& m_win;
   uint32_t m_bw;
+  uint32_t m_nb_threads;
 };
 
 
@@ -990,9 +1563,25 @@ public:
       m_kmer_size(kmer_size)
   {}
 
-  void preprocess() {}
+  std::string name() const override { return fmt::format("format S={}", m_id); }
+  std::string stage() const override { return "format"; }
+  std::vector<std::string> outputs() const override
+  {
+    return {KmDir::get().get_filter_path(m_id, m_bf_type)};
+  }
+
+  void preprocess()
+  {
+    if (!Telemetry::get().enabled())
+      return;
+    for (size_t p=0; p<m_nb_parts; p++)
+      m_stats.add_read_file("vector", KmDir::get().get_count_part_path(m_id, p, m_lz4, KM_FILE::VECTOR));
+  }
+
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+      m_stats.add_written_file("filter", KmDir::get().get_filter_path(m_id, m_bf_type));
     if (this->m_clear)
     {
       for (size_t p=0; p<m_nb_parts; p++)
@@ -1032,9 +1621,22 @@ public:
       m_kmer_size(kmer_size)
   {}
 
+  std::string name() const override
+  {
+    return fmt::format("format S={}", KmDir::get().m_fof.get_id(m_file_id));
+  }
+  std::string stage() const override { return "format"; }
+  std::vector<std::string> outputs() const override
+  {
+    return {KmDir::get().get_filter_path(KmDir::get().m_fof.get_id(m_file_id), m_bf_type)};
+  }
+
   void preprocess() {}
   void postprocess()
   {
+    if (Telemetry::get().enabled())
+      m_stats.add_written_file(
+        "filter", KmDir::get().get_filter_path(KmDir::get().m_fof.get_id(m_file_id), m_bf_type));
     this->m_finish = true;
     this->exec_callback();
   }
@@ -22,23 +22,55 @@
 #include <functional>
 #include <future>
 #include <iostream>
+#include <iterator>
 #include <queue>
+#include <set>
 #include <stdexcept>
 #include <string>
 #include <thread>
 #include <memory>
 #include <vector>
 
+#include <spdlog/spdlog.h>
+
 #include <kmtricks/itask.hpp>
 
 namespace km
 {
-class TaskPool
+/*
+  Tasks are run by priority level, then by decreasing memory() estimate so that large
+  tasks do not end up in the tail. With a memory budget, a task is admitted only while
+  the estimates of the running tasks fit into it; a task larger than the budget runs alone.
+  Smaller tasks can overtake the first task of the queue when it does not fit, at most
+  `threads` times, then no task is admitted until it fits.
+  Tasks can borrow the threads of idle workers, no task is started while they are lent, so
+  that at most `threads` threads run at any time.
+*/
+class TaskPool : public IThreadLender
 {
   using size_type = std::result_of<decltype (&std::thread::hardware_concurrency)()>::type;
 
+  struct entry
+  {
+    task_t task;
+    uint64_t memory;
+    uint64_t seq;
+  };
+
+  struct entry_cmp
+  {
+    bool operator()(const entry& lhs, const entry& rhs) const
+    {
+      if (*lhs.task > *rhs.task) return true;
+      if (*lhs.task < *rhs.task) return false;
+      if (lhs.memory != rhs.memory) return lhs.memory > rhs.memory;
+      return lhs.seq < rhs.seq;
+    }
+  };
+
  public:
-  TaskPool(size_type threads)
+  TaskPool(size_type threads, uint64_t memory_budget = 0)
+    : m_budget(memory_budget)
   {
     if (threads < m_n) m_n = threads;
     for (size_t i = 0; i < m_n; i++)
@@ -85,38 +117,131 @@ class TaskPool
     {
       std::unique_lock<std::mutex> lock(m_queue_mutex);
       task->in();
-      m_queue.push(task);
+      m_queue.insert(entry{task, task->memory(), m_seq++});
     }
     m_condition.notify_one();
   }
 
+  uint64_t memory_budget() const { return m_budget; }
+  uint64_t memory_peak() const { return m_peak; }
+
+  uint32_t borrow(uint32_t n) override
+  {
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+    uint32_t k = std::min<size_t>(n, m_n - m_running - m_lent);
+    m_lent += k;
+    return k;
+  }
+
+  void give_back(uint32_t n) override
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_queue_mutex);
+      m_lent -= n;
+    }
+    m_condition.notify_all();
+  }
+
  private:
+  // First task in queue order that fits into the budget, m_queue.end() if none.
+  std::set<entry, entry_cmp>::iterator next_task()
+  {
+    if (m_queue.empty() || !m_budget || !m_in_use)
+      return m_queue.begin();
+
+    auto head = m_queue.begin();
+    if (m_in_use + head->memory <= m_budget)
+      return head;
+    if (head->seq == m_head_seq && m_overtakes >= m_n)
+      return m_queue.end();
+
+    for (auto it = std::next(head); it != m_queue.end(); ++it)
+    {
+      if (m_in_use + it->memory <= m_budget)
+        return it;
+    }
+    return m_queue.end();
+  }
+
+  // Counts the tasks admitted before the first task of the queue.
+  void admitted(std::set<entry, entry_cmp>::iterator it)
+  {
+    auto head = m_queue.begin();
+    if (it == head)
+    {
+      m_overtakes = 0;
+      return;
+    }
+    if (head->seq != m_head_seq)
+    {
+      m_head_seq = head->seq;
+      m_overtakes = 0;
+    }
+    m_overtakes++;
+  }
+
   void worker(int i)
   {
     while (true)
     {
-      task_t task;
+      entry e;
       {
         std::unique_lock<std::mutex> lock(this->m_queue_mutex);
-        this->m_condition.wait(lock, [this] { return this->m_stop || !this->m_queue.empty(); });
+        auto it = m_queue.end();
+        this->m_condition.wait(lock, [this, &it] {
+          if (this->m_stop && this->m_queue.empty())
+            return true;
+          if (this->m_running + this->m_lent >= this->m_n)
+            return false;
+          it = this->next_task();
+          return it != this->m_queue.end();
+        });
         if (this->m_stop && this->m_queue.empty()) return;
-        task = this->m_queue.top();
-        this->m_queue.pop();
+        e = *it;
+        admitted(it);
+        this->m_queue.erase(it);
+        m_running++;
+        m_in_use += e.memory;
+        m_peak = std::max(m_peak, m_in_use);
+        if (m_budget && e.memory)
+        {
+          if (e.memory > m_budget)
+            spdlog::warn("{} needs ~{} MB, more than the memory budget ({} MB), run alone.",
+                         e.task->name(), e.memory >> 20, m_budget >> 20);
+          spdlog::debug("[admit] - {} - {} MB, {}/{} MB in use", e.task->name(),
+                        e.memory >> 20, m_in_use >> 20, m_budget >> 20);
+        }
       }
-      task->preprocess();
-      task->exec();
-      task->postprocess();
-      task->out();
+      e.task->set_lender(this);
+      e.task->run();
+      e.task->set_lender(nullptr);
+      e.task->out();
+      {
+        std::unique_lock<std::mutex> lock(this->m_queue_mutex);
+        m_in_use -= e.memory;
+        m_running--;
+      }
+      m_condition.notify_all();
     }
   }
 
  private:
   size_type m_n{std::thread::hardware_concurrency()};
   std::vector<std::thread> m_pool;
-  std::priority_queue<task_t> m_queue;
+  std::set<entry, entry_cmp> m_queue;
   std::mutex m_queue_mutex;
   std::condition_variable m_condition;
   bool m_stop{false};
+
+  uint64_t m_budget {0};
+  uint64_t m_in_use {0};
+  uint64_t m_peak {0};
+  uint64_t m_seq {0};
+  uint64_t m_head_seq {0};
+  size_t m_overtakes {0};
+
+  size_t m_running {0};
+  size_t m_lent {0};
 };
 
 };
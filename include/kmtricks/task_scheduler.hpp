@@ -25,6 +25,7 @@
 #include <kmtricks/cmd/all.hpp>
 #include <kmtricks/gatb/gatb_utils.hpp>
 #include <kmtricks/hash.hpp>
+#include <kmtricks/journal.hpp>
 #include <kmtricks/progress.hpp>
 #include <kmtricks/timer.hpp>
 #include <indicators/progress_bar.hpp>
@@ -54,6 +55,11 @@ public:
       for (auto& h : m_hists)
         HistWriter(KmDir::get().get_hist_path(KmDir::get().m_fof.get_id(h->idx())), *h, false);
     }
+    if (m_opt->sketch)
+    {
+      for (auto& sk : m_sketches)
+        SketchWriter(KmDir::get().get_sketch_path(KmDir::get().m_fof.get_id(sk->idx())), *sk, false);
+    }
   }
 
   void init_progress()
@@ -69,28 +75,163 @@ public:
 
   void init_progress2(uint32_t nb_parts)
   {
+    size_t nb_superk = 0, nb_counts = 0;
+    for (size_t i=0; i<m_nb_samples; i++)
+    {
+      nb_superk += !m_superk_parts[i].empty();
+      nb_counts += m_count_parts[i].size();
+    }
+    m_progress[2]->set_option(option::MaxProgress{nb_superk});
     m_progress.push_back(
-      get_progress_bar("Count partitions ", m_nb_samples * m_opt->restrict_to_list.size(), 50,
-                        Color::white, false));
+      get_progress_bar("Count partitions ", nb_counts, 50, Color::white, false));
     m_progress.push_back(
-      get_progress_bar("Merge partitions ", m_opt->restrict_to_list.size(), 50, Color::white, false));
+      get_progress_bar("Merge partitions ", m_merge_parts.size(), 50, Color::white, false));
     m_progress.push_back(
       get_progress_bar(
-        "Format bloom     ", m_nb_samples, 50, Color::white, false));
+        "Format bloom     ", std::count(m_format_todo.begin(), m_format_todo.end(), true),
+        50, Color::white, false));
+  }
+
+  void init_journal()
+  {
+    Journal& journal = Journal::get();
+    std::string fingerprint = m_opt->fingerprint();
+
+    if (m_opt->resume)
+    {
+      if (!journal.resume(KmDir::get().m_journal, KmDir::get().m_root))
+        throw PipelineError(fmt::format("{} is not a kmtricks journal.", KmDir::get().m_journal));
+
+      if (journal.fingerprint() != fingerprint)
+      {
+        spdlog::debug("journal: {}", journal.fingerprint());
+        spdlog::debug("current: {}", fingerprint);
+        throw PipelineError("Unable to resume, options or input samples differ from the interrupted run.");
+      }
+
+      if (journal.done("config") && journal.done("repart"))
+      {
+        spdlog::info("Resume from {}.", KmDir::get().m_journal);
+        return;
+      }
+      spdlog::warn("Configuration of the interrupted run is incomplete, restart from scratch.");
+      m_opt->resume = false;
+    }
+    journal.create(KmDir::get().m_journal, KmDir::get().m_root, fingerprint);
+  }
+
+  std::string count_name(const std::string& sid, uint32_t part) const
+  {
+    std::string prefix = "count";
+    if (m_opt->count_format == COUNT_FORMAT::HASH)
+      prefix = m_opt->skip_merge ? "hash-vec-count" : "hash-count";
+    else if (m_opt->kff)
+      prefix = "kff-count";
+    return fmt::format("{} S={} P={}", prefix, sid, part);
+  }
+
+  std::string merge_name(uint32_t part) const
+  {
+    return fmt::format("{} P={}", m_opt->count_format == COUNT_FORMAT::HASH ? "hash-merge" : "merge", part);
+  }
+
+  // Select the tasks to run. Everything is scheduled, unless resuming where only the tasks
+  // whose outputs are missing, and that are still required by a later stage, are kept.
+  void plan()
+  {
+    auto& parts = m_opt->restrict_to_list;
+    m_superk_parts.assign(m_nb_samples, parts);
+    m_count_parts.assign(m_nb_samples, parts);
+    m_merge_parts = parts;
+    m_format_todo.assign(m_nb_samples, true);
+
+    if (!m_opt->resume)
+      return;
+
+    Journal& journal = Journal::get();
+    bool run_count = m_opt->until != COMMAND::REPART && m_opt->until != COMMAND::SUPERK;
+    bool run_merge = run_count && m_opt->until != COMMAND::COUNT && !m_opt->skip_merge && !m_opt->kff;
+    bool run_format = run_count && m_opt->until != COMMAND::COUNT && m_opt->mode == MODE::BFT &&
+                      (m_opt->skip_merge || m_opt->until != COMMAND::MERGE);
+
+    size_t nb_format = 0;
+    for (size_t i=0; i<m_nb_samples; i++)
+    {
+      m_format_todo[i] = run_format &&
+        !journal.done(fmt::format("format S={}", KmDir::get().m_fof.get_id(i)));
+      nb_format += m_format_todo[i];
+    }
+
+    // In bft mode, matrices are removed once all the filters are built.
+    m_merge_parts.clear();
+    if (run_merge && (!run_format || nb_format))
+    {
+      for (auto& p : parts)
+        if (!journal.done(merge_name(p)))
+          m_merge_parts.push_back(p);
+    }
+
+    for (size_t i=0; i<m_nb_samples; i++)
+    {
+      std::string sid = KmDir::get().m_fof.get_id(i);
+      std::string sk_name = fmt::format("superk S={}", sid);
+      m_count_parts[i].clear();
+      m_superk_parts[i].clear();
+
+      if (!run_count)
+      {
+        if (!journal.done(sk_name))
+          m_superk_parts[i] = parts;
+        continue;
+      }
+
+      for (auto& p : parts)
+      {
+        bool required = true;
+        if (run_merge)
+          required = std::find(m_merge_parts.begin(), m_merge_parts.end(), p) != m_merge_parts.end();
+        else if (m_opt->skip_merge && run_format)
+          required = m_format_todo[i];
+
+        if (required && !journal.done(count_name(sid, p)))
+          m_count_parts[i].push_back(p);
+      }
+
+      // Super-k-mer files are consumed by the count tasks, they are recomputed together
+      // if one of them is missing.
+      bool intact = true;
+      for (auto& f : SuperKStorageReader::files(KmDir::get().get_superk_path(sid), m_count_parts[i]))
+        intact = intact && journal.intact(sk_name, f);
+      if (!intact)
+        m_superk_parts[i] = m_count_parts[i];
+    }
+
+    size_t nb_counts = 0, nb_superk = 0;
+    for (size_t i=0; i<m_nb_samples; i++)
+    {
+      nb_counts += m_count_parts[i].size();
+      nb_superk += !m_superk_parts[i].empty();
+    }
+    spdlog::info("Remaining tasks: {} superk, {} count, {} merge, {} format.",
+                 nb_superk, nb_counts, m_merge_parts.size(), nb_format);
   }
 
   void exec_config()
   {
-    spdlog::info("Compute configuration...");
-    IProperties* props = get_config_properties(m_opt->kmer_size,
-                                               m_opt->minim_size,
-                                               m_opt->minim_type,
-                                               m_opt->repart_type,
-                                               1,
-                                               m_opt->nb_parts,
-                                               m_opt->max_memory);
-    ConfigTask<MAX_K> config_task(m_opt->fof, props, m_opt->bloom_size, m_opt->nb_parts);
-    config_task.exec();
+    if (!m_opt->resume)
+    {
+      spdlog::info("Compute configuration...");
+      IProperties* props = get_config_properties(m_opt->kmer_size,
+                                                 m_opt->minim_size,
+                                                 m_opt->minim_type,
+                                                 m_opt->repart_type,
+                                                 1,
+                                                 m_opt->nb_parts,
+                                                 m_opt->max_memory ? m_opt->max_memory : 8000);
+      ConfigTask<MAX_K> config_task(m_opt->fof, props, m_opt->bloom_size, m_opt->nb_parts,
+                                    m_opt->nb_threads);
+      config_task.run();
+    }
     Storage* config_storage = StorageFactory(STORAGE_FILE).load(KmDir::get().m_config_storage);
     LOCAL(config_storage);
     m_config.load(config_storage->getGroup("gatb"));
@@ -98,14 +239,33 @@ public:
 
     m_hists.resize(m_nb_samples);
     for (size_t i=0; i<m_nb_samples; i++)
-      m_hists[i] = m_opt->hist ? std::make_shared<KHist>(i, m_config._kmerSize, 1, 255) : nullptr;
+      m_hists[i] = m_opt->hist ? make_hist<MAX_C>(i, m_config._kmerSize, m_opt->hist_log) : nullptr;
+
+    m_sketches.resize(m_nb_samples);
+    for (size_t i=0; i<m_nb_samples; i++)
+      m_sketches[i] = m_opt->sketch ? std::make_shared<KSketch>(i, m_config._kmerSize, 12,
+                                                                m_opt->sketch_scale,
+                                                                m_opt->sketch_size) : nullptr;
   }
 
   void exec_repart()
   {
-    spdlog::info("Compute minimizer repartition...");
-    RepartTask<MAX_K> repart_task(m_opt->fof, m_opt->from);
-    repart_task.exec(); repart_task.postprocess();
+    if (!m_opt->resume)
+    {
+      spdlog::info("Compute minimizer repartition...");
+      uint32_t sample_reads = m_opt->sample_reads ? m_opt->sample_reads
+                                                  : auto_sample_reads(KmDir::get().m_fof.size());
+      RepartTask<MAX_K> repart_task(m_opt->fof, m_opt->from, sample_reads, m_opt->sample_seed,
+                                    m_opt->nb_threads);
+      repart_task.run();
+    }
+    else
+    {
+      // The partitions may have been drawn at random with --restrict-to.
+      m_opt->restrict_to_list.clear();
+      for (auto& p : bc::utils::split(Journal::get().value("partitions"), ','))
+        m_opt->restrict_to_list.push_back(std::stoul(p));
+    }
     m_opt->m_ab_min_vec.resize(KmDir::get().m_fof.size());
     m_hw = HashWindow(KmDir::get().m_hash_win);
 
@@ -149,6 +309,16 @@ public:
         }
       }
     }
+
+    if (!m_opt->resume)
+    {
+      std::string partitions;
+      for (auto& p : m_opt->restrict_to_list)
+        partitions += fmt::format("{}{}", partitions.empty() ? "" : ",", p);
+      Journal::get().set("partitions", partitions);
+    }
+
+    plan();
     init_progress2(m_config._nb_partitions);
   }
 
@@ -163,9 +333,15 @@ public:
 
     for (auto id : KmDir::get().m_fof)
     {
+      uint32_t iid = KmDir::get().m_fof.get_i(std::get<0>(id));
+      if (m_superk_parts[iid].empty())
+        continue;
+
       task_t task = std::make_shared<SuperKTask<MAX_K>>(std::get<0>(id),
                                                         m_opt->lz4,
-                                                        m_opt->restrict_to_list);
+                                                        m_superk_parts[iid],
+                                                        m_opt->packed_superk,
+                                                        inflate_threads());
       if (m_is_info) task->set_callback([this](){ this->m_dyn[0].tick(); });
 
       spdlog::debug("[push] - SuperKTask - S={}", std::get<0>(id));
@@ -179,7 +355,7 @@ public:
   {
     if (m_is_info) { m_dyn.push_back(std::move(m_progress[3])); m_dyn[1].set_progress(0); }
 
-    TaskPool pool(m_opt->nb_threads);
+    TaskPool pool(m_opt->nb_threads, memory_budget());
 
     for (auto id : KmDir::get().m_fof)
     {
@@ -188,6 +364,7 @@ public:
       std::string sid = std::get<0>(id);
       sk_storage_t sk_storage = std::make_shared<SuperKStorageReader>(KmDir::get().get_superk_path(sid));
       parti_info_t pinfos = std::make_shared<PartiInfo<5>>(KmDir::get().get_superk_path(sid));
+      uint64_t mean_kmers = mean_part_kmers(pinfos);
       for (auto& p : m_opt->restrict_to_list)
       {
         std::string path;
@@ -201,7 +378,8 @@ public:
               sid, p, m_opt->lz4, KM_FILE::KMER);
             task = std::make_shared<CountTask<MAX_K, MAX_C, SuperKStorageReader>>(
               path, m_config, sk_storage, pinfos, p, iid, m_config._kmerSize,
-              a_min, m_opt->lz4, get_hist_clone(m_hists[iid]), !m_opt->keep_tmp);
+              a_min, m_opt->lz4, m_hists[iid], !m_opt->keep_tmp,
+              count_threads(pinfos, p, mean_kmers), m_sketches[iid]);
           }
           else if (m_opt->kff)
           {
@@ -210,7 +388,8 @@ public:
               sid, p, m_opt->lz4, KM_FILE::KFF);
             task = std::make_shared<KffCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
               path, m_config, sk_storage, pinfos, p, iid,
-              m_config._kmerSize, a_min, get_hist_clone(m_hists[iid]), !m_opt->keep_tmp);
+              m_config._kmerSize, a_min, m_hists[iid], !m_opt->keep_tmp,
+              count_threads(pinfos, p, mean_kmers), m_sketches[iid]);
           }
         }
         else
@@ -223,7 +402,8 @@ public:
             task = std::make_shared<HashCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
               path, m_config, sk_storage, pinfos, p, iid,
               m_hw.get_window_size_bits(), m_config._kmerSize, a_min, m_opt->lz4,
-              get_hist_clone(m_hists[iid]), !m_opt->keep_tmp);
+              m_hists[iid], !m_opt->keep_tmp,
+              count_threads(pinfos, p, mean_kmers), m_sketches[iid]);
           }
           else
           {
@@ -233,7 +413,8 @@ public:
             task = std::make_shared<HashVecCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
               path, m_config, sk_storage, pinfos, p, iid,
               m_hw.get_window_size_bits(), m_config._kmerSize, a_min, m_opt->lz4,
-              get_hist_clone(m_hists[iid]), !m_opt->keep_tmp);
+              m_hists[iid], !m_opt->keep_tmp,
+              count_threads(pinfos, p, mean_kmers), m_sketches[iid]);
           }
         }
         if (m_is_info) task->set_callback([this](){ this->m_dyn[1].tick(); });
@@ -242,12 +423,12 @@ public:
       }
     }
     pool.join_all();
+    log_memory(pool);
 
     if (m_opt->hist)
-    {
-      for (auto& h : m_hists)
-        h->merge_clones();
-    }
+      reduce_histograms(m_hists, m_opt->nb_threads);
+    if (m_opt->sketch)
+      reduce_sketches(m_sketches, m_opt->nb_threads);
 
     if (m_is_info) m_dyn[1].mark_as_completed();
   }
@@ -259,79 +440,99 @@ public:
       m_dyn.push_back(std::move(m_progress[2])); m_dyn[0].set_progress(0);
       m_dyn.push_back(std::move(m_progress[3])); m_dyn[1].set_progress(0);
     }
-    TaskPool pool(m_opt->nb_threads);
+    TaskPool pool(m_opt->nb_threads, memory_budget());
 
     int max_running = std::floor(m_opt->nb_threads * m_opt->focus) > 0 ? m_opt->nb_threads * m_opt->focus : 1;
 
-    for (auto id : KmDir::get().m_fof)
-    {
-      task_t task = std::make_shared<SuperKTask<MAX_K>>(std::get<0>(id),
-                                                        m_opt->lz4,
-                                                        m_opt->restrict_to_list);
-      task->set_callback([this, id, &pool](){
-        if (this->m_is_info)
-          this->m_dyn[0].tick();
-        uint32_t a_min = std::get<2>(id) == 0 ? this->m_opt->c_ab_min : std::get<2>(id);
-        uint32_t iid = KmDir::get().m_fof.get_i(std::get<0>(id));
-        std::string sid = std::get<0>(id);
-        sk_storage_t sk_storage = std::make_shared<SuperKStorageReader>(KmDir::get().get_superk_path(sid));
-        parti_info_t pinfos = std::make_shared<PartiInfo<5>>(KmDir::get().get_superk_path(sid));
-        for (auto& p : this->m_opt->restrict_to_list)
+    auto push_counts = [this, &pool](auto id) {
+      uint32_t a_min = std::get<2>(id) == 0 ? this->m_opt->c_ab_min : std::get<2>(id);
+      uint32_t iid = KmDir::get().m_fof.get_i(std::get<0>(id));
+      std::string sid = std::get<0>(id);
+      sk_storage_t sk_storage = std::make_shared<SuperKStorageReader>(KmDir::get().get_superk_path(sid));
+      parti_info_t pinfos = std::make_shared<PartiInfo<5>>(KmDir::get().get_superk_path(sid));
+      uint64_t mean_kmers = mean_part_kmers(pinfos);
+      for (auto& p : this->m_count_parts[iid])
+      {
+        std::string path;
+        task_t task = nullptr;
+        if (m_opt->count_format == COUNT_FORMAT::KMER)
         {
-          std::string path;
-          task_t task = nullptr;
-          if (m_opt->count_format == COUNT_FORMAT::KMER)
+          if (!m_opt->kff)
           {
-            if (!m_opt->kff)
-            {
-              spdlog::debug("[push] - CountTask - S={}, P={}", sid, p);
-              path = KmDir::get().get_count_part_path(
-                sid, p, this->m_opt->lz4, KM_FILE::KMER);
-              task = std::make_shared<CountTask<MAX_K, MAX_C, SuperKStorageReader>>(
-                path, this->m_config, sk_storage, pinfos, p, iid,
-                this->m_config._kmerSize, a_min, m_opt->lz4, get_hist_clone(this->m_hists[iid]),
-                !this->m_opt->keep_tmp);
-            }
-            else if (m_opt->kff)
-            {
-              spdlog::debug("[push] - KffCountTask - S={}, P={}", sid, p);
-              path = KmDir::get().get_count_part_path(
-                sid, p, this->m_opt->lz4, KM_FILE::KFF);
-              task = std::make_shared<KffCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
-                path, this->m_config, sk_storage, pinfos, p, iid,
-                this->m_config._kmerSize, a_min, get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp);
-            }
+            spdlog::debug("[push] - CountTask - S={}, P={}", sid, p);
+            path = KmDir::get().get_count_part_path(
+              sid, p, this->m_opt->lz4, KM_FILE::KMER);
+            task = std::make_shared<CountTask<MAX_K, MAX_C, SuperKStorageReader>>(
+              path, this->m_config, sk_storage, pinfos, p, iid,
+              this->m_config._kmerSize, a_min, m_opt->lz4, this->m_hists[iid],
+              !this->m_opt->keep_tmp, count_threads(pinfos, p, mean_kmers),
+              this->m_sketches[iid]);
           }
-          else
+          else if (m_opt->kff)
           {
-            if (!m_opt->skip_merge)
-            {
-              path = KmDir::get().get_count_part_path(
-                sid, p, this->m_opt->lz4, KM_FILE::HASH);
-              spdlog::debug("[push] - HashCountTask - S={}, P={}", sid, p);
-              task = std::make_shared<HashCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
-                path, m_config, sk_storage, pinfos, p, iid,
-                m_hw.get_window_size_bits(), m_config._kmerSize, a_min, m_opt->lz4,
-                get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp);
-            }
-            else
-            {
-              spdlog::debug("[push] - HashVecCountTask - S={}, P={}", sid, p);
-              path = KmDir::get().get_count_part_path(
-                sid, p, false, KM_FILE::VECTOR);
-              task = std::make_shared<HashVecCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
-                path, this->m_config, sk_storage, pinfos, p, iid,
-                this->m_hw.get_window_size_bits(), this->m_config._kmerSize, a_min, false,
-                get_hist_clone(this->m_hists[iid]), !this->m_opt->keep_tmp);
-            }
+            spdlog::debug("[push] - KffCountTask - S={}, P={}", sid, p);
+            path = KmDir::get().get_count_part_path(
+              sid, p, this->m_opt->lz4, KM_FILE::KFF);
+            task = std::make_shared<KffCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
+              path, this->m_config, sk_storage, pinfos, p, iid,
+              this->m_config._kmerSize, a_min, this->m_hists[iid], !this->m_opt->keep_tmp,
+              count_threads(pinfos, p, mean_kmers), this->m_sketches[iid]);
           }
-          if (m_is_info)
+        }
+        else
+        {
+          if (!m_opt->skip_merge)
           {
-            ProgressBar* ptr = &this->m_dyn[1];
-            task->set_callback([ptr](){ ptr->tick(); });
+            path = KmDir::get().get_count_part_path(
+              sid, p, this->m_opt->lz4, KM_FILE::HASH);
+            spdlog::debug("[push] - HashCountTask - S={}, P={}", sid, p);
+            task = std::make_shared<HashCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
+              path, m_config, sk_storage, pinfos, p, iid,
+              m_hw.get_window_size_bits(), m_config._kmerSize, a_min, m_opt->lz4,
+              this->m_hists[iid], !this->m_opt->keep_tmp,
+              count_threads(pinfos, p, mean_kmers), this->m_sketches[iid]);
+          }
+          else
+          {
+            spdlog::debug("[push] - HashVecCountTask - S={}, P={}", sid, p);
+            path = KmDir::get().get_count_part_path(
+              sid, p, false, KM_FILE::VECTOR);
+            task = std::make_shared<HashVecCountTask<MAX_K, MAX_C, SuperKStorageReader>>(
+              path, this->m_config, sk_storage, pinfos, p, iid,
+              this->m_hw.get_window_size_bits(), this->m_config._kmerSize, a_min, false,
+              this->m_hists[iid], !this->m_opt->keep_tmp,
+              count_threads(pinfos, p, mean_kmers), this->m_sketches[iid]);
           }
-          pool.add_task(task);
         }
+        if (m_is_info)
+        {
+          ProgressBar* ptr = &this->m_dyn[1];
+          task->set_callback([ptr](){ ptr->tick(); });
+        }
+        pool.add_task(task);
+      }
+    };
+
+    for (auto id : KmDir::get().m_fof)
+    {
+      uint32_t iid = KmDir::get().m_fof.get_i(std::get<0>(id));
+      if (m_superk_parts[iid].empty())
+      {
+        // Resumed run, the super-k-mers are still on disk.
+        if (!m_count_parts[iid].empty())
+          push_counts(id);
+        continue;
+      }
+
+      task_t task = std::make_shared<SuperKTask<MAX_K>>(std::get<0>(id),
+                                                        m_opt->lz4,
+                                                        m_superk_parts[iid],
+                                                        m_opt->packed_superk,
+                                                        inflate_threads());
+      task->set_callback([this, id, push_counts](){
+        if (this->m_is_info)
+          this->m_dyn[0].tick();
+        push_counts(id);
       });
 
       while (superk_in() >= max_running)
@@ -348,21 +549,61 @@ public:
       spdlog::debug("[push] - SuperKTask - S={}", std::get<0>(id));
       pool.add_task(task);
     }
-    while (superk_finish() != m_nb_samples)
+    while (superk_finish() != m_superk.size())
     {
       std::this_thread::sleep_for(std::chrono::milliseconds(20));
     }
     pool.join_all();
+    log_memory(pool);
 
     if (m_opt->hist)
-    {
-      for (auto& h : m_hists)
-        h->merge_clones();
-    }
+      reduce_histograms(m_hists, m_opt->nb_threads);
+    if (m_opt->sketch)
+      reduce_sketches(m_sketches, m_opt->nb_threads);
 
     if (m_is_info)
       m_dyn[0].mark_as_completed();
   }
+  // --max-memory bounds the estimated footprint of the count tasks running together, 0 means
+  // no budget.
+  uint64_t memory_budget() const
+  {
+    return static_cast<uint64_t>(m_opt->max_memory) << 20;
+  }
+
+  uint64_t mean_part_kmers(const parti_info_t& pinfos) const
+  {
+    uint64_t total = 0;
+    for (uint32_t p=0; p<m_config._nb_partitions; p++)
+      total += pinfos->getNbKmer(p);
+    return total / m_config._nb_partitions;
+  }
+
+  // Partitions holding several times the mean number of k-mers are sorted and dumped
+  // with several threads, otherwise they finish long after the others. This is an upper
+  // bound, the extra threads are borrowed from the idle workers of the pool.
+  uint32_t count_threads(const parti_info_t& pinfos, uint32_t part, uint64_t mean_kmers) const
+  {
+    if (mean_kmers == 0)
+      return 1;
+    uint64_t ratio = pinfos->getNbKmer(part) / mean_kmers;
+    return ratio < 2 ? 1 : static_cast<uint32_t>(std::min<uint64_t>(ratio, m_opt->nb_threads));
+  }
+
+  // Threads left to inflate BGZF inputs when there are fewer samples than threads.
+  uint32_t inflate_threads() const
+  {
+    return std::max<uint32_t>(1, m_opt->nb_threads / std::max<size_t>(m_nb_samples, 1));
+  }
+
+  void log_memory(const TaskPool& pool) const
+  {
+    if (pool.memory_budget())
+      spdlog::info("Count: peak estimated memory {} MB, budget {} MB.",
+                   pool.memory_peak() >> 20, pool.memory_budget() >> 20);
+    else
+      spdlog::info("Count: peak estimated memory {} MB.", pool.memory_peak() >> 20);
+  }
 
   size_t superk_finish()
   {
@@ -476,13 +717,19 @@ public:
       m_dyn.push_back(std::move(m_progress[4])); m_dyn[2].set_progress(0);
     }
 
-    if (m_opt->m_ab_float)
+    if (m_opt->m_ab_auto)
+    {
+      m_opt->m_ab_min_vec = compute_auto_thresholds(m_hists, KmDir::get().get_merge_th_path());
+      for (size_t i=0; i<m_opt->m_ab_min_vec.size(); i++)
+        spdlog::info("Solid threshold of {}: {}", KmDir::get().m_fof.get_id(i), m_opt->m_ab_min_vec[i]);
+    }
+    else if (m_opt->m_ab_float)
     {
       m_opt->m_ab_min_vec = compute_merge_thresholds(m_hists, m_opt->m_ab_min_f,
                                                      KmDir::get().get_merge_th_path());
     }
     TaskPool pool(m_opt->nb_threads);
-    for (auto& p : m_opt->restrict_to_list)
+    for (auto& p : m_merge_parts)
     {
       task_t task = nullptr;
       if (m_opt->count_format == COUNT_FORMAT::KMER)
@@ -507,6 +754,58 @@ public:
       m_dyn[2].mark_as_completed();
   }
 
+  // Count and merge each partition in one task, see KmerCountMergeTask.
+  void exec_count_merge()
+  {
+    if (m_is_info)
+    {
+      m_dyn.push_back(std::move(m_progress[3])); m_dyn[1].mark_as_completed();
+      m_dyn.push_back(std::move(m_progress[4])); m_dyn[2].set_progress(0);
+    }
+
+    std::vector<sk_storage_t> storages;
+    std::vector<parti_info_t> pinfos;
+    std::vector<uint32_t> a_mins;
+    for (auto id : KmDir::get().m_fof)
+    {
+      std::string sid = std::get<0>(id);
+      storages.push_back(std::make_shared<SuperKStorageReader>(KmDir::get().get_superk_path(sid)));
+      pinfos.push_back(std::make_shared<PartiInfo<5>>(KmDir::get().get_superk_path(sid)));
+      a_mins.push_back(std::get<2>(id) == 0 ? m_opt->c_ab_min : std::get<2>(id));
+    }
+
+    TaskPool pool(m_opt->nb_threads, memory_budget());
+    for (auto& p : m_merge_parts)
+    {
+      task_t task = nullptr;
+      if (m_opt->count_format == COUNT_FORMAT::KMER)
+      {
+        spdlog::debug("[push] - KmerCountMergeTask - P={}", p);
+        task = std::make_shared<KmerCountMergeTask<MAX_K, MAX_C, SuperKStorageReader>>(
+          p, storages, pinfos, a_mins, m_hists, m_opt->m_ab_min_vec, m_config._kmerSize,
+          m_opt->r_min, m_opt->save_if, m_opt->lz4, m_opt->mode, m_opt->format, !m_opt->keep_tmp);
+      }
+      else
+      {
+        spdlog::debug("[push] - HashCountMergeTask - P={}", p);
+        task = std::make_shared<HashCountMergeTask<MAX_K, MAX_C, SuperKStorageReader>>(
+          p, storages, pinfos, a_mins, m_hists, m_opt->m_ab_min_vec, m_config._kmerSize,
+          m_opt->r_min, m_opt->save_if, m_opt->lz4, m_opt->mode, m_opt->format, m_hw,
+          !m_opt->keep_tmp, m_opt->bwidth);
+      }
+      if (m_is_info) task->set_callback([this](){ this->m_dyn[2].tick(); });
+      pool.add_task(task);
+    }
+    pool.join_all();
+    log_memory(pool);
+
+    if (m_opt->hist)
+      reduce_histograms(m_hists, m_opt->nb_threads);
+
+    if (m_is_info)
+      m_dyn[2].mark_as_completed();
+  }
+
   void exec_format()
   {
     TaskPool pool(m_opt->nb_threads);
@@ -521,6 +820,8 @@ public:
     {
       for (auto id : KmDir::get().m_fof)
       {
+        if (!m_format_todo[KmDir::get().m_fof.get_i(std::get<0>(id))])
+          continue;
         spdlog::debug("[push] - FormatVectorTask - S={}", std::get<0>(id));
         task_t task = std::make_shared<FormatVectorTask>(
           std::get<0>(id), m_opt->out_format, m_hw.bloom_size(), m_config._nb_partitions, false, m_config._kmerSize, !m_opt->keep_tmp);
@@ -545,9 +846,11 @@ public:
 
       for (auto id : KmDir::get().m_fof)
       {
-        spdlog::debug("[push] - FormatTask - S={}", std::get<0>(id));
         std::string sid = std::get<0>(id);
         uint32_t file_id = KmDir::get().m_fof.get_i(sid);
+        if (!m_format_todo[file_id])
+          continue;
+        spdlog::debug("[push] - FormatTask - S={}", sid);
         task_t task = std::make_shared<FormatTask>(
           fds, mutex, m_opt->out_format, m_hw.bloom_size(), file_id, m_config._nb_partitions,
           m_config._kmerSize, !m_opt->keep_tmp);
@@ -575,6 +878,10 @@ public:
   {
     Timer whole_time;
 
+    if (m_opt->telemetry || m_opt->trace)
+      Telemetry::get().enable();
+
+    init_journal();
     exec_config();
     exec_repart();
 
@@ -588,14 +895,17 @@ public:
 
     if (m_opt->logan) {
       exec_logan_count();
+    } else if (m_opt->count_merge) {
+      exec_superk();
+      exec_count_merge();
     } else {
       exec_superk_count();
     }
 
-    if (m_opt->until == COMMAND::COUNT)
+    if (m_opt->until == COMMAND::COUNT || (m_opt->count_merge && m_opt->until == COMMAND::MERGE))
       goto end;
 
-    if (!m_opt->skip_merge && !m_opt->kff)
+    if (!m_opt->skip_merge && !m_opt->kff && !m_opt->count_merge)
     {
       exec_merge();
 
@@ -616,6 +926,13 @@ public:
     out_infos << "Time: " << std::to_string(whole_time.elapsed<std::chrono::seconds>().count());
     out_infos << " seconds" << "\n";
     out_infos << "Memory: " << std::to_string(get_peak_rss() * 0.0009765625) << "MB" << std::endl;
+
+    if (Telemetry::get().enabled())
+    {
+      Telemetry::get().write_report(KmDir::get().m_telemetry);
+      if (m_opt->trace)
+        Telemetry::get().write_trace(KmDir::get().m_trace);
+    }
     Eraser::get().join();
     return;
   }
@@ -626,6 +943,11 @@ public:
   std::vector<task_t> m_superk;
   std::vector<task_t> m_counts;
   std::vector<hist_t> m_hists;
+  std::vector<sketch_t> m_sketches;
+  std::vector<std::vector<uint32_t>> m_superk_parts;
+  std::vector<std::vector<uint32_t>> m_count_parts;
+  std::vector<uint32_t> m_merge_parts;
+  std::vector<bool> m_format_todo;
   TaskPool* m_pool {nullptr};
   std::condition_variable m_cv;
   size_t m_nb_samples;
@@ -0,0 +1,289 @@
+/*****************************************************************************
+ *   kmtricks
+ *   Authors: T. Lemane
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <kmtricks/utils.hpp>
+
+namespace fs = std::filesystem;
+
+namespace km {
+
+// Counters filled by a task while it runs, see ITask::m_stats.
+struct TaskStats
+{
+  void add_read(const std::string& type, uint64_t bytes) { m_read[type] += bytes; }
+  void add_written(const std::string& type, uint64_t bytes) { m_written[type] += bytes; }
+
+  void add_read_file(const std::string& type, const std::string& path)
+  {
+    std::error_code ec;
+    uint64_t size = fs::file_size(path, ec);
+    if (!ec) add_read(type, size);
+  }
+
+  void add_written_file(const std::string& type, const std::string& path)
+  {
+    std::error_code ec;
+    uint64_t size = fs::file_size(path, ec);
+    if (!ec) add_written(type, size);
+  }
+
+  std::map<std::string, uint64_t> m_read;
+  std::map<std::string, uint64_t> m_written;
+  uint64_t m_kmers_in {0};
+  uint64_t m_kmers_out {0};
+};
+
+struct TaskRecord
+{
+  std::string name;
+  std::string stage;
+  uint32_t tid {0};
+  // [begin, end] in microseconds since Telemetry::get().enable()
+  uint64_t pre[2] {0, 0};
+  uint64_t exec[2] {0, 0};
+  uint64_t post[2] {0, 0};
+  size_t rss {0};
+  size_t peak_rss {0};
+  TaskStats stats;
+};
+
+class Telemetry
+{
+  using clock_t = std::chrono::steady_clock;
+
+public:
+  static Telemetry& get()
+  {
+    static Telemetry telemetry;
+    return telemetry;
+  }
+
+  void enable()
+  {
+    m_origin = clock_t::now();
+    m_enabled = true;
+  }
+
+  // Stops recording and drops the records.
+  void reset()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_enabled = false;
+    m_records.clear();
+  }
+
+  bool enabled() const { return m_enabled; }
+
+  uint64_t now() const
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(clock_t::now() - m_origin).count();
+  }
+
+  static uint32_t thread_index()
+  {
+    static std::atomic<uint32_t> counter {0};
+    thread_local uint32_t index = counter++;
+    return index;
+  }
+
+  void record(TaskRecord&& record)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_records.push_back(std::move(record));
+  }
+
+  const std::vector<TaskRecord>& records() const { return m_records; }
+
+  void write_report(const std::string& path)
+  {
+    std::ofstream out(path, std::ios::out); check_fstream_good(path, out);
+    write_report(out);
+  }
+
+  void write_trace(const std::string& path)
+  {
+    std::ofstream out(path, std::ios::out); check_fstream_good(path, out);
+    write_trace(out);
+  }
+
+  // One entry per stage with aggregated counters, followed by the raw task records.
+  void write_report(std::ostream& out)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    struct stage_t
+    {
+      uint64_t nb_tasks {0};
+      uint64_t begin {UINT64_MAX};
+      uint64_t end {0};
+      uint64_t busy {0};
+      uint64_t min_exec {UINT64_MAX};
+      uint64_t max_exec {0};
+      std::string slowest;
+      size_t peak_rss {0};
+      TaskStats stats;
+    };
+
+    std::vector<std::string> order;
+    std::map<std::string, stage_t> stages;
+    for (auto& r : m_records)
+    {
+      if (!stages.count(r.stage)) order.push_back(r.stage);
+      stage_t& s = stages[r.stage];
+      uint64_t exec_time = r.exec[1] - r.exec[0];
+      s.nb_tasks++;
+      s.begin = std::min(s.begin, r.pre[0]);
+      s.end = std::max(s.end, r.post[1]);
+      s.busy += r.post[1] - r.pre[0];
+      s.min_exec = std::min(s.min_exec, exec_time);
+      if (exec_time >= s.max_exec)
+      {
+        s.max_exec = exec_time;
+        s.slowest = r.name;
+      }
+      s.peak_rss = std::max(s.peak_rss, r.peak_rss);
+      for (auto& [k, v] : r.stats.m_read) s.stats.add_read(k, v);
+      for (auto& [k, v] : r.stats.m_written) s.stats.add_written(k, v);
+      s.stats.m_kmers_in += r.stats.m_kmers_in;
+      s.stats.m_kmers_out += r.stats.m_kmers_out;
+    }
+
+    out << "{\n";
+    out << "  \"wall_time_us\": " << now() << ",\n";
+    out << "  \"peak_rss_kb\": " << get_peak_rss() << ",\n";
+    out << "  \"stages\": [";
+    for (size_t i=0; i<order.size(); i++)
+    {
+      stage_t& s = stages[order[i]];
+      uint64_t wall = s.end - s.begin;
+      double secs = static_cast<double>(wall) / 1e6;
+      out << (i ? ",\n" : "\n");
+      out << "    {\"stage\": \"" << escape(order[i]) << "\""
+          << ", \"tasks\": " << s.nb_tasks
+          << ", \"begin_us\": " << s.begin
+          << ", \"wall_us\": " << wall
+          << ", \"busy_us\": " << s.busy
+          << ", \"min_exec_us\": " << s.min_exec
+          << ", \"max_exec_us\": " << s.max_exec
+          << ", \"slowest\": \"" << escape(s.slowest) << "\""
+          << ", \"peak_rss_kb\": " << s.peak_rss << ", ";
+      write_stats(out, s.stats);
+      out << ", \"kmers_in_per_sec\": " << std::fixed << std::setprecision(1)
+          << (secs > 0 ? static_cast<double>(s.stats.m_kmers_in) / secs : 0.0) << "}";
+    }
+    out << "\n  ],\n";
+
+    out << "  \"tasks\": [";
+    for (size_t i=0; i<m_records.size(); i++)
+    {
+      auto& r = m_records[i];
+      out << (i ? ",\n" : "\n");
+      out << "    {\"name\": \"" << escape(r.name) << "\""
+          << ", \"stage\": \"" << escape(r.stage) << "\""
+          << ", \"tid\": " << r.tid
+          << ", \"preprocess\": [" << r.pre[0] << ", " << r.pre[1] << "]"
+          << ", \"exec\": [" << r.exec[0] << ", " << r.exec[1] << "]"
+          << ", \"postprocess\": [" << r.post[0] << ", " << r.post[1] << "]"
+          << ", \"rss_kb\": " << r.rss
+          << ", \"peak_rss_kb\": " << r.peak_rss << ", ";
+      write_stats(out, r.stats);
+      out << "}";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+  // Chrome trace-event format, loadable in chrome://tracing or Perfetto.
+  void write_trace(std::ostream& out)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    out << "{\"traceEvents\": [";
+    bool first = true;
+    auto event = [&](const TaskRecord& r, const char* phase, const uint64_t* t) {
+      if (!t[1]) return;
+      out << (first ? "\n" : ",\n"); first = false;
+      out << "  {\"name\": \"" << escape(r.name) << "\""
+          << ", \"cat\": \"" << escape(r.stage) << "." << phase << "\""
+          << ", \"ph\": \"X\", \"ts\": " << t[0] << ", \"dur\": " << t[1] - t[0]
+          << ", \"pid\": 1, \"tid\": " << r.tid
+          << ", \"args\": {\"kmers_in\": " << r.stats.m_kmers_in
+          << ", \"kmers_out\": " << r.stats.m_kmers_out
+          << ", \"rss_kb\": " << r.rss << "}}";
+    };
+    for (auto& r : m_records)
+    {
+      event(r, "preprocess", r.pre);
+      event(r, "exec", r.exec);
+      event(r, "postprocess", r.post);
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+  }
+
+private:
+  Telemetry() {}
+
+  static void write_stats(std::ostream& out, const TaskStats& stats)
+  {
+    auto write_map = [&](const std::map<std::string, uint64_t>& m) {
+      out << "{";
+      bool first = true;
+      for (auto& [k, v] : m)
+      {
+        out << (first ? "" : ", ") << "\"" << escape(k) << "\": " << v;
+        first = false;
+      }
+      out << "}";
+    };
+    out << "\"bytes_read\": "; write_map(stats.m_read);
+    out << ", \"bytes_written\": "; write_map(stats.m_written);
+    out << ", \"kmers_in\": " << stats.m_kmers_in << ", \"kmers_out\": " << stats.m_kmers_out;
+  }
+
+  static std::string escape(const std::string& s)
+  {
+    std::string e;
+    for (char c : s)
+    {
+      if (c == '"' || c == '\\')
+        e.push_back('\\');
+      if (static_cast<unsigned char>(c) < 0x20)
+        continue;
+      e.push_back(c);
+    }
+    return e;
+  }
+
+private:
+  bool m_enabled {false};
+  clock_t::time_point m_origin {clock_t::now()};
+  std::mutex m_mutex;
+  std::vector<TaskRecord> m_records;
+};
+
+};
@@ -3,7 +3,10 @@
 #include <string>
 #include <cstdlib>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <chrono>
 #include <sdsl/bit_vectors.hpp>
 #include <sdsl/sfstream.hpp>
@@ -57,7 +60,8 @@ BitVector::BitVector
 		numBits(0),
 		ranker1(nullptr),
 		selector0(nullptr),
-		filterInfo(0)
+		filterInfo(0),
+		mappedWords(nullptr)
 	{
 	;
 	}
@@ -69,7 +73,8 @@ BitVector::BitVector
 		offset(0),
 		ranker1(nullptr),
 		selector0(nullptr),
-		filterInfo(0)
+		filterInfo(0),
+		mappedWords(nullptr)
 	{
 	bits = nullptr;
 	if (srcBv == nullptr) return;
@@ -79,6 +84,11 @@ BitVector::BitVector
 
 	if (srcBv->bits != nullptr)
 		copy_from (srcBv->bits);
+	else if (srcBv->mappedWords != nullptr)
+		{
+		new_bits (srcBv->numBits);
+		std::memcpy (bits->data(), srcBv->mappedWords, ((numBits+63)/64) * sizeof(u64));
+		}
 	else if ((srcBv->numBits != 0)
 	      && ((srcBv->compressor() == bvcomp_zeros)
 	       || (srcBv->compressor() == bvcomp_ones)))
@@ -97,7 +107,8 @@ BitVector::BitVector
 		offset(0),
 		ranker1(nullptr),
 		selector0(nullptr),
-		filterInfo(0)
+		filterInfo(0),
+		mappedWords(nullptr)
 	{
 	bits = nullptr;
 	numBits = 0;
@@ -125,6 +136,8 @@ void BitVector::load()
 
 	if (isResident) return;
 
+	if ((mapFiles) and (compressor() == bvcomp_uncompressed) and (map_in()))
+		return;
 
 	std::ifstream* in = FileManager::open_file(filename,std::ios::binary|std::ios::in);
 	if (not *in)
@@ -145,6 +158,80 @@ void BitVector::load()
 	FileManager::close_file(in,/*really*/true);
 	}
 
+//----------
+//
+// map_in, unmap--
+//	With mapFiles set, load() maps the file of an uncompressed vector and the
+//	bits are read in place. Loading a node then costs no read nor copy, and
+//	the page cache is shared by concurrent query processes. map_in() returns
+//	false if the vector's words are not 8-byte aligned in the file, in which
+//	case the vector is read as usual. Query threads may load nodes of the same
+//	file concurrently, so the table of mappings is locked.
+//
+//----------
+
+bool BitVector::mapFiles = false;
+
+std::shared_ptr<km::MappedFile> BitVector::map_file
+   (const string& filename)
+	{
+	// the vectors of a file share its mapping, which is released along with
+	// the last of them
+
+	static std::map<string,std::weak_ptr<km::MappedFile>> mappedFiles;
+	static std::mutex mappedFilesMutex;
+
+	std::lock_guard<std::mutex> lock(mappedFilesMutex);
+	std::shared_ptr<km::MappedFile> mf = mappedFiles[filename].lock();
+	if (mf == nullptr)
+		{
+		try
+			{ mf = std::make_shared<km::MappedFile>(filename); }
+		catch (const km::IOError& e)
+			{ fatal ("error: BitVector::map_file() " + e.get_msg()); }
+		mappedFiles[filename] = mf;
+		}
+	return mf;
+	}
+
+bool BitVector::map_in()
+	{
+	std::shared_ptr<km::MappedFile> mf = map_file(filename);
+
+	size_t dataOffset = offset + sdslbitvectorHeaderBytes;
+	if ((dataOffset % sizeof(u64) != 0) or (mf->size() < dataOffset))
+		return false;
+
+	u64 fileNumBits;
+	std::memcpy (&fileNumBits, mf->data()+offset, sizeof(fileNumBits));
+	if (mf->size() < dataOffset + ((fileNumBits+63)/64) * sizeof(u64))
+		fatal ("error: BitVector::map_in(" + identity() + ")"
+		     + " \"" + filename + "\" is truncated");
+
+	mappedFile  = mf;
+	mappedWords = (const u64*) (mf->data() + dataOffset);
+	numBits     = fileNumBits;
+	isResident  = true;
+	return true;
+	}
+
+void BitVector::unmap()
+	{
+	mappedWords = nullptr;
+	mappedFile.reset();
+	}
+
+void BitVector::copy_mapped_bits()
+	{
+	// sdsl rank/select need the bits in the heap
+
+	if (mappedWords == nullptr) return;
+
+	bits = new sdslbitvector (numBits, 0);
+	std::memcpy (bits->data(), mappedWords, ((numBits+63)/64) * sizeof(u64));
+	unmap();
+	}
+
 void BitVector::serialized_in
    (std::ifstream& in)
 	{
@@ -208,6 +295,7 @@ size_t BitVector::serialized_out
 
 void BitVector::discard_bits()
 	{
+	unmap();
 
 	if (bits != nullptr)
 		{
@@ -220,6 +308,7 @@ void BitVector::discard_bits()
 void BitVector::new_bits
    (u64 _numBits)
 	{
+	unmap();
 
 	if (bits != nullptr)
 		{
@@ -252,6 +341,7 @@ void BitVector::replace_bits
 void BitVector::copy_from
    (const sdslbitvector* srcBits)
 	{
+	unmap();
 
 	if (bits != nullptr)
 		{
@@ -430,9 +520,31 @@ void BitVector::squeeze_by
 int BitVector::operator[]
    (u64 pos) const
 	{
+	if (mappedWords != nullptr) return (mappedWords[pos >> 6] >> (pos & 63)) & 1;
 	return (*bits)[pos];
 	}
 
+// access_sorted--
+//	Read the bits at n ascending positions. Consecutive positions mostly share
+//	cache lines, and the words a few positions ahead are prefetched to hide
+//	the remaining misses.
+
+void BitVector::access_sorted
+   (const u64*		pos,
+	u64				n,
+	std::uint8_t*	out) const
+	{
+	const u64 prefetchDistance = 16;
+	const u64* words = (mappedWords != nullptr)? mappedWords : bits->data();
+
+	for (u64 ix=0 ; ix<n ; ix++)
+		{
+		if (ix + prefetchDistance < n)
+			__builtin_prefetch (words + (pos[ix+prefetchDistance] >> 6));
+		out[ix] = (words[pos[ix] >> 6] >> (pos[ix] & 63)) & 1;
+		}
+	}
+
 void BitVector::write_bit
    (u64	pos,
 	int	val)
@@ -452,6 +564,8 @@ u64 BitVector::rank1
 	// rank1(n) = the number of 1 bits in the first n positions
 	//          = sum of bits[i] for 0<=i<n
 
+	copy_mapped_bits();
+
 	if (bits == nullptr)
 		fatal ("internal error for " + identity()
 		     + "; request for rank1(" + std::to_string(pos) + ")"
@@ -475,6 +589,8 @@ u64 BitVector::select0
 	//   sdsl.select0(i) = min{n s.t. rank0(n)=i}
 	// so we add 1 to their input
 
+	copy_mapped_bits();
+
 	if (bits == nullptr)
 		fatal ("internal error for " + identity()
 		     + "; request for select0(" + std::to_string(rank) + ")"
@@ -498,6 +614,7 @@ void BitVector::discard_rank_select ()
 u64 BitVector::size () const
 	{
 	if (bits != nullptr) return bits->size();
+	if (mappedWords != nullptr) return numBits;
 
 	fatal ("internal error for " + identity()
 	     + "; request for size() of null bit vector");
@@ -570,6 +687,11 @@ RrrBitVector::RrrBitVector
 
 	if (srcBv->bits != nullptr)
 		copy_from (srcBv->bits);
+	else if (srcBv->mappedWords != nullptr)
+		{
+		new_bits (srcBv->numBits);
+		std::memcpy (bits->data(), srcBv->mappedWords, ((numBits+63)/64) * sizeof(u64));
+		}
 	else if (srcBv->compressor() == bvcomp_rrr)
 		{
 		RrrBitVector* srcRrrBv = (RrrBitVector*) srcBv;
@@ -797,6 +919,33 @@ int RrrBitVector::operator[]
 	                   else return BitVector::operator[](pos);
 	}
 
+void RrrBitVector::access_sorted
+   (const u64*		pos,
+	u64				n,
+	std::uint8_t*	out) const
+	{
+	if (rrrBits == nullptr)
+		{ BitVector::access_sorted (pos, n, out);  return; }
+
+	// decode each 64-bit chunk of the RRR blocks once; ascending positions
+	// that fall in the same chunk are answered from the decoded word
+
+	u64 rrrSize = rrrBits->size();
+	u64 chunk   = (u64) -1;
+	u64 word    = 0;
+	for (u64 ix=0 ; ix<n ; ix++)
+		{
+		u64 c = pos[ix] >> 6;
+		if (c != chunk)
+			{
+			chunk = c;
+			u64 start = c << 6;
+			word = rrrBits->get_int (start, std::min<u64> (64, rrrSize-start));
+			}
+		out[ix] = (word >> (pos[ix] & 63)) & 1;
+		}
+	}
+
 void RrrBitVector::write_bit
    (u64	pos,
 	int	val)
@@ -920,6 +1069,11 @@ RoarBitVector::RoarBitVector
 
 	if (srcBv->bits != nullptr)
 		copy_from (srcBv->bits);
+	else if (srcBv->mappedWords != nullptr)
+		{
+		new_bits (srcBv->numBits);
+		std::memcpy (bits->data(), srcBv->mappedWords, ((numBits+63)/64) * sizeof(u64));
+		}
 	else if (srcBv->compressor() == bvcomp_roar)
 		{
 		RoarBitVector* srcRoarBv = (RoarBitVector*) srcBv;
@@ -1163,6 +1317,27 @@ int RoarBitVector::operator[]
 	                    else return BitVector::operator[](pos);
 	}
 
+void RoarBitVector::access_sorted
+   (const u64*		pos,
+	u64				n,
+	std::uint8_t*	out) const
+	{
+	if (roarBits == nullptr)
+		{ BitVector::access_sorted (pos, n, out);  return; }
+
+	// sweep a single iterator forward through the containers, instead of
+	// searching the container of each position from scratch
+
+	roaring_uint32_iterator_t it;
+	roaring_init_iterator (roarBits, &it);
+	for (u64 ix=0 ; ix<n ; ix++)
+		{
+		if ((it.has_value) && (it.current_value < pos[ix]))
+			roaring_move_uint32_iterator_equalorlarger (&it, (std::uint32_t) pos[ix]);
+		out[ix] = (it.has_value) && (it.current_value == pos[ix]);
+		}
+	}
+
 void RoarBitVector::write_bit
    (u64	pos,
 	int	val)
@@ -1248,6 +1423,23 @@ RawBitVector::~RawBitVector()
 	// bits will get deleted in BitVector's destructor
 	}
 
+bool RawBitVector::map_in()
+	{
+	// raw bits have no sdsl header, and numBits comes from the caller
+
+	if (numBits == 0) return false;
+
+	std::shared_ptr<km::MappedFile> mf = map_file(filename);
+	if ((offset % sizeof(u64) != 0)
+	 or (mf->size() < offset + ((numBits+63)/64) * sizeof(u64)))
+		return false;
+
+	mappedFile  = mf;
+	mappedWords = (const u64*) (mf->data() + offset);
+	isResident  = true;
+	return true;
+	}
+
 void RawBitVector::serialized_in
    (std::ifstream& in)
 	{
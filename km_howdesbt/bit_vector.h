@@ -1,10 +1,13 @@
 #ifndef bit_vector_H
 #define bit_vector_H
 
+#include <algorithm>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <sdsl/bit_vectors.hpp>
 #include <roaring/roaring.h>
+#include <kmtricks/io/mmap_file.hpp>
 #include "bloom_filter_file.h"
 
 // Honor the deployer's choice of custom RRR block size and rank period. This
@@ -87,6 +90,9 @@ public:
 	virtual std::uint32_t compressor() const { return bvcomp_uncompressed; }
 	virtual bool is_compressed() const { return false; }
 	virtual void load();
+	virtual bool map_in();
+	virtual void unmap();
+	virtual void copy_mapped_bits();
 	virtual void serialized_in(std::ifstream& in);
 	virtual void unfinished() {};  // solely for RrrBitVector and RoarBitVector to override
 	virtual void finished() {};    // solely for RrrBitVector and RoarBitVector to override
@@ -111,6 +117,7 @@ public:
 	virtual void squeeze_by(const sdslbitvector* srcBits);
 
 	virtual int operator[](std::uint64_t pos) const;
+	virtual void access_sorted(const std::uint64_t* pos, std::uint64_t n, std::uint8_t* out) const;
 	virtual void write_bit(std::uint64_t pos, int val=1);
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
@@ -134,9 +141,16 @@ public:
 	sdslselect0* selector0;
 	std::uint64_t filterInfo; // filter-dependent info for this bit vector;
 							// .. typically zero
+	std::shared_ptr<km::MappedFile> mappedFile;
+	const std::uint64_t* mappedWords; // exclusive of bits; when non-null, the
+							// .. vector is read in place from mappedFile
 
 
 public:
+	static bool mapFiles;	// true => uncompressed vectors are memory-mapped
+							// .. by load() instead of being read into the heap
+	static std::shared_ptr<km::MappedFile> map_file (const std::string& filename);
+
 	static bool       valid_filename (const std::string& filename);
 	static std::string compressor_to_string(std::uint32_t compressor);
 	static BitVector* bit_vector     (const std::string& filename,
@@ -181,6 +195,7 @@ public:
 	virtual bool is_all_ones();
 
 	virtual int operator[](std::uint64_t pos) const;
+	virtual void access_sorted(const std::uint64_t* pos, std::uint64_t n, std::uint8_t* out) const;
 	virtual void write_bit(std::uint64_t pos, int val=1);
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
@@ -228,6 +243,7 @@ public:
 	virtual bool is_all_ones();
 
 	virtual int operator[](std::uint64_t pos) const;
+	virtual void access_sorted(const std::uint64_t* pos, std::uint64_t n, std::uint8_t* out) const;
 	virtual void write_bit(std::uint64_t pos, int val=1);
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
@@ -255,6 +271,7 @@ public:
 	virtual ~RawBitVector();
 
 	virtual std::string class_identity() const { return "RawBitVector"; }
+	virtual bool map_in();
 	virtual void serialized_in(std::ifstream& in);
 	};
 
@@ -289,6 +306,7 @@ public:
 	virtual void mask_with(const sdslbitvector* srcBits);
 
 	virtual int operator[](std::uint64_t pos) const { return 0; }
+	virtual void access_sorted(const std::uint64_t* pos, std::uint64_t n, std::uint8_t* out) const { std::fill(out,out+n,0); }
 	virtual void write_bit(std::uint64_t pos, int val=1);
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
@@ -314,6 +332,7 @@ public:
 	virtual bool is_all_ones() { return true; }
 
 	virtual int operator[](std::uint64_t pos) const { return 1; }
+	virtual void access_sorted(const std::uint64_t* pos, std::uint64_t n, std::uint8_t* out) const { std::fill(out,out+n,1); }
 
 	virtual std::uint64_t rank1(std::uint64_t pos);
 	virtual std::uint64_t select0(std::uint64_t rank);
@@ -963,6 +963,23 @@ int BloomFilter::lookup
 	else return unresolved;
 	}
 
+// lookup_sorted--
+//	Resolve n ascending positions at once, as lookup() would for each of them.
+//	Reading each bit vector in one ascending sweep keeps its cache lines (or
+//	compressed blocks) hot across positions.
+
+void BloomFilter::lookup_sorted
+   (const u64*		pos,
+	u64				n,
+	std::int8_t*	resolutions) const
+	{
+	vector<std::uint8_t> bits(n);
+	bvs[0]->access_sorted (pos, n, bits.data());
+
+	for (u64 ix=0 ; ix<n ; ix++)
+		resolutions[ix] = (bits[ix] == 0)? absent : unresolved;
+	}
+
 //----------
 //
 // AllSomeFilter--
@@ -1045,6 +1062,23 @@ int AllSomeFilter::lookup
 	else                          return unresolved;
 	}
 
+void AllSomeFilter::lookup_sorted
+   (const u64*		pos,
+	u64				n,
+	std::int8_t*	resolutions) const
+	{
+	vector<std::uint8_t> allBits(n), someBits(n);
+	bvs[0]->access_sorted (pos, n, allBits.data());
+	bvs[1]->access_sorted (pos, n, someBits.data());
+
+	for (u64 ix=0 ; ix<n ; ix++)
+		{
+		if      (allBits[ix]  == 1) resolutions[ix] = present;
+		else if (someBits[ix] == 0) resolutions[ix] = absent;
+		else                        resolutions[ix] = unresolved;
+		}
+	}
+
 //----------
 //
 // DeterminedFilter--
@@ -1097,6 +1131,23 @@ int DeterminedFilter::lookup
 	else                         return absent;
 	}
 
+void DeterminedFilter::lookup_sorted
+   (const u64*		pos,
+	u64				n,
+	std::int8_t*	resolutions) const
+	{
+	vector<std::uint8_t> detBits(n), howBits(n);
+	bvs[0]->access_sorted (pos, n, detBits.data());
+	bvs[1]->access_sorted (pos, n, howBits.data());
+
+	for (u64 ix=0 ; ix<n ; ix++)
+		{
+		if      (detBits[ix] == 0) resolutions[ix] = unresolved;
+		else if (howBits[ix] == 1) resolutions[ix] = present;
+		else                       resolutions[ix] = absent;
+		}
+	}
+
 //----------
 //
 // DeterminedBriefFilter--
@@ -1158,6 +1209,37 @@ int DeterminedBriefFilter::lookup
 	else                       return absent;
 	}
 
+void DeterminedBriefFilter::lookup_sorted
+   (const u64*		pos,
+	u64				n,
+	std::int8_t*	resolutions) const
+	{
+	BitVector* bvDet = bvs[0];
+	BitVector* bvHow = bvs[1];
+
+	vector<std::uint8_t> detBits(n);
+	bvDet->access_sorted (pos, n, detBits.data());
+
+	// rank is monotonic, so the how positions of the determined bits are
+	// ascending too
+
+	vector<u64> howPos;
+	for (u64 ix=0 ; ix<n ; ix++)
+		{
+		if (detBits[ix] == 1) howPos.emplace_back(bvDet->rank1(pos[ix]));
+		}
+	vector<std::uint8_t> howBits(howPos.size());
+	bvHow->access_sorted (howPos.data(), howPos.size(), howBits.data());
+
+	u64 howIx = 0;
+	for (u64 ix=0 ; ix<n ; ix++)
+		{
+		if      (detBits[ix] == 0)        resolutions[ix] = unresolved;
+		else if (howBits[howIx++] == 1)   resolutions[ix] = present;
+		else                              resolutions[ix] = absent;
+		}
+	}
+
 void DeterminedBriefFilter::adjust_positions_in_list
    (std::vector<std::pair<std::uint64_t,std::size_t>> &smerHashes,
 	u64 numUnresolved)
@@ -71,6 +71,7 @@ public:
 	virtual bool contains (const std::string& mer) const;
 	virtual bool contains (const std::uint64_t* merData) const;
 	virtual int lookup (const std::uint64_t pos) const;
+	virtual void lookup_sorted (const std::uint64_t* pos, std::uint64_t n, std::int8_t* resolutions) const;
 
 	virtual std::uint64_t hash_modulus() const { return hashModulus; }
 	virtual std::uint64_t num_bits()     const { return numBits; }
@@ -166,6 +167,7 @@ public:
 	virtual bool contains (const std::string& mer) const;
 	virtual bool contains (const std::uint64_t* merData) const;
 	virtual int lookup (const std::uint64_t pos) const;
+	virtual void lookup_sorted (const std::uint64_t* pos, std::uint64_t n, std::int8_t* resolutions) const;
 	};
 
 
@@ -188,6 +190,7 @@ public:
 	virtual std::uint32_t kind() const { return bfkind_determined; }
 
 	virtual int lookup (const std::uint64_t pos) const;
+	virtual void lookup_sorted (const std::uint64_t* pos, std::uint64_t n, std::int8_t* resolutions) const;
 	};
 
 class DeterminedBriefFilter: public DeterminedFilter
@@ -217,6 +220,7 @@ public:
 	virtual std::uint32_t kind() const { return bfkind_determined_brief; }
 
 	virtual int lookup (const std::uint64_t pos) const;
+	virtual void lookup_sorted (const std::uint64_t* pos, std::uint64_t n, std::int8_t* resolutions) const;
 
 	virtual bool is_position_adjustor  () { return true; }
 	virtual void adjust_positions_in_list  (std::vector<std::pair<std::uint64_t,std::size_t>> &smerHashes,
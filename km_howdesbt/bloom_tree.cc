@@ -7,6 +7,7 @@
 //        300-302.
 
 #include <string>
+#include <algorithm>
 #include <cstdlib>
 #include <cstdint>
 #include <cmath>
@@ -19,6 +20,7 @@
 
 using std::string;
 using std::vector;
+using std::pair;
 using std::cout;
 using std::cerr;
 using std::endl;
@@ -1166,6 +1168,44 @@ void BloomTree::perform_batch_query
 
 	load();
 
+	// resolve the unresolved positions of all the queries in one ascending
+	// sweep over the filter; resolutions[queryBase[qIx]+posIx] is the
+	// resolution of q->smerHashes[posIx], and follows it when it is swapped
+
+	vector<u64> queryBase(nbIncomingQueries);
+	u64 numLookups = 0;
+	for (qIx=0 ; qIx<nbIncomingQueries ; qIx++)
+		{
+		queryBase[qIx] = numLookups;
+		numLookups += queries[qIx]->numUnresolved;
+		}
+
+	vector<std::int8_t> resolutions(numLookups);
+	{
+	vector<pair<u64,u64>> sortedLookups(numLookups);
+	for (qIx=0 ; qIx<nbIncomingQueries ; qIx++)
+		{
+		Query* q = queries[qIx];
+		for (u64 posIx=0 ; posIx<q->numUnresolved ; posIx++)
+			sortedLookups[queryBase[qIx]+posIx] = pair<u64,u64>(q->smerHashes[posIx].first, queryBase[qIx]+posIx);
+		}
+	std::sort (sortedLookups.begin(), sortedLookups.end());
+
+	vector<u64> sortedPos(numLookups);
+	for (u64 ix=0 ; ix<numLookups ; ix++)
+		sortedPos[ix] = sortedLookups[ix].first;
+	vector<std::int8_t> sortedResolutions(numLookups);
+	bf->lookup_sorted (sortedPos.data(), numLookups, sortedResolutions.data());
+
+	for (u64 ix=0 ; ix<numLookups ; ix++)
+		{
+		int resolution = sortedResolutions[ix];
+		if ((resolution == BloomFilter::unresolved) and (isLeaf))
+			resolution = BloomFilter::present;
+		resolutions[sortedLookups[ix].second] = resolution;
+		}
+	}
+
 	// operate on each query in the batch
 	//……… ideally, we'd like to perform this for all siblings, then unload the
 	//……… .. siblings, before we descend to the siblings' children
@@ -1174,6 +1214,7 @@ void BloomTree::perform_batch_query
 	while (qIx < nbActiveQueries)
 		{ // note that nbActiveQueries may change during this loop
 		Query* q = queries[qIx];
+		std::int8_t* qResolutions = resolutions.data() + queryBase[qIx];
 		bool queryPasses = false;
 		bool queryFails  = false;
 
@@ -1188,11 +1229,10 @@ void BloomTree::perform_batch_query
 			// Attribution: the technique of swapping resolved positions to the
 			// end of the list was inspired by reference [1]
 
-			u64 hashvalue = q->smerHashes[posIx].first;
 			size_t hash_position = q->smerHashes[posIx].second;
 
 			bool posIsResolved = true;
-			int resolution = lookup(hashvalue);
+			int resolution = qResolutions[posIx];
 
 			if (resolution == BloomFilter::absent)
 				{
@@ -1224,6 +1264,7 @@ void BloomTree::perform_batch_query
 				std::pair<std::uint64_t,std::size_t> tmp_hash_pos = q->smerHashes[posIx];
 				q->smerHashes[posIx] = std::move(q->smerHashes[positionsToTest]);
 				q->smerHashes[positionsToTest] = std::move(tmp_hash_pos);
+				std::swap (qResolutions[posIx], qResolutions[positionsToTest]);
 				}
 
 			// otherwise, move on to the next hashvalue 
@@ -1259,6 +1300,7 @@ void BloomTree::perform_batch_query
 			nbActiveQueries--;
 			queries[qIx] = queries[nbActiveQueries];
 			queries[nbActiveQueries] = q;
+			std::swap (queryBase[qIx], queryBase[nbActiveQueries]);
 			}
 		else
 			{
@@ -91,6 +91,9 @@ void QueryCommand::usage
 	s << "  --consistencycheck   before searching, check that bloom filter properties are" << endl;
 	s << "                       consistent across the tree" << endl;
 	s << "                       (not needed with --usemanager)" << endl;
+	s << "  --mmap               map uncompressed bloom filters into memory instead of" << endl;
+	s << "                       reading them, nodes are then read in place from the" << endl;
+	s << "                       page cache" << endl;
 	s << "  --time               report wall time and node i/o time" << endl;
 	s << "  --out=<filename>     file for query results; if this is not provided, results" << endl;
 	s << "                       are written to stdout" << endl;
@@ -109,6 +112,7 @@ void QueryCommand::parse
 	nodetail        			= false;
 	threshold_shared_positions 	= defaultQueryThreshold;
 	checkConsistency        	= false;
+	mapBitVectors				= false;
 	z							= 0;
 
 
@@ -232,6 +236,11 @@ void QueryCommand::parse
 		 || (arg == "--noconsistencycheck"))
 			{ checkConsistency = false;  continue; }
 
+		// --mmap
+
+		if (arg == "--mmap")
+			{ mapBitVectors = true;  continue; }
+
 
 
 		
@@ -315,7 +324,7 @@ QueryCommand::~QueryCommand()
 
 int QueryCommand::execute()
 	{
-
+	BitVector::mapFiles = mapBitVectors;
 
 	// read the tree
 
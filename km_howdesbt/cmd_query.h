@@ -45,6 +45,7 @@ public:
 	bool nodetail;
 	bool useFileManager;
 	bool checkConsistency;			// only meaningful if useFileManager is false
+	bool mapBitVectors;				// true => uncompressed nodes are memory-mapped
 	bool completeSmerCounts;
 	int z; 							// findere strategy
 
@@ -0,0 +1,40 @@
+#include <kmtricks/plugin.hpp>
+
+// Same as BasicEx, with the block interface
+using count_type = typename km::selectC<DMAX_C>::type;
+
+class BlockEx : public km::IMergePlugin
+{
+public:
+  BlockEx() = default;
+private:
+  unsigned int m_threshold {0};
+
+public:
+  // Receive the rows by blocks of 4096
+  size_t block_size() const override { return 4096; }
+
+  // Override process_kmer_block (and/or process_hash_block)
+  // Counts are stored by sample, so each loop runs over contiguous counts and can be vectorized
+  // Discard lines which contain abundances less than a threshold
+  void process_kmer_block(km::MergeBlock& block) override
+  {
+    for (size_t s = 0; s < block.nb_samples; s++)
+    {
+      const count_type* counts = block.column(s);
+      for (size_t r = 0; r < block.nb_rows; r++)
+        block.keep[r] &= counts[r] >= m_threshold;
+    }
+  }
+
+  void configure(const std::string& s) override
+  {
+    m_threshold = std::stoll(s);
+  }
+};
+
+// Make the plugin loadable
+extern "C" std::string plugin_name() { return "BlockEx"; }
+extern "C" int use_template() { return 0; }
+extern "C" km::IMergePlugin* create0() { return new BlockEx(); }
+extern "C" void destroy(km::IMergePlugin* p) { delete p; }
@@ -42,6 +42,9 @@ kmtricksCli::kmtricksCli(
   index_opt = std::make_shared<struct index_options>(index_options{});
   query_opt = std::make_shared<struct query_options>(query_options{});
   combine_opt = std::make_shared<struct combine_options>(combine_options{});
+  extract_opt = std::make_shared<struct extract_options>(extract_options{});
+  add_opt = std::make_shared<struct add_options>(add_options{});
+  sketch_opt = std::make_shared<struct sketch_options>(sketch_options{});
   all_cli(cli, all_opt);
 #ifdef WITH_KM_MODULES
   repart_cli(cli, repart_opt);
@@ -53,11 +56,14 @@ kmtricksCli::kmtricksCli(
 #endif
   dump_cli(cli, dump_opt);
   agg_cli(cli, agg_opt);
+  extract_cli(cli, extract_opt);
   combine_cli(cli, combine_opt);
+  add_cli(cli, add_opt);
+  sketch_cli(cli, sketch_opt);
 #ifdef WITH_HOWDE
   index_cli(cli, index_opt);
-  query_cli(cli, query_opt);
 #endif
+  query_cli(cli, query_opt);
   info_cli(cli);
 }
 
@@ -108,6 +114,12 @@ std::tuple<COMMAND, km_options_t> kmtricksCli::parse(int argc, char* argv[])
     return std::make_tuple(COMMAND::QUERY, query_opt);
   else if (cli->is("combine"))
     return std::make_tuple(COMMAND::COMBINE, combine_opt);
+  else if (cli->is("extract"))
+    return std::make_tuple(COMMAND::EXTRACT, extract_opt);
+  else if (cli->is("add"))
+    return std::make_tuple(COMMAND::ADD, add_opt);
+  else if (cli->is("sketch"))
+    return std::make_tuple(COMMAND::SKETCH, sketch_opt);
   else
     return std::make_tuple(COMMAND::INFOS, std::make_shared<struct km_options>(km_options{}));
 }
@@ -139,7 +151,6 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
 
   all_cmd->add_param("--run-dir", "kmtricks runtime directory.")
     ->meta("DIR")
-    ->checker(dir_already_exists)
     ->setter(options->dir);
 
   all_cmd->add_param("--kmer-size", fmt::format("size of a k-mer. [8, {}].", KL[KMER_N-1]-1))
@@ -226,6 +237,26 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->as_flag()
     ->setter(options->hist);
 
+  all_cmd->add_param("--hist-log", "one histogram bucket per power of two, up to the largest count (with --hist).")
+    ->as_flag()
+    ->setter(options->hist_log);
+
+  all_cmd->add_param("--sketch", "compute HyperLogLog and MinHash sketches of the solid k-mers.")
+    ->as_flag()
+    ->setter(options->sketch);
+
+  all_cmd->add_param("--sketch-scale", "keep the hashes below 2^64/INT in the sketches.")
+    ->meta("INT")
+    ->def("1000")
+    ->checker(bc::check::is_number)
+    ->setter(options->sketch_scale);
+
+  all_cmd->add_param("--sketch-size", "keep at most INT hashes per sketch, 0 = no limit.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->sketch_size);
+
   all_cmd->add_param("--kff-output", "output counted k-mers in kff format (only with --until count).")
     ->as_flag()
     ->setter(options->kff);
@@ -234,6 +265,14 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->as_flag()
     ->setter(options->keep_tmp);
 
+  all_cmd->add_param("--telemetry", "write per-task timings, I/O and memory to <run-dir>/telemetry.json.")
+    ->as_flag()
+    ->setter(options->telemetry);
+
+  all_cmd->add_param("--trace", "also write a chrome trace to <run-dir>/trace.json (implies --telemetry).")
+    ->as_flag()
+    ->setter(options->trace);
+
   all_cmd->add_param("--repart-from", "use repartition from another kmtricks run.")
          ->meta("STR")
          ->def("")
@@ -250,6 +289,12 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
       options->m_ab_min_path = v;
       return;
     }
+    if (v == "auto")
+    {
+      options->m_ab_auto = true;
+      options->m_ab_float = true;
+      return;
+    }
     if (v.find('.') != std::string::npos)
     {
       bc::check::throw_if_false(bc::check::f::range(0.0, 1.0)("--abundance-min<float>", v));
@@ -261,7 +306,7 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
   };
 
   all_cmd->add_param("--soft-min", "during merge, min abundance to keep a k-mer, see README.")
-    ->meta("INT/STR/FLOAT")
+    ->meta("INT/STR/FLOAT/auto")
     ->def("1")
     ->setter_c(a_min_setter);
 
@@ -294,6 +339,14 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->as_flag()
     ->setter(options->skip_merge);
 
+  all_cmd->add_param("--count-merge", "count and merge each partition in a single task, without count files.")
+    ->as_flag()
+    ->setter(options->count_merge);
+
+  all_cmd->add_param("--resume", "resume an interrupted run in --run-dir, completed tasks are skipped.")
+    ->as_flag()
+    ->setter(options->resume);
+
   all_cmd->add_group("advanced performance tweaks", "");
 
   all_cmd->add_param("--minimizer-size", "size of minimizers. [4, 15]")
@@ -320,6 +373,18 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->checker(bc::check::is_number)
     ->setter(options->nb_parts);
 
+  all_cmd->add_param("--sample-reads", "reads drawn per sample to compute the repartition (0=auto).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->sample_reads);
+
+  all_cmd->add_param("--sample-seed", "seed of the read sampling.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->sample_seed);
+
   all_cmd->add_param("--restrict-to", "Process only a fraction of partitions. [0.05, 1.0]")
     ->meta("FLOAT")
     ->def("1.0")
@@ -343,10 +408,20 @@ km_options_t all_cli(std::shared_ptr<bc::Parser<1>> cli, all_options_t options)
     ->checker(bc::check::f::range(0.0, 1.0))
     ->setter(options->focus);
 
+  all_cmd->add_param("--max-memory", "memory budget in MB, bounds the count tasks running together (0 = no budget).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->max_memory);
+
   all_cmd->add_param("--cpr", "compression for kmtricks's tmp files.")
     ->as_flag()
     ->setter(options->lz4);
 
+  all_cmd->add_param("--packed-superk", "store the super-k-mers of a sample in a single file.")
+    ->as_flag()
+    ->setter(options->packed_superk);
+
   all_cmd->add_group("hash mode configuration", "");
 
   all_cmd->add_param("--bloom-size", "bloom filter size")
@@ -444,6 +519,18 @@ km_options_t repart_cli(std::shared_ptr<bc::Parser<1>> cli, repart_options_t opt
     ->checker(bc::check::is_number)
     ->setter(options->nb_parts);
 
+  repart_cmd->add_param("--sample-reads", "reads drawn per sample to compute the repartition (0=auto).")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->sample_reads);
+
+  repart_cmd->add_param("--sample-seed", "seed of the read sampling.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->sample_seed);
+
   repart_cmd->add_param("--bloom-size", "bloom filter size")
     ->meta("INT")
     ->def("10000000")
@@ -482,6 +569,10 @@ km_options_t superk_cli(std::shared_ptr<bc::Parser<1>> cli, superk_options_t opt
     ->as_flag()
     ->setter(options->lz4);
 
+  superk_cmd->add_param("--packed", "store all partitions in a single file.")
+    ->as_flag()
+    ->setter(options->packed);
+
   add_common(superk_cmd, options);
 
   return options;
@@ -521,6 +612,26 @@ km_options_t count_cli(std::shared_ptr<bc::Parser<1>> cli, count_options_t optio
     ->as_flag()
     ->setter(options->hist);
 
+  count_cmd->add_param("--hist-log", "one histogram bucket per power of two, up to the largest count (with --hist).")
+    ->as_flag()
+    ->setter(options->hist_log);
+
+  count_cmd->add_param("--sketch", "compute HyperLogLog and MinHash sketches of the solid k-mers.")
+    ->as_flag()
+    ->setter(options->sketch);
+
+  count_cmd->add_param("--sketch-scale", "keep the hashes below 2^64/INT in the sketches.")
+    ->meta("INT")
+    ->def("1000")
+    ->checker(bc::check::is_number)
+    ->setter(options->sketch_scale);
+
+  count_cmd->add_param("--sketch-size", "keep at most INT hashes per sketch, 0 = no limit.")
+    ->meta("INT")
+    ->def("0")
+    ->checker(bc::check::is_number)
+    ->setter(options->sketch_size);
+
   count_cmd->add_param("--clear", "clear super-k-mer files.")
     ->as_flag()
     ->setter(options->clear);
@@ -555,6 +666,12 @@ km_options_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_options_t optio
       options->m_ab_min_path = v;
       return;
     }
+    if (v == "auto")
+    {
+      options->m_ab_auto = true;
+      options->m_ab_float = true;
+      return;
+    }
     if (v.find('.') != std::string::npos)
     {
       bc::check::throw_if_false(bc::check::f::range(0.0, 1.0)("--abundance-min<float>", v));
@@ -566,7 +683,7 @@ km_options_t merge_cli(std::shared_ptr<bc::Parser<1>> cli, merge_options_t optio
   };
 
   merge_cmd->add_param("--soft-min", "min abundance to keep a k-mer/hash, see README.")
-    ->meta("INT/STR/FLOAT")
+    ->meta("INT/STR/FLOAT/auto")
     ->def("1")
     ->setter_c(a_min_setter);
 
@@ -754,6 +871,42 @@ km_options_t combine_cli(std::shared_ptr<bc::Parser<1>> cli, combine_options_t o
   return options;
 }
 
+km_options_t add_cli(std::shared_ptr<bc::Parser<1>> cli, add_options_t options)
+{
+  bc::cmd_t add_cmd = cli->add_command(
+      "add", "Add samples to an existing run without recomputing the previous ones.");
+
+  add_cmd->add_param("--run-dir", "kmtricks runtime directory.")
+    ->meta("DIR")
+    ->checker(bc::check::is_dir)
+    ->checker(is_km_dir)
+    ->setter(options->dir);
+
+  add_cmd->add_param("--file", "kmtricks input file with the new samples, see README.md.")
+    ->meta("FILE")
+    ->checker(bc::check::is_file)
+    ->setter(options->fof);
+
+  add_cmd->add_param("--hist", "compute k-mer histograms of the new samples.")
+    ->as_flag()
+    ->setter(options->hist);
+
+  add_cmd->add_param("--hist-log", "one histogram bucket per power of two, up to the largest count (with --hist).")
+    ->as_flag()
+    ->setter(options->hist_log);
+
+  add_cmd->add_param("--sketch", "compute the sketches of the new samples.")
+    ->as_flag()
+    ->setter(options->sketch);
+
+  add_cmd->add_param("--keep-tmp", "keep tmp files.")
+    ->as_flag()
+    ->setter(options->keep_tmp);
+
+  add_common(add_cmd, options);
+  return options;
+}
+
 km_options_t agg_cli(std::shared_ptr<bc::Parser<1>> cli, agg_options_t options)
 {
   bc::cmd_t agg_cmd = cli->add_command("aggregate", "Aggregate partition files.");
@@ -829,6 +982,81 @@ km_options_t agg_cli(std::shared_ptr<bc::Parser<1>> cli, agg_options_t options)
   return options;
 }
 
+km_options_t extract_cli(std::shared_ptr<bc::Parser<1>> cli, extract_options_t options)
+{
+  bc::cmd_t extract_cmd = cli->add_command("extract", "Extract sample columns from count matrices.");
+  extract_cmd->add_param("--run-dir", "kmtricks runtime directory.")
+    ->meta("DIR")
+    ->checker(bc::check::is_dir)
+    ->setter(options->dir);
+
+  auto samples_setter = [options](const std::string& v) {
+    for (auto& s : bc::utils::split(v, ','))
+      options->samples.push_back(bc::utils::trim(s));
+  };
+
+  extract_cmd->add_param("--samples", "sample IDs to extract, comma separated.")
+    ->meta("STR")
+    ->setter_c(samples_setter);
+
+  extract_cmd->add_param("--matrix", "count matrix type. [kmer|hash]")
+    ->meta("STR")
+    ->def("kmer")
+    ->checker(bc::check::f::in("kmer|hash"))
+    ->setter(options->matrix);
+
+  extract_cmd->add_group("I/O options", "");
+
+  extract_cmd->add_param("--format", "output format. [text|bin]")
+    ->meta("STR")
+    ->def("text")
+    ->checker(bc::check::f::in("text|bin"))
+    ->setter(options->format);
+
+  extract_cmd->add_param("--cpr-in", "compressed inputs.")
+    ->as_flag()
+    ->setter(options->lz4_in);
+
+  extract_cmd->add_param("--cpr-out", "compressed output (ignored with --format text).")
+    ->as_flag()
+    ->setter(options->lz4);
+
+  extract_cmd->add_param("--output", "output path.")
+    ->meta("FILE")
+    ->def("stdout")
+    ->setter(options->output);
+
+  add_common(extract_cmd, options);
+  return options;
+}
+
+km_options_t sketch_cli(std::shared_ptr<bc::Parser<1>> cli, sketch_options_t options)
+{
+  bc::cmd_t sketch_cmd = cli->add_command("sketch", "All-vs-all distances from the sample sketches (see --sketch).");
+  sketch_cmd->add_param("--run-dir", "kmtricks runtime directory.")
+    ->meta("DIR")
+    ->checker(bc::check::is_dir)
+    ->setter(options->dir);
+
+  sketch_cmd->add_param("--dist", "distance, or containment of the row sample in the column sample. [mash|jaccard|containment]")
+    ->meta("STR")
+    ->def("mash")
+    ->checker(bc::check::f::in("mash|jaccard|containment"))
+    ->setter(options->dist);
+
+  sketch_cmd->add_param("--cardinality", "output the estimated number of distinct solid k-mers per sample instead.")
+    ->as_flag()
+    ->setter(options->cardinality);
+
+  sketch_cmd->add_param("--output", "output path.")
+    ->meta("FILE")
+    ->def("stdout")
+    ->setter(options->output);
+
+  add_common(sketch_cmd, options);
+  return options;
+}
+
 km_options_t filter_cli(std::shared_ptr<bc::Parser<1>> cli, filter_options_t options)
 {
   bc::cmd_t filter_cmd = cli->add_command("filter", "Filter existing matrix with a new sample.");
@@ -919,6 +1147,18 @@ km_options_t index_cli(std::shared_ptr<bc::Parser<1>> cli, index_options_t optio
     ->setter(options->dir);
 
   index_cmd->add_group("Clustering options", "");
+  index_cmd->add_param("--topology", "topology construction: cluster (HowDeSBT) or sketch (NN-chain on filter sketches).")
+    ->meta("STR")
+    ->def("cluster")
+    ->checker(bc::check::f::in("cluster|sketch"))
+    ->setter(options->topology);
+
+  index_cmd->add_param("--sketch-size", "number of bins of the filter sketches, with --topology sketch.")
+    ->meta("INT")
+    ->def("256")
+    ->checker(bc::check::f::range(1u, std::numeric_limits<uint32_t>::max()))
+    ->setter(options->sketch_size);
+
   index_cmd->add_param("--bits", "number of bits to use from each filter for topology computation.")
     ->meta("INT")
     ->def("100000")
@@ -1013,7 +1253,7 @@ km_options_t index_cli(std::shared_ptr<bc::Parser<1>> cli, index_options_t optio
 
 km_options_t query_cli(std::shared_ptr<bc::Parser<1>> cli, query_options_t options)
 {
-  bc::cmd_t query_cmd = cli->add_command("query", "Query HowDeSBT index.");
+  bc::cmd_t query_cmd = cli->add_command("query", "Query HowDeSBT index or bf/bft matrices.");
   query_cmd->add_param("--run-dir", "kmtricks runtime directory")
     ->meta("DIR")
     ->setter(options->dir);
@@ -1028,6 +1268,20 @@ km_options_t query_cli(std::shared_ptr<bc::Parser<1>> cli, query_options_t optio
     ->def("stdout")
     ->setter(options->output);
 
+#ifdef WITH_HOWDE
+  std::string default_engine = "howde";
+#else
+  std::string default_engine = "bft";
+#endif
+  query_cmd->add_param("--engine", "query engine, howde: HowDeSBT index, "
+                                   "bft: hash:bf:bin/hash:bft:bin/hash:bfc:bin matrices (--until merge or --keep-tmp). "
+                                   "With bfc matrices, the min and median log2 abundance buckets of the query "
+                                   "k-mers are reported after the ratio.")
+    ->meta("STR")
+    ->def(default_engine)
+    ->checker(bc::check::f::in("howde|bft"))
+    ->setter(options->engine);
+
   query_cmd->add_param("--threshold",
                        "fraction of query kmers that must be present in a leaf to be considered a match")
     ->meta("FLOAT")
@@ -1066,6 +1320,10 @@ km_options_t query_cli(std::shared_ptr<bc::Parser<1>> cli, query_options_t optio
     ->as_flag()
     ->setter(options->check);
 
+  query_cmd->add_param("--mmap", "map uncompressed bloom filters into memory instead of reading them (howde).")
+    ->as_flag()
+    ->setter(options->mmap);
+
   add_common(query_cmd, options);
   return options;
 }
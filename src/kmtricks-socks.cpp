@@ -88,6 +88,8 @@ int main(int argc, char* argv[])
   cerr_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] %v");
   spdlog::set_default_logger(cerr_logger);
 
+  AsyncIO::get().configure(options->io_backend);
+
   size_t kmer_size;
 
   try
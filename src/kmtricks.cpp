@@ -43,6 +43,10 @@ int main(int argc, char* argv[])
   cerr_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] %v");
   spdlog::set_default_logger(cerr_logger);
 
+  AsyncIO::get().configure(options->io_backend);
+  if (AsyncIO::get().name() == "threads" && options->io_backend == "uring")
+    spdlog::warn("io_uring is not available, fall back to the threads I/O backend.");
+
   size_t kmer_size;
   if (cmd != COMMAND::ALL && cmd != COMMAND::REPART && cmd != COMMAND::INFOS)
   {
@@ -104,16 +108,28 @@ int main(int argc, char* argv[])
     {
       const_loop_executor<0, KMER_N>::exec<main_combine>(kmer_size, options);
     }
+    else if (cmd == COMMAND::EXTRACT)
+    {
+      const_loop_executor<0, KMER_N>::exec<main_extract>(kmer_size, options);
+    }
+    else if (cmd == COMMAND::ADD)
+    {
+      const_loop_executor<0, KMER_N>::exec<main_add>(kmer_size, options);
+    }
+    else if (cmd == COMMAND::SKETCH)
+    {
+      const_loop_executor<0, KMER_N>::exec<main_sketch>(kmer_size, options);
+    }
 #ifdef WITH_HOWDE
     else if (cmd == COMMAND::INDEX)
     {
       const_loop_executor<0, KMER_N>::exec<main_index>(kmer_size, options);
     }
+#endif
     else if (cmd == COMMAND::QUERY)
     {
       const_loop_executor<0, KMER_N>::exec<main_query>(kmer_size, options);
     }
-#endif
     else if (cmd == COMMAND::INFOS)
     {
       main_infos(std::cerr);
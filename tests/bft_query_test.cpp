@@ -0,0 +1,34 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <kmtricks/bft_query.hpp>
+
+using namespace km;
+
+TEST(bft_query, bit_sliced_counter)
+{
+  std::mt19937 gen(42);
+  for (size_t nb_samples : {1, 7, 64, 130})
+  {
+    BitSlicedCounter counter(nb_samples);
+    std::vector<uint32_t> expected(nb_samples, 0);
+    std::vector<uint32_t> counts(nb_samples, 0);
+    std::vector<uint8_t> row(NBYTES(nb_samples));
+    for (size_t r = 0; r < 1000; r++)
+    {
+      std::fill(row.begin(), row.end(), 0);
+      for (size_t s = 0; s < nb_samples; s++)
+      {
+        if (gen() % 3)
+        {
+          BITSET(row, s);
+          expected[s]++;
+        }
+      }
+      counter.add(row.data());
+      if (r == 500)
+        counter.flush(counts);
+    }
+    counter.flush(counts);
+    EXPECT_EQ(counts, expected);
+  }
+}
@@ -2,6 +2,8 @@
 #include <kmtricks/histogram.hpp>
 #include <kmtricks/io/hist_file.hpp>
 
+#include <thread>
+
 using namespace km;
 
 TEST(histogram, histogram)
@@ -35,35 +37,145 @@ TEST(histogram, histogram)
   }
 }
 
-TEST(histogram, clones)
+TEST(histogram, shards)
 {
   std::vector<uint64_t> v {1, 1, 3, 9, 1};
-  std::vector<uint64_t> v2 {2, 2, 2, 9, 5};
+  std::vector<uint64_t> v2 {2, 2, 2, 9, 5, 0, 12};
 
   std::vector<uint64_t> r {3, 3, 1, 0, 1, 0, 0, 0, 2, 0};
   std::vector<uint64_t> rn {3, 6, 3, 0, 5, 0, 0, 0, 18, 0};
 
   hist_t hist = std::make_shared<KHist>(0, 20, 1, 10);
 
-  hist_t c1 = hist->clone();
-  hist_t c2 = hist->clone();
-
-  for (auto& c : v)
-    c1->inc(c);
-  for (auto& c : v2)
-    c2->inc(c);
+  std::thread t1([&]() { KHistShard& s = hist->shard(); for (auto& c : v) s.inc(c); });
+  std::thread t2([&]() { KHistShard& s = hist->shard(); for (auto& c : v2) s.inc(c); });
+  t1.join(); t2.join();
 
-  hist->merge_clones();
+  std::vector<hist_t> hists {hist, nullptr};
+  reduce_histograms(hists, 2);
 
   EXPECT_EQ(hist->lower(), 1);
   EXPECT_EQ(hist->upper(), 10);
-  EXPECT_EQ(hist->oob_upper_total(), 0);
+  EXPECT_EQ(hist->unique(), 12);
+  EXPECT_EQ(hist->total(), 47);
+  EXPECT_EQ(hist->oob_upper_total(), 12);
   EXPECT_EQ(hist->oob_lower_total(), 0);
-  EXPECT_EQ(hist->oob_lower_unique(), 0);
-  EXPECT_EQ(hist->oob_upper_unique(), 0);
-  for (int i=0; i<v.size(); i++)
+  EXPECT_EQ(hist->oob_lower_unique(), 1);
+  EXPECT_EQ(hist->oob_upper_unique(), 1);
+  for (int i=0; i<r.size(); i++)
   {
     EXPECT_EQ(r[i], hist->get_vec(KHistType::UNIQUE)[i]);
     EXPECT_EQ(rn[i], hist->get_vec(KHistType::TOTAL)[i]);
   }
 }
+
+TEST(histogram, log_scale)
+{
+  {
+    KHist hist(0, 20, 1, 1000, true);
+    EXPECT_EQ(hist.get_vec().size(), 10);
+    for (uint64_t c : {1, 2, 3, 4, 7, 8, 600, 1000, 1001, 50000})
+      hist.inc(c);
+    std::vector<uint64_t> r {1, 2, 2, 1, 0, 0, 0, 0, 0, 2};
+    EXPECT_EQ(hist.get_vec(), r);
+    EXPECT_EQ(hist.bucket_value(3), 8);
+    EXPECT_EQ(hist.oob_upper_unique(), 2);
+    HistWriter<8192> hw("./tests_tmp/hl.hist", hist, false);
+  }
+  HistReader<8192> hr("./tests_tmp/hl.hist");
+  hist_t hist = hr.get();
+  EXPECT_TRUE(hist->log_scale());
+  EXPECT_EQ(hist->get_vec()[9], 2);
+  EXPECT_EQ(hist->bucket_value(9), 512);
+}
+
+TEST(histogram, version_0)
+{
+  // Histograms written before version 1 have no log_scale field.
+  std::vector<uint64_t> u {3, 2, 1, 0}, n {3, 4, 3, 0};
+  {
+    HistFileHeader header;
+    header.km_version = 0;
+    header.compressed = false;
+    header.kmer_size = 21; header.id = 1; header.lower = 1; header.upper = 4;
+    header.uniq = 6; header.total = 10;
+    header.oob_ln = header.oob_lu = header.oob_un = header.oob_uu = 0;
+    std::ofstream out("./tests_tmp/h0.hist", std::ios::binary);
+    header.serialize(&out);
+    out.write(reinterpret_cast<char*>(u.data()), u.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<char*>(n.data()), n.size() * sizeof(uint64_t));
+  }
+  HistReader<8192> hr("./tests_tmp/h0.hist");
+  hist_t hist = hr.get();
+  EXPECT_FALSE(hist->log_scale());
+  EXPECT_EQ(hist->get_vec(KHistType::UNIQUE), u);
+  EXPECT_EQ(hist->get_vec(KHistType::TOTAL), n);
+}
+
+TEST(histogram, from_files)
+{
+  std::vector<std::string> paths;
+  for (size_t i=0; i<4; i++)
+    paths.push_back("./data/partitions/kmers/partition_" + std::to_string(i) + "/D1.kmer");
+
+  KHist expected(0, 31, 1, 255);
+  for (auto& path : paths)
+  {
+    KmerReader<8192> reader(path);
+    Kmer<32> kmer; kmer.set_k(31);
+    uint32_t count = 0;
+    while (reader.read<32, 4294967295>(kmer, count))
+      expected.inc(count);
+  }
+
+  KHist hist(0, 31, 1, 255);
+  hist_from_kmer_files<32, 4294967295>(paths, hist, 3);
+  EXPECT_GT(hist.unique(), 0);
+  EXPECT_EQ(hist.unique(), expected.unique());
+  EXPECT_EQ(hist.total(), expected.total());
+  EXPECT_EQ(hist.get_vec(), expected.get_vec());
+}
+
+TEST(histogram, first_valley)
+{
+  std::vector<uint64_t> v {100, 40, 10, 4, 3, 5, 12, 30, 50, 30, 10, 2, 0, 1, 0, 0};
+  hist_t hist = std::make_shared<KHist>(0, 20, 1, 20);
+  for (size_t i=0; i<v.size(); i++)
+    for (size_t j=0; j<v[i]; j++)
+      hist->inc(i + 1);
+  EXPECT_EQ(first_valley(*hist), 5);
+
+  hist_t low = std::make_shared<KHist>(1, 20, 1, 20);
+  for (uint64_t c : {1, 1, 1, 1, 2, 2, 3})
+    low->inc(c);
+  EXPECT_EQ(first_valley(*low), 1);
+
+  std::vector<hist_t> hists {hist, low};
+  std::vector<uint32_t> thresholds = compute_auto_thresholds(hists, "./tests_tmp/amin.txt");
+  EXPECT_EQ(thresholds, std::vector<uint32_t>({5, 1}));
+  std::ifstream in("./tests_tmp/amin.txt");
+  uint32_t t1, t2; in >> t1 >> t2;
+  EXPECT_EQ(t1, 5);
+  EXPECT_EQ(t2, 1);
+}
+
+TEST(histogram, make_hist)
+{
+  hist_t linear = make_hist<255>(0, 20, false);
+  EXPECT_FALSE(linear->log_scale());
+  EXPECT_EQ(linear->upper(), 255);
+  EXPECT_EQ(linear->get_vec().size(), 255);
+
+  hist_t log = make_hist<65535>(1, 20, true);
+  EXPECT_TRUE(log->log_scale());
+  EXPECT_EQ(log->upper(), 65535);
+  EXPECT_EQ(log->get_vec().size(), 16);
+  log->inc(65535);
+  EXPECT_EQ(log->get_vec()[15], 1);
+  EXPECT_EQ(log->oob_upper_unique(), 0);
+
+  // Thresholds are read off linear buckets only.
+  std::vector<hist_t> hists {linear, log};
+  EXPECT_THROW(compute_auto_thresholds(hists, "./tests_tmp/amin_log.txt"), PipelineError);
+  EXPECT_THROW(compute_merge_thresholds(hists, 0.1, "./tests_tmp/amin_log.txt"), PipelineError);
+}
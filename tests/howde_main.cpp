@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "bit_vector.h"
+#include "bloom_filter.h"
+
+namespace fs = std::filesystem;
+
+const std::string tmp_dir = "./tests_tmp/howde";
+
+int main(int argc, char* argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+
+  fs::create_directories(tmp_dir);
+  int r = RUN_ALL_TESTS();
+  fs::remove_all(tmp_dir);
+  return r;
+}
+
+// Random ascending positions, with duplicates and the boundaries of the vector.
+static std::vector<uint64_t> sorted_positions(uint64_t num_bits, size_t n, std::mt19937_64& gen)
+{
+  std::vector<uint64_t> pos {0, 0, 1, 63, 64, num_bits - 1, num_bits - 1};
+  for (size_t i = 0; i < n; i++)
+    pos.push_back(gen() % num_bits);
+  for (size_t i = 0; i < n / 4; i++)
+    pos.push_back(pos[gen() % pos.size()]);
+  std::sort(pos.begin(), pos.end());
+  return pos;
+}
+
+static void fill_random(BitVector* bv, uint64_t num_bits, std::mt19937_64& gen)
+{
+  for (uint64_t i = 0; i < num_bits; i++)
+    if (gen() % 3 == 0)
+      bv->write_bit(i);
+  if (auto* rrr = dynamic_cast<RrrBitVector*>(bv))
+    rrr->compress();
+  else if (auto* roar = dynamic_cast<RoarBitVector*>(bv))
+    roar->compress();
+}
+
+TEST(howde, access_sorted)
+{
+  std::mt19937_64 gen(42);
+  for (uint32_t compressor : {bvcomp_uncompressed, bvcomp_rrr, bvcomp_roar, bvcomp_zeros, bvcomp_ones})
+  {
+    for (uint64_t num_bits : {1000, 1024, 100003})
+    {
+      std::unique_ptr<BitVector> bv(BitVector::bit_vector(compressor, num_bits));
+      if (compressor != bvcomp_zeros && compressor != bvcomp_ones)
+        fill_random(bv.get(), num_bits, gen);
+
+      auto pos = sorted_positions(num_bits, 5000, gen);
+      std::vector<uint8_t> bits(pos.size());
+      bv->access_sorted(pos.data(), pos.size(), bits.data());
+      for (size_t i = 0; i < pos.size(); i++)
+        EXPECT_EQ(bits[i], (*bv)[pos[i]]) << bv->class_identity() << " at " << pos[i];
+    }
+  }
+}
+
+TEST(howde, lookup_sorted)
+{
+  std::mt19937_64 gen(7);
+  uint64_t num_bits = 100003;
+  for (uint32_t kind : {bfkind_simple, bfkind_allsome, bfkind_determined, bfkind_determined_brief})
+  {
+    for (uint32_t compressor : {bvcomp_uncompressed, bvcomp_rrr, bvcomp_roar})
+    {
+      // Brief filters rank their bits, roar vectors have no rank.
+      if (kind == bfkind_determined_brief && compressor == bvcomp_roar)
+        continue;
+      std::unique_ptr<BloomFilter> bf(
+        BloomFilter::bloom_filter(kind, "lookup_sorted.bf", 20, 1, 0, 0, num_bits));
+      bf->new_bits(compressor);
+      for (int i = 0; i < bf->numBitVectors; i++)
+        fill_random(bf->bvs[i], num_bits, gen);
+
+      auto pos = sorted_positions(num_bits, 5000, gen);
+      std::vector<int8_t> resolutions(pos.size());
+      bf->lookup_sorted(pos.data(), pos.size(), resolutions.data());
+      for (size_t i = 0; i < pos.size(); i++)
+        EXPECT_EQ(resolutions[i], bf->lookup(pos[i])) << bf->class_identity() << " at " << pos[i];
+    }
+  }
+}
+
+static std::unique_ptr<BloomFilter> load_filter(const std::string& path, bool map)
+{
+  BitVector::mapFiles = map;
+  std::unique_ptr<BloomFilter> bf(BloomFilter::bloom_filter(path));
+  bf->load();
+  BitVector::mapFiles = false;
+  return bf;
+}
+
+TEST(howde, mapped_node)
+{
+  std::mt19937_64 gen(11);
+  uint64_t num_bits = 100003;
+  // The kind of a filter file is given by its suffix.
+  std::vector<std::pair<uint32_t, std::string>> kinds {
+    {bfkind_simple, "bf"}, {bfkind_allsome, "allsome.bf"},
+    {bfkind_determined, "det.bf"}, {bfkind_determined_brief, "detbrief.bf"}};
+  for (auto& [kind, suffix] : kinds)
+  {
+    std::string path = fmt::format("{}/mapped.{}", tmp_dir, suffix);
+    {
+      std::unique_ptr<BloomFilter> bf(BloomFilter::bloom_filter(kind, path, 20, 1, 0, 0, num_bits));
+      bf->new_bits(bvcomp_uncompressed);
+      for (int i = 0; i < bf->numBitVectors; i++)
+        fill_random(bf->bvs[i], num_bits, gen);
+      bf->save();
+    }
+
+    auto loaded = load_filter(path, false);
+    auto mapped = load_filter(path, true);
+    auto mapped_too = load_filter(path, true);
+    for (int i = 0; i < mapped->numBitVectors; i++)
+    {
+      EXPECT_EQ(loaded->bvs[i]->mappedWords, nullptr);
+      EXPECT_NE(mapped->bvs[i]->mappedWords, nullptr);
+      EXPECT_EQ(mapped->bvs[i]->size(), num_bits);
+    }
+    // Nodes of the same file share its mapping.
+    EXPECT_EQ(mapped->bvs[0]->mappedFile, mapped_too->bvs[0]->mappedFile);
+
+    auto pos = sorted_positions(num_bits, 5000, gen);
+    std::vector<int8_t> expected(pos.size()), resolutions(pos.size());
+    loaded->lookup_sorted(pos.data(), pos.size(), expected.data());
+    mapped->lookup_sorted(pos.data(), pos.size(), resolutions.data());
+    EXPECT_EQ(resolutions, expected);
+    for (size_t i = 0; i < pos.size(); i++)
+      EXPECT_EQ(mapped->lookup(pos[i]), loaded->lookup(pos[i])) << mapped->class_identity() << " at " << pos[i];
+  }
+}
+
+TEST(howde, mapped_raw)
+{
+  std::mt19937_64 gen(13);
+  uint64_t num_bits = 10007;
+  std::vector<uint64_t> words((num_bits + 63) / 64);
+  for (auto& w : words)
+    w = gen();
+  words.back() &= (1ULL << (num_bits % 64)) - 1;
+
+  // Raw bits at an aligned offset are mapped, others are read.
+  std::string path = fmt::format("{}/mapped.raw", tmp_dir);
+  {
+    std::ofstream out(path, std::ios::binary);
+    out.write(std::string(8, '\0').data(), 8);
+    out.write(reinterpret_cast<const char*>(words.data()), words.size() * 8);
+  }
+  std::string path_unaligned = fmt::format("{}/mapped_unaligned.raw", tmp_dir);
+  {
+    std::ofstream out(path_unaligned, std::ios::binary);
+    out.write(std::string(4, '\0').data(), 4);
+    out.write(reinterpret_cast<const char*>(words.data()), words.size() * 8);
+  }
+
+  BitVector::mapFiles = true;
+  RawBitVector aligned(path, 8, num_bits), unaligned(path_unaligned, 4, num_bits);
+  aligned.load();
+  unaligned.load();
+  BitVector::mapFiles = false;
+
+  EXPECT_NE(aligned.mappedWords, nullptr);
+  EXPECT_EQ(unaligned.mappedWords, nullptr);
+  auto pos = sorted_positions(num_bits, 1000, gen);
+  std::vector<uint8_t> bits(pos.size());
+  aligned.access_sorted(pos.data(), pos.size(), bits.data());
+  for (size_t i = 0; i < pos.size(); i++)
+  {
+    int expected = (words[pos[i] / 64] >> (pos[i] % 64)) & 1;
+    EXPECT_EQ(aligned[pos[i]], expected);
+    EXPECT_EQ(unaligned[pos[i]], expected);
+    EXPECT_EQ(bits[i], expected);
+  }
+}
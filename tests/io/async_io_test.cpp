@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/async_io.hpp>
+#include <kmtricks/io/kmer_file.hpp>
+#include <kmtricks/utils.hpp>
+
+using namespace km;
+
+static void write_read(const std::string& backend)
+{
+  AsyncIO::get().configure(backend, 2, 4096, 3);
+  EXPECT_NE(AsyncIO::get().engine(), nullptr);
+
+  std::string content;
+  for (int i=0; i<100000; i++)
+    content.push_back(static_cast<char>(i % 251));
+  std::string path = "tests_tmp/async_" + backend + ".bin";
+  {
+    std::unique_ptr<std::iostream> out(open_file_stream(path, std::ios::out | std::ios::binary));
+    for (size_t i=0; i<content.size(); i+=777)
+      out->write(content.data() + i, std::min<size_t>(777, content.size() - i));
+  }
+  {
+    std::unique_ptr<std::iostream> in(open_file_stream(path, std::ios::in | std::ios::binary));
+    std::string read(content.size() + 10, '\0');
+    in->read(read.data(), read.size());
+    EXPECT_EQ(static_cast<size_t>(in->gcount()), content.size());
+    read.resize(in->gcount());
+    EXPECT_EQ(read, content);
+
+    in->clear();
+    in->seekg(50000);
+    EXPECT_EQ(in->tellg(), 50000);
+    char c;
+    in->read(&c, 1);
+    EXPECT_EQ(c, content[50000]);
+    in->seekg(10, std::ios::cur);
+    in->read(&c, 1);
+    EXPECT_EQ(c, content[50011]);
+  }
+
+  std::vector<std::string> kmers(5000);
+  {
+    KmerWriter kw("tests_tmp/async_" + backend + ".kmer.lz4", 21, 1, 1, 2, true);
+    for (auto& s : kmers)
+    {
+      s = random_dna_seq(21);
+      kw.write<32, 255>(Kmer<32>(s), 7);
+    }
+  }
+  {
+    KmerReader kr("tests_tmp/async_" + backend + ".kmer.lz4");
+    Kmer<32> kmer; kmer.set_k(21);
+    uint8_t c = 0;
+    for (auto& s : kmers)
+    {
+      EXPECT_TRUE((kr.read<32, 255>(kmer, c)));
+      EXPECT_EQ(kmer.to_string(), s);
+      EXPECT_EQ(c, 7);
+    }
+    EXPECT_FALSE((kr.read<32, 255>(kmer, c)));
+  }
+  AsyncIO::get().configure("sync");
+}
+
+TEST(async_io, threads)
+{
+  write_read("threads");
+}
+
+TEST(async_io, uring)
+{
+  write_read("uring");
+}
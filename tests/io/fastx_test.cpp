@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+
+#include <gatb/gatb_core.hpp>
+#include <kmtricks/io/fastx.hpp>
+
+namespace fs = std::filesystem;
+
+static const std::string fastx_content =
+  ">r1 first\nACGTACGTAC\nGGTTAACC\n\n>r2\r\nTTTTNNNNAAAA\r\n"
+  "@r3\nACGTTGCA\n+r3\n@IIIIII\nI\n@r4\nGG\n+\nII\n>r5\n>r6\nCCCC";
+
+static std::vector<std::string> read_gatb(const std::string& path)
+{
+  std::vector<std::string> seqs;
+  IBank* bank = Bank::open(path); LOCAL(bank);
+  Iterator<Sequence>* it = bank->iterator(); LOCAL(it);
+  for (it->first(); !it->isDone(); it->next())
+    seqs.push_back(it->item().toString());
+  return seqs;
+}
+
+static std::vector<std::string> read_fastx(const std::string& path, size_t buffer_size,
+                                           size_t nb_threads = 1)
+{
+  std::vector<std::string> seqs;
+  km::FastxReader reader(path, buffer_size, nb_threads);
+  while (reader.next())
+    seqs.emplace_back(reader.seq(), reader.size());
+  return seqs;
+}
+
+TEST(fastx, fastx_reader)
+{
+  fs::create_directories("./tests_tmp");
+  std::string path = "./tests_tmp/reads.fa";
+  std::ofstream(path) << fastx_content;
+
+  std::string gz_path = "./tests_tmp/reads.fa.gz";
+  gzFile gz = gzopen(gz_path.c_str(), "wb");
+  gzwrite(gz, fastx_content.data(), fastx_content.size());
+  gzclose(gz);
+
+  std::vector<std::string> expected =
+    {"ACGTACGTACGGTTAACC", "TTTTNNNNAAAA", "ACGTTGCA", "GG", "", "CCCC"};
+  EXPECT_EQ(read_gatb(path), expected);
+
+  EXPECT_TRUE(km::FastxReader::is_fastx(path));
+  EXPECT_TRUE(km::FastxReader::is_fastx(gz_path));
+  for (size_t buffer_size : {64, 1 << 20})
+  {
+    EXPECT_EQ(read_fastx(path, buffer_size), expected);
+    EXPECT_EQ(read_fastx(gz_path, buffer_size), expected);
+  }
+
+  {
+    km::FastxReader reader(gz_path, 64);
+    std::vector<std::string> names;
+    while (reader.next())
+      names.push_back(reader.name());
+    EXPECT_EQ(names, (std::vector<std::string>{"r1 first", "r2", "r3", "r4", "r5", "r6"}));
+  }
+
+  std::string long_path = "./tests_tmp/long.fa";
+  std::string long_seq(1000, 'A');
+  std::ofstream(long_path) << ">long\n" << long_seq << "\n";
+  EXPECT_EQ(read_fastx(long_path, 64), std::vector<std::string>{long_seq});
+}
+
+// One BGZF block: a gzip member with a BC extra field holding the block size.
+static std::string bgzf_block(const std::string& data)
+{
+  std::string deflated(compressBound(data.size()) + 64, '\0');
+  z_stream zs {};
+  deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  zs.avail_in = data.size();
+  zs.next_out = reinterpret_cast<Bytef*>(deflated.data());
+  zs.avail_out = deflated.size();
+  deflate(&zs, Z_FINISH);
+  deflated.resize(zs.total_out);
+  deflateEnd(&zs);
+
+  auto le = [](std::string& s, uint32_t v, int n) {
+    for (int i = 0; i < n; i++) s.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+  };
+  std::string block = {'\x1f', '\x8b', 8, 4, 0, 0, 0, 0, 0, '\xff', 6, 0, 'B', 'C', 2, 0};
+  le(block, 18 + deflated.size() + 8 - 1, 2);
+  block += deflated;
+  le(block, crc32(0, reinterpret_cast<const Bytef*>(data.data()), data.size()), 4);
+  le(block, data.size(), 4);
+  return block;
+}
+
+TEST(fastx, fastx_reader_inflate)
+{
+  fs::create_directories("./tests_tmp");
+  std::string content;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 5000; i++)
+  {
+    std::string seq(20 + i % 150, "ACGT"[i % 4]);
+    content += ">r" + std::to_string(i) + "\n" + seq + "\n";
+    expected.push_back(seq);
+  }
+
+  // Members of a few kB, records span members.
+  std::string bgzf_path = "./tests_tmp/reads_bgzf.fa.gz";
+  std::string multi_path = "./tests_tmp/reads_multi.fa.gz";
+  {
+    std::ofstream bgzf(bgzf_path, std::ios::binary);
+    for (size_t i = 0; i < content.size(); i += 4000)
+      bgzf << bgzf_block(content.substr(i, 4000));
+    bgzf << bgzf_block("");
+
+    for (size_t i = 0; i < content.size(); i += content.size() / 3 + 1)
+    {
+      gzFile gz = gzopen(multi_path.c_str(), i ? "ab" : "wb");
+      std::string part = content.substr(i, content.size() / 3 + 1);
+      gzwrite(gz, part.data(), part.size());
+      gzclose(gz);
+    }
+  }
+
+  for (size_t nb_threads : {1, 4})
+  {
+    EXPECT_EQ(read_fastx(bgzf_path, 64, nb_threads), expected);
+    EXPECT_EQ(read_fastx(bgzf_path, 1 << 20, nb_threads), expected);
+  }
+  EXPECT_EQ(read_fastx(multi_path, 1 << 10), expected);
+  EXPECT_EQ(read_gatb(bgzf_path), expected);
+
+  // Stops the producer before the end of the file.
+  {
+    km::FastxReader reader(bgzf_path, 64, 2);
+    EXPECT_TRUE(reader.next());
+  }
+
+  std::string bad_path = "./tests_tmp/reads_bad.fa.gz";
+  std::string block = bgzf_block(content.substr(0, 4000));
+  block[40] ^= 0x55;
+  std::ofstream(bad_path, std::ios::binary) << block;
+  EXPECT_THROW(read_fastx(bad_path, 1 << 20, 2), km::IOError);
+
+  // Trailing bytes after the last member are ignored, unless they start a member.
+  std::string trailing_path = "./tests_tmp/reads_trailing.fa.gz";
+  std::ifstream multi(multi_path, std::ios::binary);
+  std::string gz((std::istreambuf_iterator<char>(multi)), std::istreambuf_iterator<char>());
+  std::ofstream(trailing_path, std::ios::binary) << gz << std::string(1000, '\0');
+  EXPECT_EQ(read_fastx(trailing_path, 1 << 10), expected);
+  std::ofstream(trailing_path, std::ios::binary) << gz << "x";
+  EXPECT_EQ(read_fastx(trailing_path, 1 << 10), expected);
+  std::ofstream(trailing_path, std::ios::binary) << gz << gz.substr(0, 100);
+  EXPECT_THROW(read_fastx(trailing_path, 1 << 10), km::IOError);
+
+  // Ends within the last member.
+  std::string truncated_path = "./tests_tmp/reads_truncated.fa.gz";
+  std::ofstream(truncated_path, std::ios::binary) << gz.substr(0, gz.size() - 100);
+  EXPECT_THROW(read_fastx(truncated_path, 1 << 10), km::IOError);
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/kff_file.hpp>
+#include <kmtricks/utils.hpp>
+
+#include <map>
+
+using namespace km;
+
+template<size_t MAX_K>
+static void write_read(size_t kmer_size, size_t minim_size)
+{
+  Kmer<MAX_K>::m_kmer_size = kmer_size;
+  std::string seq = random_dna_seq(2000);
+  std::map<Kmer<MAX_K>, uint32_t> counts;
+  for (size_t i=0; i+kmer_size<=seq.size(); i++)
+    counts[Kmer<MAX_K>(seq.substr(i, kmer_size)).canonical()] = i % 300 + 1;
+  for (size_t i=0; i<100; i++)
+    counts[Kmer<MAX_K>(random_dna_seq(kmer_size)).canonical()] = 1000 + i;
+
+  std::string path = fmt::format("tests_tmp/kmers_{}_{}.kff", kmer_size, minim_size);
+  uint64_t nb_blocks = 0;
+  {
+    KffWriter<MAX_K, 4294967295> kw(path, kmer_size, minim_size);
+    for (auto& [kmer, count] : counts)
+      kw.write(kmer, count);
+    kw.close();
+    nb_blocks = kw.nb_blocks();
+  }
+  // The k-mers of the sequence overlap, so most blocks hold several of them.
+  EXPECT_LT(nb_blocks, counts.size() / 2);
+
+  KffReader kr(path, kmer_size);
+  size_t nb_kmers = 0;
+  while (auto kmer = kr.template read<MAX_K>())
+  {
+    auto it = counts.find(kmer->canonical());
+    ASSERT_NE(it, counts.end());
+    EXPECT_EQ(kr.template count<4294967295>(), it->second);
+    nb_kmers++;
+  }
+  EXPECT_EQ(nb_kmers, counts.size());
+}
+
+TEST(kff_file, KffWriteRead)
+{
+  write_read<32>(21, 10);
+  write_read<32>(32, 7);
+  write_read<64>(33, 10);
+  write_read<64>(63, 11);
+}
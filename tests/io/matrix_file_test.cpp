@@ -113,4 +113,74 @@ TEST(matrix_file, MatrixHashWriteRead)
       EXPECT_TRUE(std::equal(c.begin(), c.end(), counts[i].begin()));
     }
   }
-}
\ No newline at end of file
+}
+
+TEST(matrix_file, MatrixReadColumns)
+{
+  std::vector<std::string> str_kmers(2000);
+  std::vector<std::vector<uint16_t>> counts(2000, std::vector<uint16_t>(10000));
+  {
+    MatrixWriter mw("tests_tmp/m3.matrix", 21, 2, 10000, 1, 2, false);
+    MatrixWriter mw2("tests_tmp/m3.matrix.lz4", 21, 2, 10000, 1, 2, true);
+    for (size_t i=0; i<str_kmers.size(); i++)
+    {
+      str_kmers[i] = random_dna_seq(21);
+      counts[i] = random_count_vector<uint16_t>(10000);
+      Kmer<32> kmer(str_kmers[i]);
+      mw.write<32, 65535>(kmer, counts[i]);
+      mw2.write<32, 65535>(kmer, counts[i]);
+    }
+  }
+  {
+    std::vector<uint32_t> columns = {9999, 3, 4, 5000, 3, 0};
+    MatrixReader rw("tests_tmp/m3.matrix");
+    MatrixReader rw2("tests_tmp/m3.matrix.lz4");
+    rw.set_columns<65535>(columns);
+    rw2.set_columns<65535>(columns);
+    Kmer<32> kmer; kmer.set_k(rw.infos().kmer_size);
+    std::vector<uint16_t> c(columns.size());
+
+    for (size_t i=0; i<str_kmers.size(); i++)
+    {
+      ASSERT_TRUE((rw.read_columns<32, 65535>(kmer, c)));
+      EXPECT_EQ(kmer.to_string(), str_kmers[i]);
+      for (size_t j=0; j<columns.size(); j++)
+        EXPECT_EQ(c[j], counts[i][columns[j]]);
+      ASSERT_TRUE((rw2.read_columns<32, 65535>(kmer, c)));
+      EXPECT_EQ(kmer.to_string(), str_kmers[i]);
+      for (size_t j=0; j<columns.size(); j++)
+        EXPECT_EQ(c[j], counts[i][columns[j]]);
+    }
+    EXPECT_FALSE((rw.read_columns<32, 65535>(kmer, c)));
+    EXPECT_FALSE((rw2.read_columns<32, 65535>(kmer, c)));
+  }
+  EXPECT_THROW(MatrixReader("tests_tmp/m3.matrix").set_columns<65535>({10000}), IOError);
+}
+
+TEST(matrix_file, MatrixHashReadColumns)
+{
+  std::vector<std::vector<uint8_t>> counts(10000, std::vector<uint8_t>(50));
+  {
+    MatrixHashWriter mw("tests_tmp/m3.hash_matrix", 1, 50, 1, 2, false);
+    for (uint64_t i=0; i<10000; i++)
+    {
+      counts[i] = random_count_vector<uint8_t>(50);
+      mw.write<255>(i, counts[i]);
+    }
+  }
+  {
+    std::vector<uint32_t> columns = {49, 10, 11, 12};
+    MatrixHashReader rw("tests_tmp/m3.hash_matrix");
+    rw.set_columns<255>(columns);
+    std::vector<uint8_t> c(columns.size());
+    uint64_t hash;
+    for (uint64_t i=0; i<10000; i++)
+    {
+      ASSERT_TRUE(rw.read_columns<255>(hash, c));
+      EXPECT_EQ(hash, i);
+      for (size_t j=0; j<columns.size(); j++)
+        EXPECT_EQ(c[j], counts[i][columns[j]]);
+    }
+    EXPECT_FALSE(rw.read_columns<255>(hash, c));
+  }
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include <kmtricks/io/superk_storage.hpp>
+
+using namespace km;
+
+static std::vector<std::string> write_superk(const std::string& dir, bool lz4, bool packed)
+{
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::vector<std::string> expected(4);
+  {
+    SuperKStorageWriter writer(dir, "skp", 4, lz4, {0, 1, 2, 3}, packed);
+    uint8_t superk[32];
+    for (int i=0; i<20000; i++)
+    {
+      int part = (i * 7) % 4;
+      int size = 8 + i % 24;
+      for (int j=0; j<size; j++)
+        superk[j] = static_cast<uint8_t>((i + j) % 13);
+      writer.insertSuperkmer(superk, size, 1, part);
+      expected[part].push_back(1);
+      expected[part].append(reinterpret_cast<char*>(superk), size);
+    }
+    writer.SaveInfoFile(dir);
+  }
+  return expected;
+}
+
+static std::string read_superk(SuperKStorageReader& reader, int part)
+{
+  std::string content;
+  unsigned char* block = nullptr;
+  unsigned int max_size = 0, size = 0;
+  reader.openFile(part);
+  while (reader.readBlock(&block, &max_size, &size, part))
+    content.append(reinterpret_cast<char*>(block), size);
+  reader.closeFile(part);
+  free(block);
+  return content;
+}
+
+TEST(superk_storage, packed)
+{
+  for (bool lz4 : {false, true})
+  {
+    std::string dir = "./tests_tmp/superk_packed";
+    auto expected = write_superk(dir, lz4, true);
+    EXPECT_TRUE(fs::exists(dir + "/skp.pack"));
+    EXPECT_TRUE(fs::exists(dir + "/skp.pidx"));
+    EXPECT_FALSE(fs::exists(dir + "/skp.0"));
+
+    SuperKStorageReader reader(dir);
+    EXPECT_TRUE(reader.packed());
+    for (int p=0; p<4; p++)
+    {
+      EXPECT_EQ(read_superk(reader, p), expected[p]);
+      EXPECT_GT(reader.getDiskSize(p), 0);
+    }
+  }
+}
+
+TEST(superk_storage, files)
+{
+  std::string dir = "./tests_tmp/superk_files";
+  auto expected = write_superk(dir, true, false);
+  EXPECT_FALSE(fs::exists(dir + "/skp.pack"));
+
+  SuperKStorageReader reader(dir);
+  EXPECT_FALSE(reader.packed());
+  for (int p=0; p<4; p++)
+    EXPECT_EQ(read_superk(reader, p), expected[p]);
+}
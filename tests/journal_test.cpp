@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+
+#include <kmtricks/journal.hpp>
+
+namespace fs = std::filesystem;
+
+TEST(journal, journal_resume)
+{
+  std::string root = fs::absolute("./tests_tmp/journal").string();
+  fs::remove_all(root);
+  fs::create_directories(root + "/counts");
+  std::string path = root + "/journal.txt";
+
+  auto write = [](const std::string& p, const std::string& content) {
+    std::ofstream out(p); out << content;
+  };
+  write(root + "/counts/S1.kmer", "0123456789");
+  write(root + "/counts/S2.kmer", "01234");
+
+  km::Journal& journal = km::Journal::get();
+  journal.create(path, root, "k=31");
+  journal.set("partitions", "0,1");
+  journal.record("count S=S1 P=0", {root + "/counts/S1.kmer"});
+  journal.record("count S=S2 P=0", {root + "/counts/S2.kmer"});
+  journal.record("superk S=S1", {root + "/counts"});
+  journal.disable();
+
+  // A line truncated by a crash is ignored.
+  std::ofstream(path, std::ios::app) << "done\tcount S=S3 P=0\tcounts/S3.k";
+
+  ASSERT_TRUE(journal.resume(path, root));
+  EXPECT_EQ(journal.fingerprint(), "k=31");
+  EXPECT_EQ(journal.value("partitions"), "0,1");
+  EXPECT_TRUE(journal.done("count S=S1 P=0"));
+  EXPECT_TRUE(journal.done("superk S=S1"));
+  EXPECT_FALSE(journal.has("count S=S3 P=0"));
+  EXPECT_TRUE(journal.intact("count S=S1 P=0", root + "/counts/S1.kmer"));
+  EXPECT_FALSE(journal.intact("count S=S1 P=0", root + "/counts/S2.kmer"));
+
+  write(root + "/counts/S2.kmer", "012");
+  EXPECT_FALSE(journal.done("count S=S2 P=0"));
+  EXPECT_FALSE(journal.done("superk S=S1"));
+  fs::remove(root + "/counts/S1.kmer");
+  EXPECT_FALSE(journal.done("count S=S1 P=0"));
+
+  journal.record("count S=S2 P=0", {root + "/counts/S2.kmer"});
+  journal.disable();
+
+  std::ifstream in(path);
+  std::string line;
+  std::getline(in, line);
+  EXPECT_EQ(line, "kmtricks-journal\t1");
+
+  ASSERT_TRUE(journal.resume(path, root));
+  EXPECT_TRUE(journal.done("count S=S2 P=0"));
+  journal.disable();
+
+  write(root + "/other.txt", "not a journal\n");
+  EXPECT_FALSE(journal.resume(root + "/other.txt", root));
+  journal.disable();
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <kmtricks/gatb/kxmer_merge.hpp>
+
+template<typename Type>
+using counted_t = std::vector<std::pair<Type, uint32_t>>;
+
+// kx-mer buckets as filled by the partition counter: 256 radixes for each x in [0, 4].
+template<typename Type>
+struct kx_buckets
+{
+  std::vector<std::vector<Type>> kxmers = std::vector<std::vector<Type>>(256 * 5);
+  std::vector<Type*> ptrs = std::vector<Type*>(256 * 5);
+  std::vector<uint64_t> sizes = std::vector<uint64_t>(256 * 5);
+
+  void prepare()
+  {
+    for (size_t i = 0; i < kxmers.size(); i++)
+    {
+      std::sort(kxmers[i].begin(), kxmers[i].end());
+      ptrs[i] = kxmers[i].data();
+      sizes[i] = kxmers[i].size();
+    }
+  }
+};
+
+template<typename Type>
+Type random_kmer(std::mt19937_64& gen, size_t kmer_size)
+{
+  Type one, kmer;
+  one.setVal(1);
+  kmer.setVal(gen());
+  for (size_t i = 64; i < kmer_size * 2; i += 64)
+  {
+    Type word;
+    word.setVal(gen());
+    kmer = (kmer << 64) | word;
+  }
+  return kmer & ((one << (kmer_size * 2)) - one);
+}
+
+// Fills the buckets with sorted kx-mers drawn from a small pool, so that the same
+// k-mers come out of several streams.
+template<typename Type>
+kx_buckets<Type> random_buckets(size_t kmer_size, size_t pool_size, size_t n, uint64_t seed)
+{
+  std::mt19937_64 gen(seed);
+  std::vector<Type> pool;
+  for (size_t i = 0; i < pool_size; i++)
+    pool.push_back(random_kmer<Type>(gen, kmer_size));
+
+  kx_buckets<Type> buckets;
+  for (size_t i = 0; i < n; i++)
+    buckets.kxmers[gen() % buckets.kxmers.size()].push_back(pool[gen() % pool.size()]);
+  buckets.prepare();
+  return buckets;
+}
+
+// Expands every stream of the merger and counts the k-mers with a sort.
+template<typename Type>
+counted_t<Type> brute_force(const kx_buckets<Type>& buckets, size_t kmer_size, int first, int last)
+{
+  Type one, mask;
+  one.setVal(1);
+  mask = (one << (kmer_size * 2)) - one;
+
+  std::vector<Type> kmers;
+  for (size_t xx = 0; xx < 5; xx++)
+  {
+    for (size_t prefix = 0; prefix <= xx; prefix++)
+    {
+      for (size_t radix = 0; radix < 256; radix++)
+      {
+        Type r; r.setVal(radix);
+        for (auto& kx : buckets.kxmers[256 * xx + radix])
+        {
+          Type kmer = ((kx >> ((4 - prefix) * 2)) | (r << ((kmer_size - 4) * 2 + 2 * prefix))) & mask;
+          uint64_t p = (kmer >> ((kmer_size - 4) * 2)).getVal();
+          if (static_cast<int>(p) >= first && static_cast<int>(p) < last)
+            kmers.push_back(kmer);
+        }
+      }
+    }
+  }
+  std::sort(kmers.begin(), kmers.end());
+
+  counted_t<Type> counted;
+  for (auto& kmer : kmers)
+  {
+    if (!counted.empty() && counted.back().first == kmer)
+      counted.back().second++;
+    else
+      counted.push_back({kmer, 1});
+  }
+  return counted;
+}
+
+template<typename Type>
+counted_t<Type> merge(kx_buckets<Type>& buckets, size_t kmer_size, int first = 0, int last = 256)
+{
+  km::KxmerMerger<Type> merger(buckets.ptrs.data(), buckets.sizes.data(), kmer_size);
+  merger.restrict_to(first, last);
+  counted_t<Type> counted;
+  merger.merge([&](const Type& kmer, uint32_t count) { counted.push_back({kmer, count}); });
+  return counted;
+}
+
+template<typename Type>
+void check_equal(const counted_t<Type>& res, const counted_t<Type>& expected)
+{
+  ASSERT_EQ(res.size(), expected.size());
+  for (size_t i = 0; i < res.size(); i++)
+  {
+    EXPECT_TRUE(res[i].first == expected[i].first);
+    EXPECT_EQ(res[i].second, expected[i].second);
+  }
+}
+
+template<typename Type>
+void check_merge(size_t kmer_size)
+{
+  // Empty inputs.
+  kx_buckets<Type> empty;
+  empty.prepare();
+  EXPECT_TRUE(merge(empty, kmer_size).empty());
+
+  // A single stream: the kx-mers of size 0 of one radix.
+  kx_buckets<Type> single;
+  std::mt19937_64 gen(kmer_size);
+  Type kmer = random_kmer<Type>(gen, kmer_size);
+  for (size_t i = 0; i < 3; i++)
+    single.kxmers[42].push_back(kmer);
+  single.kxmers[42].push_back(random_kmer<Type>(gen, kmer_size));
+  single.prepare();
+  check_equal(merge(single, kmer_size), brute_force(single, kmer_size, 0, 256));
+
+  // Duplicate k-mers across all the streams.
+  for (uint64_t seed = 0; seed < 4; seed++)
+  {
+    auto buckets = random_buckets<Type>(kmer_size, 64, 5000, seed);
+    auto expected = brute_force(buckets, kmer_size, 0, 256);
+    EXPECT_TRUE(std::any_of(expected.begin(), expected.end(), [](auto& p) { return p.second > 1; }));
+    check_equal(merge(buckets, kmer_size), expected);
+
+    // Split partitions merge a range of prefixes.
+    check_equal(merge(buckets, kmer_size, 64, 200), brute_force(buckets, kmer_size, 64, 200));
+  }
+}
+
+TEST(kxmer_merge, merge_1_word)
+{
+  check_merge<LargeInt<1>>(31);
+}
+
+TEST(kxmer_merge, merge_2_words)
+{
+  check_merge<LargeInt<2>>(45);
+}
+
+TEST(kxmer_merge, merge_generic)
+{
+  check_merge<LargeInt<3>>(75);
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+
+#include <kmtricks/matrix.hpp>
+
+namespace fs = std::filesystem;
+
+using count_t = typename km::selectC<std::numeric_limits<uint32_t>::max()>::type;
+constexpr size_t C = std::numeric_limits<uint32_t>::max();
+
+TEST(matrix, append_kmer_columns)
+{
+  fs::create_directories("./tests_tmp/append");
+  std::vector<uint32_t> a {1, 1};
+  for (size_t p=0; p<4; p++)
+  {
+    std::string d = "./data/partitions/kmers/partition_" + std::to_string(p);
+    std::vector<std::string> all = {d + "/D1.kmer", d + "/D2.kmer"};
+    std::vector<std::string> first = {d + "/D1.kmer"};
+    std::vector<std::string> second = {d + "/D2.kmer"};
+    std::vector<uint32_t> a1 {1};
+
+    std::string matrix = "./tests_tmp/append/matrix.count";
+    std::string expected = "./tests_tmp/append/expected.count";
+    km::KmerMerger<32, C>(first, a1, 31, 1, 0).write_as_bin(matrix, false);
+    km::KmerMerger<32, C>(all, a, 31, 1, 0).write_as_bin(expected, false);
+
+    km::MatrixAppendTask<32, C> task(matrix, matrix + ".add", second, a1, 31, false, false);
+    task.exec();
+    EXPECT_FALSE(fs::exists(matrix + ".add.delta"));
+
+    km::MatrixReader<8192> mr(matrix + ".add");
+    km::MatrixReader<8192> er(expected);
+    EXPECT_EQ(mr.infos().nb_counts, 2);
+    km::Kmer<32> k1; k1.set_k(31);
+    km::Kmer<32> k2; k2.set_k(31);
+    std::vector<count_t> c1(2), c2(2);
+    size_t n = 0;
+    while (er.read<32, C>(k2, c2))
+    {
+      ASSERT_TRUE((mr.read<32, C>(k1, c1)));
+      EXPECT_EQ(k1, k2);
+      EXPECT_EQ(c1, c2);
+      n++;
+    }
+    EXPECT_FALSE((mr.read<32, C>(k1, c1)));
+    EXPECT_GT(n, 0);
+  }
+}
+
+TEST(matrix, append_hash_pa_columns)
+{
+  fs::create_directories("./tests_tmp/append");
+  for (size_t p=0; p<4; p++)
+  {
+    std::string d = "./data/partitions/hashes/partition_" + std::to_string(p);
+    std::vector<std::string> all = {d + "/D1.hash", d + "/D2.hash"};
+    std::vector<std::string> first = {d + "/D1.hash"};
+    std::vector<std::string> second = {d + "/D2.hash"};
+    std::vector<uint32_t> a {1, 1};
+    std::vector<uint32_t> a1 {1};
+
+    std::string matrix = "./tests_tmp/append/matrix.pa_hash";
+    std::string expected = "./tests_tmp/append/expected.pa_hash";
+    km::HashMerger<255, 32768, km::HashReader<255, 32768>>(first, a1, 1, 0).write_as_pa(matrix, false);
+    km::HashMerger<255, 32768, km::HashReader<255, 32768>>(all, a, 1, 0).write_as_pa(expected, false);
+
+    km::MatrixAppendTask<1, 255> task(matrix, matrix + ".add", second, a1, 0, true, false);
+    task.exec();
+
+    km::PAHashMatrixReader<8192> mr(matrix + ".add");
+    km::PAHashMatrixReader<8192> er(expected);
+    EXPECT_EQ(mr.infos().bits, 2);
+    uint64_t h1, h2;
+    std::vector<uint8_t> b1(1), b2(1);
+    while (er.read(h2, b2))
+    {
+      ASSERT_TRUE(mr.read(h1, b1));
+      EXPECT_EQ(h1, h2);
+      EXPECT_EQ(b1, b2);
+    }
+    EXPECT_FALSE(mr.read(h1, b1));
+  }
+}
+
+TEST(matrix, append_bf_columns)
+{
+  fs::create_directories("./tests_tmp/append");
+  std::string d = "./data/partitions/hashes/partition_0";
+  std::vector<std::string> all = {d + "/D1.hash", d + "/D2.hash"};
+  std::vector<std::string> first = {d + "/D1.hash"};
+  std::vector<std::string> second = {d + "/D2.hash"};
+  std::vector<uint32_t> a {1, 1};
+  std::vector<uint32_t> a1 {1};
+
+  uint64_t lower = std::numeric_limits<uint64_t>::max(), upper = 0;
+  {
+    km::HashMerger<255, 32768, km::HashReader<255, 32768>> m(all, a, 1, 0);
+    while (m.next())
+    {
+      lower = std::min(lower, m.current());
+      upper = std::max(upper, m.current());
+    }
+  }
+
+  std::string matrix = "./tests_tmp/append/matrix.cmbf";
+  std::string expected = "./tests_tmp/append/expected.cmbf";
+  km::HashMerger<255, 32768, km::HashReader<255, 32768>>(first, a1, 1, 0).write_as_bf(matrix, lower, upper, false);
+  km::HashMerger<255, 32768, km::HashReader<255, 32768>>(all, a, 1, 0).write_as_bf(expected, lower, upper, false);
+
+  km::BfMatrixAppendTask<255> task(matrix, matrix + ".add", second, a1);
+  task.exec();
+
+  km::VectorMatrixReader<8192> mr(matrix + ".add");
+  km::VectorMatrixReader<8192> er(expected);
+  EXPECT_EQ(mr.infos().bits, 2);
+  EXPECT_EQ(mr.infos().window, upper - lower + 1);
+  std::vector<uint8_t> b1(1), b2(1);
+  while (er.read(b2))
+  {
+    ASSERT_TRUE(mr.read(b1));
+    EXPECT_EQ(b1, b2);
+  }
+  EXPECT_FALSE(mr.read(b1));
+}
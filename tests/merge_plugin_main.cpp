@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include <kmtricks/merge.hpp>
+#include <kmtricks/count_run.hpp>
+
+#include <set>
+
+int main(int argc, char* argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+using count_type = typename km::selectC<DMAX_C>::type;
+
+// Keeps the rows with a total count >= 8 and caps the counts to 5.
+class CapBlockPlugin : public km::IMergePlugin
+{
+public:
+  size_t block_size() const override { return 64; }
+
+  void process_hash_block(km::MergeBlock& block) override
+  {
+    std::vector<uint32_t> sums(block.nb_rows, 0);
+    for (size_t s=0; s<block.nb_samples; s++)
+    {
+      count_type* counts = block.column(s);
+      for (size_t r=0; r<block.nb_rows; r++)
+      {
+        sums[r] += counts[r];
+        counts[r] = std::min<count_type>(counts[r], 5);
+      }
+    }
+    for (size_t r=0; r<block.nb_rows; r++)
+      block.keep[r] &= sums[r] >= 8;
+    m_blocks++;
+  }
+
+  size_t m_blocks {0};
+};
+
+// Same with the per-row interface, used through the default block forwarding.
+class CapRowPlugin : public km::IMergePlugin
+{
+public:
+  size_t block_size() const override { return 100; }
+
+  bool process_hash(uint64_t h, std::vector<count_type>& counts) override
+  {
+    uint32_t sum = 0;
+    for (auto& c : counts)
+    {
+      sum += c;
+      c = std::min<count_type>(c, 5);
+    }
+    return sum >= 8;
+  }
+};
+
+static std::vector<km::hrun_t<DMAX_C>> make_runs()
+{
+  std::vector<km::hrun_t<DMAX_C>> runs;
+  for (size_t i=0; i<3; i++)
+  {
+    runs.push_back(std::make_shared<km::HashRun<DMAX_C>>());
+    for (uint64_t h=0; h<1000; h++)
+      if ((h + i) % 3)
+        runs.back()->write(h * 7 + i % 2, (h * (i + 1)) % 9 + 1);
+  }
+  return runs;
+}
+
+using merger_t = km::HashMerger<DMAX_C, 4096, km::HashRunReader<DMAX_C>>;
+
+static std::vector<std::pair<uint64_t, std::vector<count_type>>> merge(km::IMergePlugin* plugin)
+{
+  std::vector<std::shared_ptr<km::HashRunReader<DMAX_C>>> readers;
+  for (auto& run : make_runs())
+    readers.push_back(std::make_shared<km::HashRunReader<DMAX_C>>(run));
+  std::vector<uint32_t> a {1, 1, 1};
+  merger_t merger(readers, a, 1, 0, 0);
+  if (plugin)
+    merger.set_plugin(plugin);
+
+  std::vector<std::pair<uint64_t, std::vector<count_type>>> rows;
+  while (merger.next())
+    if (merger.keep())
+      rows.emplace_back(merger.current(), merger.counts());
+  return rows;
+}
+
+TEST(merge_plugin, hash_block)
+{
+  auto expected = merge(nullptr);
+  expected.erase(std::remove_if(expected.begin(), expected.end(), [](auto& row) {
+    uint32_t sum = 0;
+    for (auto& c : row.second)
+    {
+      sum += c;
+      c = std::min<count_type>(c, 5);
+    }
+    return sum < 8;
+  }), expected.end());
+  EXPECT_GT(expected.size(), 0);
+
+  CapBlockPlugin block_plugin;
+  EXPECT_EQ(merge(&block_plugin), expected);
+  EXPECT_GT(block_plugin.m_blocks, 1);
+
+  CapRowPlugin row_plugin;
+  EXPECT_EQ(merge(&row_plugin), expected);
+}
+
+// Keeps the k-mers that end with 'A'.
+class EndBlockPlugin : public km::IMergePlugin
+{
+public:
+  size_t block_size() const override { return 16; }
+
+  void process_kmer_block(km::MergeBlock& block) override
+  {
+    for (size_t r=0; r<block.nb_rows; r++)
+      block.keep[r] &= (block.kmers[r * block.kmer_slots] & 3) == 0;
+  }
+};
+
+TEST(merge_plugin, kmer_block)
+{
+  std::vector<uint32_t> a {1, 1};
+  std::set<std::string> kmers;
+  std::vector<std::shared_ptr<km::KmerRunReader<DMAX_C>>> readers;
+  for (size_t i=0; i<2; i++)
+  {
+    std::set<km::Kmer<32>> sorted;
+    for (size_t j=0; j<200; j++)
+      sorted.insert(km::Kmer<32>(km::random_dna_seq(21)));
+    auto run = std::make_shared<km::KmerRun<DMAX_C>>(21);
+    for (auto& kmer : sorted)
+    {
+      run->write_raw(kmer.get_data64(), 1);
+      if (kmer.to_string().back() == 'A')
+        kmers.insert(kmer.to_string());
+    }
+    readers.push_back(std::make_shared<km::KmerRunReader<DMAX_C>>(run));
+  }
+
+  km::KmerMerger<32, DMAX_C, km::KmerRunReader<DMAX_C>> merger(readers, a, 21, 1, 0, 0);
+  EndBlockPlugin plugin;
+  merger.set_plugin(&plugin);
+  std::set<std::string> kept;
+  while (merger.next())
+    if (merger.keep())
+      kept.insert(merger.current().to_string());
+  EXPECT_EQ(kept, kmers);
+}
@@ -38,4 +38,32 @@ TEST(packc, to_n_b)
   EXPECT_EQ(km::to_n_b(32767, 3), 7);  // caped
   EXPECT_EQ(km::to_n_b(32768, 3), 7);  // caped
   EXPECT_EQ(km::to_n_b(32769, 3), 7);  // caped
-}
\ No newline at end of file
+}
+
+TEST(packc, unpack_v)
+{
+  std::vector<uint8_t> v(2, 0);
+  km::pack_v(std::vector<uint32_t>{1, 3, 0, 255}, v, 3);
+  uint32_t out[4];
+  km::unpack_v(v.data(), 4, 3, out);
+  EXPECT_EQ(out[0], 1);
+  EXPECT_EQ(out[1], 2);
+  EXPECT_EQ(out[2], 0);
+  EXPECT_EQ(out[3], 7);
+
+  for (int w = 1; w <= 8; w++)
+  {
+    for (std::size_t n : {1, 7, 9, 64, 131})
+    {
+      std::vector<uint32_t> counts(n);
+      for (auto& c : counts)
+        c = rand() % 1000;
+      std::vector<uint8_t> packed(km::byte_count_pack(n, w), 0);
+      km::pack_v(counts, packed, w);
+      std::vector<uint32_t> unpacked(n);
+      km::unpack_v(packed.data(), n, w, unpacked.data());
+      for (std::size_t i = 0; i < n; i++)
+        EXPECT_EQ(unpacked[i], km::to_n_b(counts[i], w));
+    }
+  }
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <kmtricks/sketch.hpp>
+#include <kmtricks/io/sketch_file.hpp>
+
+#include <thread>
+
+using namespace km;
+
+TEST(sketch, hyperloglog)
+{
+  for (uint64_t n : {100, 10000, 1000000})
+  {
+    HyperLogLog hll(12);
+    for (uint64_t i=0; i<n; i++)
+    {
+      hll.add(sketch_hash(i));
+      hll.add(sketch_hash(i));
+    }
+    EXPECT_NEAR(hll.estimate(), n, n * 0.05);
+  }
+
+  HyperLogLog a(12), b(12);
+  for (uint64_t i=0; i<20000; i++)
+    (i % 2 ? a : b).add(sketch_hash(i));
+  a.merge(b);
+  EXPECT_NEAR(a.estimate(), 20000, 1000);
+}
+
+TEST(sketch, minhash)
+{
+  // |A| = |B| = 200000, |A & B| = 100000, J = 1/3
+  MinHash a(100), b(100), bk(1, 2000), ck(1, 2000);
+  for (uint64_t i=0; i<200000; i++)
+  {
+    a.add(sketch_hash(i));
+    b.add(sketch_hash(i + 100000));
+    bk.add(sketch_hash(i));
+    ck.add(sketch_hash(i + 100000));
+  }
+  a.compact(); b.compact(); bk.compact(); ck.compact();
+
+  EXPECT_NEAR(a.hashes().size(), 2000, 200);
+  EXPECT_TRUE(std::is_sorted(a.hashes().begin(), a.hashes().end()));
+  EXPECT_NEAR(MinHashCmp(a, b).jaccard(), 1.0 / 3, 0.05);
+  EXPECT_NEAR(MinHashCmp(a, b).containment(), 0.5, 0.05);
+  EXPECT_DOUBLE_EQ(MinHashCmp(a, a).jaccard(), 1.0);
+
+  EXPECT_EQ(bk.hashes().size(), 2000);
+  EXPECT_EQ(bk.bound(), bk.hashes().back());
+  EXPECT_NEAR(MinHashCmp(bk, ck).jaccard(), 1.0 / 3, 0.05);
+  // Scaled and bottom-k sketches are compared below the smallest bound.
+  EXPECT_NEAR(MinHashCmp(a, ck).jaccard(), 1.0 / 3, 0.05);
+
+  EXPECT_DOUBLE_EQ(mash_distance(1.0, 21), 0.0);
+  EXPECT_DOUBLE_EQ(mash_distance(0.0, 21), 1.0);
+  EXPECT_GT(mash_distance(0.2, 21), mash_distance(0.5, 21));
+}
+
+TEST(sketch, shards)
+{
+  KSketch single(0, 21, 10, 10);
+  KSketch sharded(0, 21, 10, 10);
+  for (uint64_t i=0; i<100000; i++)
+    single.add(sketch_hash(i));
+  single.minhash().compact();
+
+  std::vector<std::thread> threads;
+  for (uint64_t t=0; t<4; t++)
+  {
+    threads.emplace_back([&sharded, t]() {
+      SketchShard& shard = sharded.shard();
+      for (uint64_t i=t; i<100000; i+=4)
+        shard.add(sketch_hash(i));
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  sharded.reduce();
+
+  EXPECT_EQ(sharded.hll().registers(), single.hll().registers());
+  EXPECT_EQ(sharded.minhash().hashes(), single.minhash().hashes());
+  EXPECT_NEAR(sharded.cardinality(), 100000, 5000);
+}
+
+TEST(sketch, sketch_file)
+{
+  KSketch sketch(3, 31, 12, 20, 1000);
+  for (uint64_t i=0; i<50000; i++)
+    sketch.add(sketch_hash(i));
+  sketch.minhash().compact();
+
+  for (bool lz4 : {false, true})
+  {
+    {
+      SketchWriter<8192> sw("./tests_tmp/sample.sketch", sketch, lz4);
+    }
+    sketch_t r = SketchReader<8192>("./tests_tmp/sample.sketch").get();
+    EXPECT_EQ(r->idx(), 3);
+    EXPECT_EQ(r->ksize(), 31);
+    EXPECT_EQ(r->minhash().scale(), 20);
+    EXPECT_EQ(r->minhash().size(), 1000);
+    EXPECT_EQ(r->minhash().bound(), sketch.minhash().bound());
+    EXPECT_EQ(r->hll().registers(), sketch.hll().registers());
+    EXPECT_EQ(r->minhash().hashes(), sketch.minhash().hashes());
+  }
+}
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+#include <kmtricks/sketch_topology.hpp>
+#include <kmtricks/sketch.hpp>
+
+#include <sstream>
+#include <set>
+
+using namespace km;
+
+// Uncompressed filter with a single bit vector, laid out as IBloomBuilder writes it. A non-zero
+// num_bits overrides the size in the header.
+static void write_filter(const std::string& path, const std::vector<uint64_t>& words,
+                         uint64_t num_bits = 0)
+{
+  uint32_t header_size = (bffileheader_size(1) + 15) & ~15;
+  std::vector<char> buffer(header_size, 0);
+  bffileheader* header = reinterpret_cast<bffileheader*>(buffer.data());
+  header->magic = bffileheaderMagic;
+  header->headerSize = header_size;
+  header->numBits = num_bits ? num_bits : words.size() * 64;
+  header->numVectors = 1;
+  header->info[0].compressor = bvcomp_uncompressed;
+  header->info[0].offset = header_size;
+  std::ofstream out(path, std::ios::out | std::ios::binary);
+  out.write(buffer.data(), buffer.size());
+  uint64_t nb_bits = words.size() * 64;
+  out.write(reinterpret_cast<char*>(&nb_bits), sizeof(nb_bits));
+  out.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint64_t));
+}
+
+TEST(sketch_topology, filter_signature)
+{
+  std::vector<uint64_t> words(16, 0);
+  words[0] = 0b1010;
+  words[5] = uint64_t{1} << 63;
+  words[15] = 1;
+  write_filter("./tests_tmp/topo.bf", words);
+
+  // 4 bins of 256 bits
+  FilterSignature sig = filter_signature("./tests_tmp/topo.bf", 4);
+  EXPECT_EQ(sig.bins(), (std::vector<uint32_t>{1, 5 * 64 + 63 - 256, FilterSignature::empty, 192}));
+
+  // Window [64, 384), 2 bins of 160 bits
+  FilterSignature win = filter_signature("./tests_tmp/topo.bf", 2, 64, 384);
+  EXPECT_EQ(win.bins(), (std::vector<uint32_t>{FilterSignature::empty, 5 * 64 + 63 - 64 - 160}));
+
+  EXPECT_DOUBLE_EQ(sig.distance(sig), 0.0);
+  FilterSignature other(4);
+  other.set(1, 100);
+  other.set(2, 7);
+  EXPECT_DOUBLE_EQ(sig.distance(other), 1.0);
+  other.merge(sig);
+  EXPECT_EQ(other.bins(), (std::vector<uint32_t>{1, 100, 7, 192}));
+  EXPECT_DOUBLE_EQ(sig.distance(other), 0.5);
+}
+
+TEST(sketch_topology, filter_signature_bins)
+{
+  write_filter("./tests_tmp/topo_bins.bf", std::vector<uint64_t>(4, 1));
+  EXPECT_THROW(filter_signature("./tests_tmp/topo_bins.bf", 0), InputError);
+
+  // Offsets in a bin must fit on 32 bits.
+  uint64_t num_bits = uint64_t{1} << 33;
+  write_filter("./tests_tmp/topo_bins.bf", std::vector<uint64_t>(4, 1), num_bits);
+  EXPECT_THROW(filter_signature("./tests_tmp/topo_bins.bf", 1), InputError);
+  EXPECT_THROW(filter_signature("./tests_tmp/topo_bins.bf", 2, 0, num_bits), InputError);
+  EXPECT_NO_THROW(filter_signature("./tests_tmp/topo_bins.bf", 4, 0, 256));
+}
+
+TEST(sketch_topology, nn_chain)
+{
+  // Two groups of 8 samples, sharing most of their bits within a group.
+  size_t nb_bins = 512;
+  std::vector<FilterSignature> sigs;
+  for (uint64_t s=0; s<16; s++)
+  {
+    FilterSignature sig(nb_bins);
+    for (uint64_t i=0; i<20000; i++)
+    {
+      uint64_t group = (s < 8) ? 0 : 1;
+      uint64_t h = sketch_hash(i + group * 1000000);
+      if (sketch_hash(h ^ s) % 10 == 0)
+        h = sketch_hash(h + s + 1);
+      sig.set(h % nb_bins, (h >> 32) & 0xffff);
+    }
+    sigs.push_back(std::move(sig));
+  }
+
+  SketchTopology topology(std::move(sigs), 2);
+  topology.build();
+  EXPECT_EQ(topology.root(), 30);
+
+  // The root splits the groups.
+  auto leaves = [&topology](uint32_t node) {
+    std::set<uint32_t> ret;
+    std::vector<uint32_t> stack {node};
+    while (!stack.empty())
+    {
+      uint32_t n = stack.back(); stack.pop_back();
+      if (n < topology.nb_leaves())
+        ret.insert(n);
+      else
+        for (auto c : topology.children(n))
+          stack.push_back(c);
+    }
+    return ret;
+  };
+  auto root = topology.children(topology.root());
+  std::set<uint32_t> a = leaves(root[0]), b = leaves(root[1]);
+  EXPECT_EQ(a.size(), 8);
+  EXPECT_EQ(b.size(), 8);
+  EXPECT_TRUE(*a.rbegin() < 8 || *a.begin() >= 8);
+  EXPECT_TRUE(*b.rbegin() < 8 || *b.begin() >= 8);
+}
+
+TEST(sketch_topology, nn_chain_non_reducible)
+{
+  // One bin per element, the distance is 1 - Jaccard. The chain goes 0, 1, 2, 3 and merges
+  // 2 and 3, their union is then the nearest node of 1, and 0 the nearest node of the union.
+  std::vector<std::vector<uint32_t>> sets {
+    {1, 2, 9}, {2, 5, 7, 11}, {2, 3, 4, 8, 10, 11, 12}, {1, 4, 6, 10, 12}
+  };
+  std::vector<FilterSignature> sigs;
+  for (auto& set : sets)
+  {
+    FilterSignature sig(13);
+    for (auto e : set)
+      sig.set(e, 0);
+    sigs.push_back(std::move(sig));
+  }
+
+  SketchTopology topology(std::move(sigs));
+  topology.build();
+  EXPECT_EQ(topology.root(), 6);
+  EXPECT_EQ(topology.children(4), (std::array<uint32_t, 2>{2, 3}));
+  EXPECT_EQ(topology.children(5), (std::array<uint32_t, 2>{0, 4}));
+  EXPECT_EQ(topology.children(6), (std::array<uint32_t, 2>{1, 5}));
+}
+
+TEST(sketch_topology, write)
+{
+  // 0 and 1 are identical, 2 is different.
+  std::vector<FilterSignature> sigs(3, FilterSignature(4));
+  for (size_t i=0; i<4; i++)
+  {
+    sigs[0].set(i, i);
+    sigs[1].set(i, i);
+    sigs[2].set(i, i + 10);
+  }
+  SketchTopology topology(std::move(sigs));
+  topology.build();
+
+  std::stringstream ss;
+  topology.write(ss, {"a.bf", "b.bf", "c.bf"}, "node");
+  EXPECT_EQ(ss.str(), "node1.bf\n*c.bf\n*node2.bf\n**a.bf\n**b.bf\n");
+
+  SketchTopology single(std::vector<FilterSignature>(1, FilterSignature(4)));
+  EXPECT_THROW(single.build(), PipelineError);
+}
@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 #include <kmtricks/task.hpp>
+#include <kmtricks/cmd.hpp>
 #include <kmtricks/repartition.hpp>
 #include <kmtricks/gatb/gatb_utils.hpp>
+#include <kmtricks/bft_query.hpp>
+#include <kmtricks/io/fastx.hpp>
 
 #define MK 32
 #define MC 4294967295
@@ -22,6 +25,153 @@ int main(int argc, char* argv[])
   return r;
 }
 
+static km::all_options_t pipeline_options(const std::string& run_dir, km::COMMAND until, bool resume)
+{
+  auto opt = std::make_shared<km::all_options>();
+  opt->dir = run_dir; opt->fof = foff;
+  opt->kmer_size = 31; opt->c_ab_min = 1; opt->m_ab_min = 1; opt->r_min = 1;
+  opt->minim_size = 10; opt->nb_parts = 4; opt->restrict_to = 1.0;
+  opt->bloom_size = 100000; opt->bwidth = 2; opt->nb_threads = 2;
+  opt->count_format = km::COUNT_FORMAT::KMER; opt->mode = km::MODE::COUNT;
+  opt->format = km::FORMAT::BIN; opt->out_format = km::OUT_FORMAT::HOWDE;
+  opt->until = until; opt->resume = resume;
+  return opt;
+}
+
+static std::map<std::string, std::string> read_dir(const std::string& path)
+{
+  std::map<std::string, std::string> files;
+  for (auto& e : fs::recursive_directory_iterator(path))
+  {
+    if (!e.is_regular_file())
+      continue;
+    std::ifstream in(e.path(), std::ios::binary);
+    std::stringstream ss; ss << in.rdbuf();
+    files[fs::relative(e.path(), path).string()] = ss.str();
+  }
+  return files;
+}
+
+TEST(pipeline, pipeline_resume)
+{
+  std::string ref = "./tests_tmp/pipeline_ref", run = "./tests_tmp/pipeline_resume";
+  km::main_all<MK>()(pipeline_options(ref, km::COMMAND::ALL, false));
+
+  // Interrupted after the count stage, while counting the last partition of D2.
+  km::main_all<MK>()(pipeline_options(run, km::COMMAND::COUNT, false));
+  fs::remove(km::KmDir::get().get_count_part_path("D2", 3, false, km::KM_FILE::KMER));
+  EXPECT_TRUE(read_dir(fmt::format("{}/matrices", run)).empty());
+
+  EXPECT_THROW(km::main_all<MK>()(pipeline_options(run, km::COMMAND::ALL, false)), km::PipelineError);
+  km::main_all<MK>()(pipeline_options(run, km::COMMAND::ALL, true));
+
+  auto expected = read_dir(fmt::format("{}/matrices", ref));
+  EXPECT_GT(expected.size(), 0);
+  EXPECT_EQ(read_dir(fmt::format("{}/matrices", run)), expected);
+
+  std::ifstream in(fmt::format("{}/journal.txt", run));
+  std::string journal((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  EXPECT_NE(journal.find("done\tmerge P=3"), std::string::npos);
+
+  // The count outputs of the interrupted run cannot be reused by fused count+merge tasks.
+  auto fused = pipeline_options(run, km::COMMAND::ALL, true);
+  fused->count_merge = true;
+  EXPECT_THROW(km::main_all<MK>()(fused), km::PipelineError);
+  fs::remove_all(ref);
+  fs::remove_all(run);
+}
+
+TEST(pipeline, pipeline_resume_packed)
+{
+  std::string run = "./tests_tmp/pipeline_resume_packed";
+  auto opt = pipeline_options(run, km::COMMAND::SUPERK, false);
+  opt->packed_superk = true;
+  km::main_all<MK>()(opt);
+
+  // The packed super-k-mers are reused, not recomputed.
+  std::string pack = fmt::format("{}/skp.pack", km::KmDir::get().get_superk_path("D1"));
+  auto old_time = fs::last_write_time(pack) - std::chrono::hours(1);
+  fs::last_write_time(pack, old_time);
+
+  auto resumed = pipeline_options(run, km::COMMAND::COUNT, true);
+  resumed->packed_superk = true; resumed->keep_tmp = true;
+  km::main_all<MK>()(resumed);
+  EXPECT_EQ(fs::last_write_time(pack), old_time);
+  EXPECT_TRUE(fs::exists(km::KmDir::get().get_count_part_path("D1", 0, false, km::KM_FILE::KMER)));
+
+  // Packing the super-k-mers changes the run.
+  resumed->packed_superk = false;
+  EXPECT_THROW(km::main_all<MK>()(resumed), km::PipelineError);
+  fs::remove_all(run);
+}
+
+using count_t = typename km::selectC<MC>::type;
+
+// Rows of all the partition matrices of a run, the partitions depend on the samples of the run.
+static std::map<std::string, std::vector<count_t>> read_matrices(const std::string& run_dir, size_t nb_samples)
+{
+  std::map<std::string, std::vector<count_t>> rows;
+  for (auto& e : fs::directory_iterator(fmt::format("{}/matrices", run_dir)))
+  {
+    km::MatrixReader<8192> mr(e.path().string());
+    EXPECT_EQ(mr.infos().nb_counts, nb_samples);
+    km::Kmer<MK> kmer; kmer.set_k(31);
+    std::vector<count_t> counts(nb_samples);
+    while (mr.read<MK, MC>(kmer, counts))
+      rows[kmer.to_string()] = counts;
+  }
+  return rows;
+}
+
+TEST(pipeline, pipeline_add)
+{
+  std::string ref = "./tests_tmp/add_ref", run = "./tests_tmp/add_run";
+  std::string d1 = "./tests_tmp/add_d1.fof", d2 = "./tests_tmp/add_d2.fof";
+  std::ofstream(d1) << "D1: data/1.fasta\n";
+  std::ofstream(d2) << "D2: data/2.fasta\n";
+
+  auto add_options = [&](const std::string& run_dir) {
+    auto opt = std::make_shared<km::add_options>();
+    opt->dir = run_dir; opt->fof = d2; opt->nb_threads = 2;
+    return opt;
+  };
+
+  km::main_all<MK>()(pipeline_options(ref, km::COMMAND::ALL, false));
+  auto first = pipeline_options(run, km::COMMAND::ALL, false);
+  first->fof = d1;
+  km::main_all<MK>()(first);
+  km::main_add<MK>()(add_options(run));
+
+  auto expected = read_matrices(ref, 2);
+  EXPECT_GT(expected.size(), 0);
+  EXPECT_EQ(read_matrices(run, 2), expected);
+  fs::remove_all(run);
+
+  // The rows filtered by the recurrence min depend on the counts of the first samples.
+  first->r_min = 2;
+  km::main_all<MK>()(first);
+  EXPECT_THROW(km::main_add<MK>()(add_options(run)), km::InputError);
+
+  fs::remove_all(ref);
+  fs::remove_all(run);
+  fs::remove(d1);
+  fs::remove(d2);
+}
+
+TEST(pipeline, run_options)
+{
+  auto opt = pipeline_options("./tests_tmp/run, mode=pa", km::COMMAND::ALL, false);
+  opt->m_ab_min_path = "./tests_tmp/soft\\min,x.txt";
+  opt->dump("./tests_tmp/options.txt");
+
+  auto run = km::parse_run_options("./tests_tmp/options.txt");
+  EXPECT_EQ(run["dir"], "./tests_tmp/run, mode=pa");
+  EXPECT_EQ(run["m_ab_min_path"], "./tests_tmp/soft\\min,x.txt");
+  EXPECT_EQ(run["mode"], "count");
+  EXPECT_EQ(run["r_min"], "1");
+  fs::remove("./tests_tmp/options.txt");
+}
+
 TEST(config_task, config_task)
 {
   km::KmDir::get().init(dir, foff, true);
@@ -55,6 +205,29 @@ TEST(repart_task, repart_task)
   }
 }
 
+TEST(repart_task, sample_bank)
+{
+  km::Fof fof(foff);
+  IBank* all = Bank::open(fof.get_all()); LOCAL(all);
+  u_int64_t nb, size, max;
+  all->estimate(nb, size, max);
+
+  km::SampleBank* b1 = new km::SampleBank(fof, 1, 42, 2); LOCAL(b1);
+  km::SampleBank* b2 = new km::SampleBank(fof, 1, 42, 1); LOCAL(b2);
+  km::SampleBank* b3 = new km::SampleBank(fof, 0, 42, 2); LOCAL(b3);
+
+  u_int64_t snb, ssize, smax;
+  b1->estimate(snb, ssize, smax);
+  EXPECT_EQ(snb, nb); EXPECT_EQ(ssize, size); EXPECT_EQ(smax, max);
+  EXPECT_EQ(b1->getNbItems(), 2);
+  EXPECT_EQ(b3->getNbItems(), 0);
+
+  Iterator<Sequence>* i1 = b1->iterator(); LOCAL(i1);
+  Iterator<Sequence>* i2 = b2->iterator(); LOCAL(i2);
+  for (i1->first(), i2->first(); !i1->isDone(); i1->next(), i2->next())
+    EXPECT_EQ(i1->item().toString(), i2->item().toString());
+}
+
 // Repartition depends on system configuration, so pre-computed repartition is used below
 TEST(superk_task, superk_task)
 {
@@ -339,6 +512,64 @@ TEST(count_task, kmer_count_task)
   }
 }
 
+TEST(count_task, kmer_count_task_split)
+{
+  km::KmDir::get().init(dir, "", false);
+  Storage* config_storage = StorageFactory(STORAGE_FILE).load(km::KmDir::get().m_config_storage);
+  LOCAL(config_storage);
+  Configuration config = Configuration();
+  config.load(config_storage->getGroup("gatb"));
+
+  km::sk_storage_t storage = std::make_shared<km::SuperKStorageReader>(km::KmDir::get().get_superk_path("D1"));
+  km::parti_info_t pinfo = std::make_shared<PartiInfo<5>>(km::KmDir::get().get_superk_path("D1"));
+  for (size_t p=0; p<4; p++)
+  {
+    std::string path = km::KmDir::get().get_count_part_path("D1", p, false, km::KM_FILE::KMER);
+    std::string split_path = path + ".split";
+    km::CountTask<MK, MC, km::SuperKStorageReader> task(
+      split_path, config, storage, pinfo, p, 0, 31, 1, false, nullptr, false, 4);
+    task.exec();
+
+    std::ifstream a(path, std::ios::binary), b(split_path, std::ios::binary);
+    std::string ca((std::istreambuf_iterator<char>(a)), std::istreambuf_iterator<char>());
+    std::string cb((std::istreambuf_iterator<char>(b)), std::istreambuf_iterator<char>());
+    EXPECT_FALSE(ca.empty());
+    EXPECT_EQ(ca, cb);
+  }
+}
+
+TEST(count_task, count_task_sketch)
+{
+  km::KmDir::get().init(dir, "", false);
+  Storage* config_storage = StorageFactory(STORAGE_FILE).load(km::KmDir::get().m_config_storage);
+  LOCAL(config_storage);
+  Configuration config = Configuration();
+  config.load(config_storage->getGroup("gatb"));
+
+  km::sk_storage_t storage = std::make_shared<km::SuperKStorageReader>(km::KmDir::get().get_superk_path("D1"));
+  km::parti_info_t pinfo = std::make_shared<PartiInfo<5>>(km::KmDir::get().get_superk_path("D1"));
+  km::sketch_t sketch = std::make_shared<km::KSketch>(0, 31, 12, 1);
+  km::KSketch expected(0, 31, 12, 1);
+  for (size_t p=0; p<4; p++)
+  {
+    std::string path = km::KmDir::get().get_count_part_path("D1", p, false, km::KM_FILE::KMER);
+    km::CountTask<MK, MC, km::SuperKStorageReader> task(
+      path + ".sketch", config, storage, pinfo, p, 0, 31, 1, false, nullptr, false, 1, sketch);
+    task.exec();
+
+    km::Kmer<MK> kmer; kmer.set_k(31);
+    uint32_t count;
+    km::KmerReader<8192> kr(path);
+    while (kr.read<MK, MC>(kmer, count))
+      expected.add(km::sketch_hash(kmer.get_data64(), 1));
+  }
+  sketch->reduce();
+  expected.minhash().compact();
+  EXPECT_FALSE(expected.minhash().hashes().empty());
+  EXPECT_EQ(sketch->minhash().hashes(), expected.minhash().hashes());
+  EXPECT_EQ(sketch->hll().registers(), expected.hll().registers());
+}
+
 TEST(count_task, hash_count_task)
 {
   km::KmDir::get().init(dir, "", false);
@@ -505,4 +736,208 @@ TEST(count_task, hash_count_task)
     }
     EXPECT_EQ(n, 39);
   }
-}
\ No newline at end of file
+}
+
+TEST(count_task, hash_count_task_split)
+{
+  km::KmDir::get().init(dir, "", false);
+  Storage* config_storage = StorageFactory(STORAGE_FILE).load(km::KmDir::get().m_config_storage);
+  LOCAL(config_storage);
+  Configuration config = Configuration();
+  config.load(config_storage->getGroup("gatb"));
+  km::HashWindow hw("./data/hash.info");
+
+  km::sk_storage_t storage = std::make_shared<km::SuperKStorageReader>(km::KmDir::get().get_superk_path("D1"));
+  km::parti_info_t pinfo = std::make_shared<PartiInfo<5>>(km::KmDir::get().get_superk_path("D1"));
+  for (size_t p=0; p<4; p++)
+  {
+    std::string path = km::KmDir::get().get_count_part_path("D1", p, false, km::KM_FILE::HASH);
+    std::string split_path = path + ".split";
+    km::HashCountTask<MK, MC, km::SuperKStorageReader> task(
+      split_path, config, storage, pinfo, p, 0, hw.get_window_size_bits(), 31, 1, false, nullptr, false, 4);
+    task.exec();
+
+    std::ifstream a(path, std::ios::binary), b(split_path, std::ios::binary);
+    std::string ca((std::istreambuf_iterator<char>(a)), std::istreambuf_iterator<char>());
+    std::string cb((std::istreambuf_iterator<char>(b)), std::istreambuf_iterator<char>());
+    EXPECT_FALSE(ca.empty());
+    EXPECT_EQ(ca, cb);
+  }
+}
+
+TEST(count_task, kmer_count_task_packed)
+{
+  km::KmDir::get().init(dir, "", false);
+  km::KmDir::get().m_repart_storage = "./data/repart";
+  std::vector<uint32_t> parts = {0, 1, 2, 3};
+  km::SuperKTask<MK> superk_task("D1", true, parts, true);
+  superk_task.exec();
+  ASSERT_TRUE(fs::exists("./tests_tmp/km_dir_test/superkmers/D1/skp.pack"));
+  ASSERT_TRUE(fs::exists("./tests_tmp/km_dir_test/superkmers/D1/skp.pidx"));
+
+  Storage* config_storage = StorageFactory(STORAGE_FILE).load(km::KmDir::get().m_config_storage);
+  LOCAL(config_storage);
+  Configuration config = Configuration();
+  config.load(config_storage->getGroup("gatb"));
+
+  km::sk_storage_t storage = std::make_shared<km::SuperKStorageReader>(km::KmDir::get().get_superk_path("D1"));
+  km::parti_info_t pinfo = std::make_shared<PartiInfo<5>>(km::KmDir::get().get_superk_path("D1"));
+  ASSERT_TRUE(storage->packed());
+  for (size_t p=0; p<4; p++)
+  {
+    std::string path = km::KmDir::get().get_count_part_path("D1", p, false, km::KM_FILE::KMER);
+    std::string packed_path = path + ".packed";
+    km::CountTask<MK, MC, km::SuperKStorageReader> task(
+      packed_path, config, storage, pinfo, p, 0, 31, 1, false, nullptr, false);
+    task.exec();
+
+    std::ifstream a(path, std::ios::binary), b(packed_path, std::ios::binary);
+    std::string ca((std::istreambuf_iterator<char>(a)), std::istreambuf_iterator<char>());
+    std::string cb((std::istreambuf_iterator<char>(b)), std::istreambuf_iterator<char>());
+    EXPECT_FALSE(ca.empty());
+    EXPECT_EQ(ca, cb);
+  }
+}
+
+static std::string file_content(const std::string& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST(count_task, count_merge_task)
+{
+  km::KmDir::get().init(dir, "", false);
+  Storage* config_storage = StorageFactory(STORAGE_FILE).load(km::KmDir::get().m_config_storage);
+  LOCAL(config_storage);
+  Configuration config = Configuration();
+  config.load(config_storage->getGroup("gatb"));
+  km::HashWindow hw("./data/hash.info");
+
+  std::vector<km::sk_storage_t> storages;
+  std::vector<km::parti_info_t> pinfos;
+  for (auto& s : {"D1", "D2"})
+  {
+    storages.push_back(std::make_shared<km::SuperKStorageReader>(km::KmDir::get().get_superk_path(s)));
+    pinfos.push_back(std::make_shared<PartiInfo<5>>(km::KmDir::get().get_superk_path(s)));
+  }
+  std::vector<uint32_t> a_mins = {1, 1};
+  std::vector<km::hist_t> hists = {nullptr, nullptr};
+  std::vector<uint32_t> ab_vec = {1, 1};
+
+  for (size_t p=0; p<4; p++)
+  {
+    std::string path = km::KmDir::get().get_matrix_path(
+      p, km::MODE::COUNT, km::FORMAT::TEXT, km::COUNT_FORMAT::KMER, false);
+    km::KmerMergeTask<MK, MC> merge_task(p, ab_vec, 31, 1, 0, false, km::MODE::COUNT, km::FORMAT::TEXT);
+    merge_task.exec();
+    std::string expected = file_content(path);
+    EXPECT_FALSE(expected.empty());
+
+    km::KmerCountMergeTask<MK, MC, km::SuperKStorageReader> task(
+      p, storages, pinfos, a_mins, hists, ab_vec, 31, 1, 0, false, km::MODE::COUNT, km::FORMAT::TEXT);
+    task.exec();
+    EXPECT_EQ(file_content(path), expected);
+  }
+
+  for (size_t p=0; p<4; p++)
+  {
+    std::string path = km::KmDir::get().get_matrix_path(
+      p, km::MODE::PA, km::FORMAT::BIN, km::COUNT_FORMAT::HASH, false);
+    km::HashMergeTask<MC> merge_task(
+      p, ab_vec, 1, 0, false, km::MODE::PA, km::FORMAT::BIN, hw, false, -1);
+    merge_task.exec();
+    std::string expected = file_content(path);
+    EXPECT_FALSE(expected.empty());
+
+    km::HashCountMergeTask<MK, MC, km::SuperKStorageReader> task(
+      p, storages, pinfos, a_mins, hists, ab_vec, 31, 1, 0, false, km::MODE::PA, km::FORMAT::BIN,
+      hw, false, -1);
+    task.exec();
+    EXPECT_EQ(file_content(path), expected);
+  }
+}
+
+TEST(count_task, bft_query)
+{
+  km::KmDir::get().init(dir, "", false);
+  km::HashWindow hw("./data/hash.info");
+  std::vector<uint32_t> ab_vec = {1, 1};
+  for (size_t p=0; p<4; p++)
+  {
+    km::HashMergeTask<MC> bft_task(p, ab_vec, 1, 0, false, km::MODE::BFT, km::FORMAT::BIN, hw, false, -1);
+    bft_task.exec();
+    km::HashMergeTask<MC> bf_task(p, ab_vec, 1, 0, false, km::MODE::BF, km::FORMAT::BIN, hw, false, -1);
+    bf_task.exec();
+  }
+
+  std::string repart = "./data/repart_gatb/repartition.minimRepart";
+  km::BFTQuery<MK> bft(km::KmDir::get().get_matrix_paths(4, km::MODE::BFT, km::FORMAT::BIN, km::COUNT_FORMAT::HASH, false),
+                       km::BF_LAYOUT::BFT, 2, repart, "./data/hash.info", 31);
+  km::BFTQuery<MK> bf(km::KmDir::get().get_matrix_paths(4, km::MODE::BF, km::FORMAT::BIN, km::COUNT_FORMAT::HASH, false),
+                      km::BF_LAYOUT::BF, 2, repart, "./data/hash.info", 31);
+  EXPECT_EQ(bft.nb_samples(), 2);
+
+  km::FastxReader reader("./data/1.fasta");
+  size_t nb_queries = 0;
+  while (reader.next())
+  {
+    std::string seq(reader.seq(), reader.size());
+    uint64_t nb_kmers = 0, nb_kmers_bf = 0;
+    std::vector<uint32_t> hits = bft.query(seq, nb_kmers);
+    EXPECT_EQ(nb_kmers, seq.size() - 30);
+    // All the k-mers of D1 are in its filter.
+    EXPECT_EQ(hits[0], nb_kmers);
+    EXPECT_EQ(bf.query(seq, nb_kmers_bf), hits);
+    nb_queries++;
+  }
+  EXPECT_GT(nb_queries, 0);
+}
+
+TEST(count_task, bfc_query)
+{
+  km::KmDir::get().init(dir, "", false);
+  km::HashWindow hw("./data/hash.info");
+  std::vector<uint32_t> ab_vec = {1, 1};
+  std::unordered_map<uint64_t, uint32_t> d1_counts;
+  for (size_t p=0; p<4; p++)
+  {
+    km::HashMergeTask<MC> bfc_task(p, ab_vec, 1, 0, false, km::MODE::BFC, km::FORMAT::BIN, hw, false, 3);
+    bfc_task.exec();
+    km::HashReader<MC> hr(km::KmDir::get().get_count_part_path("D1", p, false, km::KM_FILE::HASH));
+    uint64_t hash; uint32_t count;
+    while (hr.read(hash, count))
+      d1_counts[hash] = count;
+  }
+
+  std::string repart = "./data/repart_gatb/repartition.minimRepart";
+  std::vector<std::string> paths = km::KmDir::get().get_matrix_paths(
+    4, km::MODE::BFC, km::FORMAT::BIN, km::COUNT_FORMAT::HASH, false);
+  km::BFTQuery<MK> bfc(paths, km::BF_LAYOUT::BFC, 2, repart, "./data/hash.info", 31);
+  EXPECT_EQ(bfc.width(), 3);
+  EXPECT_EQ(bfc.nb_buckets(), 8);
+  EXPECT_THROW(km::BFTQuery<MK>(paths, km::BF_LAYOUT::BF, 2, repart, "./data/hash.info", 31), km::IOError);
+
+  km::FastxReader reader("./data/1.fasta");
+  size_t nb_queries = 0;
+  while (reader.next())
+  {
+    std::string seq(reader.seq(), reader.size());
+    uint64_t nb_kmers = 0, nb_kmers_ab = 0;
+    std::vector<uint32_t> hits = bfc.query(seq, nb_kmers);
+    std::vector<km::QueryAbundance> ab = bfc.abundance(seq, nb_kmers_ab);
+    EXPECT_EQ(nb_kmers, nb_kmers_ab);
+    EXPECT_EQ(hits[0], nb_kmers);
+    EXPECT_EQ(ab[0].hits, hits[0]);
+    EXPECT_EQ(ab[1].hits, hits[1]);
+
+    std::vector<uint32_t> buckets;
+    for (uint64_t h : bfc.hashes(seq))
+      buckets.push_back(km::to_n_b(d1_counts.at(h), 3));
+    std::sort(buckets.begin(), buckets.end());
+    EXPECT_EQ(ab[0].min, buckets.front());
+    EXPECT_EQ(ab[0].median, buckets[(buckets.size() - 1) / 2]);
+    nb_queries++;
+  }
+  EXPECT_GT(nb_queries, 0);
+}
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include <kmtricks/task_pool.hpp>
+
+class MemTask : public km::ITask
+{
+public:
+  MemTask(uint64_t memory, std::atomic<uint64_t>& in_use, std::atomic<uint64_t>& peak,
+          std::vector<uint64_t>& order, std::mutex& mutex)
+    : ITask(3), m_memory(memory), m_in_use(in_use), m_peak(peak), m_order(order), m_mutex(mutex) {}
+
+  uint64_t memory() const override { return m_memory; }
+
+  void preprocess() override {}
+  void postprocess() override {}
+  void exec() override
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_order.push_back(m_memory);
+    }
+    uint64_t v = (m_in_use += m_memory);
+    uint64_t p = m_peak.load();
+    while (v > p && !m_peak.compare_exchange_weak(p, v));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    m_in_use -= m_memory;
+  }
+
+private:
+  uint64_t m_memory;
+  std::atomic<uint64_t>& m_in_use;
+  std::atomic<uint64_t>& m_peak;
+  std::vector<uint64_t>& m_order;
+  std::mutex& m_mutex;
+};
+
+TEST(task_pool, memory_budget)
+{
+  std::atomic<uint64_t> in_use {0}, peak {0};
+  std::vector<uint64_t> order;
+  std::mutex mutex;
+  {
+    km::TaskPool pool(8, 100);
+    for (uint64_t m : {10, 60, 30, 50, 20, 40, 70, 10})
+      pool.add_task(std::make_shared<MemTask>(m, in_use, peak, order, mutex));
+    pool.join_all();
+    EXPECT_LE(pool.memory_peak(), 100);
+  }
+  EXPECT_EQ(order.size(), 8);
+  EXPECT_LE(peak.load(), 100);
+
+  // A task larger than the budget runs alone.
+  peak = 0;
+  {
+    km::TaskPool pool(8, 100);
+    for (uint64_t m : {10, 150, 30, 50})
+      pool.add_task(std::make_shared<MemTask>(m, in_use, peak, order, mutex));
+    pool.join_all();
+  }
+  EXPECT_EQ(order.size(), 12);
+  EXPECT_EQ(peak.load(), 150);
+}
+
+TEST(task_pool, largest_first)
+{
+  std::atomic<uint64_t> in_use {0}, peak {0};
+  std::vector<uint64_t> order;
+  std::mutex mutex;
+  {
+    km::TaskPool pool(1, 1000);
+    // The only worker is busy with the first task while the others are queued.
+    pool.add_task(std::make_shared<MemTask>(1, in_use, peak, order, mutex));
+    for (bool started = false; !started; std::this_thread::yield())
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      started = !order.empty();
+    }
+    for (uint64_t m : {10, 60, 30, 50})
+      pool.add_task(std::make_shared<MemTask>(m, in_use, peak, order, mutex));
+    pool.join_all();
+  }
+  ASSERT_EQ(order.size(), 5);
+  EXPECT_EQ(order[0], 1);
+  EXPECT_EQ(std::vector<uint64_t>(order.begin() + 1, order.end()), (std::vector<uint64_t>{60, 50, 30, 10}));
+}
+
+TEST(task_pool, no_starvation)
+{
+  if (std::thread::hardware_concurrency() < 2)
+    GTEST_SKIP() << "needs two workers";
+
+  std::atomic<uint64_t> in_use {0}, peak {0};
+  std::vector<uint64_t> order;
+  std::mutex mutex;
+  {
+    km::TaskPool pool(2, 100);
+    for (size_t i=0; i<20; i++)
+      pool.add_task(std::make_shared<MemTask>(10, in_use, peak, order, mutex));
+    for (bool started = false; !started; std::this_thread::yield())
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      started = !order.empty();
+    }
+    // Does not fit while a small task runs, small tasks overtake it at most twice.
+    pool.add_task(std::make_shared<MemTask>(95, in_use, peak, order, mutex));
+    pool.join_all();
+  }
+  ASSERT_EQ(order.size(), 21);
+  auto pos = std::find(order.begin(), order.end(), 95) - order.begin();
+  EXPECT_LT(pos, 10);
+  EXPECT_LE(peak.load(), 100);
+}
+
+// Borrows up to 3 extra threads, counts the running threads.
+class SplitTask : public km::ITask
+{
+public:
+  SplitTask(std::atomic<uint32_t>& active, std::atomic<uint32_t>& peak, std::atomic<uint32_t>& lent)
+    : ITask(3), m_active(active), m_peak(peak), m_lent(lent) {}
+
+  void preprocess() override {}
+  void postprocess() override {}
+  void exec() override
+  {
+    km::BorrowedThreads extra(*this, 3);
+    m_lent += extra.size();
+    uint32_t v = (m_active += 1 + extra.size());
+    uint32_t p = m_peak.load();
+    while (v > p && !m_peak.compare_exchange_weak(p, v));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    m_active -= 1 + extra.size();
+  }
+
+private:
+  std::atomic<uint32_t>& m_active;
+  std::atomic<uint32_t>& m_peak;
+  std::atomic<uint32_t>& m_lent;
+};
+
+TEST(task_pool, lend_threads)
+{
+  std::atomic<uint32_t> active {0}, peak {0}, lent {0};
+  // Pools are capped to the hardware concurrency.
+  uint32_t n = std::min(4u, std::thread::hardware_concurrency());
+  {
+    km::TaskPool pool(4);
+    pool.add_task(std::make_shared<SplitTask>(active, peak, lent));
+    pool.join_all();
+  }
+  EXPECT_EQ(lent.load(), n - 1);
+
+  peak = 0;
+  {
+    km::TaskPool pool(4);
+    for (size_t i=0; i<32; i++)
+      pool.add_task(std::make_shared<SplitTask>(active, peak, lent));
+    pool.join_all();
+  }
+  EXPECT_LE(peak.load(), n);
+
+  // Without a pool, a task gets all the threads it asks for.
+  SplitTask task(active, peak, lent);
+  EXPECT_EQ(task.borrow_threads(7), 7);
+}
+
+class CountingLender : public km::IThreadLender
+{
+public:
+  uint32_t borrow(uint32_t n) override { m_out += n; return n; }
+  void give_back(uint32_t n) override { m_out -= n; }
+  uint32_t m_out {0};
+};
+
+TEST(task_pool, give_back_on_throw)
+{
+  std::atomic<uint32_t> active {0}, peak {0}, lent {0};
+  CountingLender lender;
+  SplitTask task(active, peak, lent);
+  task.set_lender(&lender);
+  try
+  {
+    km::BorrowedThreads extra(task, 3);
+    EXPECT_EQ(lender.m_out, 3);
+    throw std::runtime_error("failed");
+  }
+  catch (const std::runtime_error&) {}
+  EXPECT_EQ(lender.m_out, 0);
+}
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include <kmtricks/task_pool.hpp>
+#include <kmtricks/telemetry.hpp>
+
+class DummyTask : public km::ITask
+{
+public:
+  DummyTask(uint32_t id) : km::ITask(0), m_id(id) {}
+
+  std::string name() const override { return "dummy " + std::to_string(m_id); }
+  std::string stage() const override { return "dummy"; }
+
+  void preprocess() override { m_stats.add_read("kmer", 10); }
+  void exec() override { m_stats.m_kmers_in = 100; m_stats.m_kmers_out = 50; }
+  void postprocess() override { m_stats.add_written("matrix", 20); }
+
+private:
+  uint32_t m_id;
+};
+
+// Telemetry is a process-wide singleton, the other tests must not record.
+class telemetry : public ::testing::Test
+{
+protected:
+  void SetUp() override { km::Telemetry::get().enable(); }
+  void TearDown() override { km::Telemetry::get().reset(); }
+};
+
+TEST_F(telemetry, telemetry_report)
+{
+  {
+    km::TaskPool pool(2);
+    for (uint32_t i=0; i<8; i++)
+      pool.add_task(std::make_shared<DummyTask>(i));
+    pool.join_all();
+  }
+
+  auto& records = km::Telemetry::get().records();
+  ASSERT_EQ(records.size(), 8);
+  for (auto& r : records)
+  {
+    EXPECT_EQ(r.stage, "dummy");
+    EXPECT_LE(r.pre[0], r.pre[1]);
+    EXPECT_LE(r.pre[1], r.exec[0]);
+    EXPECT_LE(r.exec[1], r.post[0]);
+    EXPECT_EQ(r.stats.m_read.at("kmer"), 10);
+    EXPECT_EQ(r.stats.m_written.at("matrix"), 20);
+    EXPECT_EQ(r.stats.m_kmers_in, 100);
+  }
+
+  std::stringstream report;
+  km::Telemetry::get().write_report(report);
+  std::string s = report.str();
+  EXPECT_NE(s.find("\"stage\": \"dummy\", \"tasks\": 8"), std::string::npos);
+  EXPECT_NE(s.find("\"bytes_read\": {\"kmer\": 80}"), std::string::npos);
+  EXPECT_NE(s.find("\"kmers_in\": 800, \"kmers_out\": 400"), std::string::npos);
+
+  std::stringstream trace;
+  km::Telemetry::get().write_trace(trace);
+  EXPECT_EQ(trace.str().rfind("{\"traceEvents\": [", 0), 0);
+  EXPECT_NE(trace.str().find("\"cat\": \"dummy.exec\""), std::string::npos);
+}